@@ -30,6 +30,7 @@
 #define E_RMSDEL    1011
 #define E_NQUEINST  1012
 #define E_UNKOVER   1013
+#define E_DUPKEY    1014
 
 #endif
 
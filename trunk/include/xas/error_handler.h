@@ -41,17 +41,20 @@
  * branching to an error handler when an error occurs. Errors are 
  * determined if an OK or ERR is returned.
  * 
+ * The trace state for each block is thread local, so the same
+ * function may fail in several threads at once.
+ * 
  **/
 
 #define when_error \
     do { \
-        static int trace_lines = 0;     \
-        static error_trace_t _er_trace; \
+        static __thread int trace_lines = 0;     \
+        static __thread error_trace_t _er_trace; \
 
 #define when_error_in \
     do { \
-        static int trace_lines = 0;     \
-        static error_trace_t _er_trace; \
+        static __thread int trace_lines = 0;     \
+        static __thread error_trace_t _er_trace; \
 
 #define end_when                        \
     } while(0);
@@ -33,7 +33,8 @@ error_code_t xas_codes[] = {
     { E_INVREC,   "E_INVREC",   "Invalid record size" },
     { E_RMSDEL,   "E_RMSDEL",   "Record has been deleted" },
     { E_NQUEINST, "E_NQUEINST", "Unable to insert object" },
-    { E_UNKOVER,  "E_UNKOVER",  "Unknown override" }
+    { E_UNKOVER,  "E_UNKOVER",  "Unknown override" },
+    { E_DUPKEY,   "E_DUPKEY",   "Duplicate key" }
 };
 
 #endif
@@ -31,12 +31,16 @@ struct _blk_s {
     int (*_tell)(blk_t *, off_t *);
     int (*_read)(blk_t *, void *, size_t, ssize_t *);
     int (*_write)(blk_t *, void *, size_t, ssize_t *);
-    int (*_lock)(blk_t *, off_t, off_t);
+    int (*_pread)(blk_t *, void *, size_t, off_t, ssize_t *);
+    int (*_pwrite)(blk_t *, void *, size_t, off_t, ssize_t *);
+    int (*_lock)(blk_t *, off_t, off_t, int);
     int (*_unlock)(blk_t *);
 
+    int wait;
     int locked;
     int timeout;
     int retries;
+    long waited;
     struct flock lock;
 };
 
@@ -48,6 +52,13 @@ struct _blk_s {
 
 #define BLK_K_RETRIES    2
 #define BLK_K_TIMEOUT    3
+#define BLK_K_WAIT       7
+
+#define BLK_L_EXCLUSIVE  0
+#define BLK_L_SHARED     1
+
+#define BLK_W_RETRY      0
+#define BLK_W_FOREVER    -1
 
 #define BLK_M_DESTRUCTOR 10
 #define BLK_M_SEEK       11
@@ -56,6 +67,8 @@ struct _blk_s {
 #define BLK_M_WRITE      14
 #define BLK_M_LOCK       15
 #define BLK_M_UNLOCK     16
+#define BLK_M_PREAD      41
+#define BLK_M_PWRITE     42
 
 /*-------------------------------------------------------------*/
 /* interface                                                   */
@@ -71,13 +84,20 @@ extern int blk_seek(blk_t *, off_t, int);
 extern int blk_tell(blk_t *, off_t *);
 extern int blk_read(blk_t *, void *, size_t, ssize_t *);
 extern int blk_write(blk_t *, void *, size_t, ssize_t *);
-extern int blk_lock(blk_t *, off_t, off_t);
+extern int blk_pread(blk_t *, void *, size_t, off_t, ssize_t *);
+extern int blk_pwrite(blk_t *, void *, size_t, off_t, ssize_t *);
+extern int blk_lock(blk_t *, off_t, off_t, int);
 extern int blk_unlock(blk_t *);
+extern int blk_acquire(blk_t *, struct flock *);
+extern int blk_release(blk_t *, struct flock *);
 
 extern int blk_get_retries(blk_t*, int *);
 extern int blk_set_retries(blk_t *, int);
 extern int blk_get_timeout(blk_t*, int *);
 extern int blk_set_timeout(blk_t *, int);
+extern int blk_get_wait(blk_t *, int *);
+extern int blk_set_wait(blk_t *, int);
+extern int blk_get_waited(blk_t *, long *);
 extern int blk_is_locked(blk_t *, int *);
 
 #define blk_open(self, flags, mode)  fib_open(FIB(self), flags, mode)
@@ -25,11 +25,15 @@ REDISTRIBUTION OF THIS SOFTWARE.
 #ifndef _XAS_RMS_BTREE_H_
 #define _XAS_RMS_BTREE_H_
 
+#include <stdio.h>
 #include "xas/types.h"
 
 #define BT_ro 0x6f72      // ro
 #define BT_rw 0x7772      // rw
 #define BT_fl 0x6c66      // fl
+#define BT_pk 0x6b70      // rw, a new file packs its keys
+
+#define BT_version 2                     // file format in page zero, 0 before it was kept
 
 #define BT_maxbits 15                    // maximum page size in bits
 #define BT_minbits 12                    // minimum page size in bits
@@ -67,8 +71,20 @@ typedef enum{
 
 // definition for latch implementation
 
+// Waiters spin for a short while, then park on a futex.
+// The halves of the latches are overlaid with 32 bit
+// words for the futexes, the layout is unchanged. The
+// futexes are shared, so they work across processes
+// through the mapped latch pages.
+
 volatile typedef struct {
-    ushort lock[1];
+    union {
+        struct {
+            ushort lock[1];   // latch bits and share count
+            ushort park[1];   // set when waiters are parked
+        };
+        uint word[1];         // futex word
+    };
 } BtSpinLatch;
 
 #define XCL   1
@@ -77,10 +93,20 @@ volatile typedef struct {
 #define SHARE 4
 
 volatile typedef struct {
-    ushort rin[1];       // readers in count
-    ushort rout[1];      // readers out count
-    ushort serving[1];   // writers out count
-    ushort ticket[1];    // writers in count
+    union {
+        struct {
+            ushort rin[1];       // readers in count
+            ushort rout[1];      // readers out count
+        };
+        uint readers[1];         // futex word for readers
+    };
+    union {
+        struct {
+            ushort serving[1];   // writers out count
+            ushort ticket[1];    // writers in count
+        };
+        uint writers[1];         // futex word for writers
+    };
 } RWLock;
 
 // define bits at bottom of rin
@@ -90,6 +116,15 @@ volatile typedef struct {
 #define MASK 0x3    // both write bits
 #define RINC 0x4    // reader increment
 
+// define bit at bottom of rout
+
+#define PARK 0x1    // waiters are parked
+
+// rounds of spinning and yielding before a waiter parks
+
+#define BT_spin  128
+#define BT_yield 8
+
 // Define the length of the page and key pointers
 
 #define BtId 6
@@ -116,25 +151,81 @@ typedef struct {
 
 // The key structure occupies space at the upper end of
 // each page.  It's a length byte followed by the value
-// bytes.
+// bytes. A file of version 2 or later takes long keys,
+// a key longer than BT_keymax keeps its first BT_keyhead
+// bytes in the page after a length of BT_keylong, then
+// a BtOvfl with its length and the overflow pages that
+// keep the rest of it. The keys of an older file are at
+// most 255 bytes.
 
 typedef struct {
     unsigned char len;
     unsigned char key[0];
 } *BtKey;
 
+#define BT_keymax  254            // longest key kept whole in a page
+#define BT_keyhead 64             // bytes of a long key kept in the page
+#define BT_keylong 255            // key length that marks a long key
+
+// Values. A key stored with bt_put is followed by its
+// value in the leaf page, and the slot id has BT_value
+// set with the number of bytes that follow the key. A
+// value too big for the leaf is kept in a chain of
+// overflow pages, then the slot id also has BT_ovfl set
+// and a BtOvfl follows the key. Each overflow page keeps
+// its part of the value at the end of the page, from min,
+// and links to the next with the right pointer. A long
+// key keeps the rest of itself the same way.
+
+#define BT_value 0x800000000000ULL   // value follows the key
+#define BT_ovfl  0x400000000000ULL   // value is in overflow pages
+#define BT_vmask 0xffff              // bytes that follow the key
+#define BT_idmask 0x3fffffffffffULL  // ids bt_insertkey accepts
+
+typedef struct {
+    unsigned char len[4];         // length of the value, or of the long key
+    unsigned char page[BtId];     // first overflow page
+} BtOvfl;
+
+// Postings. In duplicates mode a key keeps a sorted list
+// of uids as its value, so a key can point to many records.
+// A list is a block of varints, the first uid as it is and
+// each one after as the difference from the one before. A
+// short list is kept in the leaf, a longer one in overflow
+// pages, each with a block of its own, so adding or deleting
+// a uid changes one page.
+
+typedef struct {
+    uid id;                       // uid to add or delete
+    uint add;                     // add the uid, else delete it
+    uint same;                    // nothing is left to store
+    uid word;                     // slot id for the new list
+    unsigned char *val;           // new list, or its BtOvfl
+    uint vlen;                    // bytes in val
+    uid chain;                    // overflow page written for the list
+    BtOvfl ovfl[1];               // the list in an overflow page
+} BtPost;
+
 // The first part of an index page.
 // It is immediately followed
 // by the BtSlot array of keys.
 
+// The pages of a file created with BT_pk are packed. The
+// prefix the keys of a packed page share is kept once, at
+// the end of the page with its length in the last byte, and
+// each key is kept without it. A page search compares the
+// prefix once, then only the rest of the keys.
+
 typedef struct BtPage_ {
     uint cnt;                     // count of keys in page
     uint act;                     // count of active keys
     uint min;                     // next key offset
-    unsigned char bits:6;         // page size in bits
+    unsigned char bits:5;         // page size in bits
+    unsigned char pack:1;         // keys are kept without the page prefix
     unsigned char free:1;         // page is on free list
     unsigned char dirty:1;        // page is dirty in cache
-    unsigned char lvl:6;          // level of page
+    unsigned char lvl:5;          // level of page
+    unsigned char longkeys:1;     // the page takes long keys, see BtKey
     unsigned char kill:1;         // page is being deleted
     unsigned char clean:1;        // page needs cleaning
     unsigned char right[BtId];    // page number to right
@@ -150,8 +241,39 @@ typedef struct {
     volatile uint latchvictim;    // next latch hash entry to examine
     volatile uint safelevel;      // safe page level in cache
     volatile uint cache[MAX_lvl]; // cache census counts by btree level
+    BtSpinLatch loglock[1];       // appends to the redo log
+    BtSpinLatch synclock[1];      // one log sync at a time
+    BtSpinLatch ckptlock[1];      // one checkpoint at a time
+    volatile uint loggen;         // log file being appended to
+    volatile uid logtail;         // lsn at the end of the log
+    volatile uid logsynced;       // the log is durable up to this lsn
+    volatile uid logstart[2];     // lsn at the start of each log file
+    BtSpinLatch resize[1];        // one pool resize at a time
+    volatile uint latchlimit;     // latch entries in use, up to latchtotal
+    volatile uint logged;         // changes go to the redo log, see bt_setlog
+    uint version;                 // BT_version of the file, 2 takes long keys
+    uint pack;                    // the pages are packed
 } BtLatchMgr;
 
+// Redo log. It is off until bt_setlog turns it on for the
+// btree file. Each change to a page then appends an image of
+// the page to <name>.log0 or <name>.log1. Only the page
+// header and slots, up to lo, and the keys, from hi, are
+// logged. A checkpoint switches to the other file, flushes
+// the buffer pool, and empties the file it left. bt_open
+// replays both files when nobody else has the btree open.
+
+typedef struct {
+    uint sum;                // checksum of the rest of the record
+    uint size;               // size of the record
+    uid lsn;                 // lsn at the start of the record
+    uid page_no;             // page the image is for
+    ushort lo;               // bytes from the start of the page
+    ushort hi;               // offset of the bytes to the end of the page
+} BtLogRec;
+
+#define BT_logmax (64 << 20)   // log size that starts a checkpoint
+
 // latch hash table entries
 
 typedef struct {
@@ -177,6 +299,34 @@ typedef struct {
 #define LVL_mask 0x1800
 #define LVL_shift 11
 
+// Buffer pool statistics. The counters are kept by each
+// handle, the sizes and the census by level are shared by
+// every handle on the btree. Latch waits are counted for
+// the whole process.
+
+typedef struct {
+    uid pins;                // latch entries pinned
+    uid hits;                // pages found in the pool
+    uid misses;              // pages read into the pool
+    uid evictions;           // pages taken out of the pool
+    uid writes;              // dirty pages written back on eviction
+    uid scans;               // entries the clock looked at
+    uid maps;                // pool pages mapped
+    uid resizes;             // changes to the pool size
+    uid waits;               // latch waits
+    uid parks;               // latch waits that parked on a futex
+    uid waitns;              // nanoseconds parked or yielding on latches
+    uint limit;              // latch entries in use
+    uint total;              // latch entries allocated
+    uint deployed;           // latch entries deployed
+    uint dirty;              // dirty pages in the pool
+    uint safelevel;          // highest level being evicted
+    uint census[MAX_lvl];    // pages in the pool by level
+} BtPoolStat;
+
+#define BT_poolmin 16          // smallest pool size
+#define BT_window  4096        // pins between pool size checks
+
 //    The object structure for Btree access
 
 typedef struct _BtDb {
@@ -202,6 +352,20 @@ typedef struct _BtDb {
 #endif
     unsigned char *mem;      // frame, cursor, memory buffers
     uint found;              // last deletekey found key
+    char *name;              // btree file name, for the log files
+    int logfd[2];            // redo log files
+    int logerr;              // a log append failed since our last checkpoint
+    uid loglsn;              // lsn after our last log record
+    uid logmax;              // log size that starts a checkpoint
+    unsigned char *logbuf;   // record being appended
+    BtPoolStat stats;        // buffer pool counters
+    uid window;              // misses at the last pool size check
+    uint growrate;           // misses per thousand pins to grow the pool
+    uint shrinkrate;         // misses per thousand pins to shrink the pool
+    unsigned char *postbuf;  // postings block being merged
+    unsigned char keybuf[256]; // key bt_key rebuilt from a packed page
+    unsigned char *keydata;  // key bt_keydata read from its overflow pages
+    uint keysize;            // bytes there is room for in keydata
 } BtDb;
 
 typedef enum {
@@ -218,12 +382,71 @@ typedef enum {
     BTERR_eof
 } BTERR;
 
+//	The object structure for a bulk load. Keys are
+//	given in ascending order and packed into pages
+//	that are written once, the upper levels are built
+//	from the fence keys as the pages fill.
+
+typedef struct {
+    BtDb *bt;                // btree being loaded
+    uint fill;               // bytes of each page to fill
+    uid next;                // next page number to allocate
+    uid count;               // number of keys loaded
+    uid page_no[MAX_lvl];    // page number for each level, 0 if unassigned
+    BtPage page[MAX_lvl];    // page being filled on each level
+    unsigned char *last;     // previous key, to check the order
+    uint lastlen;            // length of the previous key
+    uint lastmax;            // bytes there is room for in last
+} BtLoad;
+
+//	The cursor structure for range scans. A batch of keys
+//	points into a pool page, which stays pinned and read
+//	locked until the next batch is asked for, or the cursor
+//	is closed. The keys of a packed page, and long keys, are
+//	rebuilt in the cursor, and last as long.
+
+typedef struct {
+    unsigned char *key;      // key in the pool page
+    uint len;                // length of the key
+    uid id;                  // id associated with key
+} BtPair;
+
+typedef struct {
+    BtDb *bt;                // btree being scanned
+    BtLatchSet *latch;       // latch of the page in the batch
+    BtPage page;             // pool page in the batch
+    uid right;               // page to the right, 0 at the end
+    uint slot;               // next slot on the page
+    uint started;            // a batch has been returned
+    uint done;               // the scan is finished
+    uint limit;              // the scan stops at the high key
+    unsigned char *last;     // last key returned, or the low key
+    uint lastlen;            // length of the last key
+    uint lastmax;            // bytes there is room for in last
+    unsigned char *high;     // highest key to return
+    uint highlen;            // length of the high key
+    unsigned char *keys;     // keys of a batch that are rebuilt
+    uint keymax;             // bytes there is room for in keys
+} BtCursor;
+
+//	The cursor structure for a postings list. The list
+//	is copied when the cursor is opened, as one block,
+//	and decoded a uid at a time.
+
+typedef struct {
+    unsigned char *list;     // the list, as differences
+    uint len;                // bytes in the list
+    uint off;                // next byte to decode
+    uid last;                // uid decoded last, the cursor is on it
+} BtPostings;
+
 // B-Tree functions
 
 extern void bt_close(BtDb *bt);
 extern uid bt_uid(BtDb *bt, uint slot);
 extern uint bt_tod(BtDb *bt, uint slot);
 extern BtKey bt_key(BtDb *bt, uint slot);
+extern unsigned char *bt_keydata(BtDb *bt, uint slot, uint *len);
 extern uint bt_nextkey(BtDb *bt, uint slot);
 extern uid bt_findkey(BtDb *bt, unsigned char *key, uint len);
 extern uint bt_startkey(BtDb *bt, unsigned char *key, uint len);
@@ -231,5 +454,35 @@ extern BtDb *bt_open(char *name, uint mode, uint bits, uint cacheblk);
 extern BTERR bt_deletekey(BtDb *bt, unsigned char *key, uint len, uint lvl);
 extern BTERR bt_insertkey(BtDb *bt, unsigned char *key, uint len, uint lvl, uid id, uint tod);
 
+extern BTERR bt_put(BtDb *bt, unsigned char *key, uint len, unsigned char *value, uint vlen);
+extern int bt_get(BtDb *bt, unsigned char *key, uint len, unsigned char *value, uint max);
+
+extern void bt_poolstats(BtDb *bt, BtPoolStat *stat);
+extern void bt_pooldump(BtDb *bt, FILE *fp);
+extern BTERR bt_poolresize(BtDb *bt, uint entries);
+extern void bt_pooladapt(BtDb *bt, uint growrate, uint shrinkrate);
+
+extern int bt_parking;
+
+extern BTERR bt_setlog(BtDb *bt, uint on);
+extern BTERR bt_commit(BtDb *bt);
+extern BTERR bt_checkpoint(BtDb *bt);
+
+extern BtLoad *bt_loadopen(BtDb *bt, uint fill);
+extern BTERR bt_loadkey(BtLoad *load, unsigned char *key, uint len, uid id);
+extern BTERR bt_loadclose(BtLoad *load);
+
+extern BtCursor *bt_cursoropen(BtDb *bt, unsigned char *low, uint lowlen, unsigned char *high, uint highlen);
+extern uint bt_cursornext(BtCursor *cursor, BtPair *pairs, uint max);
+extern void bt_cursorclose(BtCursor *cursor);
+
+extern BTERR bt_postadd(BtDb *bt, unsigned char *key, uint len, uid id);
+extern BTERR bt_postdel(BtDb *bt, unsigned char *key, uint len, uid id);
+extern BtPostings *bt_postopen(BtDb *bt, unsigned char *key, uint len);
+extern uid bt_postnext(BtPostings *post);
+extern uid bt_postseek(BtPostings *post, uid id);
+extern uint bt_postand(BtPostings *post1, BtPostings *post2, uid *ids, uint max);
+extern void bt_postclose(BtPostings *post);
+
 #endif
 
@@ -0,0 +1,99 @@
+
+/*---------------------------------------------------------------------------*/
+/*                Copyright (c) 2024 by Kevin L. Esteb                       */
+/*                                                                           */
+/*  Permission to use, copy, modify, and distribute this software and its    */
+/*  documentation for any purpose and without fee is hereby granted,         */
+/*  provided that this copyright notice appears in all copies. The author    */
+/*  makes no representations about the suitability of this software for      */
+/*  any purpose. It is provided "as is" without express or implied warranty. */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#ifndef _XAS_RMS_ISAM_H_
+#define _XAS_RMS_ISAM_H_
+
+#include "xas/rms/rel.h"
+#include "xas/rms/btree.h"
+
+/*-------------------------------------------------------------*/
+/* klass data                                                  */
+/*-------------------------------------------------------------*/
+
+typedef struct _isam_index_s {
+    int duplicates;                      /* allow duplicate keys          */
+    int rebuild;                         /* index needs to be built       */
+    int (*extract)(void *, void *, int *); /* record, key, key length     */
+    BtDb *btree;                         /* the index                     */
+} isam_index_t;
+
+/*-------------------------------------------------------------*/
+/* klass defination                                            */
+/*-------------------------------------------------------------*/
+
+#define ISAM_KEYSIZE 240
+
+typedef struct _isam_s isam_t;
+
+struct _isam_s {
+    rel_t parent_klass;
+    int (*ctor)(object_t *, item_list_t *);
+    int (*dtor)(object_t *);
+    int (*_compare)(isam_t *, isam_t *);
+    int (*_override)(isam_t *, item_list_t *);
+    int (*_start)(isam_t *, int, void *, int, int);
+    int (*_next)(isam_t *, void *, off_t *);
+
+    int indexes;
+    isam_index_t *index;
+    int current;
+    int match;
+    uint slot;
+    int wantlen;
+    int highlen;
+    unsigned char want[ISAM_KEYSIZE];
+    unsigned char high[ISAM_KEYSIZE];
+};
+
+/*-------------------------------------------------------------*/
+/* klass constants                                             */
+/*-------------------------------------------------------------*/
+
+#define ISAM(x) ((isam_t *)(x))
+
+#define ISAM_M_DESTRUCTOR 45
+#define ISAM_M_START      46
+#define ISAM_M_NEXT       47
+
+#define ISAM_S_EQUAL      0
+#define ISAM_S_PARTIAL    1
+#define ISAM_S_GREATER    2
+
+/*-------------------------------------------------------------*/
+/* klass interface                                             */
+/*-------------------------------------------------------------*/
+
+extern isam_t *isam_create(char *, char *, int, int, int, int);
+extern int isam_destroy(isam_t *);
+extern int isam_compare(isam_t *, isam_t *);
+extern int isam_override(isam_t *, item_list_t *);
+extern char *isam_version(isam_t *);
+
+extern int isam_add_index(isam_t *, int, int (*extract)(void *, void *, int *), int *);
+extern int isam_close(isam_t *);
+extern int isam_start(isam_t *, int, void *, int, int);
+extern int isam_range(isam_t *, int, void *, int, void *, int);
+extern int isam_next(isam_t *, void *, off_t *);
+extern int isam_get_key(isam_t *, int, void *, int, void *, off_t *);
+
+#define isam_open(self, flags, mode)   rel_open(REL(self), flags, mode)
+#define isam_add(self, record)         rel_add(REL(self), record)
+#define isam_del(self, recnum)         rel_del(REL(self), recnum)
+#define isam_get(self, recnum, record) rel_get(REL(self), recnum, record)
+#define isam_put(self, recnum, record) rel_put(REL(self), recnum, record)
+#define isam_record(self, recnum)      rel_record(REL(self), recnum)
+#define isam_remove(self)              rel_remove(REL(self))
+#define isam_set_trace(self, trace)    object_set_trace(OBJECT(self), trace)
+
+#endif
+
@@ -25,6 +25,18 @@ typedef struct record {
     void *data;
 } rel_record_t;
 
+typedef struct _rel_cursor_s {
+    int mode;               /* consistent or dirty reads            */
+    off_t first;            /* record number of the buffer start    */
+    off_t count;            /* number of records in the buffer      */
+    off_t recnum;           /* current record number                */
+    size_t size;            /* size of the buffer in bytes          */
+    unsigned char *buffer;  /* read ahead buffer                    */
+    off_t bitsfirst;        /* bitmap offset of the bits buffer     */
+    off_t bitscount;        /* number of bytes in the bits buffer   */
+    unsigned char *bits;    /* read ahead buffer for the bitmap     */
+} rel_cursor_t;
+
 /*-------------------------------------------------------------*/
 /* klass defination                                            */
 /*-------------------------------------------------------------*/
@@ -47,6 +59,8 @@ struct _rel_s {
     int (*_record)(rel_t *, off_t *);
     int (*_get)(rel_t *, off_t, void *);
     int (*_put)(rel_t *, off_t, void *);
+    int (*_get_many)(rel_t *, off_t *, void **, int);
+    int (*_put_many)(rel_t *, off_t *, void **, int);
     int (*_read_header)(rel_t *);
     int (*_write_header)(rel_t *);
     int (*_update_header)(rel_t *);
@@ -59,6 +73,7 @@ struct _rel_s {
     int (*_last)(rel_t *, rel_record_t *, ssize_t *);
     int (*_first)(rel_t *, rel_record_t *, ssize_t *);
     int (*_normalize)(rel_t *, void *, void *);
+    int (*_default)(rel_t *, void *, void *);
     int (*_find)(rel_t *, void *, int (*compare)(void *, void *), off_t *);
     int (*_search)(rel_t *, void *, int (*compare)(void *, void *), int (*capture)(rel_t *, void *, queue_t *), queue_t *);
 
@@ -66,9 +81,18 @@ struct _rel_s {
     int records;
     int recsize;
     int lastrec;
+    int scan;
+    int freelist;
     int autoextend;
     int master_locked;
+    int master_held;
     struct flock master;
+    rel_cursor_t *cursor;
+    int access;
+    off_t mapsize;
+    unsigned char *map;
+    int bitmap;
+    blk_t *live;
 };
 
 /*-------------------------------------------------------------*/
@@ -104,10 +128,19 @@ struct _rel_s {
 #define REL_M_READ_HEADER   38
 #define REL_M_UPDATE_HEADER 39
 #define REL_M_DEFAULT       40
+#define REL_M_GET_MANY      43
+#define REL_M_PUT_MANY      44
 
 #define REL_F_MARK      1
 #define REL_F_DELETED   2
 
+#define REL_C_CONSISTENT 0
+#define REL_C_DIRTY      1
+#define REL_C_CHUNK      (256 * 1024)
+
+#define REL_A_BLOCK      0
+#define REL_A_MMAP       1
+
 /*-------------------------------------------------------------*/
 /* klass interface                                             */
 /*-------------------------------------------------------------*/
@@ -119,6 +152,7 @@ extern int rel_override(rel_t *, item_list_t *);
 extern char *rel_version(rel_t *);
 
 extern int rel_open(rel_t *, int, mode_t);
+extern int rel_close(rel_t *);
 extern int rel_remove(rel_t *);
 extern int rel_del(rel_t *, off_t);
 extern int rel_add(rel_t *, void *);
@@ -126,12 +160,26 @@ extern int rel_extend(rel_t *, int);
 extern int rel_record(rel_t *, off_t *);
 extern int rel_get(rel_t *, off_t, void *);
 extern int rel_put(rel_t *, off_t, void *);
+extern int rel_get_many(rel_t *, off_t *, void **, int);
+extern int rel_put_many(rel_t *, off_t *, void **, int);
 extern int rel_find(rel_t *, void *, int (*compare)(void *, void *), off_t *);
 extern int rel_search(rel_t *, void *, int (*compare)(void *, void *), int (*capture)(rel_t *, void *, queue_t *), queue_t *);
+extern int rel_search_parallel(rel_t *, void *, int (*compare)(void *, void *), int (*capture)(rel_t *, void *, queue_t *), queue_t *, int);
 extern int rel_get_records(rel_t *, off_t *);
+extern int rel_get_live(rel_t *, off_t *);
 extern int rel_get_recsize(rel_t *, off_t *);
+extern int rel_get_scan(rel_t *, int *);
+extern int rel_set_scan(rel_t *, int);
+extern int rel_get_autoextend(rel_t *, int *);
+extern int rel_set_autoextend(rel_t *, int);
+extern int rel_get_access(rel_t *, int *);
+extern int rel_set_access(rel_t *, int);
+
+extern int rel_cursor_create(rel_t *, int, rel_cursor_t **);
+extern int rel_cursor_destroy(rel_t *, rel_cursor_t *);
+extern int rel_cursor_first(rel_t *, rel_cursor_t *, void *, off_t *);
+extern int rel_cursor_next(rel_t *, rel_cursor_t *, void *, off_t *);
 
-#define rel_close(self)               blk_close(BLK(self))
 #define rel_set_trace(self, trace)    object_set_trace(OBJECT(self), trace)
 
 #endif
@@ -29,8 +29,20 @@ struct _seq_s {
     int (*_override)(seq_t *, item_list_t *);
     int (*_gets)(seq_t *, char *, size_t, ssize_t *);
     int (*_puts)(seq_t *, char *, ssize_t *);
+    int (*_getline)(seq_t *, char **, size_t *);
 
     char *eol;
+    int eof;                /* the last read returned nothing       */
+    size_t head;            /* start of the unread data             */
+    size_t tail;            /* end of the unread data               */
+    size_t size;            /* size of the read buffer              */
+    char *buffer;           /* read buffer                          */
+    int interval;           /* seconds, checked on the next write   */
+    time_t stamp;           /* when the pending writes started      */
+    size_t pending;         /* bytes waiting in the write buffer    */
+    char *output;           /* write buffer                         */
+    int access;             /* buffered or memory mapped reads      */
+    char *map;              /* memory mapping of the file           */
 };
 
 /*-------------------------------------------------------------*/
@@ -42,6 +54,12 @@ struct _seq_s {
 #define SEQ_M_DESTRUCTOR 18
 #define SEQ_M_GETS       9
 #define SEQ_M_PUTS       10
+#define SEQ_M_GETLINE    11
+
+#define SEQ_C_BUFSIZE    (256 * 1024)
+
+#define SEQ_A_BUFFER     0  /* seq_getline() lines end with a '\0'    */
+#define SEQ_A_MMAP       1  /* lines are not terminated, use length  */
 
 /*-------------------------------------------------------------*/
 /* interface                                                   */
@@ -54,11 +72,17 @@ extern int seq_override(seq_t *, item_list_t *);
 extern char *seq_version(seq_t *);
 extern int seq_gets(seq_t *, char *, size_t , ssize_t *);
 extern int seq_puts(seq_t *, char *, ssize_t *);
+extern int seq_getline(seq_t *, char **, size_t *);
+extern int seq_open(seq_t *, int, mode_t);
+extern int seq_close(seq_t *);
+extern int seq_flush(seq_t *);
+extern int seq_set_flush(seq_t *, int);
+extern int seq_get_access(seq_t *, int *);
+extern int seq_set_access(seq_t *, int);
+extern int seq_process_parallel(seq_t *, void *(*create)(void *), int (*process)(void *, char *, size_t), int (*reduce)(void *, void *), void *, int);
 extern int seq_get_eol(seq_t *, char *);
 extern int seq_set_eol(seq_t *, char *);
 
-#define seq_open(self, flags, mode) fib_open(FIB(self), flags, mode)
-#define seq_close(self)             fib_close(FIB(self))
 #define seq_exists(self, flag)      fib_exists(FIB(self), flag)
 #define seq_size(self, length)      fib_size(FIB(self), length)
 #define seq_stat(self, stat)        fib_stat(FIB(self), stat)
@@ -0,0 +1,204 @@
+
+#include <stdio.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/blk.h"
+#include "xas/misc/misc.h"
+#include "rms-test.h"
+
+/*
+ * record isolation between threads. Each thread uses its own blk_t
+ * handle and does a locked read, modify and write of a counter. Inside
+ * the lock, another handle is opened and closed on the same file. With
+ * process owned locks the threads don't exclude each other, and closing
+ * the other handle drops the lock, so updates are lost.
+ */
+
+#define THREADS    8
+#define RECORDS    16
+#define ITERATIONS 2000
+
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+char *filename = "blk-test1.dat";
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+void capture_trace(error_trace_t *error) {
+
+    tracer_add(trace, error);
+
+}
+
+void *worker(void *data) {
+
+    int x;
+    long counter;
+    int stat = OK;
+    ssize_t count = 0;
+    blk_t *temp = NULL;
+    blk_t *other = NULL;
+    off_t recsize = sizeof(long);
+    long id = (long)data;
+
+    when_error_in {
+
+        temp = blk_create(filename, 0, 0);
+        check_creation(temp);
+
+        other = blk_create(filename, 0, 0);
+        check_creation(other);
+
+        stat = blk_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = blk_set_wait(temp, BLK_W_FOREVER);
+        check_return(stat, temp);
+
+        stat = blk_open(temp, O_RDWR, 0);
+        check_return(stat, temp);
+
+        for (x = 0; x < ITERATIONS; x++) {
+
+            off_t offset = ((id + x) % RECORDS) * recsize;
+
+            stat = blk_lock(temp, offset, recsize, BLK_L_EXCLUSIVE);
+            check_return(stat, temp);
+
+            stat = blk_pread(temp, &counter, recsize, offset, &count);
+            check_return(stat, temp);
+
+            stat = blk_open(other, O_RDONLY, 0);
+            check_return(stat, other);
+
+            stat = blk_close(other);
+            check_return(stat, other);
+
+            sched_yield();
+            counter++;
+
+            stat = blk_pwrite(temp, &counter, recsize, offset, &count);
+            check_return(stat, temp);
+
+            stat = blk_unlock(temp);
+            check_return(stat, temp);
+
+        }
+
+        stat = blk_close(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        capture_error(trace);
+
+    } end_when;
+
+    blk_destroy(other);
+    blk_destroy(temp);
+
+    return (void *)(long)stat;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    void *result;
+    long counter;
+    long total = 0;
+    int stat = OK;
+    int bad = 0;
+    int failed = 0;
+    ssize_t count = 0;
+    blk_t *temp = NULL;
+    pthread_t threads[THREADS];
+    long counters[RECORDS] = {0};
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        temp = blk_create(filename, 0, 0);
+        check_creation(temp);
+
+        stat = blk_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = blk_open(temp, O_RDWR | O_CREAT | O_TRUNC, (S_IRWXU | S_IRWXG));
+        check_return(stat, temp);
+
+        stat = blk_write(temp, counters, sizeof(counters), &count);
+        check_return(stat, temp);
+
+        for (x = 0; x < THREADS; x++) {
+
+            errno = pthread_create(&threads[x], NULL, worker, (void *)(long)x);
+            check_status(errno);
+
+        }
+
+        for (x = 0; x < THREADS; x++) {
+
+            pthread_join(threads[x], &result);
+            if ((long)result != OK) failed++;
+
+        }
+
+        for (x = 0; x < RECORDS; x++) {
+
+            stat = blk_pread(temp, &counter, sizeof(long), x * sizeof(long), &count);
+            check_return(stat, temp);
+
+            total += counter;
+
+        }
+
+        printf("threads: %d, failed: %d, expected: %d, counted: %ld - %s\n",
+               THREADS, failed, THREADS * ITERATIONS, total,
+               (total == (THREADS * ITERATIONS)) ? "isolated" : "NOT isolated");
+
+        if ((failed > 0) || (total != (THREADS * ITERATIONS))) bad++;
+
+        stat = blk_close(temp);
+        check_return(stat, temp);
+
+        stat = blk_unlink(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    blk_destroy(temp);
+
+    return passed(bad);
+
+}
+
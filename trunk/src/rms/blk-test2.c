@@ -0,0 +1,211 @@
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/blk.h"
+#include "xas/misc/misc.h"
+#include "rms-test.h"
+
+/*
+ * positional reads and writes. A file of numbered records is read and
+ * written with blk_pread() and blk_pwrite(), the file position set by
+ * blk_seek() must not move and each record must hold its number. Reads
+ * at the end of the file come back short. Then threads share one handle
+ * and read records at random, with no seeks there is nothing to race.
+ */
+
+#define RECORDS    4096
+#define THREADS    4
+#define ITERATIONS 20000
+
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+blk_t *temp = NULL;
+char *filename = "blk-test2.dat";
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+void capture_trace(error_trace_t *error) {
+
+    tracer_add(trace, error);
+
+}
+
+void *worker(void *data) {
+
+    int x;
+    long record;
+    long wrong = 0;
+    ssize_t count = 0;
+    unsigned int seed = (long)data;
+
+    for (x = 0; x < ITERATIONS; x++) {
+
+        long recnum = rand_r(&seed) % RECORDS;
+
+        if ((blk_pread(temp, &record, sizeof(long), recnum * sizeof(long), &count) != OK) ||
+            (count != sizeof(long)) || (record != recnum)) {
+
+            wrong++;
+
+        }
+
+    }
+
+    return (void *)wrong;
+
+}
+
+int main(int argc, char **argv) {
+
+    long x;
+    long record;
+    long buffer[4];
+    void *result;
+    int stat = OK;
+    int bad = 0;
+    off_t where = 0;
+    ssize_t count = 0;
+    pthread_t threads[THREADS];
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        temp = blk_create(filename, 0, 0);
+        check_creation(temp);
+
+        stat = blk_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = blk_open(temp, O_RDWR | O_CREAT | O_TRUNC, (S_IRWXU | S_IRWXG));
+        check_return(stat, temp);
+
+        /* every other record written in place, then the rest */
+
+        for (x = 0; x < RECORDS; x += 2) {
+
+            stat = blk_pwrite(temp, &x, sizeof(long), x * sizeof(long), &count);
+            check_return(stat, temp);
+
+            if (count != sizeof(long)) bad++;
+
+        }
+
+        for (x = 1; x < RECORDS; x += 2) {
+
+            stat = blk_pwrite(temp, &x, sizeof(long), x * sizeof(long), &count);
+            check_return(stat, temp);
+
+        }
+
+        /* the file position stays where it was put */
+
+        stat = blk_seek(temp, 100 * sizeof(long), SEEK_SET);
+        check_return(stat, temp);
+
+        for (x = RECORDS - 1; x >= 0; x -= 7) {
+
+            stat = blk_pread(temp, &record, sizeof(long), x * sizeof(long), &count);
+            check_return(stat, temp);
+
+            if ((count != sizeof(long)) || (record != x)) bad++;
+
+        }
+
+        record = 100;
+
+        stat = blk_pwrite(temp, &record, sizeof(long), 200 * sizeof(long), &count);
+        check_return(stat, temp);
+
+        stat = blk_tell(temp, &where);
+        check_return(stat, temp);
+
+        if (where != 100 * sizeof(long)) bad++;
+
+        stat = blk_read(temp, &record, sizeof(long), &count);
+        check_return(stat, temp);
+
+        if (record != 100) bad++;
+
+        /* short reads at the end */
+
+        stat = blk_pread(temp, buffer, sizeof(buffer), (RECORDS - 2) * sizeof(long), &count);
+        check_return(stat, temp);
+
+        if ((count != 2 * sizeof(long)) || (buffer[0] != RECORDS - 2) || (buffer[1] != RECORDS - 1)) bad++;
+
+        stat = blk_pread(temp, buffer, sizeof(buffer), RECORDS * sizeof(long), &count);
+        check_return(stat, temp);
+
+        if (count != 0) bad++;
+
+        printf("positional: %d errors\n", bad);
+
+        /* one handle, many readers */
+
+        record = 200;
+
+        stat = blk_pwrite(temp, &record, sizeof(long), 200 * sizeof(long), &count);
+        check_return(stat, temp);
+
+        for (x = 0; x < THREADS; x++) {
+
+            errno = pthread_create(&threads[x], NULL, worker, (void *)(x + 1));
+            check_status(errno);
+
+        }
+
+        for (x = 0; x < THREADS; x++) {
+
+            pthread_join(threads[x], &result);
+
+            if ((long)result != 0) {
+
+                printf("thread %ld: %ld wrong records\n", x, (long)result);
+                bad++;
+
+            }
+
+        }
+
+        printf("threads: %d, reads: %d, %d errors\n", THREADS, THREADS * ITERATIONS, bad);
+
+        stat = blk_close(temp);
+        check_return(stat, temp);
+
+        stat = blk_unlink(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    blk_destroy(temp);
+
+    return passed(bad);
+
+}
+
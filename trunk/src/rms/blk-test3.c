@@ -0,0 +1,222 @@
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/blk.h"
+#include "xas/misc/misc.h"
+#include "rms-test.h"
+
+/*
+ * shared and exclusive locks. A child process holds a lock on a range
+ * of the file while the parent tries to take locks without waiting.
+ * Under a shared lock, other shared locks are granted and exclusive
+ * ones are refused. Under an exclusive lock, both are refused. Ranges
+ * that don't overlap are always granted, and when the child lets go
+ * everything is. A shared lock works on a file opened for reading,
+ * an exclusive lock does not.
+ */
+
+#define OFFSET 4096
+#define LENGTH 512
+
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+blk_t *temp = NULL;
+char *filename = "blk-test3.dat";
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+/* the refused locks leave errors behind, each one is copied */
+/* so the tracer owns what it frees                          */
+
+void capture_trace(error_trace_t *error) {
+
+    error_trace_t *copy = calloc(1, sizeof(error_trace_t));
+
+    if (copy != NULL) {
+
+        copy->errnum = error->errnum;
+        copy->lineno = error->lineno;
+        copy->filename = strdup(error->filename);
+        copy->function = strdup(error->function);
+        tracer_add(trace, copy);
+
+    }
+
+}
+
+/* a child that holds a lock until it is told to let go */
+
+pid_t holder(int mode, int *go) {
+
+    int ready[2];
+    int release[2];
+    char byte = 0;
+    pid_t pid;
+    blk_t *other = NULL;
+
+    pipe(ready);
+    pipe(release);
+    fflush(stdout);
+
+    if ((pid = fork()) == 0) {
+
+        other = blk_create(filename, 0, 0);
+        blk_open(other, O_RDWR, 0);
+
+        byte = (blk_lock(other, OFFSET, LENGTH, mode) == OK) ? 1 : 0;
+        write(ready[1], &byte, 1);
+        read(release[0], &byte, 1);
+
+        blk_unlock(other);
+        blk_close(other);
+        exit(0);
+
+    }
+
+    read(ready[0], &byte, 1);
+    close(ready[0]);
+    close(ready[1]);
+    close(release[0]);
+
+    *go = release[1];
+
+    return byte ? pid : -1;
+
+}
+
+void let_go(pid_t pid, int go) {
+
+    char byte = 1;
+
+    write(go, &byte, 1);
+    close(go);
+    waitpid(pid, NULL, 0);
+
+}
+
+/* try a lock, it should be granted or not */
+
+int try(off_t offset, int mode, int granted, char *what) {
+
+    int stat = blk_lock(temp, offset, LENGTH, mode);
+
+    if (stat == OK) blk_unlock(temp);
+
+    if ((stat == OK) != granted) {
+
+        printf("%s: lock was %s\n", what, (stat == OK) ? "granted" : "refused");
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+int main(int argc, char **argv) {
+
+    int go;
+    int bad = 0;
+    int stat = OK;
+    ssize_t count = 0;
+    pid_t pid;
+    char buffer[OFFSET * 2];
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        temp = blk_create(filename, 0, 0);
+        check_creation(temp);
+
+        stat = blk_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = blk_open(temp, O_RDWR | O_CREAT | O_TRUNC, (S_IRWXU | S_IRWXG));
+        check_return(stat, temp);
+
+        memset(buffer, 0, sizeof(buffer));
+
+        stat = blk_write(temp, buffer, sizeof(buffer), &count);
+        check_return(stat, temp);
+
+        /* the child holds a shared lock */
+
+        if ((pid = holder(BLK_L_SHARED, &go)) < 0) bad++;
+
+        bad += try(OFFSET, BLK_L_SHARED, TRUE, "shared under shared");
+        bad += try(OFFSET, BLK_L_EXCLUSIVE, FALSE, "exclusive under shared");
+        bad += try(OFFSET + LENGTH / 2, BLK_L_EXCLUSIVE, FALSE, "overlapping exclusive under shared");
+        bad += try(OFFSET + LENGTH, BLK_L_EXCLUSIVE, TRUE, "exclusive beside shared");
+
+        let_go(pid, go);
+
+        printf("shared: %d errors\n", bad);
+
+        /* the child holds an exclusive lock */
+
+        if ((pid = holder(BLK_L_EXCLUSIVE, &go)) < 0) bad++;
+
+        bad += try(OFFSET, BLK_L_SHARED, FALSE, "shared under exclusive");
+        bad += try(OFFSET, BLK_L_EXCLUSIVE, FALSE, "exclusive under exclusive");
+        bad += try(OFFSET - LENGTH, BLK_L_SHARED, TRUE, "shared beside exclusive");
+
+        let_go(pid, go);
+
+        bad += try(OFFSET, BLK_L_EXCLUSIVE, TRUE, "exclusive after release");
+
+        printf("exclusive: %d errors\n", bad);
+
+        /* the modes need the file opened for them */
+
+        stat = blk_close(temp);
+        check_return(stat, temp);
+
+        stat = blk_open(temp, O_RDONLY, 0);
+        check_return(stat, temp);
+
+        bad += try(OFFSET, BLK_L_SHARED, TRUE, "shared when read only");
+        bad += try(OFFSET, BLK_L_EXCLUSIVE, FALSE, "exclusive when read only");
+
+        printf("read only: %d errors\n", bad);
+
+        stat = blk_close(temp);
+        check_return(stat, temp);
+
+        stat = blk_unlink(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    blk_destroy(temp);
+
+    return passed(bad);
+
+}
+
@@ -0,0 +1,218 @@
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/blk.h"
+#include "xas/misc/misc.h"
+#include "rms-test.h"
+
+/*
+ * lock wait modes. A child process holds an exclusive lock for a while
+ * and the parent asks for the same range. With a deadline shorter than
+ * the hold the request fails once the deadline has passed, with a
+ * longer one it is granted when the child lets go, as it is when the
+ * parent blocks. BLK_W_RETRY without retries gives up at once. The time
+ * reported by blk_get_waited() must match each case.
+ */
+
+#define OFFSET 0
+#define LENGTH 512
+#define HOLD   300
+#define SHORT  100
+#define LONG   5000
+
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+blk_t *temp = NULL;
+char *filename = "blk-test4.dat";
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+/* the requests that time out leave errors behind, each one is */
+/* copied so the tracer owns what it frees                     */
+
+void capture_trace(error_trace_t *error) {
+
+    error_trace_t *copy = calloc(1, sizeof(error_trace_t));
+
+    if (copy != NULL) {
+
+        copy->errnum = error->errnum;
+        copy->lineno = error->lineno;
+        copy->filename = strdup(error->filename);
+        copy->function = strdup(error->function);
+        tracer_add(trace, copy);
+
+    }
+
+}
+
+/* a child that holds a lock for hold milliseconds */
+
+pid_t holder(long hold) {
+
+    int ready[2];
+    char byte = 0;
+    pid_t pid;
+    blk_t *other = NULL;
+    struct timespec nap;
+
+    pipe(ready);
+    fflush(stdout);
+
+    if ((pid = fork()) == 0) {
+
+        other = blk_create(filename, 0, 0);
+        blk_open(other, O_RDWR, 0);
+
+        byte = (blk_lock(other, OFFSET, LENGTH, BLK_L_EXCLUSIVE) == OK) ? 1 : 0;
+        write(ready[1], &byte, 1);
+
+        nap.tv_sec = hold / 1000;
+        nap.tv_nsec = (hold % 1000) * 1000000L;
+        nanosleep(&nap, NULL);
+
+        blk_unlock(other);
+        blk_close(other);
+        exit(0);
+
+    }
+
+    read(ready[0], &byte, 1);
+    close(ready[0]);
+    close(ready[1]);
+
+    return byte ? pid : -1;
+
+}
+
+/* ask for the lock while the child holds it, the time waited */
+/* is in milliseconds and must fall between low and high      */
+
+int request(int wait, int granted, long low, long high, char *what) {
+
+    int bad = 0;
+    int stat = OK;
+    long waited = 0;
+    pid_t pid;
+
+    if ((pid = holder(HOLD)) < 0) bad++;
+
+    blk_set_wait(temp, wait);
+
+    if ((stat = blk_lock(temp, OFFSET, LENGTH, BLK_L_EXCLUSIVE)) == OK) {
+
+        blk_unlock(temp);
+
+    }
+
+    blk_get_waited(temp, &waited);
+    waitpid(pid, NULL, 0);
+
+    waited /= 1000;
+
+    if (((stat == OK) != granted) || (waited < low) || (waited > high)) bad++;
+
+    printf("%s: %s after %ld ms, %s\n", what,
+           (stat == OK) ? "granted" : "refused", waited,
+           bad ? "WRONG" : "ok");
+
+    return bad;
+
+}
+
+int main(int argc, char **argv) {
+
+    int bad = 0;
+    int wait = 0;
+    int stat = OK;
+    long waited = 0;
+    ssize_t count = 0;
+    char buffer[LENGTH];
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        temp = blk_create(filename, 0, 0);
+        check_creation(temp);
+
+        stat = blk_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = blk_open(temp, O_RDWR | O_CREAT | O_TRUNC, (S_IRWXU | S_IRWXG));
+        check_return(stat, temp);
+
+        memset(buffer, 0, sizeof(buffer));
+
+        stat = blk_write(temp, buffer, sizeof(buffer), &count);
+        check_return(stat, temp);
+
+        stat = blk_get_wait(temp, &wait);
+        check_return(stat, temp);
+
+        if (wait != BLK_W_RETRY) bad++;
+
+        bad += request(BLK_W_RETRY, FALSE, 0, SHORT / 2, "no retries");
+        bad += request(SHORT, FALSE, SHORT, HOLD - SHORT / 2, "short deadline");
+        bad += request(LONG, TRUE, HOLD - SHORT, LONG / 2, "long deadline");
+        bad += request(BLK_W_FOREVER, TRUE, HOLD - SHORT, LONG / 2, "forever");
+
+        stat = blk_get_wait(temp, &wait);
+        check_return(stat, temp);
+
+        if (wait != BLK_W_FOREVER) bad++;
+
+        /* nobody holds it, so nothing is waited for */
+
+        stat = blk_lock(temp, OFFSET, LENGTH, BLK_L_EXCLUSIVE);
+        check_return(stat, temp);
+
+        stat = blk_get_waited(temp, &waited);
+        check_return(stat, temp);
+
+        if (waited / 1000 >= SHORT) bad++;
+
+        stat = blk_unlock(temp);
+        check_return(stat, temp);
+
+        stat = blk_close(temp);
+        check_return(stat, temp);
+
+        stat = blk_unlink(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    blk_destroy(temp);
+
+    return passed(bad);
+
+}
+
@@ -10,9 +10,12 @@
 /*  warranty.                                                                */
 /*---------------------------------------------------------------------------*/
 
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -32,11 +35,13 @@ int _blk_dtor(object_t *);
 int _blk_compare(blk_t *, blk_t *);
 int _blk_override(blk_t *, item_list_t *);
 
-int _blk_lock(blk_t *, off_t, off_t);
+int _blk_lock(blk_t *, off_t, off_t, int);
 int _blk_read(blk_t *, void *, size_t, ssize_t *);
 int _blk_seek(blk_t *, off_t, int);
 int _blk_tell(blk_t *, off_t *);
 int _blk_write(blk_t *, void *, size_t, ssize_t *);
+int _blk_pread(blk_t *, void *, size_t, off_t, ssize_t *);
+int _blk_pwrite(blk_t *, void *, size_t, off_t, ssize_t *);
 int _blk_unlock(blk_t *);
 
 /*----------------------------------------------------------------*/
@@ -50,6 +55,40 @@ declare_klass(BLK_KLASS) {
     .dtor = _blk_dtor,
 };
 
+/*----------------------------------------------------------------*/
+/* klass private macros                                           */
+/*----------------------------------------------------------------*/
+
+/* when waiting on a lock with a deadline, the pause between      */
+/* attempts starts small and doubles up to a limit. This keeps a  */
+/* waiter close behind the holder without spinning on fcntl().    */
+
+#define BLK_B_MIN   100L       /* microseconds */
+#define BLK_B_MAX   10000L     /* microseconds */
+
+/* open file description locks belong to the open file and not to */
+/* the process. So each handle owns its locks, threads using their */
+/* own handles exclude each other and closing some other fd on the */
+/* same file does not drop them. Use them when they are available. */
+
+#ifdef F_OFD_SETLK
+# define BLK_SETLK   F_OFD_SETLK
+# define BLK_SETLKW  F_OFD_SETLKW
+# define BLK_PID     0
+#else
+# define BLK_SETLK   F_SETLK
+# define BLK_SETLKW  F_SETLKW
+# define BLK_PID     getpid()
+#endif
+
+/*----------------------------------------------------------------*/
+/* private methods                                                */
+/*----------------------------------------------------------------*/
+
+static long _blk_elapsed(struct timespec *);
+static int _blk_acquire(blk_t *, struct flock *);
+static int _blk_release(blk_t *, struct flock *);
+
 /*----------------------------------------------------------------*/
 /* klass interface                                                */
 /*----------------------------------------------------------------*/
@@ -305,15 +344,78 @@ int blk_write(blk_t *self, void *buffer, size_t size, ssize_t *count) {
 
 }
 
-int blk_lock(blk_t *self, off_t offset, off_t length) {
+int blk_pread(blk_t *self, void *buffer, size_t size, off_t offset, ssize_t *count) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self != NULL)) {
+        if ((self != NULL) && (buffer != NULL) && 
+            (count != NULL) && (offset >= 0)) {
 
-            stat = self->_lock(self, offset, length);
+            stat = self->_pread(self, buffer, size, offset, count);
+            check_return(stat, self);
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int blk_pwrite(blk_t *self, void *buffer, size_t size, off_t offset, ssize_t *count) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && (buffer != NULL) && 
+            (count != NULL) && (offset >= 0)) {
+
+            stat = self->_pwrite(self, buffer, size, offset, count);
+            check_return(stat, self);
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int blk_lock(blk_t *self, off_t offset, off_t length, int mode) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && 
+            ((mode == BLK_L_EXCLUSIVE) || (mode == BLK_L_SHARED))) {
+
+            stat = self->_lock(self, offset, length, mode);
             check_return(stat, self);
 
         } else {
@@ -365,6 +467,67 @@ int blk_unlock(blk_t *self) {
 
 }
 
+int blk_acquire(blk_t *self, struct flock *lock) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && (lock != NULL) && 
+            ((lock->l_type == F_RDLCK) || (lock->l_type == F_WRLCK))) {
+
+            stat = _blk_acquire(self, lock);
+            check_return(stat, self);
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int blk_release(blk_t *self, struct flock *lock) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && (lock != NULL)) {
+
+            stat = _blk_release(self, lock);
+            check_return(stat, self);
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
 int blk_get_timeout(blk_t *self, int *timeout) {
 
     int stat = OK;
@@ -481,6 +644,93 @@ int blk_set_retries(blk_t *self, int retries) {
 
 }
 
+int blk_get_wait(blk_t *self, int *wait) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && (wait != NULL)) {
+
+            *wait = self->wait;
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int blk_set_wait(blk_t *self, int wait) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && (wait >= BLK_W_FOREVER)) {
+
+            self->wait = wait;
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int blk_get_waited(blk_t *self, long *waited) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && (waited != NULL)) {
+
+            *waited = self->waited;
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
 int blk_is_locked(blk_t *self, int *locked) {
 
     int stat = OK;
@@ -519,6 +769,7 @@ int _blk_ctor(object_t *object, item_list_t *items) {
     int stat = ERR;
     int retries = 10;
     int timeout = 30;
+    int wait = BLK_W_RETRY;
     blk_t *self = NULL;
 
     if (object != NULL) {
@@ -555,6 +806,12 @@ int _blk_ctor(object_t *object, item_list_t *items) {
                                   items[x].buffer_length);
                            break;
                        }
+                       case BLK_K_WAIT: {
+                           memcpy(&wait, 
+                                  items[x].buffer_address, 
+                                  items[x].buffer_length);
+                           break;
+                       }
                    }
 
                }
@@ -578,6 +835,8 @@ int _blk_ctor(object_t *object, item_list_t *items) {
 
             self->_read   = _blk_read;
             self->_write  = _blk_write;
+            self->_pread  = _blk_pread;
+            self->_pwrite = _blk_pwrite;
             self->_seek   = _blk_seek;
             self->_tell   = _blk_tell;
             self->_lock   = _blk_lock;
@@ -585,6 +844,8 @@ int _blk_ctor(object_t *object, item_list_t *items) {
 
             /* initialize internal variables here */
 
+            self->wait = wait;
+            self->waited = 0;
             self->locked = FALSE;
             self->retries = retries;
             self->timeout = timeout;
@@ -659,6 +920,18 @@ int _blk_override(blk_t *self, item_list_t *items) {
                         check_null(self->_write);
                         break;
                     }
+                    case BLK_M_PREAD: {
+                        self->_pread = NULL;
+                        self->_pread = items[x].buffer_address;
+                        check_null(self->_pread);
+                        break;
+                    }
+                    case BLK_M_PWRITE: {
+                        self->_pwrite = NULL;
+                        self->_pwrite = items[x].buffer_address;
+                        check_null(self->_pwrite);
+                        break;
+                    }
                     case BLK_M_SEEK: {
                         self->_seek = NULL;
                         self->_seek = items[x].buffer_address;
@@ -715,6 +988,8 @@ int _blk_compare(blk_t *self, blk_t *other) {
             (self->_override == other->_override) &&
             (self->_read == other->_read) &&
             (self->_write == other->_write) &&
+            (self->_pread == other->_pread) &&
+            (self->_pwrite == other->_pwrite) &&
             (self->_seek == other->_seek) &&
             (self->_tell == other->_tell) &&
             (self->_lock == other->_lock) &&
@@ -861,62 +1136,224 @@ int _blk_write(blk_t *self, void *buffer, size_t size, ssize_t *count) {
 
 }
 
-int _blk_lock(blk_t *self, off_t offset, off_t length) {
+int _blk_pread(blk_t *self, void *buffer, size_t size, off_t offset, ssize_t *count) {
 
     int fd;
     int stat = OK;
-    int count = 0;
 
     when_error_in {
 
         stat = fib_get_fd(FIB(self), &fd);
         check_return(stat, self);
 
-        self->lock.l_type = F_WRLCK;
+        errno = 0;
+        if ((*count = pread(fd, buffer, size, offset)) == -1) {
+
+            cause_error(errno);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _blk_pwrite(blk_t *self, void *buffer, size_t size, off_t offset, ssize_t *count) {
+
+    int fd;
+    int stat = OK;
+
+    when_error_in {
+
+        stat = fib_get_fd(FIB(self), &fd);
+        check_return(stat, self);
+
+        errno = 0;
+        if ((*count = pwrite(fd, buffer, size, offset)) == -1) {
+
+            cause_error(errno);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _blk_lock(blk_t *self, off_t offset, off_t length, int mode) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        self->lock.l_type = (mode == BLK_L_SHARED) ? F_RDLCK : F_WRLCK;
         self->lock.l_start = offset;
         self->lock.l_len = length;
         self->lock.l_whence = SEEK_SET;
-        self->lock.l_pid = getpid();
+
+        stat = _blk_acquire(self, &self->lock);
+        check_return(stat, self);
+
+        self->locked = TRUE;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _blk_unlock(blk_t *self) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        stat = _blk_release(self, &self->lock);
+        check_return(stat, self);
+
+        self->locked = FALSE;
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+/*----------------------------------------------------------------*/
+/* private methods                                                */
+/*----------------------------------------------------------------*/
+
+static long _blk_elapsed(struct timespec *start) {
+
+    /* microseconds since start */
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((now.tv_sec - start->tv_sec) * 1000000L) +
+           ((now.tv_nsec - start->tv_nsec) / 1000L);
+
+}
+
+static int _blk_acquire(blk_t *self, struct flock *lock) {
+
+    /* take a lock according to the wait mode. BLK_W_RETRY is  */
+    /* the original retries/timeout behavior, BLK_W_FOREVER    */
+    /* blocks in the kernel and anything else is a deadline in */
+    /* milliseconds.                                           */
+
+    int fd;
+    int stat = OK;
+    int count = 0;
+    long pause = BLK_B_MIN;
+    long remaining = 0;
+    struct timespec nap;
+    struct timespec start;
+
+    when_error_in {
+
+        /* the clock is read first, the error path measures from it */
+
+        self->waited = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        stat = fib_get_fd(FIB(self), &fd);
+        check_return(stat, self);
+
+        lock->l_pid = BLK_PID;
 
         for (;;) {
 
             errno = 0;
-            if (fcntl(fd, F_SETLK, &self->lock) == -1) {
+            if (self->wait == BLK_W_FOREVER) {
 
-                if ((errno == EAGAIN) || (errno == EACCES)) {
+                if (fcntl(fd, BLK_SETLKW, lock) == 0) break;
+                if (errno == EINTR) continue;
 
-                    count++;
+                cause_error(errno);
 
-                    if (count > self->retries) {
+            }
 
-                        cause_error(errno);
+            if (fcntl(fd, BLK_SETLK, lock) == 0) break;
 
-                    } else {
+            if ((errno != EAGAIN) && (errno != EACCES)) {
 
-                        sleep(self->timeout);
+                cause_error(errno);
 
-                    }
+            }
+
+            if (self->wait == BLK_W_RETRY) {
+
+                count++;
 
-                } else {
+                if (count > self->retries) {
 
                     cause_error(errno);
 
                 }
 
+                sleep(self->timeout);
+
             } else {
 
-                self->locked = TRUE;
-                break;
+                remaining = (self->wait * 1000L) - _blk_elapsed(&start);
+
+                if (remaining <= 0) {
+
+                    cause_error(errno);
+
+                }
+
+                if (pause > remaining) pause = remaining;
+
+                nap.tv_sec = pause / 1000000L;
+                nap.tv_nsec = (pause % 1000000L) * 1000L;
+                nanosleep(&nap, NULL);
+
+                pause = ((pause * 2) > BLK_B_MAX) ? BLK_B_MAX : (pause * 2);
 
             }
 
         }
 
+        self->waited = _blk_elapsed(&start);
+
         exit_when;
 
     } use {
 
         stat = ERR;
+        self->waited = _blk_elapsed(&start);
         process_error(self);
 
     } end_when;
@@ -925,7 +1362,7 @@ int _blk_lock(blk_t *self, off_t offset, off_t length) {
 
 }
 
-int _blk_unlock(blk_t *self) {
+static int _blk_release(blk_t *self, struct flock *lock) {
 
     int fd;
     int stat = OK;
@@ -935,16 +1372,16 @@ int _blk_unlock(blk_t *self) {
         stat = fib_get_fd(FIB(self), &fd);
         check_return(stat, self);
 
-        self->lock.l_type = F_UNLCK;
+        lock->l_type = F_UNLCK;
+        lock->l_pid = BLK_PID;
 
         errno = 0;
-        if (fcntl(fd, F_SETLK, &self->lock) == -1) {
+        if (fcntl(fd, BLK_SETLK, lock) == -1) {
 
             cause_error(errno);
 
         }
 
-        self->locked = FALSE;
         exit_when;
 
     } use {
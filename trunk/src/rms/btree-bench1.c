@@ -0,0 +1,198 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "xas/types.h"
+#include "xas/rms/btree.h"
+
+/*
+ * latch contention. Many more threads than cores hammer a small btree
+ * with lookups and inserts, each thread with its own handle on the
+ * file. The run is done with the waiters parked on futexes and again
+ * with them yielding, the wall time, cpu time and the per operation
+ * latencies are compared.
+ *
+ * usage: btree-bench1 [threads] [operations per thread]
+ */
+
+#define KEYS 20000
+#define BITS 12
+#define POOL 64
+
+typedef struct _worker_s {
+    int id;
+    int ops;
+    double *latency;
+} worker_t;
+
+char *filename = "btree-bench1.ix";
+
+double now(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000000.0) + (ts.tv_nsec / 1000.0);
+
+}
+
+double cpu(void) {
+
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return ((usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0) +
+           ((usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0);
+
+}
+
+int compare(const void *a, const void *b) {
+
+    double x = *(double *)a;
+    double y = *(double *)b;
+
+    return (x > y) - (x < y);
+
+}
+
+void *worker(void *data) {
+
+    int x;
+    int k;
+    char key[16];
+    double start;
+    worker_t *self = data;
+    unsigned int seed = self->id;
+    BtDb *bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    for (x = 0; x < self->ops; x++) {
+
+        k = rand_r(&seed) % KEYS;
+        snprintf(key, sizeof(key), "%08d", k);
+
+        start = now();
+
+        if ((x % 5) == 0) {
+
+            bt_insertkey(bt, (unsigned char *)key, 8, 0, k + 1, 0);
+
+        } else {
+
+            bt_findkey(bt, (unsigned char *)key, 8);
+
+        }
+
+        self->latency[x] = now() - start;
+
+    }
+
+    bt_close(bt);
+
+    return NULL;
+
+}
+
+void run(char *name, int threads, int ops) {
+
+    int x;
+    int total = threads * ops;
+    double wall;
+    double used;
+    double *latency = calloc(total, sizeof(double));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    worker_t *workers = calloc(threads, sizeof(worker_t));
+
+    wall = now();
+    used = cpu();
+
+    for (x = 0; x < threads; x++) {
+
+        workers[x].id = x + 1;
+        workers[x].ops = ops;
+        workers[x].latency = &latency[x * ops];
+
+        pthread_create(&tids[x], NULL, worker, &workers[x]);
+
+    }
+
+    for (x = 0; x < threads; x++) {
+
+        pthread_join(tids[x], NULL);
+
+    }
+
+    wall = (now() - wall) / 1000.0;
+    used = cpu() - used;
+
+    qsort(latency, total, sizeof(double), compare);
+
+    printf("%-8s wall %8.1f ms  cpu %8.1f ms  p50 %7.1f us  p99 %8.1f us  max %9.1f us\n",
+           name, wall, used, latency[total / 2], latency[(total * 99) / 100],
+           latency[total - 1]);
+
+    free(workers);
+    free(latency);
+    free(tids);
+
+}
+
+void cleanup(void) {
+
+    char path[256];
+
+    unlink(filename);
+
+    snprintf(path, sizeof(path), "%s.log0", filename);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s.log1", filename);
+    unlink(path);
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int ops = 20000;
+    int threads = 32;
+    char key[16];
+    BtDb *bt = NULL;
+
+    if (argc > 1) threads = atoi(argv[1]);
+    if (argc > 2) ops = atoi(argv[2]);
+
+    cleanup();
+
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    for (x = 0; x < KEYS; x += 2) {
+
+        snprintf(key, sizeof(key), "%08d", x);
+        bt_insertkey(bt, (unsigned char *)key, 8, 0, x + 1, 0);
+
+    }
+
+    printf("%d threads on %ld cores, %d operations each\n",
+           threads, sysconf(_SC_NPROCESSORS_ONLN), ops);
+
+    bt_parking = 1;
+    run("futex", threads, ops);
+
+    bt_parking = 0;
+    run("yield", threads, ops);
+
+    bt_close(bt);
+    cleanup();
+
+    return 0;
+
+}
+
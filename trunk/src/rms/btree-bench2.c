@@ -0,0 +1,559 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "xas/types.h"
+#include "xas/rms/btree.h"
+
+/*
+ * concurrent btree benchmark. Threads in one or more processes, each
+ * thread with its own handle on one file, run a mix of inserts, finds,
+ * deletes and range scans on keys drawn from a uniform or a Zipfian
+ * distribution. The file is bulk loaded with every other key first.
+ * The operations per second, the latency percentiles of each kind of
+ * operation, the pool hit rate and the time spent waiting on latches
+ * are printed as one line of JSON.
+ *
+ * usage: btree-bench2 [-t threads] [-p processes] [-n operations]
+ *                     [-k keys] [-m insert:find:delete:scan]
+ *                     [-d uniform|zipf] [-z theta] [-s scan length]
+ *                     [-b page bits] [-c pool pages] [-f file]
+ *
+ * -n is the number of operations of each thread, the mix is given in
+ * parts, the default is 10:80:5:5 and theta defaults to 0.99.
+ */
+
+#define INSERT  0
+#define FIND    1
+#define DELETE  2
+#define SCAN    3
+#define KINDS   4
+
+#define SUB     16              /* histogram buckets in each power of two */
+#define BUCKETS (40 * SUB)
+#define BATCH   64
+
+typedef struct _result_s {
+    uid ops[KINDS];
+    uid sum[KINDS];
+    uid max[KINDS];
+    uid hist[KINDS][BUCKETS];
+    BtPoolStat pool;
+} result_t;
+
+typedef struct _shared_s {
+    volatile int ready;
+    volatile int go;
+    uid waits;
+    uid parks;
+    uid waitns;
+} shared_t;
+
+typedef struct _bench_s {
+    int threads;
+    int processes;
+    int ops;
+    uint keys;
+    int mix[KINDS];
+    int total;
+    int zipf;
+    double theta;
+    int scan;
+    uint bits;
+    uint pool;
+    char *filename;
+    double zetan;
+    double alpha;
+    double eta;
+} bench_t;
+
+typedef struct _worker_s {
+    int id;
+    bench_t *bench;
+    result_t *result;
+} worker_t;
+
+char *names[KINDS] = { "insert", "find", "delete", "scan" };
+
+shared_t *shared = NULL;
+
+uid now(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uid)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+
+}
+
+/* xorshift64*, one state for each thread */
+
+uid next_random(uid *state) {
+
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 2685821657736338717ULL;
+
+}
+
+double next_double(uid *state) {
+
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+
+}
+
+/* Zipfian ranks, as in Gray et al. "Quickly generating billion-record
+ * synthetic databases". The ranks are hashed so the hot keys are spread
+ * over the btree instead of sitting on a few pages. */
+
+void zipf_setup(bench_t *bench) {
+
+    uint x;
+    double zeta2 = 0;
+
+    bench->zetan = 0;
+
+    for (x = 1; x <= bench->keys; x++) {
+
+        bench->zetan += 1.0 / pow((double)x, bench->theta);
+
+    }
+
+    zeta2 = 1.0 + (1.0 / pow(2.0, bench->theta));
+
+    bench->alpha = 1.0 / (1.0 - bench->theta);
+    bench->eta = (1.0 - pow(2.0 / bench->keys, 1.0 - bench->theta)) /
+                 (1.0 - (zeta2 / bench->zetan));
+
+}
+
+uint next_key(bench_t *bench, uid *state) {
+
+    uid rank;
+    double u;
+    double uz;
+
+    if (!bench->zipf) return next_random(state) % bench->keys;
+
+    u = next_double(state);
+    uz = u * bench->zetan;
+
+    if (uz < 1.0) {
+
+        rank = 0;
+
+    } else if (uz < 1.0 + pow(0.5, bench->theta)) {
+
+        rank = 1;
+
+    } else {
+
+        rank = (uid)(bench->keys * pow((bench->eta * u) - bench->eta + 1.0, bench->alpha));
+
+    }
+
+    /* FNV-1a of the rank */
+
+    rank = (rank ^ 14695981039346656037ULL) * 1099511628211ULL;
+
+    return rank % bench->keys;
+
+}
+
+/* log linear latency histogram, about 6% wide buckets */
+
+int bucket(uid ns) {
+
+    int msb;
+    int shift;
+    int idx;
+
+    if (ns < SUB) return ns;
+
+    msb = 63 - __builtin_clzll(ns);
+    shift = msb - 4;
+    idx = ((shift + 1) * SUB) + ((ns >> shift) & (SUB - 1));
+
+    return (idx < BUCKETS) ? idx : BUCKETS - 1;
+
+}
+
+uid bucket_value(int idx) {
+
+    int shift;
+
+    if (idx < SUB) return idx;
+
+    shift = (idx / SUB) - 1;
+
+    return (uid)(SUB + (idx % SUB)) << shift;
+
+}
+
+double percentile(result_t *total, int kind, double pct) {
+
+    int x;
+    uid seen = 0;
+    uid want = (uid)ceil(total->ops[kind] * pct / 100.0);
+
+    if (want == 0) want = 1;
+
+    for (x = 0; x < BUCKETS; x++) {
+
+        if ((seen += total->hist[kind][x]) >= want) break;
+
+    }
+
+    if (x == BUCKETS) x = BUCKETS - 1;
+
+    return bucket_value(x) / 1000.0;
+
+}
+
+int make_key(char *key, uint k) {
+
+    return snprintf(key, 16, "%010u", k);
+
+}
+
+void *worker(void *data) {
+
+    int x;
+    int y;
+    int op;
+    int len;
+    uint k;
+    uint cnt;
+    uid state;
+    uid start;
+    uid took;
+    char key[16];
+    worker_t *self = data;
+    bench_t *bench = self->bench;
+    result_t *result = self->result;
+    BtPair pairs[BATCH];
+    BtCursor *cursor = NULL;
+    BtDb *bt = bt_open(bench->filename, BT_rw, bench->bits, bench->pool);
+
+    state = 0x9e3779b97f4a7c15ULL * (self->id + 1);
+
+    __sync_fetch_and_add(&shared->ready, 1);
+
+    while (!shared->go) sched_yield();
+
+    for (x = 0; x < bench->ops; x++) {
+
+        y = next_random(&state) % bench->total;
+
+        for (op = 0; y >= bench->mix[op]; op++) y -= bench->mix[op];
+
+        k = next_key(bench, &state);
+        len = make_key(key, k);
+
+        start = now();
+
+        switch (op) {
+            case INSERT:
+                bt_insertkey(bt, (unsigned char *)key, len, 0, k + 1, 0);
+                break;
+
+            case FIND:
+                bt_findkey(bt, (unsigned char *)key, len);
+                break;
+
+            case DELETE:
+                bt_deletekey(bt, (unsigned char *)key, len, 0);
+                break;
+
+            case SCAN:
+                cursor = bt_cursoropen(bt, (unsigned char *)key, len, NULL, 0);
+
+                for (y = 0; y < bench->scan; y += cnt) {
+
+                    cnt = bench->scan - y;
+                    if (cnt > BATCH) cnt = BATCH;
+                    if ((cnt = bt_cursornext(cursor, pairs, cnt)) == 0) break;
+
+                }
+
+                bt_cursorclose(cursor);
+                break;
+        }
+
+        took = now() - start;
+
+        result->ops[op]++;
+        result->sum[op] += took;
+        result->hist[op][bucket(took)]++;
+        if (took > result->max[op]) result->max[op] = took;
+
+    }
+
+    bt_poolstats(bt, &result->pool);
+    bt_close(bt);
+
+    return NULL;
+
+}
+
+/* the threads of one process, the latch counters are kept for the process */
+
+void process(bench_t *bench, result_t *results, int first) {
+
+    int x;
+    BtPoolStat before;
+    BtPoolStat after;
+    BtDb *bt = bt_open(bench->filename, BT_rw, bench->bits, bench->pool);
+    pthread_t *tids = calloc(bench->threads, sizeof(pthread_t));
+    worker_t *workers = calloc(bench->threads, sizeof(worker_t));
+
+    bt_poolstats(bt, &before);
+
+    for (x = 0; x < bench->threads; x++) {
+
+        workers[x].id = first + x;
+        workers[x].bench = bench;
+        workers[x].result = &results[first + x];
+
+        pthread_create(&tids[x], NULL, worker, &workers[x]);
+
+    }
+
+    for (x = 0; x < bench->threads; x++) {
+
+        pthread_join(tids[x], NULL);
+
+    }
+
+    bt_poolstats(bt, &after);
+    bt_close(bt);
+
+    __sync_fetch_and_add(&shared->waits, after.waits - before.waits);
+    __sync_fetch_and_add(&shared->parks, after.parks - before.parks);
+    __sync_fetch_and_add(&shared->waitns, after.waitns - before.waitns);
+
+    free(workers);
+    free(tids);
+
+}
+
+void cleanup(char *filename) {
+
+    char path[256];
+
+    unlink(filename);
+
+    snprintf(path, sizeof(path), "%s.log0", filename);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s.log1", filename);
+    unlink(path);
+
+}
+
+void usage(void) {
+
+    fprintf(stderr, "usage: btree-bench2 [-t threads] [-p processes] [-n operations]\n");
+    fprintf(stderr, "                    [-k keys] [-m insert:find:delete:scan]\n");
+    fprintf(stderr, "                    [-d uniform|zipf] [-z theta] [-s scan length]\n");
+    fprintf(stderr, "                    [-b page bits] [-c pool pages] [-f file]\n");
+
+    exit(1);
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int y;
+    int opt;
+    int len;
+    int workers;
+    uid wall;
+    uid ops = 0;
+    uid hits = 0;
+    uid pins = 0;
+    char key[16];
+    char *mix = "10:80:5:5";
+    bench_t bench;
+    pid_t *pids = NULL;
+    BtDb *bt = NULL;
+    BtLoad *load = NULL;
+    result_t total;
+    result_t *results = NULL;
+
+    memset(&bench, 0, sizeof(bench));
+
+    bench.threads = 4;
+    bench.processes = 1;
+    bench.ops = 100000;
+    bench.keys = 1000000;
+    bench.theta = 0.99;
+    bench.scan = 100;
+    bench.bits = 12;
+    bench.pool = 4096;
+    bench.filename = "btree-bench2.ix";
+
+    while ((opt = getopt(argc, argv, "t:p:n:k:m:d:z:s:b:c:f:")) != -1) {
+
+        switch (opt) {
+            case 't': bench.threads = atoi(optarg); break;
+            case 'p': bench.processes = atoi(optarg); break;
+            case 'n': bench.ops = atoi(optarg); break;
+            case 'k': bench.keys = strtoul(optarg, NULL, 10); break;
+            case 'm': mix = optarg; break;
+            case 'd': bench.zipf = (strcmp(optarg, "zipf") == 0); break;
+            case 'z': bench.theta = atof(optarg); break;
+            case 's': bench.scan = atoi(optarg); break;
+            case 'b': bench.bits = atoi(optarg); break;
+            case 'c': bench.pool = atoi(optarg); break;
+            case 'f': bench.filename = optarg; break;
+            default: usage();
+        }
+
+    }
+
+    if (sscanf(mix, "%d:%d:%d:%d", &bench.mix[INSERT], &bench.mix[FIND],
+               &bench.mix[DELETE], &bench.mix[SCAN]) != KINDS) usage();
+
+    for (x = 0; x < KINDS; x++) bench.total += bench.mix[x];
+
+    if ((bench.total <= 0) || (bench.threads < 1) || (bench.processes < 1) ||
+        (bench.keys < 2) || (bench.zipf && ((bench.theta <= 0) || (bench.theta >= 1)))) usage();
+
+    if (bench.zipf) zipf_setup(&bench);
+
+    /* every other key, bulk loaded */
+
+    cleanup(bench.filename);
+
+    bt = bt_open(bench.filename, BT_rw, bench.bits, bench.pool);
+    load = bt_loadopen(bt, 90);
+
+    for (x = 0; x < bench.keys; x += 2) {
+
+        len = make_key(key, x);
+        bt_loadkey(load, (unsigned char *)key, len, x + 1);
+
+    }
+
+    bt_loadclose(load);
+    bt_close(bt);
+
+    /* the results are shared with the processes */
+
+    workers = bench.threads * bench.processes;
+
+    shared = mmap(NULL, sizeof(shared_t), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    results = mmap(NULL, workers * sizeof(result_t), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if ((shared == MAP_FAILED) || (results == MAP_FAILED)) {
+
+        perror("mmap");
+        exit(1);
+
+    }
+
+    pids = calloc(bench.processes, sizeof(pid_t));
+
+    for (x = 0; x < bench.processes; x++) {
+
+        if ((pids[x] = fork()) == 0) {
+
+            process(&bench, results, x * bench.threads);
+            _exit(0);
+
+        }
+
+    }
+
+    while (shared->ready < workers) usleep(1000);
+
+    wall = now();
+    shared->go = 1;
+
+    for (x = 0; x < bench.processes; x++) {
+
+        waitpid(pids[x], NULL, 0);
+
+    }
+
+    wall = now() - wall;
+
+    /* add up the workers */
+
+    memset(&total, 0, sizeof(total));
+
+    for (x = 0; x < workers; x++) {
+
+        for (opt = 0; opt < KINDS; opt++) {
+
+            total.ops[opt] += results[x].ops[opt];
+            total.sum[opt] += results[x].sum[opt];
+
+            if (results[x].max[opt] > total.max[opt]) total.max[opt] = results[x].max[opt];
+
+            for (y = 0; y < BUCKETS; y++) total.hist[opt][y] += results[x].hist[opt][y];
+
+        }
+
+        pins += results[x].pool.pins;
+        hits += results[x].pool.hits;
+        total.pool.misses += results[x].pool.misses;
+        total.pool.evictions += results[x].pool.evictions;
+        total.pool.writes += results[x].pool.writes;
+
+    }
+
+    for (x = 0; x < KINDS; x++) ops += total.ops[x];
+
+    printf("{\"threads\":%d,\"processes\":%d,\"cores\":%ld,\"keys\":%u,"
+           "\"mix\":\"%s\",\"distribution\":\"%s\",\"theta\":%.2f,"
+           "\"scan\":%d,\"page_bits\":%u,\"pool\":%u,",
+           bench.threads, bench.processes, sysconf(_SC_NPROCESSORS_ONLN),
+           bench.keys, mix, bench.zipf ? "zipf" : "uniform", bench.theta,
+           bench.scan, bench.bits, bench.pool);
+
+    printf("\"ops\":%llu,\"wall_ms\":%.1f,\"ops_per_sec\":%.0f,",
+           ops, wall / 1000000.0, ops / (wall / 1000000000.0));
+
+    for (x = 0; x < KINDS; x++) {
+
+        if (total.ops[x] == 0) continue;
+
+        printf("\"%s\":{\"ops\":%llu,\"mean_us\":%.2f,\"p50_us\":%.2f,"
+               "\"p90_us\":%.2f,\"p99_us\":%.2f,\"p999_us\":%.2f,\"max_us\":%.2f},",
+               names[x], total.ops[x], (total.sum[x] / (double)total.ops[x]) / 1000.0,
+               percentile(&total, x, 50), percentile(&total, x, 90),
+               percentile(&total, x, 99), percentile(&total, x, 99.9),
+               total.max[x] / 1000.0);
+
+    }
+
+    printf("\"pool_pins\":%llu,\"pool_hit_rate\":%.4f,\"pool_misses\":%llu,"
+           "\"pool_evictions\":%llu,\"pool_writes\":%llu,",
+           pins, pins ? (double)hits / pins : 0.0, total.pool.misses,
+           total.pool.evictions, total.pool.writes);
+
+    printf("\"latch_waits\":%llu,\"latch_parks\":%llu,\"latch_wait_ms\":%.1f}\n",
+           shared->waits, shared->parks, shared->waitns / 1000000.0);
+
+    cleanup(bench.filename);
+
+    return 0;
+
+}
+
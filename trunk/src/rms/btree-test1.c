@@ -0,0 +1,167 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "xas/types.h"
+#include "xas/rms/btree.h"
+#include "rms-test.h"
+
+/*
+ * bulk loading. The same sorted keys are inserted one at a time into
+ * one btree and bulk loaded into another. Every key must be found in
+ * the loaded btree, a scan must return them in order, and keys can
+ * still be inserted after the load.
+ */
+
+#define KEYS 200000
+#define BITS 12
+#define POOL 256
+#define FILL 90
+
+char *inserted = "btree-test1a.ix";
+char *loaded = "btree-test1b.ix";
+
+off_t file_size(char *name) {
+
+    struct stat buf;
+
+    if (stat(name, &buf) < 0) return 0;
+
+    return buf.st_size;
+
+}
+
+void cleanup(char *name) {
+
+    char path[256];
+
+    unlink(name);
+
+    snprintf(path, sizeof(path), "%s.log0", name);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s.log1", name);
+    unlink(path);
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int count = 0;
+    int errors = 0;
+    uint slot = 0;
+    char key[16];
+    BtKey ptr;
+    BtDb *bt = NULL;
+    BtLoad *load = NULL;
+    struct timespec start;
+
+    cleanup(inserted);
+    cleanup(loaded);
+
+    /* one key at a time */
+
+    bt = bt_open(inserted, BT_rw, BITS, POOL);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (x = 0; x < KEYS; x++) {
+
+        snprintf(key, sizeof(key), "%010d", x * 2);
+        bt_insertkey(bt, (unsigned char *)key, 10, 0, x + 1, 0);
+
+    }
+
+    printf("insert: %.1f ms, %ld bytes\n", elapsed(&start), (long)file_size(inserted));
+    bt_close(bt);
+
+    /* bulk loaded */
+
+    bt = bt_open(loaded, BT_rw, BITS, POOL);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if ((load = bt_loadopen(bt, FILL)) == NULL) {
+
+        printf("bt_loadopen failed: %d\n", bt->err);
+        return 1;
+
+    }
+
+    for (x = 0; x < KEYS; x++) {
+
+        snprintf(key, sizeof(key), "%010d", x * 2);
+        if (bt_loadkey(load, (unsigned char *)key, 10, x + 1)) errors++;
+
+    }
+
+    /* keys out of order are refused */
+
+    if (bt_loadkey(load, (unsigned char *)"0000000000", 10, 1) != BTERR_struct) errors++;
+
+    if (bt_loadclose(load)) errors++;
+
+    printf("load: %.1f ms, %ld bytes\n", elapsed(&start), (long)file_size(loaded));
+
+    /* a loaded btree can't be loaded again */
+
+    if (bt_loadopen(bt, FILL) != NULL) errors++;
+
+    for (x = 0; x < KEYS; x++) {
+
+        snprintf(key, sizeof(key), "%010d", x * 2);
+        if (bt_findkey(bt, (unsigned char *)key, 10) != x + 1) errors++;
+
+        snprintf(key, sizeof(key), "%010d", (x * 2) + 1);
+        if (bt_findkey(bt, (unsigned char *)key, 10) != 0) errors++;
+
+    }
+
+    printf("find: %d errors\n", errors);
+
+    /* insert between the loaded keys, then scan */
+
+    for (x = 0; x < KEYS; x += 7) {
+
+        snprintf(key, sizeof(key), "%010d", (x * 2) + 1);
+        bt_insertkey(bt, (unsigned char *)key, 10, 0, KEYS + x + 1, 0);
+
+    }
+
+    bt_close(bt);
+    bt = bt_open(loaded, BT_rw, BITS, POOL);
+
+    x = -1;
+
+    for (slot = bt_startkey(bt, (unsigned char *)"", 0); slot > 0;
+         slot = bt_nextkey(bt, slot)) {
+
+        ptr = bt_key(bt, slot);
+        memcpy(key, ptr->key, ptr->len);
+        key[ptr->len] = '\0';
+
+        if (atoi(key) <= x) errors++;
+
+        x = atoi(key);
+        count++;
+
+    }
+
+    /* every seventh key has one inserted after it */
+
+    if (count != KEYS + (KEYS + 6) / 7) errors++;
+
+    printf("scan: %d keys, %d errors\n", count, errors);
+
+    bt_close(bt);
+
+    cleanup(inserted);
+    cleanup(loaded);
+
+    return passed(errors);
+
+}
+
@@ -0,0 +1,178 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "xas/types.h"
+#include "xas/rms/btree.h"
+#include "rms-test.h"
+
+/*
+ * range cursors. A bulk loaded btree is scanned with bt_startkey and
+ * bt_nextkey, then with a cursor in batches. Both must return the same
+ * keys in order. A limited range and small batches, which leave pages
+ * part way, are checked against the keys that should be there.
+ */
+
+#define KEYS  1000000
+#define BITS  12
+#define POOL  1024
+#define BATCH 256
+
+char *filename = "btree-test2.ix";
+
+int scan(BtDb *bt, char *low, char *high, uint batch, long *sum) {
+
+    uint x;
+    uint count = 0;
+    int total = 0;
+    int previous = -1;
+    int value = 0;
+    char key[16];
+    BtCursor *cursor = NULL;
+    BtPair pairs[BATCH];
+
+    *sum = 0;
+    cursor = bt_cursoropen(bt, (unsigned char *)low, strlen(low),
+                           (unsigned char *)high, high ? strlen(high) : 0);
+
+    while ((count = bt_cursornext(cursor, pairs, batch)) > 0) {
+
+        for (x = 0; x < count; x++) {
+
+            memcpy(key, pairs[x].key, pairs[x].len);
+            key[pairs[x].len] = '\0';
+            value = atoi(key);
+
+            if ((value <= previous) || (pairs[x].id != value + 1)) return -1;
+
+            previous = value;
+            *sum += value;
+            total++;
+
+        }
+
+    }
+
+    bt_cursorclose(cursor);
+
+    return total;
+
+}
+
+void cleanup(void) {
+
+    char path[256];
+
+    unlink(filename);
+
+    snprintf(path, sizeof(path), "%s.log0", filename);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s.log1", filename);
+    unlink(path);
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int count = 0;
+    int errors = 0;
+    uint slot = 0;
+    uint batch = 0;
+    long sum = 0;
+    long expected = 0;
+    char key[16];
+    BtDb *bt = NULL;
+    BtLoad *load = NULL;
+    BtCursor *cursor = NULL;
+    BtPair pairs[BATCH];
+    struct timespec start;
+
+    cleanup();
+
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+    load = bt_loadopen(bt, 100);
+
+    for (x = 0; x < KEYS; x++) {
+
+        snprintf(key, sizeof(key), "%08d", x * 2);
+        bt_loadkey(load, (unsigned char *)key, 8, (x * 2) + 1);
+
+    }
+
+    bt_loadclose(load);
+
+    /* one key at a time, from a copy of each page */
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (slot = bt_startkey(bt, (unsigned char *)"", 0); slot > 0;
+         slot = bt_nextkey(bt, slot)) {
+
+        sum += bt_uid(bt, slot);
+        count++;
+
+    }
+
+    printf("nextkey: %d keys, %.1f ms\n", count, elapsed(&start));
+
+    /* the ids are the keys plus one, 1 + 3 + ... adds up to KEYS^2 */
+
+    if ((count != KEYS) || (sum != (long)KEYS * KEYS)) errors++;
+
+    /* batches from the pool pages */
+
+    sum = 0;
+    count = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    cursor = bt_cursoropen(bt, (unsigned char *)"", 0, NULL, 0);
+
+    while ((batch = bt_cursornext(cursor, pairs, BATCH)) > 0) {
+
+        for (x = 0; x < batch; x++) sum += pairs[x].id;
+        count += batch;
+
+    }
+
+    bt_cursorclose(cursor);
+    printf("cursor: %d keys, %.1f ms\n", count, elapsed(&start));
+
+    if ((count != KEYS) || (sum != (long)KEYS * KEYS)) errors++;
+
+    count = scan(bt, "", NULL, BATCH, &sum);
+    printf("ordered: %d keys\n", count);
+
+    if ((count != KEYS) || (sum != (long)KEYS * (KEYS - 1))) errors++;
+
+    /* a range, 00100000 .. 00200000 inclusive, in small batches */
+
+    for (x = 100000; x <= 200000; x += 2) expected += x;
+
+    count = scan(bt, "00100000", "00200000", 7, &sum);
+    printf("range: %d keys, %s\n", count, (sum == expected) ? "correct" : "WRONG");
+
+    if ((count != 50001) || (sum != expected)) errors++;
+
+    /* bounds that fall between keys, 2 4 6 8 */
+
+    count = scan(bt, "00000001", "00000009", BATCH, &sum);
+    printf("between: %d keys, sum %ld\n", count, sum);
+
+    if ((count != 4) || (sum != 20)) errors++;
+
+    count = scan(bt, "99999999", NULL, BATCH, &sum);
+    printf("past the end: %d keys\n", count);
+
+    if (count != 0) errors++;
+
+    bt_close(bt);
+    cleanup();
+
+    return passed(errors);
+
+}
+
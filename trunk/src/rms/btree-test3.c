@@ -0,0 +1,294 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "xas/types.h"
+#include "xas/rms/btree.h"
+#include "rms-test.h"
+
+/*
+ * redo log. A child process inserts keys, commits every few keys and
+ * tells the parent how far it has committed, then it is killed. The
+ * btree is reopened and every committed key must be there. This is done
+ * with the buffer pool left as it was, and again with the pool wiped
+ * out in the file, as if the pages had never been written. The last run
+ * uses a small log, so checkpoints happen while the keys are inserted.
+ * The log is off until bt_setlog() turns it on, a btree that never
+ * turns it on must not have log files.
+ */
+
+#define KEYS   200000
+#define BITS   12
+#define POOL   256
+#define COMMIT 1000
+
+char *filename = "btree-test3.ix";
+
+off_t file_size(char *name) {
+
+    struct stat buf;
+
+    if (stat(name, &buf) < 0) return 0;
+
+    return buf.st_size;
+
+}
+
+void cleanup(void) {
+
+    char path[256];
+
+    unlink(filename);
+
+    snprintf(path, sizeof(path), "%s.log0", filename);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s.log1", filename);
+    unlink(path);
+
+}
+
+void inserter(int fd, uid logmax) {
+
+    int x;
+    char key[16];
+    BtDb *bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    bt_setlog(bt, TRUE);
+    if (logmax) bt->logmax = logmax;
+
+    for (x = 0; x < KEYS; x++) {
+
+        snprintf(key, sizeof(key), "%08d", x);
+        bt_insertkey(bt, (unsigned char *)key, 8, 0, x + 1, 0);
+
+        if (((x + 1) % COMMIT) == 0) {
+
+            bt_commit(bt);
+            write(fd, &x, sizeof(x));
+
+        }
+
+    }
+
+    /* wait to be killed */
+
+    pause();
+
+}
+
+/* zero the latch tables and the buffer pool in the file */
+
+void wipe(void) {
+
+    int fd;
+    off_t size;
+    char *zeros;
+    BtLatchMgr mgr;
+    uint page_size = 1 << BITS;
+
+    fd = open(filename, O_RDWR);
+    pread(fd, &mgr, sizeof(mgr), 0);
+
+    size = (off_t)mgr.nlatchpage * page_size;
+    zeros = calloc(1, size);
+
+    pwrite(fd, zeros, size, (off_t)(MIN_lvl + 1) * page_size);
+
+    free(zeros);
+    close(fd);
+
+}
+
+int crash(char *name, int wiped, uid logmax, int target) {
+
+    int x;
+    int fds[2];
+    int count = 0;
+    int errors = 0;
+    int committed = -1;
+    uint slot = 0;
+    char key[16];
+    char path[256];
+    pid_t pid;
+    BtKey ptr;
+    BtDb *bt = NULL;
+    struct timespec start;
+
+    cleanup();
+    pipe(fds);
+
+    if ((pid = fork()) == 0) {
+
+        close(fds[0]);
+        inserter(fds[1], logmax);
+        _exit(0);
+
+    }
+
+    close(fds[1]);
+
+    while (read(fds[0], &x, sizeof(x)) == sizeof(x)) {
+
+        committed = x;
+        if (committed + 1 >= target) break;
+
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    close(fds[0]);
+
+    snprintf(path, sizeof(path), "%s.log%d", filename, 0);
+    printf("%s: %d committed, logs %ld + ",
+           name, committed + 1, (long)file_size(path));
+    snprintf(path, sizeof(path), "%s.log%d", filename, 1);
+    printf("%ld bytes\n", (long)file_size(path));
+
+    if (wiped) wipe();
+
+    /* reopen, which replays the logs */
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+    printf("%s: recovered in %.1f ms, ", name, elapsed(&start));
+
+    for (x = 0; x <= committed; x++) {
+
+        snprintf(key, sizeof(key), "%08d", x);
+        if (bt_findkey(bt, (unsigned char *)key, 8) != x + 1) errors++;
+
+    }
+
+    /* the btree must still be whole */
+
+    x = -1;
+
+    for (slot = bt_startkey(bt, (unsigned char *)"", 0); slot > 0;
+         slot = bt_nextkey(bt, slot)) {
+
+        ptr = bt_key(bt, slot);
+        memcpy(key, ptr->key, ptr->len);
+        key[ptr->len] = '\0';
+
+        if (atoi(key) <= x) errors++;
+
+        x = atoi(key);
+        count++;
+
+    }
+
+    if (count < committed + 1) errors++;
+
+    snprintf(path, sizeof(path), "%s.log%d", filename, 0);
+    printf("%d keys, %d errors, logs %ld + ",
+           count, errors, (long)file_size(path));
+    snprintf(path, sizeof(path), "%s.log%d", filename, 1);
+    printf("%ld bytes\n", (long)file_size(path));
+
+    bt_close(bt);
+    cleanup();
+
+    return errors;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int errors = 0;
+    char key[16];
+    BtDb *bt = NULL;
+    char path[256];
+    struct timespec start;
+
+    /* not logged unless asked */
+
+    cleanup();
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    for (x = 0; x < 2000; x++) {
+
+        snprintf(key, sizeof(key), "%08d", x);
+        bt_insertkey(bt, (unsigned char *)key, 8, 0, x + 1, 0);
+
+    }
+
+    if (bt_commit(bt) != 0) errors++;
+
+    bt_close(bt);
+
+    snprintf(path, sizeof(path), "%s.log0", filename);
+    if (access(path, F_OK) == 0) errors++;
+
+    /* and a logged btree stays logged when it is reopened */
+
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+    if (bt_setlog(bt, TRUE) != 0) errors++;
+    bt_close(bt);
+
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+    if (!bt->latchmgr->logged) errors++;
+
+    snprintf(key, sizeof(key), "%08d", 2000);
+    bt_insertkey(bt, (unsigned char *)key, 8, 0, 2001, 0);
+    if (file_size(path) == 0) errors++;
+
+    /* turning it off empties the logs */
+
+    if (bt_setlog(bt, FALSE) != 0) errors++;
+    if (file_size(path) != 0) errors++;
+    if (bt_findkey(bt, (unsigned char *)key, 8) != 2001) errors++;
+
+    bt_close(bt);
+    cleanup();
+
+    printf("log off: %d errors\n", errors);
+
+    errors += crash("pool kept", FALSE, 0, KEYS / 2);
+    errors += crash("pool lost", TRUE, 0, KEYS / 2);
+    errors += crash("checkpoints", TRUE, 1 << 20, KEYS);
+
+    /* the cost of a commit after every key */
+
+    cleanup();
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+    bt_setlog(bt, TRUE);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (x = 0; x < 2000; x++) {
+
+        snprintf(key, sizeof(key), "%08d", x);
+        bt_insertkey(bt, (unsigned char *)key, 8, 0, x + 1, 0);
+        bt_commit(bt);
+
+    }
+
+    printf("commit each: 2000 keys, %.1f ms\n", elapsed(&start));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (x = 2000; x < 4000; x++) {
+
+        snprintf(key, sizeof(key), "%08d", x);
+        bt_insertkey(bt, (unsigned char *)key, 8, 0, x + 1, 0);
+
+    }
+
+    bt_commit(bt);
+    printf("commit once: 2000 keys, %.1f ms\n", elapsed(&start));
+
+    bt_close(bt);
+    cleanup();
+
+    return passed(errors);
+
+}
+
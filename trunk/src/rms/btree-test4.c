@@ -0,0 +1,548 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "xas/types.h"
+#include "xas/rms/btree.h"
+#include "rms-test.h"
+
+/*
+ * values. Keys are stored with values of many sizes, small ones stay
+ * in the leaf and large ones go to overflow pages. Each value must come
+ * back as it was put, after it is replaced with a value of another size,
+ * and after the btree is reopened. Replacing and deleting large values
+ * must give their pages back, so the file doesn't keep growing. An id
+ * with the bits that mark a value is refused by bt_insertkey.
+ *
+ * Long keys, up to past 64KB, many with the same first bytes, are
+ * inserted in random order, in a plain and in a packed file. Each must
+ * be found, with bt_keydata, a scan and a cursor in order, and after
+ * some are deleted. They are bulk loaded into another file and found
+ * there, a long key takes a value, and replacing the longest key gives
+ * its pages back. A file of the format before long keys refuses them.
+ */
+
+#define KEYS  20000
+#define BITS  12
+#define POOL  256
+#define LARGE 100000
+#define LONGS 3000
+#define HUGE  70000
+
+char *filename = "btree-test4.ix";
+char *loadname = "btree-test4b.ix";
+
+off_t file_size(char *name) {
+
+    struct stat buf;
+
+    if (stat(name, &buf) < 0) return 0;
+
+    return buf.st_size;
+
+}
+
+void remove_file(char *name) {
+
+    char path[256];
+
+    unlink(name);
+
+    snprintf(path, sizeof(path), "%s.log0", name);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s.log1", name);
+    unlink(path);
+
+}
+
+void cleanup(void) {
+
+    remove_file(filename);
+
+}
+
+/* the size and bytes of a value depend on the key and a round */
+
+uint value_size(int x, int round) {
+
+    switch ((x + round) % 4) {
+        case 0: return 0;
+        case 1: return (x % 200) + 1;
+        case 2: return 500 + (x % 3000);
+        default: return 5000 + (x % 20000);
+    }
+
+}
+
+void value_fill(unsigned char *value, uint size, int x, int round) {
+
+    uint y;
+
+    for (y = 0; y < size; y++) {
+
+        value[y] = (unsigned char)(x * 31 + round * 7 + y);
+
+    }
+
+}
+
+int check(BtDb *bt, int x, int round, unsigned char *value, unsigned char *buffer) {
+
+    int length;
+    char key[16];
+    uint size = value_size(x, round);
+
+    snprintf(key, sizeof(key), "key%08d", x);
+    value_fill(value, size, x, round);
+
+    length = bt_get(bt, (unsigned char *)key, 11, buffer, LARGE);
+
+    if ((length != size) || memcmp(value, buffer, size)) return 1;
+
+    return 0;
+
+}
+
+/* long key x, its length cycles thru the sizes around the */
+/* inline limit and every 500th is past 64KB. The odd keys  */
+/* have their number after 100 bytes that are all the same  */
+
+uint long_key(unsigned char *key, int x) {
+
+    uint sizes[] = { 10, 200, 254, 255, 256, 1000, 5000 };
+    uint len = (x % 500) == 499 ? HUGE + x : sizes[x % 7];
+    uint off = (x % 2) ? ((len < 108) ? len - 8 : 100) : 0;
+    char number[16];
+
+    memset(key, 'k', len);
+    snprintf(number, sizeof(number), "%08d", x);
+    memcpy(key + off, number, 8);
+
+    return len;
+
+}
+
+/* the order of the keys, memcmp and then the length */
+
+int key_compare(unsigned char *key1, uint len1, unsigned char *key2, uint len2) {
+
+    int ans = memcmp(key1, key2, len1 < len2 ? len1 : len2);
+
+    if (ans) return ans;
+
+    return (len1 > len2) ? 1 : (len1 < len2) ? -1 : 0;
+
+}
+
+/* set the format version kept in the file */
+
+void set_version(uint version) {
+
+    int fd;
+
+    fd = open(filename, O_RDWR);
+    pwrite(fd, &version, sizeof(version), offsetof(BtLatchMgr, version));
+    close(fd);
+
+}
+
+int long_keys(uint mode) {
+
+    int x;
+    int y;
+    int count = 0;
+    int expected = 0;
+    int errors = 0;
+    int *order = calloc(LONGS, sizeof(int));
+    int *sorted = calloc(LONGS, sizeof(int));
+    char *live = calloc(LONGS, 1);
+    char *what = (mode == BT_pk) ? "packed" : "plain";
+    uint x2;
+    uint len;
+    uint batch;
+    uint slot;
+    uint lastlen = 0;
+    off_t size = 0;
+    unsigned int seed = 1;
+    unsigned char *key = malloc(HUGE + LONGS);
+    unsigned char *last = malloc(HUGE + LONGS);
+    unsigned char *data = NULL;
+    unsigned char value[64];
+    BtDb *bt = NULL;
+    BtLoad *load = NULL;
+    BtCursor *cursor = NULL;
+    BtPair pairs[50];
+
+    cleanup();
+    bt = bt_open(filename, mode, BITS, POOL);
+
+    for (x = 0; x < LONGS; x++) order[x] = x;
+
+    for (x = LONGS - 1; x > 0; x--) {
+
+        y = rand_r(&seed) % (x + 1);
+        len = order[x];
+        order[x] = order[y];
+        order[y] = len;
+
+    }
+
+    for (x = 0; x < LONGS; x++) {
+
+        len = long_key(key, order[x]);
+        if (bt_insertkey(bt, key, len, 0, order[x] + 1, 0)) errors++;
+        live[order[x]] = 1;
+
+    }
+
+    /* delete a third */
+
+    for (x = 0; x < LONGS; x += 3) {
+
+        len = long_key(key, x);
+        if (bt_deletekey(bt, key, len, 0)) errors++;
+        live[x] = 0;
+
+    }
+
+    for (x = 0; x < LONGS; x++) {
+
+        len = long_key(key, x);
+
+        if (bt_findkey(bt, key, len) != (live[x] ? x + 1 : 0)) errors++;
+
+        /* the same key a byte shorter or with the last byte changed */
+
+        if (len > 10 && bt_findkey(bt, key, len - 1) != 0) errors++;
+
+        key[len - 1] ^= 1;
+        if (bt_findkey(bt, key, len) != 0) errors++;
+
+        expected += live[x];
+
+    }
+
+    /* a key past 64KB comes back whole */
+
+    len = long_key(key, 499);
+
+    if (((slot = bt_startkey(bt, key, len)) == 0) || (bt_uid(bt, slot) != 500) ||
+        ((data = bt_keydata(bt, slot, &x2)) == NULL) ||
+        (x2 != len) || memcmp(data, key, len)) errors++;
+
+    /* a scan */
+
+    for (slot = bt_startkey(bt, (unsigned char *)"", 0); slot > 0;
+         slot = bt_nextkey(bt, slot)) {
+
+        if ((data = bt_keydata(bt, slot, &len)) == NULL) {
+
+            errors++;
+            break;
+
+        }
+
+        x = bt_uid(bt, slot) - 1;
+
+        if ((x < 0) || (x >= LONGS) || (count >= expected)) {
+
+            errors++;
+            continue;
+
+        }
+
+        /* the slot bt_startkey returns can be a deleted key */
+
+        if (! live[x]) continue;
+
+        if ((long_key(key, x) != len) || memcmp(key, data, len)) errors++;
+        if (count && key_compare(last, lastlen, data, len) >= 0) errors++;
+
+        memcpy(last, data, len);
+        lastlen = len;
+        sorted[count++] = x;
+
+    }
+
+    if (count != expected) errors++;
+
+    /* a cursor returns the same keys */
+
+    count = 0;
+    cursor = bt_cursoropen(bt, (unsigned char *)"", 0, NULL, 0);
+
+    while ((batch = bt_cursornext(cursor, pairs, 50)) > 0) {
+
+        for (x2 = 0; x2 < batch; x2++, count++) {
+
+            if ((count >= expected) || (pairs[x2].id != sorted[count] + 1)) {
+
+                errors++;
+                continue;
+
+            }
+
+            len = long_key(key, sorted[count]);
+
+            if ((pairs[x2].len != len) || memcmp(pairs[x2].key, key, len)) errors++;
+
+        }
+
+    }
+
+    bt_cursorclose(cursor);
+
+    if (count != expected) errors++;
+
+    /* and one that starts and stops at long keys */
+
+    count = 0;
+    len = long_key(key, sorted[10]);
+    x2 = long_key(last, sorted[expected - 10]);
+    cursor = bt_cursoropen(bt, key, len, last, x2);
+
+    while ((batch = bt_cursornext(cursor, pairs, 7)) > 0) {
+
+        for (x2 = 0; x2 < batch; x2++, count++) {
+
+            if (pairs[x2].id != sorted[count + 10] + 1) errors++;
+
+        }
+
+    }
+
+    bt_cursorclose(cursor);
+
+    if (count != expected - 19) errors++;
+
+    printf("%s long keys: %d keys, %d errors\n", what, expected, errors);
+
+    /* a long key takes a value */
+
+    len = long_key(key, 1499);
+    memset(value, 'v', sizeof(value));
+
+    if (bt_put(bt, key, len, value, sizeof(value))) errors++;
+    if (bt_get(bt, key, len, last, HUGE) != sizeof(value)) errors++;
+    if (memcmp(last, value, sizeof(value))) errors++;
+
+    /* replacing the longest key reuses its pages */
+
+    len = long_key(key, 2999);
+
+    for (x = 0; x < 50; x++) {
+
+        if (bt_deletekey(bt, key, len, 0)) errors++;
+        if (bt_insertkey(bt, key, len, 0, x + 1, 0)) errors++;
+        if (x == 1) size = file_size(filename);
+
+    }
+
+    if (file_size(filename) > size) errors++;
+    if (bt_findkey(bt, key, len) != 50) errors++;
+
+    /* the keys loaded in order into another file */
+
+    bt_close(bt);
+    remove_file(loadname);
+    bt = bt_open(loadname, mode, BITS, POOL);
+    load = bt_loadopen(bt, 100);
+
+    for (x = 0; x < expected; x++) {
+
+        len = long_key(key, sorted[x]);
+        if (bt_loadkey(load, key, len, sorted[x] + 1)) errors++;
+
+    }
+
+    if (bt_loadclose(load)) errors++;
+
+    for (x = 0; x < LONGS; x++) {
+
+        len = long_key(key, x);
+
+        if (bt_findkey(bt, key, len) != (live[x] ? x + 1 : 0)) errors++;
+
+    }
+
+    printf("%s long keys loaded: %d errors\n", what, errors);
+
+    bt_close(bt);
+    remove_file(loadname);
+    cleanup();
+
+    free(order);
+    free(sorted);
+    free(live);
+    free(key);
+    free(last);
+
+    return errors;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int round;
+    int errors = 0;
+    char key[16];
+    off_t size = 0;
+    BtDb *bt = NULL;
+    unsigned char *value = malloc(LARGE);
+    unsigned char *buffer = malloc(LARGE);
+    struct timespec start;
+
+    cleanup();
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    /* put, then replace everything twice with other sizes */
+
+    for (round = 0; round < 3; round++) {
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (x = 0; x < KEYS; x++) {
+
+            snprintf(key, sizeof(key), "key%08d", x);
+            value_fill(value, value_size(x, round), x, round);
+
+            if (bt_put(bt, (unsigned char *)key, 11, value, value_size(x, round))) errors++;
+
+        }
+
+        printf("put round %d: %.1f ms, ", round, elapsed(&start));
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (x = 0; x < KEYS; x++) {
+
+            errors += check(bt, x, round, value, buffer);
+
+        }
+
+        printf("get: %.1f ms, %d errors\n", elapsed(&start), errors);
+
+    }
+
+    /* a large value, and a short buffer gets a part of it */
+
+    value_fill(value, LARGE, 1, 1);
+    bt_put(bt, (unsigned char *)"large", 5, value, LARGE);
+
+    if (bt_get(bt, (unsigned char *)"large", 5, buffer, 100) != LARGE) errors++;
+    if (memcmp(value, buffer, 100)) errors++;
+    if (bt_get(bt, (unsigned char *)"large", 5, buffer, LARGE) != LARGE) errors++;
+    if (memcmp(value, buffer, LARGE)) errors++;
+    if (bt_get(bt, (unsigned char *)"missing", 7, buffer, LARGE) != -1) errors++;
+
+    /* replacing a large value reuses the pages */
+
+    for (x = 0; x < 50; x++) {
+
+        value_fill(value, LARGE, x, 2);
+        bt_put(bt, (unsigned char *)"large", 5, value, LARGE);
+        if (x == 1) size = file_size(filename);
+
+    }
+
+    if (file_size(filename) > size) errors++;
+
+    printf("large: %d errors, file %ld bytes\n", errors, (long)file_size(filename));
+
+    /* delete every other key, then reopen */
+
+    for (x = 0; x < KEYS; x += 2) {
+
+        snprintf(key, sizeof(key), "key%08d", x);
+        bt_deletekey(bt, (unsigned char *)key, 11, 0);
+
+    }
+
+    bt_close(bt);
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    for (x = 0; x < KEYS; x++) {
+
+        snprintf(key, sizeof(key), "key%08d", x);
+
+        if (x % 2) {
+
+            errors += check(bt, x, 2, value, buffer);
+
+        } else if (bt_get(bt, (unsigned char *)key, 11, buffer, LARGE) != -1) {
+
+            errors++;
+
+        }
+
+    }
+
+    /* the deleted values give their pages back */
+
+    size = file_size(filename);
+
+    for (x = 0; x < KEYS; x += 2) {
+
+        snprintf(key, sizeof(key), "key%08d", x);
+        value_fill(value, value_size(x, 2), x, 2);
+        bt_put(bt, (unsigned char *)key, 11, value, value_size(x, 2));
+
+    }
+
+    for (x = 0; x < KEYS; x++) {
+
+        errors += check(bt, x, 2, value, buffer);
+
+    }
+
+    printf("reopen: %d errors, file grew %ld bytes\n", errors,
+           (long)(file_size(filename) - size));
+
+    /* ids that would be read as values */
+
+    if (bt_insertkey(bt, (unsigned char *)"badid", 5, 0, BT_value | 10, 0) != BTERR_struct) errors++;
+    if (bt_insertkey(bt, (unsigned char *)"badid", 5, 0, BT_ovfl | 10, 0) != BTERR_struct) errors++;
+    if (bt_insertkey(bt, (unsigned char *)"badid", 5, 0, 1ULL << 48, 0) != BTERR_struct) errors++;
+    if (bt_findkey(bt, (unsigned char *)"badid", 5) != 0) errors++;
+    if (bt_insertkey(bt, (unsigned char *)"badid", 5, 0, BT_idmask, 0) != BTERR_ok) errors++;
+    if (bt_findkey(bt, (unsigned char *)"badid", 5) != BT_idmask) errors++;
+
+    printf("ids: %d errors\n", errors);
+
+    bt_close(bt);
+    cleanup();
+
+    errors += long_keys(BT_rw);
+    errors += long_keys(BT_pk);
+
+    /* a file of the format before long keys */
+
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+    bt_insertkey(bt, (unsigned char *)"short", 5, 0, 1, 0);
+    bt_close(bt);
+
+    set_version(1);
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    if (bt_insertkey(bt, (unsigned char *)buffer, 256, 0, 2, 0) != BTERR_struct) errors++;
+    if (bt_findkey(bt, (unsigned char *)"short", 5) != 1) errors++;
+
+    printf("old format: %d errors\n", errors);
+
+    bt_close(bt);
+    cleanup();
+
+    free(value);
+    free(buffer);
+
+    return passed(errors);
+
+}
+
@@ -0,0 +1,335 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "xas/types.h"
+#include "xas/rms/btree.h"
+#include "rms-test.h"
+
+/*
+ * packed pages. Keys that share a long prefix, like a customer id
+ * followed by a date, are inserted in random order and some are
+ * deleted and inserted again. Shorter keys that are a prefix of the
+ * others, and keys that sort before the shared prefix, are mixed in
+ * so pages lose their prefix. Every key must be found, the deleted
+ * ones must not, and a scan and a cursor must be in order. The keys
+ * the scan returned are bulk loaded into another file, where they
+ * must be found again. Then the random lookups are timed. This is done
+ * for a plain file and for one created with BT_pk, which must be the
+ * smaller. A reopened file keeps its choice, a file from before the
+ * format was kept can still be read and one from a later format is
+ * refused.
+ */
+
+#define KEYS    200000
+#define LOOKUPS 1000000
+#define BITS    12
+#define POOL    1024
+
+char *filename = "btree-test5.ix";
+char *loadname = "btree-test5b.ix";
+
+off_t file_size(char *name) {
+
+    struct stat buf;
+
+    if (stat(name, &buf) < 0) return 0;
+
+    return buf.st_size;
+
+}
+
+void cleanup(char *name) {
+
+    char path[256];
+
+    unlink(name);
+
+    snprintf(path, sizeof(path), "%s.log0", name);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s.log1", name);
+    unlink(path);
+
+}
+
+/* key x, one in each customer is cut short and every hundredth has another prefix */
+
+int make_key(char *key, int x) {
+
+    int len;
+
+    if ((x % 100) == 7) {
+
+        len = snprintf(key, 64, "account-%08d", x);
+
+    } else {
+
+        len = snprintf(key, 64, "customer-%08d-2024-%02d-%02d",
+                       x / 37, (x % 12) + 1, (x % 28) + 1);
+
+        if ((x % 37) == 3) len = 17;
+
+    }
+
+    return len;
+
+}
+
+int run(uint mode, off_t *size) {
+
+    int x;
+    int y;
+    int len;
+    int count = 0;
+    int expected = 0;
+    int errors = 0;
+    int *order = calloc(KEYS, sizeof(int));
+    char key[64];
+    char last[64];
+    char *live = calloc(KEYS, 1);
+    char (*sorted)[64] = calloc(KEYS, 64);
+    char *what = (mode == BT_pk) ? "packed" : "plain";
+    uint x2;
+    uint batch = 0;
+    uint slot = 0;
+    unsigned int seed = 1;
+    BtKey ptr;
+    BtDb *bt = NULL;
+    BtLoad *load = NULL;
+    BtCursor *cursor = NULL;
+    BtPair pairs[100];
+    struct timespec start;
+
+    cleanup(filename);
+    bt = bt_open(filename, mode, BITS, POOL);
+
+    if (bt->latchmgr->pack != (mode == BT_pk)) errors++;
+
+    for (x = 0; x < KEYS; x++) order[x] = x;
+
+    for (x = KEYS - 1; x > 0; x--) {
+
+        y = rand_r(&seed) % (x + 1);
+        len = order[x];
+        order[x] = order[y];
+        order[y] = len;
+
+    }
+
+    for (x = 0; x < KEYS; x++) {
+
+        len = make_key(key, order[x]);
+        bt_insertkey(bt, (unsigned char *)key, len, 0, order[x] + 1, 0);
+        live[order[x]] = 1;
+
+    }
+
+    /* delete a third, then put back half of those */
+
+    for (x = 0; x < KEYS; x += 3) {
+
+        if (!live[x]) continue;
+
+        len = make_key(key, x);
+        bt_deletekey(bt, (unsigned char *)key, len, 0);
+        live[x] = 0;
+
+    }
+
+    for (x = 0; x < KEYS; x += 6) {
+
+        len = make_key(key, x);
+        bt_insertkey(bt, (unsigned char *)key, len, 0, x + 1, 0);
+        live[x] = 1;
+
+    }
+
+    for (x = 0; x < KEYS; x++) {
+
+        len = make_key(key, x);
+
+        if (bt_findkey(bt, (unsigned char *)key, len) != (live[x] ? x + 1 : 0)) errors++;
+
+    }
+
+    /* keys that are not there, between and past the others */
+
+    if (bt_findkey(bt, (unsigned char *)"customer-", 9) != 0) errors++;
+    if (bt_findkey(bt, (unsigned char *)"customer-00000001-", 18) != 0) errors++;
+    if (bt_findkey(bt, (unsigned char *)"zzz", 3) != 0) errors++;
+
+    for (x = 0; x < KEYS; x++) expected += live[x];
+
+    last[0] = '\0';
+
+    for (slot = bt_startkey(bt, (unsigned char *)"", 0); slot > 0;
+         slot = bt_nextkey(bt, slot)) {
+
+        ptr = bt_key(bt, slot);
+        memcpy(key, ptr->key, ptr->len);
+        key[ptr->len] = '\0';
+
+        if (last[0] && (strcmp(key, last) <= 0)) errors++;
+        if (count < KEYS) strcpy(sorted[count], key);
+
+        strcpy(last, key);
+        count++;
+
+    }
+
+    if (count != expected) errors++;
+
+    *size = file_size(filename);
+    printf("%s scan: %d keys, %d errors, file %ld bytes\n",
+           what, count, errors, (long)*size);
+
+    /* a cursor returns the same keys */
+
+    count = 0;
+    cursor = bt_cursoropen(bt, (unsigned char *)"", 0, NULL, 0);
+
+    while ((batch = bt_cursornext(cursor, pairs, 100)) > 0) {
+
+        for (x2 = 0; x2 < batch; x2++, count++) {
+
+            if ((count >= expected) ||
+                (pairs[x2].len != strlen(sorted[count])) ||
+                (memcmp(pairs[x2].key, sorted[count], pairs[x2].len) != 0)) errors++;
+
+        }
+
+    }
+
+    bt_cursorclose(cursor);
+
+    if (count != expected) errors++;
+
+    /* the keys loaded in order into another file */
+
+    cleanup(loadname);
+    bt_close(bt);
+    bt = bt_open(loadname, mode, BITS, POOL);
+    load = bt_loadopen(bt, 100);
+
+    for (x = 0; x < expected; x++) {
+
+        if (bt_loadkey(load, (unsigned char *)sorted[x], strlen(sorted[x]), x + 1)) errors++;
+
+    }
+
+    if (bt_loadclose(load)) errors++;
+
+    for (x = 0; x < expected; x++) {
+
+        if (bt_findkey(bt, (unsigned char *)sorted[x], strlen(sorted[x])) != x + 1) errors++;
+
+    }
+
+    if (bt_findkey(bt, (unsigned char *)"customer-", 9) != 0) errors++;
+
+    printf("%s load: %d keys, %d errors, file %ld bytes\n",
+           what, expected, errors, (long)file_size(loadname));
+
+    bt_close(bt);
+    cleanup(loadname);
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    /* random lookups */
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (x = 0; x < LOOKUPS; x++) {
+
+        y = rand_r(&seed) % KEYS;
+        len = make_key(key, y);
+        bt_findkey(bt, (unsigned char *)key, len);
+
+    }
+
+    printf("%s lookups: %d, %.1f ms\n", what, LOOKUPS, elapsed(&start));
+
+    bt_close(bt);
+
+    /* the file keeps the choice it was made with */
+
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    if (bt->latchmgr->pack != (mode == BT_pk)) errors++;
+
+    len = make_key(key, 1);
+    if (bt_findkey(bt, (unsigned char *)key, len) != (live[1] ? 2 : 0)) errors++;
+
+    bt_close(bt);
+    cleanup(filename);
+
+    free(order);
+    free(live);
+    free(sorted);
+
+    return errors;
+
+}
+
+/* set the format version kept in the file */
+
+void set_version(uint version) {
+
+    int fd;
+
+    fd = open(filename, O_RDWR);
+    pwrite(fd, &version, sizeof(version), offsetof(BtLatchMgr, version));
+    close(fd);
+
+}
+
+int main(int argc, char **argv) {
+
+    int errors = 0;
+    off_t plain = 0;
+    off_t packed = 0;
+    BtDb *bt = NULL;
+
+    errors += run(BT_rw, &plain);
+    errors += run(BT_pk, &packed);
+
+    if (packed >= plain) errors++;
+
+    /* a file from before the version was kept */
+
+    cleanup(filename);
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+    bt_insertkey(bt, (unsigned char *)"customer-1", 10, 0, 1, 0);
+    bt_close(bt);
+
+    set_version(0);
+
+    if ((bt = bt_open(filename, BT_rw, BITS, POOL)) == NULL) return passed(errors + 1);
+
+    if (bt_findkey(bt, (unsigned char *)"customer-1", 10) != 1) errors++;
+
+    bt_close(bt);
+
+    /* and one from a later format */
+
+    set_version(BT_version + 1);
+
+    if ((bt = bt_open(filename, BT_rw, BITS, POOL)) != NULL) {
+
+        bt_close(bt);
+        errors++;
+
+    }
+
+    cleanup(filename);
+
+    return passed(errors);
+
+}
+
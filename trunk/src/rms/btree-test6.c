@@ -0,0 +1,217 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "xas/types.h"
+#include "xas/rms/btree.h"
+#include "rms-test.h"
+
+/*
+ * buffer pool statistics and sizing. Lookups over a btree bigger than
+ * the pool are counted, the pool is shrunk and grown by hand while
+ * threads insert and look up keys, and then left to size itself for a
+ * small and a large working set. Every key must still be found after
+ * the btree is reopened.
+ */
+
+#define KEYS    100000
+#define BITS    12
+#define POOL    2048
+#define THREADS 4
+#define OPS     50000
+
+typedef struct _worker_s {
+    int id;
+    int errors;
+} worker_t;
+
+char *filename = "btree-test6.ix";
+volatile int running = 1;
+
+void cleanup(void) {
+
+    char path[256];
+
+    unlink(filename);
+
+    snprintf(path, sizeof(path), "%s.log0", filename);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s.log1", filename);
+    unlink(path);
+
+}
+
+void *worker(void *data) {
+
+    int x;
+    int k;
+    char key[16];
+    worker_t *self = data;
+    unsigned int seed = self->id;
+    BtDb *bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    for (x = 0; x < OPS; x++) {
+
+        k = rand_r(&seed) % KEYS;
+        snprintf(key, sizeof(key), "%08d", k);
+
+        if ((x % 4) == 0) {
+
+            bt_insertkey(bt, (unsigned char *)key, 8, 0, k + 1, 0);
+
+        } else if (bt_findkey(bt, (unsigned char *)key, 8) != k + 1) {
+
+            self->errors++;
+
+        }
+
+    }
+
+    bt_close(bt);
+
+    return NULL;
+
+}
+
+void *resizer(void *data) {
+
+    int x = 0;
+    uint sizes[] = { 64, 1024, 16, 2048, 300 };
+    BtDb *bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    while (running) {
+
+        bt_poolresize(bt, sizes[x++ % 5]);
+        usleep(2000);
+
+    }
+
+    bt_poolresize(bt, POOL);
+    bt_close(bt);
+
+    return NULL;
+
+}
+
+uint lookups(BtDb *bt, int range, int count, unsigned int *seed) {
+
+    int x;
+    int k;
+    uint errors = 0;
+    char key[16];
+
+    for (x = 0; x < count; x++) {
+
+        k = rand_r(seed) % range;
+        snprintf(key, sizeof(key), "%08d", k);
+
+        if (bt_findkey(bt, (unsigned char *)key, 8) != k + 1) errors++;
+
+    }
+
+    return errors;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int errors = 0;
+    uint census = 0;
+    char key[16];
+    unsigned int seed = 1;
+    BtDb *bt = NULL;
+    BtPoolStat stat;
+    pthread_t tids[THREADS + 1];
+    worker_t workers[THREADS];
+
+    cleanup();
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    for (x = 0; x < KEYS; x++) {
+
+        snprintf(key, sizeof(key), "%08d", x);
+        bt_insertkey(bt, (unsigned char *)key, 8, 0, x + 1, 0);
+
+    }
+
+    /* the counters add up */
+
+    bt_poolresize(bt, 256);
+    memset(&bt->stats, 0, sizeof(bt->stats));
+    errors += lookups(bt, KEYS, 100000, &seed);
+    bt_poolstats(bt, &stat);
+
+    for (x = 0; x < MAX_lvl; x++) census += stat.census[x];
+
+    if (stat.pins != stat.hits + stat.misses) errors++;
+    if (stat.deployed >= stat.limit) errors++;
+    if (census != stat.deployed) errors++;
+
+    printf("256 entries:\n");
+    bt_pooldump(bt, stdout);
+
+    /* resized while in use */
+
+    for (x = 0; x < THREADS; x++) {
+
+        workers[x].id = x + 1;
+        workers[x].errors = 0;
+        pthread_create(&tids[x], NULL, worker, &workers[x]);
+
+    }
+
+    pthread_create(&tids[THREADS], NULL, resizer, NULL);
+
+    for (x = 0; x < THREADS; x++) {
+
+        pthread_join(tids[x], NULL);
+        errors += workers[x].errors;
+
+    }
+
+    running = 0;
+    pthread_join(tids[THREADS], NULL);
+
+    printf("resized while in use: %d errors\n", errors);
+
+    /* sized by the miss rate, first for a few keys, then all of them */
+
+    bt_poolresize(bt, POOL);
+    bt_pooladapt(bt, 20, 1);
+
+    errors += lookups(bt, 1000, 400000, &seed);
+    bt_poolstats(bt, &stat);
+    printf("adapted to 1000 keys: %u entries, %u deployed\n", stat.limit, stat.deployed);
+
+    errors += lookups(bt, KEYS, 400000, &seed);
+    bt_poolstats(bt, &stat);
+    printf("adapted to %d keys: %u entries, %u deployed\n", KEYS, stat.limit, stat.deployed);
+
+    bt_pooladapt(bt, 0, 0);
+    bt_close(bt);
+
+    /* everything that was written back is there */
+
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+    errors += lookups(bt, KEYS, KEYS, &seed);
+
+    for (x = 0; x < KEYS; x++) {
+
+        snprintf(key, sizeof(key), "%08d", x);
+        if (bt_findkey(bt, (unsigned char *)key, 8) != x + 1) errors++;
+
+    }
+
+    bt_close(bt);
+    cleanup();
+
+    return passed(errors);
+
+}
+
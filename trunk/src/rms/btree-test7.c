@@ -0,0 +1,427 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "xas/types.h"
+#include "xas/rms/btree.h"
+#include "rms-test.h"
+
+/*
+ * postings lists. Records are indexed on two fields that many records
+ * share, a status and a region, by adding their record numbers to the
+ * lists of the field values in random order. The lists must come back
+ * sorted and complete after a third of the records are deleted, their
+ * intersection must match the records with both values, and a list
+ * that is emptied must give its pages back. Threads adding to the same
+ * list at once must not lose a record number. Lists in overflow pages
+ * are emptied on leaves filled to the last byte, so the leaf has to
+ * split before the key can give up its overflow pages.
+ */
+
+#define RECORDS 100000
+#define STATUS  5
+#define REGIONS 13
+#define BITS    12
+#define POOL    1024
+#define THREADS 4
+#define BATCH   100
+#define FULL    50
+#define LONG    1000
+
+char *filename = "btree-test7.ix";
+
+off_t file_size(char *name) {
+
+    struct stat buf;
+
+    if (stat(name, &buf) < 0) return 0;
+
+    return buf.st_size;
+
+}
+
+void cleanup(void) {
+
+    char path[256];
+
+    unlink(filename);
+
+    snprintf(path, sizeof(path), "%s.log0", filename);
+    unlink(path);
+
+    snprintf(path, sizeof(path), "%s.log1", filename);
+    unlink(path);
+
+}
+
+int status_of(int r) { return r % STATUS; }
+int region_of(int r) { return (r * 7 / 3) % REGIONS; }
+
+int status_key(char *key, int s) { return snprintf(key, 32, "status=%d", s); }
+int region_key(char *key, int g) { return snprintf(key, 32, "region=%02d", g); }
+
+/* the list of a key must be the live records with the value */
+
+int check(BtDb *bt, char *key, int len, char *live, int (*field)(int), int value) {
+
+    int r;
+    int errors = 0;
+    uid id;
+    uid last = 0;
+    BtPostings *post = bt_postopen(bt, (unsigned char *)key, len);
+
+    for (r = 1; r <= RECORDS; r++) {
+
+        if (!live[r] || (field(r) != value)) continue;
+
+        id = bt_postnext(post);
+
+        if ((id != r) || (id <= last)) {
+
+            errors++;
+            break;
+
+        }
+
+        last = id;
+
+    }
+
+    if (bt_postnext(post) != 0) errors++;
+
+    bt_postclose(post);
+
+    return errors;
+
+}
+
+/* room left in the leaf that has the key */
+
+int leaf_room(BtDb *bt, char *key, int len) {
+
+    BtPage page;
+
+    bt_findkey(bt, (unsigned char *)key, len);
+    page = bt->page;
+
+    return (int)page->min - (int)(sizeof(struct BtPage_) + (page->cnt + 1) * sizeof(BtSlot));
+
+}
+
+/* fill the leaf with keys after the key, the first one is too */
+/* big for the room, which cleans out what the list left behind */
+
+void fill_leaf(BtDb *bt, char *key, int len) {
+
+    int x;
+    int room;
+    int flen;
+    char filler[256];
+
+    for (x = 0; x < 100; x++) {
+
+        room = leaf_room(bt, key, len);
+
+        if ((x > 0) && (room <= len)) break;
+
+        flen = (x == 0) ? room + 20 : room - 1 - len;
+        if (flen > 200) flen = 200;
+        if (flen < len + 5) flen = len + 5;
+
+        memset(filler, 'f', flen);
+        snprintf(filler, sizeof(filler), "%s-%03d", key, x);
+        filler[len + 4] = 'f';
+
+        bt_insertkey(bt, (unsigned char *)filler, flen, 0, x + 1, 0);
+
+    }
+
+}
+
+typedef struct _worker_s {
+    int id;
+} worker_t;
+
+void *worker(void *data) {
+
+    int r;
+    worker_t *self = data;
+    BtDb *bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    for (r = self->id; r <= RECORDS; r += THREADS) {
+
+        bt_postadd(bt, (unsigned char *)"shared", 6, r);
+
+    }
+
+    bt_close(bt);
+
+    return NULL;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int y;
+    int r;
+    int len;
+    int count;
+    int errors = 0;
+    int *order = calloc(RECORDS + 1, sizeof(int));
+    char *live = calloc(RECORDS + 1, 1);
+    char key[32];
+    char key2[32];
+    uint cnt;
+    uid last;
+    uid ids[BATCH];
+    off_t size;
+    unsigned int seed = 1;
+    BtDb *bt = NULL;
+    BtPostings *post1 = NULL;
+    BtPostings *post2 = NULL;
+    pthread_t tids[THREADS];
+    worker_t workers[THREADS];
+    struct timespec start;
+
+    cleanup();
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    for (x = 1; x <= RECORDS; x++) order[x] = x;
+
+    for (x = RECORDS; x > 1; x--) {
+
+        y = (rand_r(&seed) % x) + 1;
+        r = order[x];
+        order[x] = order[y];
+        order[y] = r;
+
+    }
+
+    /* index the records in random order, some twice */
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (x = 1; x <= RECORDS; x++) {
+
+        r = order[x];
+
+        len = status_key(key, status_of(r));
+        if (bt_postadd(bt, (unsigned char *)key, len, r)) errors++;
+
+        len = region_key(key, region_of(r));
+        if (bt_postadd(bt, (unsigned char *)key, len, r)) errors++;
+
+        if ((x % 10) == 0) bt_postadd(bt, (unsigned char *)key, len, r);
+
+        live[r] = 1;
+
+    }
+
+    printf("add: %d records, %.1f ms, file %ld bytes\n",
+           RECORDS, elapsed(&start), (long)file_size(filename));
+
+    /* delete a third of them */
+
+    for (r = 3; r <= RECORDS; r += 3) {
+
+        len = status_key(key, status_of(r));
+        if (bt_postdel(bt, (unsigned char *)key, len, r)) errors++;
+
+        len = region_key(key, region_of(r));
+        if (bt_postdel(bt, (unsigned char *)key, len, r)) errors++;
+
+        live[r] = 0;
+
+    }
+
+    /* deleting what isn't there changes nothing */
+
+    len = status_key(key, 1);
+    bt_postdel(bt, (unsigned char *)key, len, 3);
+    bt_postdel(bt, (unsigned char *)"missing", 7, 1);
+
+    for (x = 0; x < STATUS; x++) {
+
+        len = status_key(key, x);
+        errors += check(bt, key, len, live, status_of, x);
+
+    }
+
+    for (x = 0; x < REGIONS; x++) {
+
+        len = region_key(key, x);
+        errors += check(bt, key, len, live, region_of, x);
+
+    }
+
+    printf("lists: %d errors\n", errors);
+
+    /* status 2 and region 5, in batches */
+
+    count = 0;
+    last = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    len = status_key(key, 2);
+    post1 = bt_postopen(bt, (unsigned char *)key, len);
+    len = region_key(key2, 5);
+    post2 = bt_postopen(bt, (unsigned char *)key2, len);
+
+    while ((cnt = bt_postand(post1, post2, ids, BATCH)) > 0) {
+
+        for (x = 0; x < cnt; x++) {
+
+            r = ids[x];
+
+            if ((r <= last) || !live[r] || (status_of(r) != 2) || (region_of(r) != 5)) errors++;
+
+            last = r;
+            count++;
+
+        }
+
+    }
+
+    bt_postclose(post1);
+    bt_postclose(post2);
+
+    for (r = 1; r <= RECORDS; r++) {
+
+        if (live[r] && (status_of(r) == 2) && (region_of(r) == 5)) count--;
+
+    }
+
+    if (count != 0) errors++;
+
+    printf("intersection: %.1f ms, %d errors\n", elapsed(&start), errors);
+
+    /* empty a list, its pages are used again */
+
+    len = status_key(key, 4);
+
+    for (r = 1; r <= RECORDS; r++) {
+
+        if (live[r] && (status_of(r) == 4)) bt_postdel(bt, (unsigned char *)key, len, r);
+
+    }
+
+    post1 = bt_postopen(bt, (unsigned char *)key, len);
+    if (bt_postnext(post1) != 0) errors++;
+    bt_postclose(post1);
+
+    size = file_size(filename);
+
+    for (r = 1; r <= RECORDS; r++) {
+
+        if (live[r] && (status_of(r) == 4)) bt_postadd(bt, (unsigned char *)key, len, r);
+
+    }
+
+    errors += check(bt, key, len, live, status_of, 4);
+
+    if (file_size(filename) > size) errors++;
+
+    printf("emptied: %d errors\n", errors);
+
+    /* threads adding to one list */
+
+    for (x = 0; x < THREADS; x++) {
+
+        workers[x].id = x + 1;
+        pthread_create(&tids[x], NULL, worker, &workers[x]);
+
+    }
+
+    for (x = 0; x < THREADS; x++) {
+
+        pthread_join(tids[x], NULL);
+
+    }
+
+    count = 0;
+    last = 0;
+    post1 = bt_postopen(bt, (unsigned char *)"shared", 6);
+
+    while ((ids[0] = bt_postnext(post1)) != 0) {
+
+        if (ids[0] != last + 1) errors++;
+
+        last = ids[0];
+        count++;
+
+    }
+
+    bt_postclose(post1);
+
+    if (count != RECORDS) errors++;
+
+    printf("threads: %d records, %d errors\n", count, errors);
+
+    /* lists emptied on full leaves */
+
+    for (x = 0; x < FULL; x++) {
+
+        len = snprintf(key, 32, "full=%03d", x);
+
+        for (r = 1; r <= LONG; r++) {
+
+            bt_postadd(bt, (unsigned char *)key, len, r);
+
+        }
+
+    }
+
+    for (x = 0; x < FULL; x++) {
+
+        len = snprintf(key, 32, "full=%03d", x);
+        fill_leaf(bt, key, len);
+
+        for (r = 1; r <= LONG; r++) {
+
+            if (bt_postdel(bt, (unsigned char *)key, len, r)) errors++;
+
+        }
+
+        post1 = bt_postopen(bt, (unsigned char *)key, len);
+        if (bt_postnext(post1) != 0) errors++;
+        bt_postclose(post1);
+
+    }
+
+    printf("full leaves: %d errors\n", errors);
+
+    /* and all of it after reopening */
+
+    bt_close(bt);
+    bt = bt_open(filename, BT_rw, BITS, POOL);
+
+    for (x = 0; x < STATUS; x++) {
+
+        len = status_key(key, x);
+        errors += check(bt, key, len, live, status_of, x);
+
+    }
+
+    for (x = 0; x < REGIONS; x++) {
+
+        len = region_key(key, x);
+        errors += check(bt, key, len, live, region_of, x);
+
+    }
+
+    bt_close(bt);
+    cleanup();
+
+    free(order);
+    free(live);
+
+    return passed(errors);
+
+}
+
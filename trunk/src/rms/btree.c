@@ -38,7 +38,15 @@ REDISTRIBUTION OF THIS SOFTWARE.
 #include <sys/mman.h>
 #include <errno.h>
 #include <sched.h>
-#else
+#endif
+
+#ifdef linux
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#ifndef unix
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <stdio.h>
@@ -51,12 +59,46 @@ REDISTRIBUTION OF THIS SOFTWARE.
 #include <memory.h>
 #include <string.h>
 
+#ifdef unix
+#include <sys/uio.h>
+
+//	use open file description locks when available, so
+//	handles in one process exclude each other as well
+
+#ifdef F_OFD_SETLK
+# define BT_setlk   F_OFD_SETLK
+# define BT_setlkw  F_OFD_SETLKW
+#else
+# define BT_setlk   F_SETLK
+# define BT_setlkw  F_SETLKW
+#endif
+#endif
+
 #include "xas/rms/btree.h"
 
 //	internal functions
 
 void bt_update (BtDb *bt, BtPage page);
 BtPage bt_mappage (BtDb *bt, BtLatchSet *latch);
+void bt_spinreleaseread(BtSpinLatch *latch);
+BTERR bt_logpage (BtDb *bt, BtPage page, uid page_no);
+BTERR bt_logsync (BtDb *bt, uid lsn);
+BTERR bt_logfiles (BtDb *bt);
+BTERR bt_logopen (BtDb *bt);
+void bt_logcheck (BtDb *bt);
+BTERR bt_freechain (BtDb *bt, uid page_no);
+uid bt_writechain (BtDb *bt, unsigned char *value, uint vlen);
+BTERR bt_readchain (BtDb *bt, uid page_no, unsigned char *value, uint max);
+uint bt_ovfllen (BtOvfl *ovfl);
+void bt_putovfllen (BtOvfl *ovfl, uint len);
+void bt_pooladjust (BtDb *bt);
+BTERR bt_insertval (BtDb *bt, unsigned char *key, uint len, uint lvl, uid id, uint tod, unsigned char *val, uint vlen, BtPost *post);
+BTERR bt_postmerge (BtDb *bt, BtPage page, uint slot, uint found, uint len, BtPost *post);
+BtLatchSet *bt_pinlatch (BtDb *bt, uid page_no);
+void bt_unpinlatch (BtLatchSet *latch);
+void bt_lockpage(BtLock mode, BtLatchSet *latch);
+void bt_unlockpage(BtLock mode, BtLatchSet *latch);
+uint bt_getkey (BtPage page, uint slot, unsigned char *buf);
 
 //  Helper functions to return slot values
 
@@ -117,6 +159,28 @@ extern uint bt_tod (BtDb *bt, uint slot);
 
 #define slotptr(page, slot) (((BtSlot *)(page+1)) + (slot-1))
 #define keyptr(page, slot) ((BtKey)((unsigned char*)(page) + slotptr(page, slot)->off))
+#define valptr(page, slot) ((unsigned char *)keyptr(page, slot) + keysize(page, keyptr(page, slot)))
+
+//	a long key, and the BtOvfl after its head, see BtKey
+
+#define longkey(page, ptr) ((page)->longkeys && (ptr)->len == BT_keylong)
+#define keyovfl(ptr) ((BtOvfl *)((ptr)->key + BT_keyhead))
+#define keysize(page, ptr) (longkey(page, ptr) ? 1 + BT_keyhead + sizeof(BtOvfl) : (ptr)->len + 1)
+
+//	the bytes a new key takes in a page with a prefix of pfx
+
+#define newsize(page, len, pfx) ((page)->longkeys && (len) > BT_keymax ? 1 + BT_keyhead + sizeof(BtOvfl) : (len) - (pfx) + 1)
+
+//	the longest key a file takes, an old one has no long keys,
+//	and the most bytes a key takes in a page of the file
+
+#define keylimit(bt) ((bt)->latchmgr->version > 1 ? ~0U : 255)
+#define keyroom(bt, len) ((len) > BT_keymax && (bt)->latchmgr->version > 1 ? 1 + BT_keyhead + sizeof(BtOvfl) : (len) + 1)
+
+//	the prefix of a packed page, see BtPage
+
+#define pfxlen(page) ((page)->pack ? ((unsigned char *)(page))[(1 << (page)->bits) - 1] : 0)
+#define pfxptr(page) ((unsigned char *)(page) + (1 << (page)->bits) - 1 - pfxlen(page))
 
 void bt_putid(unsigned char *dest, uid id)
 {
@@ -139,21 +203,123 @@ int i;
 
 BTERR bt_abort (BtDb *bt, BtPage page, uid page_no, BTERR err)
 {
-BtKey ptr;
+unsigned char fence[256];
 
 	fprintf(stderr, "\n Btree2 abort, error %d on page %.8x\n", err, (unsigned int)page_no);
 	fprintf(stderr, "level=%d kill=%d free=%d cnt=%x act=%x\n", page->lvl, page->kill, page->free, page->cnt, page->act);
-	ptr = keyptr(page, page->cnt);
-	fprintf(stderr, "fence='%.*s'\n", ptr->len, ptr->key);
+	bt_getkey (page, page->cnt, fence);
+	fprintf(stderr, "fence='%.*s'\n", *fence, fence + 1);
 	fprintf(stderr, "right=%.8x\n", (unsigned int)bt_getid(page->right));
 	return bt->err = err;
 }
 
+//	Latch waiting. A waiter spins for BT_spin rounds, then
+//	yields for BT_yield rounds, then sets the park flag and
+//	sleeps on the futex word while it still holds the value
+//	that blocked it. The release side wakes the waiters when
+//	it sees the park flag. Spinning is skipped on a single
+//	processor, as the holder can't run while we spin. Set
+//	bt_parking to zero to keep yielding instead of parking.
+
+int bt_parking = 1;
+
+//	latch waits in this process, for the pool statistics
+
+static uid bt_latchwaits;
+static uid bt_latchparks;
+static uid bt_latchwaitns;
+
+void bt_relax (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause ();
+#endif
+}
+
+//	monotonic clock in nanoseconds, to time the waits
+//	that give up the processor
+
+uid bt_clock (void)
+{
+#ifdef unix
+struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uid)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+void bt_latchwait (volatile uint *word, uint value, volatile ushort *flag, ushort bit, uint spin)
+{
+static int spins = -1;
+uid start;
+
+#ifdef unix
+	if( spins < 0 )
+		spins = sysconf (_SC_NPROCESSORS_ONLN) > 1 ? BT_spin : 0;
+#else
+	spins = BT_spin;
+#endif
+	if( !spin )
+		__sync_fetch_and_add (&bt_latchwaits, 1);
+
+	if( spin < spins ) {
+		bt_relax ();
+		return;
+	}
+#ifdef linux
+	if( bt_parking && spin >= spins + BT_yield ) {
+		if( spin == spins + BT_yield )
+			__sync_fetch_and_add (&bt_latchparks, 1);
+		__sync_fetch_and_or (flag, bit);
+		start = bt_clock ();
+		syscall (SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+		__sync_fetch_and_add (&bt_latchwaitns, bt_clock () - start);
+		return;
+	}
+#endif
+#ifdef unix
+	start = bt_clock ();
+	sched_yield ();
+	__sync_fetch_and_add (&bt_latchwaitns, bt_clock () - start);
+#else
+	SwitchToThread ();
+#endif
+}
+
+void bt_latchwake (volatile uint *word, volatile ushort *flag, ushort bit)
+{
+#ifdef linux
+	if( *flag & bit ) {
+		__sync_fetch_and_and (flag, ~bit);
+		syscall (SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	}
+#endif
+}
+
+//	wake everyone parked on a reader/writer lock, the
+//	park flag covers both words so both are woken
+
+void bt_rwwake (RWLock *lock)
+{
+#ifdef linux
+	if( *lock->rout & PARK ) {
+		__sync_fetch_and_and (lock->rout, ~PARK);
+		syscall (SYS_futex, lock->readers, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+		syscall (SYS_futex, lock->writers, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	}
+#endif
+}
+
 //	Phase-Fair reader/writer lock implementation
 
 void WriteLock (RWLock *lock)
 {
+RWLock snap[1];
 ushort w, r, tix;
+uint spin;
 
 #ifdef unix
 	tix = __sync_fetch_and_add (lock->ticket, 1);
@@ -162,12 +328,12 @@ ushort w, r, tix;
 #endif
 	// wait for our ticket to come up
 
-	while( tix != lock->serving[0] )
-#ifdef unix
-		sched_yield();
-#else
-		SwitchToThread ();
-#endif
+	for( spin = 0; ; spin++ ) {
+		*snap->writers = *lock->writers;
+		if( tix == *snap->serving )
+			break;
+		bt_latchwait (lock->writers, *snap->writers, lock->rout, PARK, spin);
+	}
 
 	w = PRES | (tix & PHID);
 #ifdef  unix
@@ -175,45 +341,53 @@ ushort w, r, tix;
 #else
 	r = _InterlockedExchangeAdd16 (lock->rin, w);
 #endif
-	while( r != *lock->rout )
-#ifdef unix
-		sched_yield();
-#else
-		SwitchToThread();
-#endif
+	// wait for the readers to drain
+
+	for( spin = 0; ; spin++ ) {
+		*snap->readers = *lock->readers;
+		if( r == (*snap->rout & ~PARK) )
+			break;
+		bt_latchwait (lock->readers, *snap->readers, lock->rout, PARK, spin);
+	}
 }
 
 void WriteRelease (RWLock *lock)
 {
 #ifdef unix
 	__sync_fetch_and_and (lock->rin, ~MASK);
+	__sync_fetch_and_add (lock->serving, 1);
 #else
 	_InterlockedAnd16 (lock->rin, ~MASK);
-#endif
 	lock->serving[0]++;
+#endif
+	bt_rwwake (lock);
 }
 
 void ReadLock (RWLock *lock)
 {
+RWLock snap[1];
 ushort w;
+uint spin;
+
 #ifdef unix
 	w = __sync_fetch_and_add (lock->rin, RINC) & MASK;
 #else
 	w = _InterlockedExchangeAdd16 (lock->rin, RINC) & MASK;
 #endif
 	if( w )
-	  while( w == (*lock->rin & MASK) )
-#ifdef unix
-		sched_yield ();
-#else
-		SwitchToThread ();
-#endif
+	  for( spin = 0; ; spin++ ) {
+		*snap->readers = *lock->readers;
+		if( w != (*snap->rin & MASK) )
+			break;
+		bt_latchwait (lock->readers, *snap->readers, lock->rout, PARK, spin);
+	  }
 }
 
 void ReadRelease (RWLock *lock)
 {
 #ifdef unix
-	__sync_fetch_and_add (lock->rout, RINC);
+	if( __sync_fetch_and_add (lock->rout, RINC) & PARK )
+		bt_rwwake (lock);
 #else
 	_InterlockedExchangeAdd16 (lock->rout, RINC);
 #endif
@@ -226,9 +400,11 @@ void ReadRelease (RWLock *lock)
 
 void bt_spinreadlock(BtSpinLatch *latch)
 {
+BtSpinLatch snap[1];
 ushort prev;
+uint spin;
 
-  do {
+  for( spin = 0; ; spin++ ) {
 #ifdef unix
 	prev = __sync_fetch_and_add (latch->lock, SHARE);
 #else
@@ -238,25 +414,26 @@ ushort prev;
 
 	if( !(prev & BOTH) )
 		return;
-#ifdef unix
-	prev = __sync_fetch_and_add (latch->lock, -SHARE);
-#else
-	prev = _InterlockedExchangeAdd16(latch->lock, -SHARE);
-#endif
-#ifdef  unix
-  } while( sched_yield(), 1 );
-#else
-  } while( SwitchToThread(), 1 );
-#endif
+
+	//	back out, a pending writer may be waiting on us
+
+	bt_spinreleaseread (latch);
+
+	*snap->word = *latch->word;
+	if( *snap->lock & BOTH )
+		bt_latchwait (latch->word, *snap->word, latch->park, 1, spin);
+  }
 }
 
 //	wait for other read and write latches to relinquish
 
 void bt_spinwritelock(BtSpinLatch *latch)
 {
+BtSpinLatch snap[1];
 ushort prev;
+uint spin;
 
-  do {
+  for( spin = 0; ; spin++ ) {
 #ifdef  unix
 	prev = __sync_fetch_and_or(latch->lock, PEND | XCL);
 #else
@@ -273,11 +450,13 @@ ushort prev;
 #endif
       }
     }
-#ifdef  unix
-  } while(( sched_yield(), 1 ));
-#else
-  } while( SwitchToThread(), 1 );
-#endif
+
+	//	wait while another writer or any reader holds it
+
+	*snap->word = *latch->word;
+	if( (*snap->lock & XCL) || (*snap->lock & ~BOTH) )
+		bt_latchwait (latch->word, *snap->word, latch->park, 1, spin);
+  }
 }
 
 //	try to obtain write lock
@@ -319,6 +498,7 @@ void bt_spinreleasewrite(BtSpinLatch *latch)
 #else
 	_InterlockedAnd16(latch->lock, ~BOTH);
 #endif
+	bt_latchwake (latch->word, latch->park, 1);
 }
 
 //	decrement reader count
@@ -330,6 +510,7 @@ void bt_spinreleaseread(BtSpinLatch *latch)
 #else
 	_InterlockedExchangeAdd16(latch->lock, -SHARE);
 #endif
+	bt_latchwake (latch->word, latch->park, 1);
 }
 
 //	read page from permanent location in Btree file
@@ -393,1444 +574,4029 @@ uint amt[1];
 	return 0;
 }
 
-//	link latch table entry into head of latch hash table
+//	Redo log. Appends are serialized by the log latch,
+//	each record goes at the end of the current log file.
+//	Durability is asked for with bt_commit, and the first
+//	handle to get the sync latch does one fdatasync for
+//	everything appended so far, so waiting commits share
+//	it. A dirty page is only written back once the log
+//	is durable up to the end, so the log always covers it.
 
-BTERR bt_latchlink (BtDb *bt, uint hashidx, uint slot, uid page_no)
+//	checksum a run of bytes a word at a time
+
+uint bt_logsum (uint sum, unsigned char *data, uint len)
 {
-BtPage page = (BtPage)((uid)slot * bt->page_size + bt->pagepool);
-BtLatchSet *latch = bt->latchsets + slot;
-int lvl;
+unsigned long long hash = sum, word;
 
-	if(( latch->next = bt->table[hashidx].slot )) {
-		bt->latchsets[latch->next].prev = slot;
-    }
+	while( len >= sizeof(word) ) {
+		memcpy (&word, data, sizeof(word));
+		hash = (hash ^ word) * 0x100000001b3ULL;
+		data += sizeof(word);
+		len -= sizeof(word);
+	}
 
-	bt->table[hashidx].slot = slot;
-	latch->page_no = page_no;
-	latch->prev = 0;
-	latch->pin = 1;
+	while( len-- )
+		hash = (hash ^ *data++) * 0x100000001b3ULL;
 
-	if(( bt_readpage (bt, page, page_no) )) {
-		return bt->err;
-    }
+	return (uint)(hash ^ (hash >> 32));
+}
 
-	lvl = page->lvl << LVL_shift;
-	if(( lvl > LVL_mask )) {
-		lvl = LVL_mask;
-    }
-	latch->pin |= lvl;		// store lvl
-	latch->pin |= lvl << 3; // initialize clock
+//	raise the durable lsn, it only moves forward
 
-#ifdef unix
-	__sync_fetch_and_add (&bt->latchmgr->cache[page->lvl], 1);
-#else
-	_InterlockedExchangeAdd(&bt->latchmgr->cache[page->lvl], 1);
-#endif
-	return bt->err = 0;
+void bt_logsynced (BtDb *bt, uid lsn)
+{
+uid synced;
+
+	do {
+		if( (synced = bt->latchmgr->logsynced) >= lsn )
+			return;
+	} while( !__sync_bool_compare_and_swap (&bt->latchmgr->logsynced, synced, lsn) );
 }
 
-//	release latch pin
+//	append an image of a page to the redo log
 
-void bt_unpinlatch (BtLatchSet *latch)
+BTERR bt_logpage (BtDb *bt, BtPage page, uid page_no)
 {
 #ifdef unix
-	__sync_fetch_and_add(&latch->pin, -1);
-#else
-	_InterlockedDecrement16 (&latch->pin);
-#endif
-}
+BtLatchMgr *mgr = bt->latchmgr;
+BtLogRec *rec;
+unsigned char *data;
+uint lo, hi, gen;
 
-//	find existing latchset or inspire new one
-//	return with latchset pinned
+	if( !mgr->logged )
+		return 0;
 
-BtLatchSet *bt_pinlatch (BtDb *bt, uid page_no)
-{
-uint hashidx = page_no % bt->latchmgr->latchhash;
-BtLatchSet *latch;
-uint slot, idx;
-uint lvl, cnt;
-BtPage page;
+	//	a failed append is kept until our next checkpoint,
+	//	so bt_commit can't report the change durable
 
-  //  try to find our entry
+	if( bt_logfiles (bt) )
+		return bt->logerr = bt->err;
 
-  bt_spinwritelock(bt->table[hashidx].latch);
+	rec = (BtLogRec *)bt->logbuf;
+	data = bt->logbuf + sizeof(BtLogRec);
 
-  if(( slot = bt->table[hashidx].slot )) do
-  {
-	latch = bt->latchsets + slot;
-	if(( page_no == latch->page_no )) {
-		break;
-    }
-  } while(( slot = latch->next ));
+	//	copy the used parts of the page, so the image
+	//	can't change while it is being written
 
-  //  found our entry
-  //  increment clock
+	if( page_no == ALLOC_page ) {
+		lo = sizeof(mgr->alloc);
+		hi = bt->page_size;
+	} else {
+		lo = sizeof(*page) + page->cnt * sizeof(BtSlot);
+		hi = page->min;
+		if( lo > bt->page_size )
+			lo = bt->page_size;
+		if( hi < lo )
+			hi = lo;
+	}
 
-  if(( slot )) {
-	latch = bt->latchsets + slot;
-	lvl = (latch->pin & LVL_mask) >> LVL_shift;
-	lvl *= CLOCK_unit * 2;
-	lvl |= CLOCK_unit;
-#ifdef unix
-	__sync_fetch_and_add(&latch->pin, 1);
-	__sync_fetch_and_or(&latch->pin, lvl);
-#else
-	_InterlockedIncrement16 (&latch->pin);
-	_InterlockedOr16 (&latch->pin, lvl);
-#endif
-	bt_spinreleasewrite(bt->table[hashidx].latch);
-	return latch;
-  }
+	memcpy (data, page, lo);
+	memcpy (data + lo, (unsigned char *)page + hi, bt->page_size - hi);
 
-	//  see if there are any unused pool entries
-#ifdef unix
-	slot = __sync_fetch_and_add (&bt->latchmgr->latchdeployed, 1) + 1;
-#else
-	slot = _InterlockedIncrement (&bt->latchmgr->latchdeployed);
-#endif
+	rec->size = sizeof(BtLogRec) + lo + bt->page_size - hi;
+	rec->page_no = page_no;
+	rec->lo = lo;
+	rec->hi = hi;
 
-	if( slot < bt->latchmgr->latchtotal ) {
-		latch = bt->latchsets + slot;
-		if( bt_latchlink (bt, hashidx, slot, page_no) )
-			return NULL;
-		bt_spinreleasewrite (bt->table[hashidx].latch);
-		return latch;
+	bt_spinwritelock (mgr->loglock);
+
+	gen = mgr->loggen;
+	rec->lsn = mgr->logtail;
+	rec->sum = bt_logsum (0, (unsigned char *)&rec->size, rec->size - sizeof(rec->sum));
+
+	if( pwrite (bt->logfd[gen], rec, rec->size, rec->lsn - mgr->logstart[gen]) < rec->size ) {
+		bt_spinreleasewrite (mgr->loglock);
+		return bt->logerr = bt->err = BTERR_wrt;
 	}
 
-#ifdef unix
-	__sync_fetch_and_add (&bt->latchmgr->latchdeployed, -1);
-#else
-	_InterlockedDecrement (&bt->latchmgr->latchdeployed);
-#endif
-  //  find and reuse previous entry on victim
+	mgr->logtail = rec->lsn + rec->size;
+	bt->loglsn = mgr->logtail;
 
-  while( 1 ) {
-#ifdef unix
-	slot = __sync_fetch_and_add(&bt->latchmgr->latchvictim, 1);
-#else
-	slot = _InterlockedIncrement (&bt->latchmgr->latchvictim) - 1;
+	bt_spinreleasewrite (mgr->loglock);
 #endif
-	// try to get write lock on hash chain
-	//	skip entry if not obtained
-	//	or has outstanding pins
+	return 0;
+}
 
-	slot %= bt->latchmgr->latchtotal;
+//	make the log durable up to the given lsn
 
-	//	on slot wraparound, check census
-	//	count and increment safe level
+BTERR bt_logsync (BtDb *bt, uid lsn)
+{
+#ifdef unix
+BtLatchMgr *mgr = bt->latchmgr;
+uid tail;
+uint gen;
 
-	cnt = bt->latchmgr->cache[bt->latchmgr->safelevel];
+	if( !mgr->logged || mgr->logsynced >= lsn )
+		return 0;
 
-	if( !slot ) {
-	  if( cnt < bt->latchmgr->latchtotal / 10 )
-#ifdef unix
-		__sync_fetch_and_add(&bt->latchmgr->safelevel, 1);
-#else
-		_InterlockedIncrement (&bt->latchmgr->safelevel);
-#endif
-	  continue;
-	}
+	if( bt_logfiles (bt) )
+		return bt->err;
 
-	latch = bt->latchsets + slot;
-	idx = latch->page_no % bt->latchmgr->latchhash;
-	lvl = (latch->pin & LVL_mask) >> LVL_shift;
+	//	whoever gets the latch syncs for everyone waiting,
+	//	the tail is read before the file, a switch syncs
+	//	the file it leaves
 
-	//	see if we are evicting this level yet
-	//	or if we are on same chain as hashidx
+	bt_spinwritelock (mgr->synclock);
 
-	if( idx == hashidx || lvl > bt->latchmgr->safelevel )
-		continue;
+	if( mgr->logsynced < lsn ) {
+		tail = mgr->logtail;
+		__sync_synchronize ();
+		gen = mgr->loggen;
 
-	if( !bt_spinwritetry (bt->table[idx].latch) )
-		continue;
+		if( fdatasync (bt->logfd[gen]) ) {
+			bt_spinreleasewrite (mgr->synclock);
+			return bt->err = BTERR_wrt;
+		}
 
-	if( latch->pin & ~LVL_mask ) {
-	  if( latch->pin & CLOCK_mask )
-#ifdef unix
-		__sync_fetch_and_add(&latch->pin, -CLOCK_unit);
-#else
-		_InterlockedExchangeAdd16 (&latch->pin, -CLOCK_unit);
-#endif
-	  bt_spinreleasewrite (bt->table[idx].latch);
-	  continue;
+		bt_logsynced (bt, tail);
 	}
 
-	//  update permanent page area in btree
-
-	page = (BtPage)((uid)slot * bt->page_size + bt->pagepool);
-#ifdef unix
-	posix_fadvise (bt->idx, page_no << bt->page_bits, bt->page_size, POSIX_FADV_WILLNEED);
-	__sync_fetch_and_add (&bt->latchmgr->cache[page->lvl], -1);
-#else
-	_InterlockedExchangeAdd(&bt->latchmgr->cache[page->lvl], -1);
+	bt_spinreleasewrite (mgr->synclock);
 #endif
-	if( page->dirty )
-	  if( bt_writepage (bt, page, latch->page_no) )
-		return NULL;
+	return 0;
+}
 
-	//  unlink our available slot from its hash chain
+//	make our changes so far durable
 
-	if( latch->prev )
-		bt->latchsets[latch->prev].next = latch->next;
-	else
-		bt->table[idx].slot = latch->next;
-
-	if( latch->next )
-		bt->latchsets[latch->next].prev = latch->prev;
-
-	bt_spinreleasewrite (bt->table[idx].latch);
-
-	if( bt_latchlink (bt, hashidx, slot, page_no) )
-		return NULL;
+BTERR bt_commit (BtDb *bt)
+{
+	if( bt->logerr )
+		return bt->err = bt->logerr;
 
-	bt_spinreleasewrite (bt->table[hashidx].latch);
-	return latch;
-  }
+	return bt_logsync (bt, bt->loglsn);
 }
 
-//	close and release memory
+//	switch log files, write the dirty pages in the
+//	buffer pool back to the btree, and empty the log
+//	file that was left. Call with the checkpoint latch.
 
-void bt_close (BtDb *bt)
+BTERR bt_logflush (BtDb *bt)
 {
 #ifdef unix
-	munmap (bt->table, bt->latchmgr->nlatchpage * bt->page_size);
-	munmap (bt->latchmgr, bt->page_size);
-#else
-	FlushViewOfFile(bt->latchmgr, 0);
-	UnmapViewOfFile(bt->latchmgr);
-	CloseHandle(bt->halloc);
-#endif
-#ifdef unix
-	if( bt->mem )
-		free (bt->mem);
-	close (bt->idx);
-	free (bt);
-#else
-	if( bt->mem)
-		VirtualFree (bt->mem, 0, MEM_RELEASE);
-	FlushFileBuffers(bt->idx);
-	CloseHandle(bt->idx);
-	GlobalFree (bt);
-#endif
-}
-//  open/create new btree
+BtLatchMgr *mgr = bt->latchmgr;
+BtLatchSet *latch;
+uint slot, max, old;
+BtPage page;
+uid page_no;
 
-//	call with file_name, BT_openmode, bits in page size (e.g. 16),
-//		size of mapped page pool (e.g. 8192)
+	if( bt_logfiles (bt) )
+		return bt->err;
 
-BtDb *bt_open (char *name, uint mode, uint bits, uint nodemax)
-{
-uint lvl, last;
-uint nlatchpage, latchhash;
-BtLatchMgr *latchmgr;
-off64_t size;
-uint amt[1];
-BtKey key;
-BtDb* bt;
-int flag;
-int stat;
-int flags = O_RDWR;
-int xmode = (S_IRWXU | S_IRWXG);
-int create = (O_RDWR | O_CREAT);
+	bt_spinwritelock (mgr->loglock);
 
-#ifndef unix
-OVERLAPPED ovl[1];
-#else
-struct flock lock[1];
-#endif
+	old = mgr->loggen;
 
-	// determine sanity of page size and buffer pool
+	if( fdatasync (bt->logfd[old]) ) {
+		bt_spinreleasewrite (mgr->loglock);
+		return bt->err = BTERR_wrt;
+	}
 
-	if( bits > BT_maxbits )
-		bits = BT_maxbits;
-	else if( bits < BT_minbits )
-		bits = BT_minbits;
+	bt_logsynced (bt, mgr->logtail);
+	mgr->logstart[!old] = mgr->logtail;
+	mgr->loggen = !old;
 
-	if( mode == BT_ro ) {
-		fprintf(stderr, "ReadOnly mode not supported: %s\n", name);
-		return NULL;
-	}
-#ifdef unix
-	bt = calloc (1, sizeof(BtDb));
+	bt_spinreleasewrite (mgr->loglock);
 
-    errno = 0;
-    stat = access(name, (R_OK | W_OK));
-    if ((stat < 0) && (errno != ENOENT)) {
+	//	every change in the old file is in a dirty page,
+	//	or has been written back already
 
-		fprintf(stderr, "unable to open %s, errno: %s\n", name, strerror(errno));
-		return free(bt), NULL;
+	max = mgr->latchdeployed;
+	if( max >= mgr->latchtotal )
+		max = mgr->latchtotal - 1;
 
-    }
-    if (stat == 0) {
+	for( slot = 1; slot <= max; slot++ ) {
+		page = (BtPage)((uid)slot * bt->page_size + bt->pagepool);
 
-        bt->idx = open((char*)name, flags, xmode);
+		if( !(page_no = bt->latchsets[slot].page_no) || !page->dirty )
+			continue;
 
-    } else {
+		if( !(latch = bt_pinlatch (bt, page_no)) )
+			break;
 
-        bt->idx = open((char*)name, create, xmode);
+		bt_lockpage (BtLockRead, latch);
+		page = bt_mappage (bt, latch);
 
-    }
+		if( page->dirty )
+		  if( bt_logsync (bt, mgr->logtail) || bt_writepage (bt, page, page_no) ) {
+			bt_unlockpage (BtLockRead, latch);
+			bt_unpinlatch (latch);
+			break;
+		  }
 
-    posix_fadvise( bt->idx, 0, 0, POSIX_FADV_RANDOM);
- 
-	if( bt->idx == -1 ) {
-		fprintf(stderr, "unable to open %s\n", name);
-		return free(bt), NULL;
+		bt_unlockpage (BtLockRead, latch);
+		bt_unpinlatch (latch);
 	}
-#else
-	bt = GlobalAlloc (GMEM_FIXED|GMEM_ZEROINIT, sizeof(BtDb));
-	attr = FILE_ATTRIBUTE_NORMAL;
-	bt->idx = CreateFile(name, GENERIC_READ| GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, attr, NULL);
 
-	if( bt->idx == INVALID_HANDLE_VALUE ) {
-		fprintf(stderr, "unable to open %s\n", name);
-		return GlobalFree(bt), NULL;
-	}
+	if( slot <= max )
+		return bt->err ? bt->err : (bt->err = BTERR_wrt);
+
+	if( fdatasync (bt->idx) || ftruncate (bt->logfd[old], 0) )
+		return bt->err = BTERR_wrt;
+
+	//	whatever we failed to log is in the btree now
+
+	bt->logerr = 0;
 #endif
+	return bt->err = 0;
+}
+
+//	checkpoint the btree, waiting for one that
+//	is already running to finish
+
+BTERR bt_checkpoint (BtDb *bt)
+{
+BtLatchMgr *mgr = bt->latchmgr;
+BTERR err;
+
+	if( !mgr->logged )
+		return bt->err = 0;
+
+	bt_spinwritelock (mgr->ckptlock);
+	err = bt_logflush (bt);
+	bt_spinreleasewrite (mgr->ckptlock);
+	return err;
+}
+
+//	start a checkpoint when the log has grown too big,
+//	unless somebody else has already started one
+
+void bt_logcheck (BtDb *bt)
+{
+BtLatchMgr *mgr = bt->latchmgr;
+
+	if( !mgr->logged )
+		return;
+
+	if( mgr->logtail - mgr->logstart[mgr->loggen] > bt->logmax )
+	  if( bt_spinwritetry (mgr->ckptlock) ) {
+		bt_logflush (bt);
+		bt_spinreleasewrite (mgr->ckptlock);
+	  }
+}
+
+//	turn the redo log on or off for the btree file, it
+//	stays that way for every handle until it is changed.
+//	Call it while nobody is changing the btree.
+
+BTERR bt_setlog (BtDb *bt, uint on)
+{
 #ifdef unix
-	memset (lock, 0, sizeof(lock));
-	lock->l_len = sizeof(struct BtPage_);
-	lock->l_type = F_WRLCK;
+BtLatchMgr *mgr = bt->latchmgr;
+uint gen;
 
-	if( fcntl (bt->idx, F_SETLKW, lock) < 0 ) {
-		fprintf(stderr, "unable to lock record zero %s\n", name);
-		return bt_close (bt), NULL;
-	}
-#else
-	memset (ovl, 0, sizeof(ovl));
+	if( !on == !mgr->logged )
+		return bt->err = 0;
 
-	//	use large offsets to
-	//	simulate advisory locking
+	//	every change made so far goes to the btree first
 
-	ovl->OffsetHigh |= 0x80000000;
+	if( !on && bt_checkpoint (bt) )
+		return bt->err;
 
-	if( !LockFileEx (bt->idx, LOCKFILE_EXCLUSIVE_LOCK, 0, sizeof(struct BtPage_), 0L, ovl) ) {
-		fprintf(stderr, "unable to lock record zero %s, GetLastError = %d\n", name, GetLastError());
-		return bt_close (bt), NULL;
+	if( bt_logfiles (bt) )
+		return bt->err;
+
+	bt_spinwritelock (mgr->loglock);
+
+	gen = mgr->loggen;
+
+	if( ftruncate (bt->logfd[0], 0) || ftruncate (bt->logfd[1], 0) ) {
+		bt_spinreleasewrite (mgr->loglock);
+		return bt->err = BTERR_wrt;
 	}
-#endif 
+
+	mgr->logstart[gen] = mgr->logtail;
+	mgr->logsynced = mgr->logtail;
+	mgr->logged = on ? 1 : 0;
+
+	bt_spinreleasewrite (mgr->loglock);
+
+	//	the setting is on disk before anything is logged
+
+	if( msync (mgr, bt->page_size, MS_SYNC) )
+		return bt->err = BTERR_wrt;
+#endif
+	return bt->err = 0;
+}
 
 #ifdef unix
-	latchmgr = valloc (BT_maxpage);
-	*amt = 0;
+//	replay the records of one log file, they must have
+//	good checksums and follow each other
 
-	// read minimum page size to get root info
+BTERR bt_logreplay (BtDb *bt, int fd)
+{
+BtLogRec *rec = (BtLogRec *)bt->logbuf;
+unsigned char *data = bt->logbuf + sizeof(BtLogRec);
+off64_t off = 0;
+uid lsn = 0;
+uint tail;
+
+	while( pread (fd, rec, sizeof(BtLogRec), off) == sizeof(BtLogRec) ) {
+		if( rec->size < sizeof(BtLogRec) || rec->size > sizeof(BtLogRec) + bt->page_size )
+			break;
+		if( rec->lo > rec->hi || rec->hi > bt->page_size )
+			break;
+		if( rec->size != sizeof(BtLogRec) + rec->lo + bt->page_size - rec->hi )
+			break;
+		if( off && rec->lsn != lsn )
+			break;
+		if( pread (fd, data, rec->size - sizeof(BtLogRec), off + sizeof(BtLogRec)) < rec->size - sizeof(BtLogRec) )
+			break;
+		if( rec->sum != bt_logsum (0, (unsigned char *)&rec->size, rec->size - sizeof(rec->sum)) )
+			break;
 
-	if(( size = lseek (bt->idx, 0L, 2) )) {
-		if(( pread(bt->idx, latchmgr, BT_minpage, 0) == BT_minpage )) {
-			bits = latchmgr->alloc->bits;
+		//	the allocation area is all that is logged of
+		//	page zero, the latch manager is left alone
+
+		tail = bt->page_size - rec->hi;
+
+		if( rec->page_no == ALLOC_page ) {
+			if( pwrite (bt->idx, data, rec->lo, 0) < rec->lo )
+				return bt->err = BTERR_wrt;
 		} else {
-			fprintf(stderr, "Unable to read page zero\n");
-			return free(bt), free(latchmgr), NULL;
+			memset (bt->frame, 0, bt->page_size);
+			memcpy (bt->frame, data, rec->lo);
+			memcpy ((unsigned char *)bt->frame + rec->hi, data + rec->lo, tail);
+			if( bt_writepage (bt, bt->frame, rec->page_no) )
+				return bt->err;
 		}
-	}
-#else
-	latchmgr = VirtualAlloc(NULL, BT_maxpage, MEM_COMMIT, PAGE_READWRITE);
-	size = GetFileSize(bt->idx, amt);
 
-	if( size || *amt ) {
-		if( !ReadFile(bt->idx, (char *)latchmgr, BT_minpage, amt, NULL) ) {
-			fprintf(stderr, "Unable to read page zero\n");
-			return bt_close (bt), NULL;
-		} else
-			bits = latchmgr->alloc->bits;
+		lsn = rec->lsn + rec->size;
+		off += rec->size;
 	}
-#endif
 
-	bt->page_size = 1 << bits;
-	bt->page_bits = bits;
+	return 0;
+}
 
-	bt->mode = mode;
+//	bring the btree up to date after it was last used,
+//	called when no other handle has it open
 
-	if( size || *amt ) {
-		nlatchpage = latchmgr->nlatchpage;
-		goto btlatch;
-	}
+BTERR bt_recover (BtDb *bt)
+{
+BtLatchMgr *mgr = bt->latchmgr;
+BtLogRec first[2];
+uint slot, max, gen;
+BtPage page;
+uid page_no;
 
-	if( nodemax < 16 ) {
-		fprintf(stderr, "Buffer pool too small: %d\n", nodemax);
-		return bt_close(bt), NULL;
+	//	dirty pages in the pool are written back first,
+	//	the log has an image for each of them
+
+	max = mgr->latchdeployed;
+	if( max >= mgr->latchtotal )
+		max = mgr->latchtotal - 1;
+
+	for( slot = 1; slot <= max; slot++ ) {
+		page = (BtPage)((uid)slot * bt->page_size + bt->pagepool);
+		if(( page_no = bt->latchsets[slot].page_no ) && page->dirty )
+			if( bt_writepage (bt, page, page_no) )
+				return bt->err;
 	}
 
-	// initialize an empty b-tree with latch page, root page, page of leaves
-	// and page(s) of latches and page pool cache
+	//	replay the older log file first
 
-	memset (latchmgr, 0, 1 << bits);
-	latchmgr->alloc->bits = bt->page_bits;
+	for( gen = 0; gen < 2; gen++ )
+		if( pread (bt->logfd[gen], &first[gen], sizeof(BtLogRec), 0) < sizeof(BtLogRec) )
+			first[gen].lsn = ~0ULL;
 
-	//  calculate number of latch hash table entries
+	gen = first[1].lsn < first[0].lsn;
 
-	nlatchpage = (nodemax/16 * sizeof(BtHashEntry) + bt->page_size - 1) / bt->page_size;
-	latchhash = nlatchpage * bt->page_size / sizeof(BtHashEntry);
+	if( bt_logreplay (bt, bt->logfd[gen]) || bt_logreplay (bt, bt->logfd[!gen]) )
+		return bt->err;
 
-	nlatchpage += nodemax;		// size of the buffer pool in pages
-	nlatchpage += (sizeof(BtLatchSet) * nodemax + bt->page_size - 1)/bt->page_size;
+	if( fdatasync (bt->idx) )
+		return bt->err = BTERR_wrt;
 
-	bt_putid(latchmgr->alloc->right, MIN_lvl+1+nlatchpage);
-	latchmgr->nlatchpage = nlatchpage;
-	latchmgr->latchtotal = nodemax;
-	latchmgr->latchhash = latchhash;
+	//	start over with empty latch tables and log
 
-	if( bt_writepage (bt, latchmgr->alloc, 0) ) {
-		fprintf (stderr, "Unable to create btree page zero\n");
-		return bt_close (bt), NULL;
-	}
+	memset ((void *)bt->table, 0, mgr->latchhash * sizeof(BtHashEntry));
+	memset ((void *)bt->latchsets, 0, mgr->latchtotal * sizeof(BtLatchSet));
 
-	memset (latchmgr, 0, 1 << bits);
-	latchmgr->alloc->bits = bt->page_bits;
+	*mgr->lock->word = 0;
+	*mgr->loglock->word = 0;
+	*mgr->synclock->word = 0;
+	*mgr->ckptlock->word = 0;
+	*mgr->resize->word = 0;
+	mgr->latchdeployed = 0;
+	mgr->latchvictim = 0;
+	mgr->safelevel = 0;
+	memset ((void *)mgr->cache, 0, sizeof(mgr->cache));
 
-	for( lvl=MIN_lvl; lvl--; ) {
-		last = MIN_lvl - lvl;	// page number
-		slotptr(latchmgr->alloc, 1)->off = bt->page_size - 3;
-		bt_putid(slotptr(latchmgr->alloc, 1)->id, lvl ? last + 1 : 0);
-		key = keyptr(latchmgr->alloc, 1);
-		key->len = 2;		// create stopper key
-		key->key[0] = 0xff;
-		key->key[1] = 0xff;
+	mgr->loggen = 0;
+	mgr->logtail = 0;
+	mgr->logsynced = 0;
+	mgr->logstart[0] = mgr->logstart[1] = 0;
 
-		latchmgr->alloc->min = bt->page_size - 3;
-		latchmgr->alloc->lvl = lvl;
-		latchmgr->alloc->cnt = 1;
-		latchmgr->alloc->act = 1;
+	if( ftruncate (bt->logfd[0], 0) || ftruncate (bt->logfd[1], 0) )
+		return bt->err = BTERR_wrt;
 
-		if( bt_writepage (bt, latchmgr->alloc, last) ) {
-			fprintf (stderr, "Unable to create btree page %.8x\n", last);
-			return bt_close (bt), NULL;
-		}
-	}
+	return 0;
+}
+#endif
 
-	// clear out buffer pool pages
+//	open the log files the first time this handle needs them
 
-	memset(latchmgr, 0, bt->page_size);
-	last = MIN_lvl + nlatchpage;
+BTERR bt_logfiles (BtDb *bt)
+{
+#ifdef unix
+char path[1024];
+int gen;
 
-	if( bt_writepage (bt, latchmgr->alloc, last) ) {
-		fprintf (stderr, "Unable to write buffer pool page %.8x\n", last);
-		return bt_close (bt), NULL;
+	if( bt->logfd[1] >= 0 )
+		return 0;
+
+	if( !bt->logbuf )
+	  if( !(bt->logbuf = malloc (sizeof(BtLogRec) + bt->page_size)) )
+		return bt->err = BTERR_ovflw;
+
+	for( gen = 0; gen < 2; gen++ ) {
+		if( bt->logfd[gen] >= 0 )
+			continue;
+		snprintf (path, sizeof(path), "%s.log%d", bt->name, gen);
+		if( (bt->logfd[gen] = open (path, O_RDWR | O_CREAT, S_IRWXU | S_IRWXG)) < 0 )
+			return bt->err = BTERR_read;
 	}
-		
-#ifdef unix
-	free (latchmgr);
-#else
-	VirtualFree (latchmgr, 0, MEM_RELEASE);
 #endif
+	return 0;
+}
 
-btlatch:
+//	the first handle to open the btree recovers it
+//	when it is logged, the rest share it
+
+BTERR bt_logopen (BtDb *bt)
+{
 #ifdef unix
-	lock->l_type = F_UNLCK;
-	if( fcntl (bt->idx, F_SETLK, lock) < 0 ) {
-		fprintf (stderr, "Unable to unlock page zero\n");
-		return bt_close (bt), NULL;
+struct flock use[1];
+
+	bt->logmax = BT_logmax;
+
+	//	hold a byte after the page zero lock for as long
+	//	as the btree is open, if it can be held alone
+	//	nobody else is using the btree
+
+	memset (use, 0, sizeof(use));
+	use->l_start = sizeof(struct BtPage_);
+	use->l_len = 1;
+	use->l_type = F_WRLCK;
+
+#ifdef F_OFD_SETLK
+	if( !fcntl (bt->idx, F_OFD_SETLK, use) && bt->latchmgr->logged )
+		if( bt_logfiles (bt) || bt_recover (bt) )
+			return bt->err;
+
+	use->l_type = F_RDLCK;
+
+	if( fcntl (bt->idx, F_OFD_SETLK, use) < 0 )
+		return bt->err = BTERR_lock;
+#endif
+#endif
+	return 0;
+}
+
+//	link latch table entry into head of latch hash table
+
+BTERR bt_latchlink (BtDb *bt, uint hashidx, uint slot, uid page_no)
+{
+BtPage page = (BtPage)((uid)slot * bt->page_size + bt->pagepool);
+BtLatchSet *latch = bt->latchsets + slot;
+int lvl;
+
+	if(( latch->next = bt->table[hashidx].slot )) {
+		bt->latchsets[latch->next].prev = slot;
+    }
+
+	bt->table[hashidx].slot = slot;
+	latch->page_no = page_no;
+	latch->prev = 0;
+	latch->pin = 1;
+
+	if(( bt_readpage (bt, page, page_no) )) {
+		return bt->err;
+    }
+
+	lvl = page->lvl << LVL_shift;
+	if(( lvl > LVL_mask )) {
+		lvl = LVL_mask;
+    }
+	latch->pin |= lvl;		// store lvl
+	latch->pin |= lvl << 3; // initialize clock
+
+#ifdef unix
+	__sync_fetch_and_add (&bt->latchmgr->cache[page->lvl], 1);
+#else
+	_InterlockedExchangeAdd(&bt->latchmgr->cache[page->lvl], 1);
+#endif
+	return bt->err = 0;
+}
+
+//	release latch pin
+
+void bt_unpinlatch (BtLatchSet *latch)
+{
+#ifdef unix
+	__sync_fetch_and_add(&latch->pin, -1);
+#else
+	_InterlockedDecrement16 (&latch->pin);
+#endif
+}
+
+//	find existing latchset or inspire new one
+//	return with latchset pinned
+
+BtLatchSet *bt_pinlatch (BtDb *bt, uid page_no)
+{
+uint hashidx = page_no % bt->latchmgr->latchhash;
+BtLatchSet *latch;
+uint slot, idx;
+uint lvl, cnt;
+uint laps = 0;
+uid victim;
+BtPage page;
+
+  //  check the pool size now and then
+
+  if( !(++bt->stats.pins % BT_window) && (bt->growrate || bt->shrinkrate) )
+	bt_pooladjust (bt);
+
+  //  try to find our entry
+
+  bt_spinwritelock(bt->table[hashidx].latch);
+
+  if(( slot = bt->table[hashidx].slot )) do
+  {
+	latch = bt->latchsets + slot;
+	if(( page_no == latch->page_no )) {
+		break;
+    }
+  } while(( slot = latch->next ));
+
+  //  found our entry
+  //  increment clock
+
+  if(( slot )) {
+	latch = bt->latchsets + slot;
+	lvl = (latch->pin & LVL_mask) >> LVL_shift;
+	lvl *= CLOCK_unit * 2;
+	lvl |= CLOCK_unit;
+#ifdef unix
+	__sync_fetch_and_add(&latch->pin, 1);
+	__sync_fetch_and_or(&latch->pin, lvl);
+#else
+	_InterlockedIncrement16 (&latch->pin);
+	_InterlockedOr16 (&latch->pin, lvl);
+#endif
+	bt_spinreleasewrite(bt->table[hashidx].latch);
+	bt->stats.hits++;
+	return latch;
+  }
+
+	bt->stats.misses++;
+
+	//  see if there are any unused pool entries,
+	//	the pool can't be resized while we look
+
+  if( bt->latchmgr->latchdeployed + 1 < bt->latchmgr->latchlimit ) {
+	bt_spinreadlock (bt->latchmgr->resize);
+#ifdef unix
+	slot = __sync_fetch_and_add (&bt->latchmgr->latchdeployed, 1) + 1;
+#else
+	slot = _InterlockedIncrement (&bt->latchmgr->latchdeployed);
+#endif
+
+	if( slot < bt->latchmgr->latchlimit ) {
+		latch = bt->latchsets + slot;
+		if( bt_latchlink (bt, hashidx, slot, page_no) ) {
+			bt_spinreleaseread (bt->latchmgr->resize);
+			return NULL;
+		}
+		bt_spinreleaseread (bt->latchmgr->resize);
+		bt_spinreleasewrite (bt->table[hashidx].latch);
+		return latch;
 	}
+
+#ifdef unix
+	__sync_fetch_and_add (&bt->latchmgr->latchdeployed, -1);
 #else
-	if( !UnlockFileEx (bt->idx, 0, sizeof(struct BtPage_), 0, ovl) ) {
-		fprintf (stderr, "Unable to unlock page zero, GetLastError = %d\n", GetLastError());
-		return bt_close (bt), NULL;
+	_InterlockedDecrement (&bt->latchmgr->latchdeployed);
+#endif
+	bt_spinreleaseread (bt->latchmgr->resize);
+  }
+
+  //  find and reuse previous entry on victim
+
+  while( 1 ) {
+#ifdef unix
+	slot = __sync_fetch_and_add(&bt->latchmgr->latchvictim, 1);
+#else
+	slot = _InterlockedIncrement (&bt->latchmgr->latchvictim) - 1;
+#endif
+	// try to get write lock on hash chain
+	//	skip entry if not obtained
+	//	or has outstanding pins
+
+	slot %= bt->latchmgr->latchlimit;
+	bt->stats.scans++;
+
+	//	on slot wraparound, check census
+	//	count and increment safe level,
+	//	or if two whole laps found nothing
+	//	to evict, as a small pool can be
+	//	all upper level pages
+
+	cnt = bt->latchmgr->cache[bt->latchmgr->safelevel];
+
+	if( !slot ) {
+	  if( cnt < bt->latchmgr->latchlimit / 10 || laps++ > 1 )
+#ifdef unix
+		__sync_fetch_and_add(&bt->latchmgr->safelevel, 1);
+#else
+		_InterlockedIncrement (&bt->latchmgr->safelevel);
+#endif
+	  continue;
+	}
+
+	latch = bt->latchsets + slot;
+	victim = latch->page_no;
+	idx = victim % bt->latchmgr->latchhash;
+	lvl = (latch->pin & LVL_mask) >> LVL_shift;
+
+	//	see if we are evicting this level yet
+	//	or if we are on same chain as hashidx,
+	//	an entry being deployed has no page yet
+
+	if( idx == hashidx || lvl > bt->latchmgr->safelevel || !victim )
+		continue;
+
+	if( !bt_spinwritetry (bt->table[idx].latch) )
+		continue;
+
+	//	another thread may have moved the entry
+	//	to another chain before we locked this one
+
+	if( latch->page_no != victim ) {
+	  bt_spinreleasewrite (bt->table[idx].latch);
+	  continue;
 	}
+
+	if( latch->pin & ~LVL_mask ) {
+	  if( latch->pin & CLOCK_mask )
+#ifdef unix
+		__sync_fetch_and_add(&latch->pin, -CLOCK_unit);
+#else
+		_InterlockedExchangeAdd16 (&latch->pin, -CLOCK_unit);
 #endif
+	  bt_spinreleasewrite (bt->table[idx].latch);
+	  continue;
+	}
+
+	//  update permanent page area in btree
+
+	page = (BtPage)((uid)slot * bt->page_size + bt->pagepool);
 #ifdef unix
-	flag = PROT_READ | PROT_WRITE;
-	bt->latchmgr = mmap (0, bt->page_size, flag, MAP_SHARED, bt->idx, ALLOC_page * bt->page_size);
-	if( bt->latchmgr == MAP_FAILED ) {
-		fprintf (stderr, "Unable to mmap page zero, errno = %d", errno);
-		return bt_close (bt), NULL;
+	posix_fadvise (bt->idx, page_no << bt->page_bits, bt->page_size, POSIX_FADV_WILLNEED);
+	__sync_fetch_and_add (&bt->latchmgr->cache[page->lvl], -1);
+#else
+	_InterlockedExchangeAdd(&bt->latchmgr->cache[page->lvl], -1);
+#endif
+	if( page->dirty ) {
+	  if( bt_logsync (bt, bt->latchmgr->logtail) )
+		return NULL;
+	  if( bt_writepage (bt, page, latch->page_no) )
+		return NULL;
+	  bt->stats.writes++;
+	}
+
+	bt->stats.evictions++;
+
+	//  unlink our available slot from its hash chain
+
+	if( latch->prev )
+		bt->latchsets[latch->prev].next = latch->next;
+	else
+		bt->table[idx].slot = latch->next;
+
+	if( latch->next )
+		bt->latchsets[latch->next].prev = latch->prev;
+
+	//	without a page but pinned, a shrinking
+	//	pool leaves the entry to us
+
+	latch->page_no = 0;
+	latch->pin = 1;
+	bt_spinreleasewrite (bt->table[idx].latch);
+
+	if( bt_latchlink (bt, hashidx, slot, page_no) )
+		return NULL;
+
+	bt_spinreleasewrite (bt->table[hashidx].latch);
+	return latch;
+  }
+}
+
+//	Buffer pool sizing. The latch table and the pool pages
+//	are laid out for latchtotal entries when the btree is
+//	created, latchlimit is how many of them are used. The
+//	clock only looks below the limit, and a smaller limit
+//	takes the entries above it out of use from the top.
+
+//	take a latch entry out of use, it can't be pinned
+
+int bt_poolvacate (BtDb *bt, uint slot)
+{
+BtLatchSet *latch = bt->latchsets + slot;
+uid page_no = latch->page_no;
+BtPage page;
+uint idx;
+
+	//	an entry without a page is empty, unless it
+	//	is pinned on its way to another page
+
+	if( !page_no )
+		return !latch->pin;
+
+	idx = page_no % bt->latchmgr->latchhash;
+
+	if( !bt_spinwritetry (bt->table[idx].latch) )
+		return 0;
+
+	if( latch->page_no != page_no || (latch->pin & PIN_mask) ) {
+		bt_spinreleasewrite (bt->table[idx].latch);
+		return 0;
+	}
+
+	page = (BtPage)((uid)slot * bt->page_size + bt->pagepool);
+
+	if( page->dirty ) {
+	  if( bt_logsync (bt, bt->latchmgr->logtail) || bt_writepage (bt, page, page_no) ) {
+		bt_spinreleasewrite (bt->table[idx].latch);
+		return 0;
+	  }
+	  bt->stats.writes++;
+	}
+
+#ifdef unix
+	__sync_fetch_and_add (&bt->latchmgr->cache[page->lvl], -1);
+#else
+	_InterlockedExchangeAdd(&bt->latchmgr->cache[page->lvl], -1);
+#endif
+	if( latch->prev )
+		bt->latchsets[latch->prev].next = latch->next;
+	else
+		bt->table[idx].slot = latch->next;
+
+	if( latch->next )
+		bt->latchsets[latch->next].prev = latch->prev;
+
+	latch->page_no = 0;
+	latch->next = latch->prev = 0;
+	latch->pin = 0;
+
+	bt_spinreleasewrite (bt->table[idx].latch);
+
+	//	give the memory of the page back
+
+#ifdef MADV_REMOVE
+	madvise (page, bt->page_size, MADV_REMOVE);
+#endif
+	bt->stats.evictions++;
+	return 1;
+}
+
+//	change the number of latch entries in use,
+//	between BT_poolmin and the size of the table
+
+BTERR bt_poolresize (BtDb *bt, uint entries)
+{
+BtLatchMgr *mgr = bt->latchmgr;
+uint slot;
+
+	if( entries < BT_poolmin )
+		entries = BT_poolmin;
+
+	if( entries > mgr->latchtotal )
+		entries = mgr->latchtotal;
+
+	bt_spinwritelock (mgr->resize);
+
+	if( mgr->latchlimit != entries ) {
+		mgr->latchlimit = entries;
+		bt->stats.resizes++;
+	}
+
+	//	empty the entries from the top down, nothing
+	//	is deployed while we hold the resize latch.
+	//	A pinned entry stops us, the rest are emptied
+	//	by a later call.
+
+	while( (slot = mgr->latchdeployed) >= mgr->latchlimit ) {
+		if( !bt_poolvacate (bt, slot) )
+			break;
+#ifdef unix
+		__sync_fetch_and_add (&mgr->latchdeployed, -1);
+#else
+		_InterlockedDecrement (&mgr->latchdeployed);
+#endif
+	}
+
+	bt_spinreleasewrite (mgr->resize);
+	return 0;
+}
+
+//	grow the pool when it misses too often, shrink it
+//	when it hardly misses at all
+
+void bt_pooladjust (BtDb *bt)
+{
+BtLatchMgr *mgr = bt->latchmgr;
+uint limit = mgr->latchlimit;
+uint rate;
+
+	rate = (bt->stats.misses - bt->window) * 1000 / BT_window;
+	bt->window = bt->stats.misses;
+
+	if( bt->growrate && rate > bt->growrate && limit < mgr->latchtotal )
+		bt_poolresize (bt, limit + limit / 4);
+	else if( bt->shrinkrate && rate < bt->shrinkrate && limit > BT_poolmin )
+		bt_poolresize (bt, limit - limit / 8);
+	else if( mgr->latchdeployed >= limit )
+		bt_poolresize (bt, limit);
+}
+
+//	let the pool size follow the miss rate, the rates
+//	are misses per thousand pins, zero turns it off
+
+void bt_pooladapt (BtDb *bt, uint growrate, uint shrinkrate)
+{
+	bt->growrate = growrate;
+	bt->shrinkrate = shrinkrate;
+	bt->window = bt->stats.misses;
+}
+
+//	copy the pool statistics
+
+void bt_poolstats (BtDb *bt, BtPoolStat *stat)
+{
+BtLatchMgr *mgr = bt->latchmgr;
+uint slot, max, lvl;
+BtPage page;
+
+	*stat = bt->stats;
+	stat->waits = bt_latchwaits;
+	stat->parks = bt_latchparks;
+	stat->waitns = bt_latchwaitns;
+	stat->limit = mgr->latchlimit;
+	stat->total = mgr->latchtotal;
+	stat->deployed = mgr->latchdeployed;
+	stat->safelevel = mgr->safelevel;
+	stat->dirty = 0;
+
+	for( lvl = 0; lvl < MAX_lvl; lvl++ )
+		stat->census[lvl] = mgr->cache[lvl];
+
+	max = mgr->latchdeployed;
+	if( max >= mgr->latchtotal )
+		max = mgr->latchtotal - 1;
+
+	for( slot = 1; slot <= max; slot++ ) {
+		page = (BtPage)((uid)slot * bt->page_size + bt->pagepool);
+		if( bt->latchsets[slot].page_no && page->dirty )
+			stat->dirty++;
+	}
+}
+
+//	print the pool statistics
+
+void bt_pooldump (BtDb *bt, FILE *fp)
+{
+BtPoolStat stat[1];
+uint lvl;
+
+	bt_poolstats (bt, stat);
+
+	fprintf (fp, "pool: %u of %u entries, %u deployed, %u dirty\n", stat->limit, stat->total, stat->deployed, stat->dirty);
+	fprintf (fp, "pins: %llu, hits: %llu, misses: %llu", stat->pins, stat->hits, stat->misses);
+	fprintf (fp, ", hit rate: %.1f%%\n", stat->pins ? stat->hits * 100.0 / stat->pins : 0.0);
+	fprintf (fp, "evictions: %llu, writes: %llu, scans: %llu, maps: %llu, resizes: %llu\n", stat->evictions, stat->writes, stat->scans, stat->maps, stat->resizes);
+	fprintf (fp, "latch waits: %llu, parked: %llu, waited %.1f ms\n", stat->waits, stat->parks, stat->waitns / 1000000.0);
+	fprintf (fp, "census:");
+
+	for( lvl = 0; lvl < MAX_lvl; lvl++ )
+		if( stat->census[lvl] )
+			fprintf (fp, " %u:%u", lvl, stat->census[lvl]);
+
+	fprintf (fp, ", evicting up to level %u\n", stat->safelevel);
+}
+
+//	close and release memory
+
+void bt_close (BtDb *bt)
+{
+#ifdef unix
+	munmap (bt->table, bt->latchmgr->nlatchpage * bt->page_size);
+	munmap (bt->latchmgr, bt->page_size);
+#else
+	FlushViewOfFile(bt->latchmgr, 0);
+	UnmapViewOfFile(bt->latchmgr);
+	CloseHandle(bt->halloc);
+#endif
+#ifdef unix
+	if( bt->mem )
+		free (bt->mem);
+	if( bt->logbuf )
+		free (bt->logbuf);
+	if( bt->postbuf )
+		free (bt->postbuf);
+	if( bt->keydata )
+		free (bt->keydata);
+	if( bt->name )
+		free (bt->name);
+	if( bt->logfd[0] >= 0 )
+		close (bt->logfd[0]);
+	if( bt->logfd[1] >= 0 )
+		close (bt->logfd[1]);
+	close (bt->idx);
+	free (bt);
+#else
+	if( bt->mem)
+		VirtualFree (bt->mem, 0, MEM_RELEASE);
+	if( bt->logbuf )
+		free (bt->logbuf);
+	if( bt->postbuf )
+		free (bt->postbuf);
+	if( bt->keydata )
+		free (bt->keydata);
+	if( bt->name )
+		free (bt->name);
+	FlushFileBuffers(bt->idx);
+	CloseHandle(bt->idx);
+	GlobalFree (bt);
+#endif
+}
+//  open/create new btree
+
+//	call with file_name, BT_openmode, bits in page size (e.g. 16),
+//		size of mapped page pool (e.g. 8192)
+
+//	BT_pk creates a file with packed pages, an existing file
+//	keeps the choice it was created with. A file from before
+//	the version was kept is version 0, it has plain pages, and
+//	keys of version 0 and 1 files are at most 255 bytes. A file
+//	of a later version is refused.
+
+BtDb *bt_open (char *name, uint mode, uint bits, uint nodemax)
+{
+uint lvl, last, nxt;
+uint nlatchpage, latchhash;
+BtLatchMgr *latchmgr;
+off64_t size;
+uint amt[1];
+BtKey key;
+BtDb* bt;
+int flag;
+int stat;
+int flags = O_RDWR;
+int xmode = (S_IRWXU | S_IRWXG);
+int create = (O_RDWR | O_CREAT);
+
+#ifndef unix
+OVERLAPPED ovl[1];
+#else
+struct flock lock[1];
+#endif
+
+	// determine sanity of page size and buffer pool
+
+	if( bits > BT_maxbits )
+		bits = BT_maxbits;
+	else if( bits < BT_minbits )
+		bits = BT_minbits;
+
+	if( mode == BT_ro ) {
+		fprintf(stderr, "ReadOnly mode not supported: %s\n", name);
+		return NULL;
+	}
+#ifdef unix
+	bt = calloc (1, sizeof(BtDb));
+	bt->logfd[0] = bt->logfd[1] = -1;
+	bt->name = strdup (name);
+
+    errno = 0;
+    stat = access(name, (R_OK | W_OK));
+    if ((stat < 0) && (errno != ENOENT)) {
+
+		fprintf(stderr, "unable to open %s, errno: %s\n", name, strerror(errno));
+		return free(bt->name), free(bt), NULL;
+
+    }
+    if (stat == 0) {
+
+        bt->idx = open((char*)name, flags, xmode);
+
+    } else {
+
+        bt->idx = open((char*)name, create, xmode);
+
+    }
+
+    posix_fadvise( bt->idx, 0, 0, POSIX_FADV_RANDOM);
+ 
+	if( bt->idx == -1 ) {
+		fprintf(stderr, "unable to open %s\n", name);
+		return free(bt->name), free(bt), NULL;
+	}
+#else
+	bt = GlobalAlloc (GMEM_FIXED|GMEM_ZEROINIT, sizeof(BtDb));
+	bt->name = _strdup (name);
+	attr = FILE_ATTRIBUTE_NORMAL;
+	bt->idx = CreateFile(name, GENERIC_READ| GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, attr, NULL);
+
+	if( bt->idx == INVALID_HANDLE_VALUE ) {
+		fprintf(stderr, "unable to open %s\n", name);
+		return GlobalFree(bt), NULL;
+	}
+#endif
+#ifdef unix
+	memset (lock, 0, sizeof(lock));
+	lock->l_len = sizeof(struct BtPage_);
+	lock->l_type = F_WRLCK;
+
+	if( fcntl (bt->idx, BT_setlkw, lock) < 0 ) {
+		fprintf(stderr, "unable to lock record zero %s\n", name);
+		return bt_close (bt), NULL;
+	}
+#else
+	memset (ovl, 0, sizeof(ovl));
+
+	//	use large offsets to
+	//	simulate advisory locking
+
+	ovl->OffsetHigh |= 0x80000000;
+
+	if( !LockFileEx (bt->idx, LOCKFILE_EXCLUSIVE_LOCK, 0, sizeof(struct BtPage_), 0L, ovl) ) {
+		fprintf(stderr, "unable to lock record zero %s, GetLastError = %d\n", name, GetLastError());
+		return bt_close (bt), NULL;
+	}
+#endif 
+
+#ifdef unix
+	latchmgr = valloc (BT_maxpage);
+	*amt = 0;
+
+	// read minimum page size to get root info
+
+	if(( size = lseek (bt->idx, 0L, 2) )) {
+		if(( pread(bt->idx, latchmgr, BT_minpage, 0) == BT_minpage )) {
+			bits = latchmgr->alloc->bits;
+		} else {
+			fprintf(stderr, "Unable to read page zero\n");
+			return free(bt->name), free(bt), free(latchmgr), NULL;
+		}
+	}
+#else
+	latchmgr = VirtualAlloc(NULL, BT_maxpage, MEM_COMMIT, PAGE_READWRITE);
+	size = GetFileSize(bt->idx, amt);
+
+	if( size || *amt ) {
+		if( !ReadFile(bt->idx, (char *)latchmgr, BT_minpage, amt, NULL) ) {
+			fprintf(stderr, "Unable to read page zero\n");
+			return bt_close (bt), NULL;
+		} else
+			bits = latchmgr->alloc->bits;
+	}
+#endif
+
+	bt->page_size = 1 << bits;
+	bt->page_bits = bits;
+
+	bt->mode = mode;
+
+	if( size || *amt ) {
+		if( latchmgr->version > BT_version ) {
+			fprintf(stderr, "btree file format %d is newer than %d: %s\n", latchmgr->version, BT_version, name);
+#ifdef unix
+			close (bt->idx);
+			return free(bt->name), free(bt), free(latchmgr), NULL;
+#else
+			CloseHandle(bt->idx);
+			VirtualFree (latchmgr, 0, MEM_RELEASE);
+			return free(bt->name), GlobalFree(bt), NULL;
+#endif
+		}
+		nlatchpage = latchmgr->nlatchpage;
+		goto btlatch;
+	}
+
+	if( nodemax < 16 ) {
+		fprintf(stderr, "Buffer pool too small: %d\n", nodemax);
+		return bt_close(bt), NULL;
+	}
+
+	// initialize an empty b-tree with latch page, root page, page of leaves
+	// and page(s) of latches and page pool cache
+
+	memset (latchmgr, 0, 1 << bits);
+	latchmgr->alloc->bits = bt->page_bits;
+	latchmgr->version = BT_version;
+	latchmgr->pack = mode == BT_pk;
+
+	//  calculate number of latch hash table entries
+
+	nlatchpage = (nodemax/16 * sizeof(BtHashEntry) + bt->page_size - 1) / bt->page_size;
+	latchhash = nlatchpage * bt->page_size / sizeof(BtHashEntry);
+
+	nlatchpage += nodemax;		// size of the buffer pool in pages
+	nlatchpage += (sizeof(BtLatchSet) * nodemax + bt->page_size - 1)/bt->page_size;
+
+	bt_putid(latchmgr->alloc->right, MIN_lvl+1+nlatchpage);
+	latchmgr->nlatchpage = nlatchpage;
+	latchmgr->latchtotal = nodemax;
+	latchmgr->latchhash = latchhash;
+
+	if( bt_writepage (bt, latchmgr->alloc, 0) ) {
+		fprintf (stderr, "Unable to create btree page zero\n");
+		return bt_close (bt), NULL;
+	}
+
+	memset (latchmgr, 0, 1 << bits);
+	latchmgr->alloc->bits = bt->page_bits;
+	latchmgr->alloc->pack = mode == BT_pk;
+	latchmgr->alloc->longkeys = 1;
+
+	//	a packed page starts with no prefix, the length
+	//	byte at the end of the page is left zero
+
+	nxt = bt->page_size - 3 - latchmgr->alloc->pack;
+
+	for( lvl=MIN_lvl; lvl--; ) {
+		last = MIN_lvl - lvl;	// page number
+		slotptr(latchmgr->alloc, 1)->off = nxt;
+		bt_putid(slotptr(latchmgr->alloc, 1)->id, lvl ? last + 1 : 0);
+		key = keyptr(latchmgr->alloc, 1);
+		key->len = 2;		// create stopper key
+		key->key[0] = 0xff;
+		key->key[1] = 0xff;
+
+		latchmgr->alloc->min = nxt;
+		latchmgr->alloc->lvl = lvl;
+		latchmgr->alloc->cnt = 1;
+		latchmgr->alloc->act = 1;
+
+		if( bt_writepage (bt, latchmgr->alloc, last) ) {
+			fprintf (stderr, "Unable to create btree page %.8x\n", last);
+			return bt_close (bt), NULL;
+		}
+	}
+
+	// clear out buffer pool pages
+
+	memset(latchmgr, 0, bt->page_size);
+	last = MIN_lvl + nlatchpage;
+
+	if( bt_writepage (bt, latchmgr->alloc, last) ) {
+		fprintf (stderr, "Unable to write buffer pool page %.8x\n", last);
+		return bt_close (bt), NULL;
+	}
+		
+#ifdef unix
+	free (latchmgr);
+#else
+	VirtualFree (latchmgr, 0, MEM_RELEASE);
+#endif
+
+btlatch:
+#ifndef unix
+	if( !UnlockFileEx (bt->idx, 0, sizeof(struct BtPage_), 0, ovl) ) {
+		fprintf (stderr, "Unable to unlock page zero, GetLastError = %d\n", GetLastError());
+		return bt_close (bt), NULL;
+	}
+#endif
+#ifdef unix
+	flag = PROT_READ | PROT_WRITE;
+	bt->latchmgr = mmap (0, bt->page_size, flag, MAP_SHARED, bt->idx, ALLOC_page * bt->page_size);
+	if( bt->latchmgr == MAP_FAILED ) {
+		fprintf (stderr, "Unable to mmap page zero, errno = %d", errno);
+		return bt_close (bt), NULL;
+	}
+	bt->table = (void *)mmap (0, (uid)nlatchpage * bt->page_size, flag, MAP_SHARED, bt->idx, LATCH_page * bt->page_size);
+	if( bt->table == MAP_FAILED ) {
+		fprintf (stderr, "Unable to mmap buffer pool, errno = %d", errno);
+		return bt_close (bt), NULL;
+	}
+	madvise (bt->table, (uid)nlatchpage << bt->page_bits, MADV_RANDOM | MADV_WILLNEED);
+#else
+	flag = PAGE_READWRITE;
+	bt->halloc = CreateFileMapping(bt->idx, NULL, flag, 0, ((uid)nlatchpage + LATCH_page) * bt->page_size, NULL);
+	if( !bt->halloc ) {
+		fprintf (stderr, "Unable to create file mapping for buffer pool mgr, GetLastError = %d\n", GetLastError());
+		return bt_close (bt), NULL;
+	}
+
+	flag = FILE_MAP_WRITE;
+	bt->latchmgr = MapViewOfFile(bt->halloc, flag, 0, 0, ((uid)nlatchpage + LATCH_page) * bt->page_size);
+	if( !bt->latchmgr ) {
+		fprintf (stderr, "Unable to map buffer pool, GetLastError = %d\n", GetLastError());
+		return bt_close (bt), NULL;
+	}
+
+	bt->table = (void *)((char *)bt->latchmgr + LATCH_page * bt->page_size);
+#endif
+	bt->pagepool = (unsigned char *)bt->table + (uid)(nlatchpage - bt->latchmgr->latchtotal) * bt->page_size;
+	bt->latchsets = (BtLatchSet *)(bt->pagepool - (uid)bt->latchmgr->latchtotal * sizeof(BtLatchSet));
+
+	//	a new pool uses all of its latch entries
+
+	if( !bt->latchmgr->latchlimit || bt->latchmgr->latchlimit > bt->latchmgr->latchtotal )
+		bt->latchmgr->latchlimit = bt->latchmgr->latchtotal;
+
+#ifdef unix
+	bt->mem = valloc (2 * bt->page_size);
+#else
+	bt->mem = VirtualAlloc(NULL, 2 * bt->page_size, MEM_COMMIT, PAGE_READWRITE);
+#endif
+	bt->frame = (BtPage)bt->mem;
+	bt->cursor = (BtPage)(bt->mem + bt->page_size);
+#ifdef unix
+	// recover from the redo log if we are the only
+	// user, then let others open the btree
+
+	if( bt_logopen (bt) ) {
+		fprintf (stderr, "Unable to open the redo log for %s\n", name);
+		return bt_close (bt), NULL;
+	}
+
+	lock->l_type = F_UNLCK;
+	if( fcntl (bt->idx, BT_setlk, lock) < 0 ) {
+		fprintf (stderr, "Unable to unlock page zero\n");
+		return bt_close (bt), NULL;
+	}
+#endif
+	return bt;
+}
+
+// place write, read, or parent lock on requested page_no.
+
+void bt_lockpage(BtLock mode, BtLatchSet *latch)
+{
+	switch( mode ) {
+	case BtLockRead:
+		ReadLock (latch->readwr);
+		break;
+	case BtLockWrite:
+		WriteLock (latch->readwr);
+		break;
+	case BtLockAccess:
+		ReadLock (latch->access);
+		break;
+	case BtLockDelete:
+		WriteLock (latch->access);
+		break;
+	case BtLockParent:
+		WriteLock (latch->parent);
+		break;
+	}
+}
+
+// remove write, read, or parent lock on requested page
+
+void bt_unlockpage(BtLock mode, BtLatchSet *latch)
+{
+	switch( mode ) {
+	case BtLockRead:
+		ReadRelease (latch->readwr);
+		break;
+	case BtLockWrite:
+		WriteRelease (latch->readwr);
+		break;
+	case BtLockAccess:
+		ReadRelease (latch->access);
+		break;
+	case BtLockDelete:
+		WriteRelease (latch->access);
+		break;
+	case BtLockParent:
+		WriteRelease (latch->parent);
+		break;
+	}
+}
+
+//	allocate a new page and write page into it
+
+uid bt_newpage(BtDb *bt, BtPage page)
+{
+BtLatchSet *latch;
+uid new_page;
+BtPage temp;
+
+	//	lock allocation page
+
+	bt_spinwritelock(bt->latchmgr->lock);
+
+	// use empty chain first
+	// else allocate empty page
+
+	if(( new_page = bt_getid(bt->latchmgr->alloc[1].right) )) {
+	  if(( latch = bt_pinlatch (bt, new_page) )) {
+	  	temp = bt_mappage (bt, latch);
+	  } else {
+		return 0;
+      }
+
+	  bt_putid(bt->latchmgr->alloc[1].right, bt_getid(temp->right));
+	  bt_spinreleasewrite(bt->latchmgr->lock);
+	  memcpy (temp, page, bt->page_size);
+
+	  bt_update (bt, temp);
+	  bt_unpinlatch (latch);
+	  return new_page;
+	} else {
+	  new_page = bt_getid(bt->latchmgr->alloc->right);
+	  bt_putid(bt->latchmgr->alloc->right, new_page+1);
+	  bt_spinreleasewrite(bt->latchmgr->lock);
+
+	  if( bt_logpage (bt, page, new_page) )
+		return 0;
+
+	  if(( bt_writepage (bt, page, new_page) )) {
+		return 0;
+      }
+	}
+
+	bt_update (bt, bt->latchmgr->alloc);
+	return new_page;
+}
+
+//  compare two keys, returning > 0, = 0, or < 0
+//  as the comparison value
+
+int keycmp (BtKey key1, unsigned char *key2, uint len2)
+{
+uint len1 = key1->len;
+int ans;
+
+	if(( ans = memcmp (key1->key, key2, len1 > len2 ? len2 : len1) )) {
+		return ans;
+    }
+
+	if(( len1 > len2 )) {
+		return 1;
+    }
+
+	if(( len1 < len2 )) {
+		return -1;
+    }
+
+	return 0;
+}
+
+//	number of leading bytes two keys share
+
+uint bt_lcp (unsigned char *key1, uint len1, unsigned char *key2, uint len2)
+{
+uint idx = 0;
+
+	while( idx < len1 && idx < len2 && key1[idx] == key2[idx] )
+		idx++;
+
+	return idx;
+}
+
+//	compare up to len bytes of an overflow chain with a key
+
+int bt_chaincmp (BtDb *bt, uid page_no, unsigned char *key, uint len)
+{
+BtLatchSet *latch;
+uint amt, off = 0;
+BtPage page;
+int ans = 0;
+
+	while( page_no && off < len && !ans ) {
+		if( !(latch = bt_pinlatch (bt, page_no)) )
+			return 0;
+
+		bt_lockpage (BtLockRead, latch);
+		page = bt_mappage (bt, latch);
+
+		amt = bt->page_size - page->min;
+		if( amt > len - off )
+			amt = len - off;
+
+		ans = memcmp ((unsigned char *)page + page->min, key + off, amt);
+		page_no = bt_getid(page->right);
+		off += amt;
+
+		bt_unlockpage (BtLockRead, latch);
+		bt_unpinlatch (latch);
+	}
+
+	return ans;
+}
+
+//	compare a long key with a key, the head in the
+//	page first, then the rest in its overflow pages
+
+int bt_longcmp (BtDb *bt, BtKey ptr, unsigned char *key, uint len)
+{
+BtOvfl *ovfl = keyovfl(ptr);
+uint total = bt_ovfllen (ovfl);
+int ans;
+
+	if(( ans = memcmp (ptr->key, key, len > BT_keyhead ? BT_keyhead : len) ))
+		return ans;
+
+	//	a long key is longer than its head
+
+	if( len <= BT_keyhead )
+		return 1;
+
+	if(( ans = bt_chaincmp (bt, bt_getid(ovfl->page), key + BT_keyhead, (len < total ? len : total) - BT_keyhead) ))
+		return ans;
+
+	if( total > len )
+		return 1;
+
+	if( total < len )
+		return -1;
+
+	return 0;
+}
+
+//	compare the key of a slot with a key, the prefix
+//	of a packed page first, then the rest of the key
+
+int bt_slotcmp (BtDb *bt, BtPage page, uint slot, unsigned char *key, uint len)
+{
+BtKey ptr = keyptr(page, slot);
+uint pfx = pfxlen(page);
+int ans;
+
+	if(( ans = memcmp (pfxptr(page), key, pfx > len ? len : pfx) ))
+		return ans;
+
+	if( len < pfx )
+		return 1;
+
+	if( longkey(page, ptr) )
+		return bt_longcmp (bt, ptr, key, len);
+
+	return keycmp (ptr, key + pfx, len - pfx);
+}
+
+//	the bytes of the key of a slot that are kept in
+//	the page after the page prefix, a long key has
+//	no more than its head there
+
+unsigned char *bt_keyview (BtPage page, uint slot, uint *len)
+{
+BtKey ptr = keyptr(page, slot);
+uint pfx = pfxlen(page);
+
+	if( !longkey(page, ptr) ) {
+		*len = ptr->len;
+		return ptr->key;
+	}
+
+	if( pfx > BT_keyhead )
+		pfx = BT_keyhead;
+
+	*len = BT_keyhead - pfx;
+	return ptr->key + pfx;
+}
+
+//	copy the whole key of a slot to buf, as a
+//	length byte and the key, return the length.
+//	A long key is cut to its head.
+
+uint bt_getkey (BtPage page, uint slot, unsigned char *buf)
+{
+uint pfx = pfxlen(page);
+BtKey ptr = keyptr(page, slot);
+
+	if( longkey(page, ptr) ) {
+		buf[0] = BT_keyhead;
+		memcpy (buf + 1, ptr->key, BT_keyhead);
+		return buf[0];
+	}
+
+	buf[0] = pfx + ptr->len;
+	memcpy (buf + 1, pfxptr(page), pfx);
+	memcpy (buf + 1 + pfx, ptr->key, ptr->len);
+	return buf[0];
+}
+
+//	the whole key of a slot and its length. It is
+//	put in buf, which has room for 256 bytes, unless
+//	it is a long key, that is read into memory the
+//	caller frees. NULL if it can't be read.
+
+unsigned char *bt_wholekey (BtDb *bt, BtPage page, uint slot, unsigned char *buf, uint *len)
+{
+BtKey ptr = keyptr(page, slot);
+unsigned char *key;
+
+	if( !longkey(page, ptr) ) {
+		*len = bt_getkey (page, slot, buf);
+		return buf + 1;
+	}
+
+	*len = bt_ovfllen (keyovfl(ptr));
+
+	if( !(key = malloc (*len)) ) {
+		bt->err = BTERR_ovflw;
+		return NULL;
+	}
+
+	memcpy (key, ptr->key, BT_keyhead);
+
+	if( bt_readchain (bt, bt_getid(keyovfl(ptr)->page), key + BT_keyhead, *len - BT_keyhead) ) {
+		free (key);
+		return NULL;
+	}
+
+	return key;
+}
+
+//	write a long key at ptr, the rest of
+//	it is in the overflow chain
+
+void bt_putlong (BtKey ptr, unsigned char *key, uint len, uid chain)
+{
+	ptr->len = BT_keylong;
+	memcpy (ptr->key, key, BT_keyhead);
+	bt_putovfllen (keyovfl(ptr), len);
+	bt_putid(keyovfl(ptr)->page, chain);
+}
+
+//	free the overflow pages of a long key
+//	that is taken off its page
+
+BTERR bt_freekey (BtDb *bt, BtPage page, uint slot)
+{
+BtKey ptr = keyptr(page, slot);
+
+	if( !longkey(page, ptr) )
+		return 0;
+
+	return bt_freechain (bt, bt_getid(keyovfl(ptr)->page));
+}
+
+//	length of the prefix the keys of slots first thru
+//	last share, the keys are in order so it is the one
+//	the two of them share. A plain page keeps none.
+
+uint bt_prefix (BtPage page, uint first, uint last)
+{
+unsigned char *key1, *key2;
+uint len1, len2;
+
+	if( !page->pack )
+		return 0;
+
+	key1 = bt_keyview (page, first, &len1);
+	key2 = bt_keyview (page, last, &len2);
+	return pfxlen(page) + bt_lcp (key1, len1, key2, len2);
+}
+
+//	number of value bytes after a leaf key
+
+uint bt_valsize (BtPage page, uint slot)
+{
+uid id = bt_getid(slotptr(page, slot)->id);
+
+	if( page->lvl || !(id & BT_value) )
+		return 0;
+
+	return id & BT_vmask;
+}
+
+//	first overflow page of a leaf value, or zero
+
+uid bt_ovflpage (BtPage page, uint slot)
+{
+BtOvfl *ovfl;
+
+	if( page->lvl || !(bt_getid(slotptr(page, slot)->id) & BT_ovfl) )
+		return 0;
+
+	ovfl = (BtOvfl *)valptr(page, slot);
+	return bt_getid(ovfl->page);
+}
+
+//	copy the keys of slots first thru last of src, with
+//	their values, to the empty page dest. A dead key is
+//	left behind, unless it is the last one, the fence. A
+//	packed dest keeps the first pfx bytes of the keys once.
+//	Return the slot in dest of the key at slot in src.
+
+uint bt_copykeys (BtDb *bt, BtPage dest, BtPage src, uint first, uint last, uint pfx, uint slot)
+{
+unsigned char *base = (unsigned char *)dest;
+uint spfx = pfxlen(src), nxt = bt->page_size;
+uint cnt, idx = 0, newslot = slot, len, vlen;
+unsigned char *view;
+BtKey key;
+
+	//	the new prefix is the old one, cut short or with
+	//	more of the keys, which the fence has in the page
+
+	if( dest->pack ) {
+		nxt -= pfx + 1;
+		len = pfx < spfx ? pfx : spfx;
+		memcpy (base + nxt, pfxptr(src), len);
+		view = bt_keyview (src, last, &vlen);
+		memcpy (base + nxt + len, view, pfx - len);
+		base[bt->page_size - 1] = pfx;
+	} else
+		pfx = 0;
+
+	dest->act = 0;
+
+	for( cnt = first; cnt <= last; cnt++ ) {
+		if( cnt == slot )
+			newslot = idx + 1;
+
+		//	the overflow pages of a long key go with it,
+		//	a failure leaves them behind
+
+		if( cnt < last && slotptr(src, cnt)->dead ) {
+			bt_freekey (bt, src, cnt);
+			continue;
+		}
+
+		key = keyptr(src, cnt);
+		vlen = bt_valsize (src, cnt);
+
+		//	a long key has its whole head, it is copied as
+		//	it is, others gain or lose the bytes between the
+		//	two prefixes, the value is copied as it is
+
+		if( longkey(src, key) ) {
+			nxt -= keysize(src, key) + vlen;
+			memcpy (base + nxt, key, keysize(src, key) + vlen);
+		} else {
+			len = spfx + key->len - pfx;
+			nxt -= len + 1 + vlen;
+			base[nxt] = len;
+
+			if( pfx < spfx ) {
+				memcpy (base + nxt + 1, pfxptr(src) + pfx, spfx - pfx);
+				memcpy (base + nxt + 1 + spfx - pfx, key->key, key->len + vlen);
+			} else
+				memcpy (base + nxt + 1, key->key + pfx - spfx, len + vlen);
+		}
+
+		memcpy(slotptr(dest, ++idx)->id, slotptr(src, cnt)->id, BtId);
+		if( !(slotptr(dest, idx)->dead = slotptr(src, cnt)->dead) )
+			dest->act++;
+#ifdef USETOD
+		slotptr(dest, idx)->tod = slotptr(src, cnt)->tod;
+#endif
+		slotptr(dest, idx)->off = nxt;
+	}
+
+	dest->min = nxt;
+	dest->cnt = idx;
+	return newslot;
+}
+
+//  Update current page of btree by
+//	flushing mapped area to disk backing of cache pool.
+//	mark page as dirty for rewrite to permanent location
+
+void bt_update (BtDb *bt, BtPage page)
+{
+uid page_no = ALLOC_page;
+
+	//	when the btree is logged, the page is logged before
+	//	it is marked dirty, so a dirty page always has an
+	//	image in the log. A failed append is kept in logerr.
+
+	if( bt->latchmgr->logged ) {
+	  if( page != bt->latchmgr->alloc )
+		page_no = bt->latchsets[((unsigned char *)page - bt->pagepool) >> bt->page_bits].page_no;
+
+	  bt_logpage (bt, page, page_no);
+	}
+#ifdef unix
+	msync (page, bt->page_size, MS_ASYNC);
+#else
+//	FlushViewOfFile (page, bt->page_size);
+#endif
+	page->dirty = 1;
+}
+
+//  map the btree cached page onto current page
+
+BtPage bt_mappage (BtDb *bt, BtLatchSet *latch)
+{
+	bt->stats.maps++;
+	return (BtPage)((uid)(latch - bt->latchsets) * bt->page_size + bt->pagepool);
+}
+
+//	deallocate a deleted page 
+//	place on free chain out of allocator page
+//	call with page latched for Writing and Deleting
+
+BTERR bt_freepage(BtDb *bt, uid page_no, BtLatchSet *latch)
+{
+BtPage page = bt_mappage (bt, latch);
+
+	//	lock allocation page
+
+	bt_spinwritelock (bt->latchmgr->lock);
+
+	//	store chain in second right
+	bt_putid(page->right, bt_getid(bt->latchmgr->alloc[1].right));
+	bt_putid(bt->latchmgr->alloc[1].right, page_no);
+
+	page->free = 1;
+	bt_update(bt, page);
+
+	// unlock released page
+
+	bt_unlockpage (BtLockDelete, latch);
+	bt_unlockpage (BtLockWrite, latch);
+	bt_unpinlatch (latch);
+
+	// unlock allocation page
+
+	bt_spinreleasewrite (bt->latchmgr->lock);
+	bt_update (bt, bt->latchmgr->alloc);
+	return 0;
+}
+
+//  find slot in page for given key at a given level
+
+int bt_findslot (BtDb *bt, unsigned char *key, uint len)
+{
+uint diff, higher = bt->page->cnt, low = 1, slot;
+uint pfx = pfxlen(bt->page), good = 0;
+unsigned char *whole = key;
+uint wholelen = len;
+BtKey ptr;
+int ans;
+
+	//	make stopper key an infinite fence value
+
+	if(( bt_getid (bt->page->right) )) {
+		higher++;
+	} else {
+		good++;
+    }
+
+	//	the prefix of a packed page is compared once, a key
+	//	without it sorts before or after all the keys, the
+	//	rest of a key with it is compared with the slots
+
+	if(( pfx )) {
+		if( !(ans = memcmp (pfxptr(bt->page), key, pfx > len ? len : pfx)) && len < pfx )
+			ans = 1;
+
+		if(( ans > 0 )) {
+			return 1;
+		} else if(( ans < 0 )) {
+			return good ? higher : 0;
+		}
+
+		key += pfx;
+		len -= pfx;
+	}
+
+	//	low is the lowest candidate, higher is already
+	//	tested as .ge. the given key, loop ends when they meet.
+	//	A long key is compared whole.
+
+	while(( diff = higher - low )) {
+		slot = low + ( diff >> 1 );
+		ptr = keyptr(bt->page, slot);
+
+		if( longkey(bt->page, ptr) )
+			ans = bt_longcmp (bt, ptr, whole, wholelen);
+		else
+			ans = keycmp (ptr, key, len);
+
+		if(( ans < 0 )) {
+			low = slot + 1;
+		} else {
+			higher = slot, good++;
+        }
+	}
+
+	//	return zero if key is on right link page
+
+ 	return good ? higher : 0;
+}
+
+//  find and load page at given level for given key
+//	leave page rd or wr locked as requested
+
+int bt_loadpage (BtDb *bt, unsigned char *key, uint len, uint lvl, uint lock)
+{
+uid page_no = ROOT_page, prevpage = 0;
+uint drill = 0xff, slot;
+BtLatchSet *prevlatch;
+uint mode, prevmode;
+
+  //  start at root of btree and drill down
+
+  do {
+	// determine lock mode of drill level
+	mode = (lock == BtLockWrite) && (drill == lvl) ? BtLockWrite : BtLockRead; 
+
+	if(( bt->latch = bt_pinlatch(bt, page_no) )) {
+		bt->page_no = page_no;
+	} else {
+		return 0;
+    }
+
+ 	// obtain access lock using lock chaining
+
+	if(( page_no > ROOT_page )) {
+		bt_lockpage(BtLockAccess, bt->latch);
+    }
+
+	if(( prevpage )) {
+		bt_unlockpage(prevmode, prevlatch);
+		bt_unpinlatch(prevlatch);
+		prevpage = 0;
+	}
+
+ 	// obtain read lock using lock chaining
+
+	bt_lockpage(mode, bt->latch);
+
+	if(( page_no > ROOT_page )) {
+		bt_unlockpage(BtLockAccess, bt->latch);
+    }
+
+	//	map/obtain page contents
+
+	bt->page = bt_mappage (bt, bt->latch);
+
+	// re-read and re-lock root after determining actual level of root
+
+	if(( bt->page->lvl != drill)) {
+		if(( bt->page_no != ROOT_page )) {
+			return bt->err = BTERR_struct, 0;
+        }
+			
+		drill = bt->page->lvl;
+
+		if(( lock != BtLockRead && drill == lvl )) {
+			bt_unlockpage(mode, bt->latch);
+			bt_unpinlatch(bt->latch);
+			continue;
+		}
+	}
+
+	prevpage = bt->page_no;
+	prevlatch = bt->latch;
+	prevmode = mode;
+
+	//  find key on page at this level
+	//  and descend to requested level
+
+	if(( !bt->page->kill )) {
+	 if(( slot = bt_findslot (bt, key, len) )) {
+	  if(( drill == lvl )) {
+		return slot;
+      }
+
+	  while( slotptr(bt->page, slot)->dead ) {
+		if(( slot++ < bt->page->cnt )) {
+			continue;
+		} else {
+			goto slideright;
+        }
+      }
+
+	  page_no = bt_getid(slotptr(bt->page, slot)->id);
+	  drill--;
+	  continue;
+	 }
+    }
+
+	//  or slide right into next page
+
+slideright:
+	page_no = bt_getid(bt->page->right);
+
+  } while( page_no );
+
+  // return error on end of right chain
+
+  bt->err = BTERR_eof;
+  return 0;	// return error
+}
+
+//	a fence key was deleted from a page
+//	push new fence value upwards
+
+BTERR bt_fixfence (BtDb *bt, uid page_no, uint lvl)
+{
+unsigned char leftbuf[256], rightbuf[256];
+unsigned char *leftkey, *rightkey;
+BtLatchSet *latch = bt->latch;
+uint leftlen, rightlen;
+BTERR err = 0;
+
+	// remove deleted key, the old fence value
+
+	if( !(rightkey = bt_wholekey (bt, bt->page, bt->page->cnt, rightbuf, &rightlen)) )
+		return bt->err;
+
+	if( !(leftkey = bt_wholekey (bt, bt->page, bt->page->cnt - 1, leftbuf, &leftlen)) ) {
+		if( rightkey != rightbuf + 1 )
+			free (rightkey);
+		return bt->err;
+	}
+
+	bt_freekey (bt, bt->page, bt->page->cnt);
+	memset (slotptr(bt->page, bt->page->cnt--), 0, sizeof(BtSlot));
+	bt->page->clean = 1;
+
+	bt_update (bt, bt->page);
+	bt_lockpage (BtLockParent, latch);
+	bt_unlockpage (BtLockWrite, latch);
+
+	//  insert new (now smaller) fence key
+
+	if( bt_insertkey (bt, leftkey, leftlen, lvl + 1, page_no, time(NULL)) )
+		err = bt->err;
+
+	//  remove old (larger) fence key
+
+	if( !err && bt_deletekey (bt, rightkey, rightlen, lvl + 1) )
+		err = bt->err;
+
+	if( leftkey != leftbuf + 1 )
+		free (leftkey);
+
+	if( rightkey != rightbuf + 1 )
+		free (rightkey);
+
+	if( err )
+		return err;
+
+	bt_unlockpage (BtLockParent, latch);
+	bt_unpinlatch (latch);
+	return 0;
+}
+
+//	root has a single child
+//	collapse a level from the btree
+//	call with root locked in bt->page
+
+BTERR bt_collapseroot (BtDb *bt, BtPage root)
+{
+BtLatchSet *latch;
+BtPage temp;
+uid child;
+uint idx;
+
+	// find the child entry
+	//	and promote to new root
+
+  do {
+	for( idx = 0; idx++ < root->cnt; ) {
+	  if( !slotptr(root, idx)->dead ) {
+		break;
+      }
+    }
+
+	child = bt_getid (slotptr(root, idx)->id);
+	if(( latch = bt_pinlatch (bt, child) )) {
+		temp = bt_mappage (bt, latch);
+	} else {
+		return bt->err;
+    }
+
+	bt_lockpage (BtLockDelete, latch);
+	bt_lockpage (BtLockWrite, latch);
+
+	//	the keys of the root are replaced, the child's
+	//	keep their overflow pages
+
+	for( idx = 0; idx++ < root->cnt; )
+		bt_freekey (bt, root, idx);
+
+	memcpy (root, temp, bt->page_size);
+
+	bt_update (bt, root);
+
+	if(( bt_freepage (bt, child, latch) ))
+		return bt->err;
+
+  } while( root->lvl > 1 && root->act == 1 );
+
+  bt_unlockpage (BtLockWrite, bt->latch);
+  bt_unpinlatch (bt->latch);
+  return 0;
+}
+
+//  find and delete key on page by marking delete flag bit
+//  when page becomes empty, delete it
+
+BTERR bt_deletekey (BtDb *bt, unsigned char *key, uint len, uint lvl)
+{
+unsigned char lowerbuf[256], higherbuf[256];
+unsigned char *lowerkey, *higherkey;
+uint slot, dirty = 0, idx, fence, found;
+uint lowerlen, higherlen;
+BtLatchSet *latch, *rlatch;
+uid page_no, right, chain;
+BTERR err = 0;
+BtPage temp;
+
+	if( !lvl )
+		bt_logcheck (bt);
+
+	if( !(slot = bt_loadpage (bt, key, len, lvl, BtLockWrite)) )
+		return bt->err;
+
+	// are we deleting a fence slot?
+
+	fence = slot == bt->page->cnt;
+
+	// if key is found delete it, otherwise ignore request
+
+	if(( found = !bt_slotcmp (bt, bt->page, slot, key, len) )) {
+	  if(( found = slotptr(bt->page, slot)->dead == 0 )) {
+ 		dirty = slotptr(bt->page,slot)->dead = 1;
+ 		bt->page->clean = 1;
+ 		bt->page->act--;
+
+		// release the overflow pages of the value
+
+		if(( chain = bt_ovflpage (bt->page, slot) )) {
+		  bt_putid(slotptr(bt->page, slot)->id, bt_getid(slotptr(bt->page, slot)->id) & ~BT_ovfl);
+		  if( bt_freechain (bt, chain) )
+			return bt->err;
+		}
+
+		// collapse empty slots
+
+		while(( idx = bt->page->cnt - 1 )) {
+		  if( slotptr(bt->page, idx)->dead ) {
+			bt_freekey (bt, bt->page, idx);
+			*slotptr(bt->page, idx) = *slotptr(bt->page, idx + 1);
+			memset (slotptr(bt->page, bt->page->cnt--), 0, sizeof(BtSlot));
+		  } else {
+			break;
+          }
+        }
+	  }
+    }
+
+	right = bt_getid(bt->page->right);
+	page_no = bt->page_no;
+	latch = bt->latch;
+
+	if(( !dirty )) {
+	  if(( lvl )) {
+		return bt_abort (bt, bt->page, page_no, BTERR_notfound);
+      }
+	  bt_unlockpage(BtLockWrite, latch);
+	  bt_unpinlatch (latch);
+	  return bt->found = found, 0;
+	}
+
+	//	did we delete a fence key in an upper level?
+
+	if(( lvl && bt->page->act && fence )) {
+	  if(( bt_fixfence (bt, page_no, lvl) )) {
+		return bt->err;
+	  }else{
+		return bt->found = found, 0;
+      }
+    }
+
+	//	is this a collapsed root?
+
+	if(( lvl > 1 && page_no == ROOT_page && bt->page->act == 1 )) {
+	  if(( bt_collapseroot (bt, bt->page) )) {
+		return bt->err;
+	  }else{
+		return bt->found = found, 0;
+      }
+    }
+
+	// return if page is not empty
+
+	if(( bt->page->act )) {
+	  bt_update(bt, bt->page);
+	  bt_unlockpage(BtLockWrite, latch);
+	  bt_unpinlatch (latch);
+	  return bt->found = found, 0;
+	}
+
+	// obtain lock on right page
+
+	if(( rlatch = bt_pinlatch (bt, right) )) {
+		temp = bt_mappage (bt, rlatch);
+	} else {
+		return bt->err;
+    }
+
+	bt_lockpage(BtLockWrite, rlatch);
+
+	if(( temp->kill )) {
+		bt_abort(bt, temp, right, 0);
+		return bt_abort(bt, bt->page, bt->page_no, BTERR_kill);
+	}
+
+	// cache copy of fence key
+	//	in order to find parent
+
+	if( !(lowerkey = bt_wholekey (bt, bt->page, bt->page->cnt, lowerbuf, &lowerlen)) )
+		return bt->err;
+
+	//	cache copy of key to update
+
+	if( !(higherkey = bt_wholekey (bt, temp, temp->cnt, higherbuf, &higherlen)) ) {
+		if( lowerkey != lowerbuf + 1 )
+			free (lowerkey);
+		return bt->err;
+	}
+
+	// pull contents of next page into current empty page,
+	// the keys that are replaced are gone with their
+	// overflow pages, a failure leaves them behind
+
+	for( idx = 0; idx++ < bt->page->cnt; )
+		bt_freekey (bt, bt->page, idx);
+
+	memcpy (bt->page, temp, bt->page_size);
+
+	//  Mark right page as deleted and point it to left page
+	//	until we can post updates at higher level.
+
+	bt_putid(temp->right, page_no);
+	temp->kill = 1;
+
+	bt_update(bt, bt->page);
+	bt_update(bt, temp);
+
+	bt_lockpage(BtLockParent, latch);
+	bt_unlockpage(BtLockWrite, latch);
+
+	bt_lockpage(BtLockParent, rlatch);
+	bt_unlockpage(BtLockWrite, rlatch);
+
+	//  redirect higher key directly to consolidated node
+
+	if(( bt_insertkey (bt, higherkey, higherlen, lvl+1, page_no, time(NULL)) ))
+		err = bt->err;
+
+	//  delete old lower key to consolidated node
+
+	if(( !err && bt_deletekey (bt, lowerkey, lowerlen, lvl + 1) ))
+		err = bt->err;
+
+	if( lowerkey != lowerbuf + 1 )
+		free (lowerkey);
+
+	if( higherkey != higherbuf + 1 )
+		free (higherkey);
+
+	if( err )
+		return err;
+
+	//  obtain write & delete lock on deleted node
+	//	add right block to free chain
+
+	bt_lockpage(BtLockDelete, rlatch);
+	bt_lockpage(BtLockWrite, rlatch);
+	bt_unlockpage(BtLockParent, rlatch);
+
+	if(( bt_freepage (bt, right, rlatch) ))
+		return bt->err;
+
+	bt_unlockpage(BtLockParent, latch);
+	bt_unpinlatch(latch);
+	return 0;
+}
+
+//	find key in leaf level and return row-id
+
+uid bt_findkey (BtDb *bt, unsigned char *key, uint len)
+{
+uint  slot;
+uid id;
+
+	if( !(slot = bt_loadpage (bt, key, len, 0, BtLockRead)) )
+		return 0;
+
+	// if key exists, and isn't dead, return row-id
+	//	otherwise return 0
+
+	if(( !bt_slotcmp (bt, bt->page, slot, key, len) && !slotptr(bt->page, slot)->dead )) {
+		id = bt_getid(slotptr(bt->page,slot)->id);
+	}else{
+		id = 0;
+    }
+
+	bt_unlockpage (BtLockRead, bt->latch);
+	bt_unpinlatch (bt->latch);
+	return id;
+}
+
+//	check page for space available,
+//	clean if necessary and return
+//	0 - page needs splitting
+//	>0 - go ahead with new slot
+
+//	The key must share the prefix of a packed page, a key
+//	that doesn't packs the page again under a shorter one,
+//	if the keys still fit.
+
+uint bt_cleanpage(BtDb *bt, unsigned char *key, uint len, uint vlen, uint slot)
+{
+BtPage page = bt->page;
+uint pfx = pfxlen(page);
+uint max = page->cnt;
+uint cnt, first = 0, keep = 0, total = 0;
+uint share, most, need, size, kept = 0;
+unsigned char *view;
+BtKey ptr;
+
+	share = bt_lcp (pfxptr(page), pfx, key, len);
+
+	if( share == pfx && page->min >= (max+1) * sizeof(BtSlot) + sizeof(*page) + newsize(page, len, pfx) + vlen )
+		return slot;
+
+	//	skip cleanup if nothing to reclaim
+
+	if( share == pfx && !page->clean )
+		return 0;
+
+	//	the bytes the keys that stay take whole, keep
+	//	of them lose the prefix, long keys keep theirs
+
+	for( cnt = 1; cnt <= max; cnt++ ) {
+		// always leave fence key in list
+		if( cnt < max && slotptr(page, cnt)->dead )
+			continue;
+
+		if( !first )
+			first = cnt;
+
+		ptr = keyptr(page, cnt);
+		size = keysize(page, ptr) + bt_valsize (page, cnt);
+
+		if( !longkey(page, ptr) )
+			size += pfx, keep++;
+
+		total += size;
+		kept++;
+	}
+
+	//	the prefix they share, and how much of it
+	//	the new key shares
+
+	most = bt_prefix (page, first, max);
+
+	if( share == pfx && page->pack ) {
+		view = bt_keyview (page, first, &size);
+		share += bt_lcp (view, size, key + pfx, len - pfx);
+	}
+
+	if( share > most )
+		share = most;
+
+	need = sizeof(*page) + (kept + 1) * sizeof(BtSlot) + total - keep * share + newsize(page, len, share) + vlen;
+
+	if( page->pack )
+		need += share + 1;
+
+	if( need > bt->page_size && !page->clean )
+		return 0;
+
+	memcpy (bt->frame, page, bt->page_size);
+
+	// skip page info and set rest of page to zero
+
+	memset (page+1, 0, bt->page_size - sizeof(*page));
+
+	if( need <= bt->page_size )
+		return bt_copykeys (bt, page, bt->frame, 1, max, share, slot);
+
+	bt_copykeys (bt, page, bt->frame, 1, max, most, slot);
+	return 0;
+}
+
+// split the root and raise the height of the btree
+
+BTERR bt_splitroot(BtDb *bt, unsigned char *leftkey, uint leftlen, uid page_no2)
+{
+uint nxt = bt->page_size;
+BtPage root = bt->page;
+uid right, chain = 0;
+
+	//	a long key in the root has overflow pages of its own
+
+	if( root->longkeys && leftlen > BT_keymax )
+	  if( !(chain = bt_writechain (bt, leftkey + BT_keyhead, leftlen - BT_keyhead)) )
+		return bt->err;
+
+	//  Obtain an empty page to use, and copy the current
+	//  root contents into it
+
+	if( !(right = bt_newpage(bt, root)) ) {
+		bt_freechain (bt, chain);
+		return bt->err;
+	}
+
+	// preserve the page info at the bottom
+	// and set rest to zero, a packed root
+	// keeps no prefix
+
+	memset(root+1, 0, bt->page_size - sizeof(*root));
+	nxt -= root->pack;
+
+	// insert first key on newroot page
+
+	nxt -= newsize(root, leftlen, 0);
+
+	if( chain )
+		bt_putlong ((BtKey)((unsigned char *)root + nxt), leftkey, leftlen, chain);
+	else {
+		((unsigned char *)root)[nxt] = leftlen;
+		memcpy ((unsigned char *)root + nxt + 1, leftkey, leftlen);
+	}
+
+	bt_putid(slotptr(root, 1)->id, right);
+	slotptr(root, 1)->off = nxt;
+	
+	// insert second key on newroot page
+	// and increase the root height
+
+	nxt -= 3;
+	((unsigned char *)root)[nxt] = 2;
+	((unsigned char *)root)[nxt+1] = 0xff;
+	((unsigned char *)root)[nxt+2] = 0xff;
+	bt_putid(slotptr(root, 2)->id, page_no2);
+	slotptr(root, 2)->off = nxt;
+
+	bt_putid(root->right, 0);
+	root->min = nxt;		// reset lowest used offset and key count
+	root->cnt = 2;
+	root->act = 2;
+	root->lvl++;
+
+	// update and release root (bt->page)
+
+	bt_update(bt, root);
+
+	bt_unlockpage(BtLockWrite, bt->latch);
+	bt_unpinlatch(bt->latch);
+	return 0;
+}
+
+//  split already locked full node
+//	return unlocked.
+
+BTERR bt_splitpage (BtDb *bt)
+{
+unsigned char fencebuf[256], rightbuf[256];
+unsigned char *fencekey, *rightkey;
+uid page_no = bt->page_no, right;
+BtLatchSet *latch, *rlatch = NULL;
+BtPage page = bt->page;
+uint fencelen, rightlen;
+uint lvl = page->lvl;
+uint max = page->cnt;
+uint half = max / 2;
+BTERR err = 0;
+
+	latch = bt->latch;
+
+	//	remember fence key for new right page
+
+	if( !(rightkey = bt_wholekey (bt, page, max, rightbuf, &rightlen)) )
+		return bt->err;
+
+	//  split higher half of keys to bt->frame
+	//	the last key (fence key) might be dead
+
+	memset (bt->frame, 0, bt->page_size);
+	bt->frame->bits = bt->page_bits;
+	bt->frame->pack = page->pack;
+	bt->frame->longkeys = page->longkeys;
+	bt->frame->lvl = lvl;
+
+	bt_copykeys (bt, bt->frame, page, half + 1, max, bt_prefix (page, half + 1, max), 0);
+
+	// link right node
+
+	if( page_no > ROOT_page )
+		memcpy (bt->frame->right, page->right, BtId);
+
+	//	get new free page and write frame to it.
+
+	if( !(right = bt_newpage(bt, bt->frame)) ) {
+		if( rightkey != rightbuf + 1 )
+			free (rightkey);
+		return bt->err;
+	}
+
+	//	update lower keys to continue in old page
+
+	memcpy (bt->frame, page, bt->page_size);
+	memset (page+1, 0, bt->page_size - sizeof(*page));
+	page->clean = 0;
+
+	//  assemble page of smaller keys
+	//	(they're all active keys)
+
+	bt_copykeys (bt, page, bt->frame, 1, half, bt_prefix (bt->frame, 1, half), 0);
+
+	bt_putid(page->right, right);
+
+	// remember fence key for smaller page
+
+	if( !(fencekey = bt_wholekey (bt, page, page->cnt, fencebuf, &fencelen)) ) {
+		if( rightkey != rightbuf + 1 )
+			free (rightkey);
+		return bt->err;
+	}
+
+	// if current page is the root page, split it
+
+	if(( page_no == ROOT_page )) {
+		err = bt_splitroot (bt, fencekey, fencelen, right);
+	}
+
+	//	lock right page
+
+	else if(( rlatch = bt_pinlatch (bt, right) )) {
+		bt_lockpage (BtLockParent, rlatch);
+
+		// update left (containing) node
+
+		bt_update(bt, page);
+
+		bt_lockpage (BtLockParent, latch);
+		bt_unlockpage (BtLockWrite, latch);
+
+		// insert new fence for reformulated left block
+
+		if( bt_insertkey (bt, fencekey, fencelen, lvl+1, page_no, time(NULL)) )
+			err = bt->err;
+
+		//	switch fence for right block of larger keys to new right page
+
+		else if( bt_insertkey (bt, rightkey, rightlen, lvl+1, right, time(NULL)) )
+			err = bt->err;
+	} else
+		err = bt->err;
+
+	if( fencekey != fencebuf + 1 )
+		free (fencekey);
+
+	if( rightkey != rightbuf + 1 )
+		free (rightkey);
+
+	if( err || page_no == ROOT_page )
+		return err;
+
+	bt_unlockpage (BtLockParent, latch);
+	bt_unlockpage (BtLockParent, rlatch);
+
+	bt_unpinlatch (rlatch);
+	bt_unpinlatch (latch);
+	return 0;
+}
+
+//  Insert new key into the btree at requested level.
+//  Pages are unlocked at exit. The id can't use the
+//  bits that mark a value, see BT_idmask.
+
+BTERR bt_insertkey (BtDb *bt, unsigned char *key, uint len, uint lvl, uid id, uint tod)
+{
+	if( len > keylimit(bt) || (id & ~BT_idmask) )
+		return bt->err = BTERR_struct;
+
+	return bt_insertval (bt, key, len, lvl, id, tod, NULL, 0, NULL);
+}
+
+//  Insert new key with the value bytes that follow it.
+//  The id tells how many there are, see BT_value. With
+//  post, the value is the key's postings list with a
+//  uid added or deleted.
+
+BTERR bt_insertval (BtDb *bt, unsigned char *key, uint len, uint lvl, uid id, uint tod, unsigned char *val, uint vlen, BtPost *post)
+{
+uint slot, idx, pfx;
+uid chain = 0;
+BtPage page;
+BtKey ptr;
+
+  if( !lvl )
+	bt_logcheck (bt);
+
+  while( 1 ) {
+	//	a list written for a page that split is
+	//	merged again
+
+	if( post && post->chain ) {
+		if( bt_freechain (bt, post->chain) )
+			return bt->err;
+		post->chain = 0;
 	}
-	bt->table = (void *)mmap (0, (uid)nlatchpage * bt->page_size, flag, MAP_SHARED, bt->idx, LATCH_page * bt->page_size);
-	if( bt->table == MAP_FAILED ) {
-		fprintf (stderr, "Unable to mmap buffer pool, errno = %d", errno);
-		return bt_close (bt), NULL;
+
+	if(( slot = bt_loadpage (bt, key, len, lvl, BtLockWrite) )) {
+		ptr = keyptr(bt->page, slot);
 	}
-	madvise (bt->table, (uid)nlatchpage << bt->page_bits, MADV_RANDOM | MADV_WILLNEED);
-#else
-	flag = PAGE_READWRITE;
-	bt->halloc = CreateFileMapping(bt->idx, NULL, flag, 0, ((uid)nlatchpage + LATCH_page) * bt->page_size, NULL);
-	if( !bt->halloc ) {
-		fprintf (stderr, "Unable to create file mapping for buffer pool mgr, GetLastError = %d\n", GetLastError());
-		return bt_close (bt), NULL;
+    else
+	{
+		if( !bt->err )
+			bt->err = BTERR_ovflw;
+		return bt->err;
 	}
 
-	flag = FILE_MAP_WRITE;
-	bt->latchmgr = MapViewOfFile(bt->halloc, flag, 0, 0, ((uid)nlatchpage + LATCH_page) * bt->page_size);
-	if( !bt->latchmgr ) {
-		fprintf (stderr, "Unable to map buffer pool, GetLastError = %d\n", GetLastError());
-		return bt_close (bt), NULL;
+	page = bt->page;
+
+	//	the postings list is merged while the
+	//	leaf is locked
+
+	if( post ) {
+	  if( bt_postmerge (bt, page, slot, !bt_slotcmp (bt, page, slot, key, len) && !slotptr(page, slot)->dead, len, post) ) {
+		bt_unlockpage(BtLockWrite, bt->latch);
+		bt_unpinlatch (bt->latch);
+		return bt->err;
+	  }
+
+	  if( post->same ) {
+		bt_unlockpage(BtLockWrite, bt->latch);
+		bt_unpinlatch (bt->latch);
+		return 0;
+	  }
+
+	  id = post->word;
+	  val = post->val;
+	  vlen = post->vlen;
 	}
 
-	bt->table = (void *)((char *)bt->latchmgr + LATCH_page * bt->page_size);
+	// if key already exists, update id and value and return
+
+	if( !bt_slotcmp (bt, page, slot, key, len) ) {
+	  chain = slotptr(page, slot)->dead ? 0 : bt_ovflpage (page, slot);
+
+	  //  a value of another size moves the key to
+	  //  new space, the old space is left for cleanup
+
+	  if( bt_valsize (page, slot) != vlen ) {
+		page->clean = 1;
+
+		if( !(slot = bt_cleanpage (bt, key, len, vlen, slot)) ) {
+		  if( bt_splitpage (bt) )
+			return bt->err;
+		  continue;
+		}
+
+		ptr = keyptr(page, slot);
+		page->min -= keysize(page, ptr) + vlen;
+		memcpy ((unsigned char *)page + page->min, ptr, keysize(page, ptr));
+		slotptr(page, slot)->off = page->min;
+	  }
+
+	  if( slotptr(page, slot)->dead )
+		page->act++;
+
+	  slotptr(page, slot)->dead = 0;
+#ifdef USETOD
+	  slotptr(page, slot)->tod = tod;
 #endif
-	bt->pagepool = (unsigned char *)bt->table + (uid)(nlatchpage - bt->latchmgr->latchtotal) * bt->page_size;
-	bt->latchsets = (BtLatchSet *)(bt->pagepool - (uid)bt->latchmgr->latchtotal * sizeof(BtLatchSet));
+	  bt_putid(slotptr(page,slot)->id, id);
+	  if( vlen )
+		memcpy (valptr(page, slot), val, vlen);
+	  bt_update(bt, bt->page);
+	  bt_unlockpage(BtLockWrite, bt->latch);
+	  bt_unpinlatch (bt->latch);
 
-#ifdef unix
-	bt->mem = valloc (2 * bt->page_size);
-#else
-	bt->mem = VirtualAlloc(NULL, 2 * bt->page_size, MEM_COMMIT, PAGE_READWRITE);
+	  //  the old value is out of reach now
+
+	  if( chain )
+		return bt_freechain (bt, chain);
+
+	  return 0;
+	}
+
+	// check if page has enough space
+
+	if(( slot = bt_cleanpage (bt, key, len, vlen, slot) ))
+		break;
+
+	if( bt_splitpage (bt) )
+		return bt->err;
+  }
+
+  // calculate next available slot and copy key into page,
+  // a packed page keeps it without the page prefix, a long
+  // key keeps its head and overflow pages of its own
+
+  pfx = pfxlen(page);
+
+  if( page->longkeys && len > BT_keymax ) {
+	if( !(chain = bt_writechain (bt, key + BT_keyhead, len - BT_keyhead)) ) {
+	  bt_unlockpage(BtLockWrite, bt->latch);
+	  bt_unpinlatch(bt->latch);
+	  return bt->err;
+	}
+
+	page->min -= newsize(page, len, pfx) + vlen;
+	bt_putlong ((BtKey)((unsigned char *)page + page->min), key, len, chain);
+  } else {
+	page->min -= newsize(page, len, pfx) + vlen; // reset lowest used offset
+	((unsigned char *)page)[page->min] = len - pfx;
+	memcpy ((unsigned char *)page + page->min +1, key + pfx, len - pfx);
+  }
+
+  if( vlen )
+	memcpy ((unsigned char *)page + page->min + newsize(page, len, pfx), val, vlen);
+
+  for( idx = slot; idx < page->cnt; idx++ )
+	if( slotptr(page, idx)->dead )
+		break;
+
+  // now insert key into array before slot
+  // preserving the fence slot
+
+  if( idx == page->cnt )
+	idx++, page->cnt++;
+
+  page->act++;
+
+  while( idx > slot )
+	*slotptr(page, idx) = *slotptr(page, idx -1), idx--;
+
+  bt_putid(slotptr(page,slot)->id, id);
+  slotptr(page, slot)->off = page->min;
+#ifdef USETOD
+  slotptr(page, slot)->tod = tod;
 #endif
-	bt->frame = (BtPage)bt->mem;
-	bt->cursor = (BtPage)(bt->mem + bt->page_size);
-	return bt;
+  slotptr(page, slot)->dead = 0;
+  bt_update(bt, bt->page);
+
+  bt_unlockpage(BtLockWrite, bt->latch);
+  bt_unpinlatch(bt->latch);
+  return 0;
 }
 
-// place write, read, or parent lock on requested page_no.
+//  cache page of keys into cursor and return starting slot for given key
 
-void bt_lockpage(BtLock mode, BtLatchSet *latch)
+uint bt_startkey (BtDb *bt, unsigned char *key, uint len)
 {
-	switch( mode ) {
-	case BtLockRead:
-		ReadLock (latch->readwr);
-		break;
-	case BtLockWrite:
-		WriteLock (latch->readwr);
-		break;
-	case BtLockAccess:
-		ReadLock (latch->access);
-		break;
-	case BtLockDelete:
-		WriteLock (latch->access);
+uint slot;
+
+	// cache page for retrieval
+
+	if(( slot = bt_loadpage (bt, key, len, 0, BtLockRead) )) {
+	  memcpy (bt->cursor, bt->page, bt->page_size);
+	}else{
+	  return 0;
+    }
+
+	bt_unlockpage(BtLockRead, bt->latch);
+	bt->cursor_page = bt->page_no;
+	bt_unpinlatch (bt->latch);
+	return slot;
+}
+
+//  return next slot for cursor page
+//  or slide cursor right into next page
+
+uint bt_nextkey (BtDb *bt, uint slot)
+{
+BtLatchSet *latch;
+off64_t right;
+
+  do {
+	right = bt_getid(bt->cursor->right);
+
+	while( slot++ < bt->cursor->cnt )
+	  if( slotptr(bt->cursor,slot)->dead ) {
+		continue;
+	  } else if( right || (slot < bt->cursor->cnt)) {
+		return slot;
+	  } else {
 		break;
-	case BtLockParent:
-		WriteLock (latch->parent);
+      }
+
+	if( !right )
 		break;
+
+	bt->cursor_page = right;
+
+	if(( latch = bt_pinlatch (bt, right) )) {
+    	bt_lockpage(BtLockRead, latch);
+	}else{
+		return 0;
+    }
+
+	bt->page = bt_mappage (bt, latch);
+	memcpy (bt->cursor, bt->page, bt->page_size);
+	bt_unlockpage(BtLockRead, latch);
+	bt_unpinlatch (latch);
+	slot = 0;
+  } while( 1 );
+
+  return bt->err = 0;
+}
+
+//	the key of a packed page is rebuilt in keybuf,
+//	a long key is cut to its first 255 bytes there,
+//	bt_keydata returns it whole
+
+BtKey bt_key(BtDb *bt, uint slot)
+{
+unsigned char *key;
+uint len;
+
+	if( longkey(bt->cursor, keyptr(bt->cursor, slot)) ) {
+		if( !(key = bt_keydata (bt, slot, &len)) )
+			return NULL;
+
+		bt->keybuf[0] = 255;
+		memcpy (bt->keybuf + 1, key, 255);
+		return (BtKey)bt->keybuf;
 	}
+
+	if( !pfxlen(bt->cursor) )
+		return keyptr(bt->cursor, slot);
+
+	bt_getkey (bt->cursor, slot, bt->keybuf);
+	return (BtKey)bt->keybuf;
 }
 
-// remove write, read, or parent lock on requested page
+//	the whole key at slot, a long key is
+//	read from its chain into keydata
 
-void bt_unlockpage(BtLock mode, BtLatchSet *latch)
+unsigned char *bt_keydata(BtDb *bt, uint slot, uint *len)
 {
-	switch( mode ) {
-	case BtLockRead:
-		ReadRelease (latch->readwr);
-		break;
-	case BtLockWrite:
-		WriteRelease (latch->readwr);
-		break;
-	case BtLockAccess:
-		ReadRelease (latch->access);
-		break;
-	case BtLockDelete:
-		WriteRelease (latch->access);
-		break;
-	case BtLockParent:
-		WriteRelease (latch->parent);
-		break;
+BtKey ptr = keyptr(bt->cursor, slot);
+unsigned char *key;
+
+	if( !longkey(bt->cursor, ptr) ) {
+		bt_getkey (bt->cursor, slot, bt->keybuf);
+		*len = bt->keybuf[0];
+		return bt->keybuf + 1;
+	}
+
+	*len = bt_ovfllen (keyovfl(ptr));
+
+	if( *len > bt->keysize ) {
+		if( !(key = realloc (bt->keydata, *len)) ) {
+			bt->err = BTERR_ovflw;
+			return NULL;
+		}
+
+		bt->keydata = key;
+		bt->keysize = *len;
+	}
+
+	memcpy (bt->keydata, ptr->key, BT_keyhead);
+
+	if( bt_readchain (bt, bt_getid(keyovfl(ptr)->page), bt->keydata + BT_keyhead, *len - BT_keyhead) )
+		return NULL;
+
+	return bt->keydata;
+}
+
+uid bt_uid(BtDb *bt, uint slot)
+{
+	return bt_getid(slotptr(bt->cursor,slot)->id);
+}
+
+#ifdef USETOD
+uint bt_tod(BtDb *bt, uint slot)
+{
+	return slotptr(bt->cursor,slot)->tod;
+}
+#endif
+
+//	Values. Small values are kept in the leaf after
+//	their key, a value that would take more than an
+//	eighth of a page goes to a chain of overflow pages.
+
+//	write a value to a new chain of overflow pages,
+//	the last part first so each page links to the next
+
+uid bt_writechain (BtDb *bt, unsigned char *value, uint vlen)
+{
+uint max = bt->page_size - sizeof(*bt->frame);
+uint part = (vlen + max - 1) / max;
+uid next = 0, page_no;
+uint off, amt;
+
+	while( part-- ) {
+		off = part * max;
+		amt = vlen - off > max ? max : vlen - off;
+
+		memset (bt->frame, 0, bt->page_size);
+		bt->frame->bits = bt->page_bits;
+		bt->frame->min = bt->page_size - amt;
+		memcpy ((unsigned char *)bt->frame + bt->frame->min, value + off, amt);
+		bt_putid(bt->frame->right, next);
+
+		if( !(page_no = bt_newpage (bt, bt->frame)) ) {
+			bt_freechain (bt, next);
+			return 0;
+		}
+
+		next = page_no;
+	}
+
+	return next;
+}
+
+//	put the pages of an overflow chain on the free chain
+
+BTERR bt_freechain (BtDb *bt, uid page_no)
+{
+BtLatchSet *latch;
+uid next;
+
+	while( page_no ) {
+		if( !(latch = bt_pinlatch (bt, page_no)) )
+			return bt->err;
+
+		bt_lockpage (BtLockDelete, latch);
+		bt_lockpage (BtLockWrite, latch);
+		next = bt_getid(bt_mappage (bt, latch)->right);
+
+		if( bt_freepage (bt, page_no, latch) )
+			return bt->err;
+
+		page_no = next;
 	}
+
+	return 0;
 }
 
-//	allocate a new page and write page into it
+//	copy up to max bytes of a value from its overflow chain
 
-uid bt_newpage(BtDb *bt, BtPage page)
+BTERR bt_readchain (BtDb *bt, uid page_no, unsigned char *value, uint max)
 {
 BtLatchSet *latch;
-uid new_page;
-BtPage temp;
+uint amt, off = 0;
+BtPage page;
 
-	//	lock allocation page
+	while( page_no && off < max ) {
+		if( !(latch = bt_pinlatch (bt, page_no)) )
+			return bt->err;
 
-	bt_spinwritelock(bt->latchmgr->lock);
+		bt_lockpage (BtLockRead, latch);
+		page = bt_mappage (bt, latch);
 
-	// use empty chain first
-	// else allocate empty page
+		amt = bt->page_size - page->min;
+		if( amt > max - off )
+			amt = max - off;
 
-	if(( new_page = bt_getid(bt->latchmgr->alloc[1].right) )) {
-	  if(( latch = bt_pinlatch (bt, new_page) )) {
-	  	temp = bt_mappage (bt, latch);
-	  } else {
-		return 0;
-      }
+		memcpy (value + off, (unsigned char *)page + page->min, amt);
+		page_no = bt_getid(page->right);
+		off += amt;
 
-	  bt_putid(bt->latchmgr->alloc[1].right, bt_getid(temp->right));
-	  bt_spinreleasewrite(bt->latchmgr->lock);
-	  memcpy (temp, page, bt->page_size);
+		bt_unlockpage (BtLockRead, latch);
+		bt_unpinlatch (latch);
+	}
 
-	  bt_update (bt, temp);
-	  bt_unpinlatch (latch);
-	  return new_page;
-	} else {
-	  new_page = bt_getid(bt->latchmgr->alloc->right);
-	  bt_putid(bt->latchmgr->alloc->right, new_page+1);
-	  bt_spinreleasewrite(bt->latchmgr->lock);
+	return 0;
+}
 
-	  if(( bt_writepage (bt, page, new_page) )) {
-		return 0;
-      }
+//	store a key with its value, replacing any value
+//	the key has
+
+BTERR bt_put (BtDb *bt, unsigned char *key, uint len, unsigned char *value, uint vlen)
+{
+BtOvfl ovfl[1];
+uid chain;
+
+	if( len > keylimit(bt) )
+		return bt->err = BTERR_struct;
+
+	if( vlen <= bt->page_size >> 3 && keyroom(bt, len) + vlen <= bt->page_size >> 3 )
+		return bt_insertval (bt, key, len, 0, BT_value | vlen, time(NULL), value, vlen, NULL);
+
+	if( !(chain = bt_writechain (bt, value, vlen)) )
+		return bt->err;
+
+	ovfl->len[0] = vlen >> 24;
+	ovfl->len[1] = vlen >> 16;
+	ovfl->len[2] = vlen >> 8;
+	ovfl->len[3] = vlen;
+	bt_putid(ovfl->page, chain);
+
+	if( bt_insertval (bt, key, len, 0, BT_value | BT_ovfl | sizeof(BtOvfl), time(NULL), (unsigned char *)ovfl, sizeof(BtOvfl), NULL) ) {
+		bt_freechain (bt, chain);
+		return bt->err;
 	}
 
-	bt_update (bt, bt->latchmgr->alloc);
-	return new_page;
+	return 0;
 }
 
-//  compare two keys, returning > 0, = 0, or < 0
-//  as the comparison value
+//	find a key and copy up to max bytes of its value,
+//	return the length of the value or -1 if the key
+//	isn't there
 
-int keycmp (BtKey key1, unsigned char *key2, uint len2)
+int bt_get (BtDb *bt, unsigned char *key, uint len, unsigned char *value, uint max)
 {
-uint len1 = key1->len;
-int ans;
+unsigned char *val;
+uint slot, vlen;
+int ret = -1;
+BtOvfl *ovfl;
+uid id;
 
-	if(( ans = memcmp (key1->key, key2, len1 > len2 ? len2 : len1) )) {
-		return ans;
-    }
+	if( !(slot = bt_loadpage (bt, key, len, 0, BtLockRead)) )
+		return -1;
 
-	if(( len1 > len2 )) {
-		return 1;
-    }
+	//	the leaf stays locked while the overflow
+	//	pages are read, so they can't be freed
 
-	if(( len1 < len2 )) {
-		return -1;
-    }
+	if(( !bt_slotcmp (bt, bt->page, slot, key, len) && !slotptr(bt->page, slot)->dead )) {
+		id = bt_getid(slotptr(bt->page, slot)->id);
+		val = valptr(bt->page, slot);
+		vlen = bt_valsize (bt->page, slot);
 
-	return 0;
+		if( id & BT_ovfl ) {
+			ovfl = (BtOvfl *)val;
+			vlen = ovfl->len[0] << 24 | ovfl->len[1] << 16 | ovfl->len[2] << 8 | ovfl->len[3];
+			if( !bt_readchain (bt, bt_getid(ovfl->page), value, vlen < max ? vlen : max) )
+				ret = vlen;
+		} else {
+			memcpy (value, val, vlen < max ? vlen : max);
+			ret = vlen;
+		}
+	}
+
+	bt_unlockpage (BtLockRead, bt->latch);
+	bt_unpinlatch (bt->latch);
+	return ret;
 }
 
-//  Update current page of btree by
-//	flushing mapped area to disk backing of cache pool.
-//	mark page as dirty for rewrite to permanent location
 
-void bt_update (BtDb *bt, BtPage page)
+//	Postings, see BtPost. Blocks are encoded a uid at a
+//	time in 7 bit groups, with the high bit set on all but
+//	the last group of each.
+
+uint bt_postput (unsigned char *buf, uid val)
 {
-#ifdef unix
-	msync (page, bt->page_size, MS_ASYNC);
-#else
-//	FlushViewOfFile (page, bt->page_size);
-#endif
-	page->dirty = 1;
+uint off = 0;
+
+	while( val > 0x7f )
+		buf[off++] = (unsigned char)val | 0x80, val >>= 7;
+
+	buf[off++] = (unsigned char)val;
+	return off;
 }
 
-//  map the btree cached page onto current page
+//	decode a number, return the bytes it took
 
-BtPage bt_mappage (BtDb *bt, BtLatchSet *latch)
+uint bt_postget (unsigned char *buf, uint max, uid *val)
 {
-	return (BtPage)((uid)(latch - bt->latchsets) * bt->page_size + bt->pagepool);
+uint off = 0, shift = 0;
+
+	*val = 0;
+
+	while( off < max ) {
+		*val |= (uid)(buf[off] & 0x7f) << shift;
+		shift += 7;
+
+		if( !(buf[off++] & 0x80) )
+			break;
+	}
+
+	return off;
 }
 
-//	deallocate a deleted page 
-//	place on free chain out of allocator page
-//	call with page latched for Writing and Deleting
+//	add or delete a uid in a block, making the new block
+//	in out. Return its length, or -1 when the uid is
+//	already there, or isn't there to delete.
 
-BTERR bt_freepage(BtDb *bt, uid page_no, BtLatchSet *latch)
+int bt_postblock (unsigned char *block, uint len, uid id, uint add, unsigned char *out)
 {
-BtPage page = bt_mappage (bt, latch);
+uid prev = 0, cur = 0, delta;
+uint at = 0, nxt = 0;
+int amt;
 
-	//	lock allocation page
+	//	find the first uid at or after id
 
-	bt_spinwritelock (bt->latchmgr->lock);
+	while( at < len ) {
+		nxt = at + bt_postget (block + at, len - at, &delta);
 
-	//	store chain in second right
-	bt_putid(page->right, bt_getid(bt->latchmgr->alloc[1].right));
-	bt_putid(bt->latchmgr->alloc[1].right, page_no);
+		if( (cur = prev + delta) >= id )
+			break;
 
-	page->free = 1;
-	bt_update(bt, page);
+		prev = cur;
+		at = nxt;
+	}
 
-	// unlock released page
+	if( add ) {
+		if( at < len && cur == id )
+			return -1;
 
-	bt_unlockpage (BtLockDelete, latch);
-	bt_unlockpage (BtLockWrite, latch);
-	bt_unpinlatch (latch);
+		memcpy (out, block, at);
+		amt = at + bt_postput (out + at, id - prev);
 
-	// unlock allocation page
+		if( at < len ) {
+			amt += bt_postput (out + amt, cur - id);
+			memcpy (out + amt, block + nxt, len - nxt);
+			amt += len - nxt;
+		}
 
-	bt_spinreleasewrite (bt->latchmgr->lock);
-	bt_update (bt, bt->latchmgr->alloc);
-	return 0;
+		return amt;
+	}
+
+	if( at == len || cur != id )
+		return -1;
+
+	//	the uid after the deleted one now follows prev
+
+	memcpy (out, block, at);
+	amt = at;
+
+	if( nxt < len ) {
+		nxt += bt_postget (block + nxt, len - nxt, &delta);
+		amt += bt_postput (out + amt, cur + delta - prev);
+		memcpy (out + amt, block + nxt, len - nxt);
+		amt += len - nxt;
+	}
+
+	return amt;
 }
 
-//  find slot in page for given key at a given level
+uint bt_ovfllen (BtOvfl *ovfl)
+{
+	return ovfl->len[0] << 24 | ovfl->len[1] << 16 | ovfl->len[2] << 8 | ovfl->len[3];
+}
 
-int bt_findslot (BtDb *bt, unsigned char *key, uint len)
+void bt_putovfllen (BtOvfl *ovfl, uint len)
 {
-uint diff, higher = bt->page->cnt, low = 1, slot;
-uint good = 0;
+	ovfl->len[0] = len >> 24;
+	ovfl->len[1] = len >> 16;
+	ovfl->len[2] = len >> 8;
+	ovfl->len[3] = len;
+}
 
-	//	make stopper key an infinite fence value
+//	add or delete a uid in a list kept in overflow pages,
+//	with the leaf that has the list write locked. The uid
+//	belongs on the last page that starts at or before it.
+//	A page that fills is split in two, an empty one is
+//	taken out of the chain.
 
-	if(( bt_getid (bt->page->right) )) {
-		higher++;
-	} else {
-		good++;
-    }
+BTERR bt_postchain (BtDb *bt, BtOvfl *ovfl, BtPost *post)
+{
+uint max = bt->page_size - sizeof(*bt->frame);
+uid page_no = bt_getid(ovfl->page), prev_no = 0;
+uid next_no, first, delta, val;
+uint len, at, half, total;
+BtLatchSet *latch, *next;
+BtPage page, temp;
+int amt;
+
+	if( !(latch = bt_pinlatch (bt, page_no)) )
+		return bt->err;
 
-	//	low is the lowest candidate, higher is already
-	//	tested as .ge. the given key, loop ends when they meet
+	bt_lockpage (BtLockWrite, latch);
+	page = bt_mappage (bt, latch);
 
-	while(( diff = higher - low )) {
-		slot = low + ( diff >> 1 );
-		if(( keycmp (keyptr(bt->page, slot), key, len) < 0 )) {
-			low = slot + 1;
-		} else {
-			higher = slot, good++;
-        }
+	while(( next_no = bt_getid(page->right) )) {
+		if( !(next = bt_pinlatch (bt, next_no)) ) {
+			bt_unlockpage (BtLockWrite, latch);
+			bt_unpinlatch (latch);
+			return bt->err;
+		}
+
+		bt_lockpage (BtLockWrite, next);
+		temp = bt_mappage (bt, next);
+		bt_postget ((unsigned char *)temp + temp->min, bt->page_size - temp->min, &first);
+
+		if( first > post->id ) {
+			bt_unlockpage (BtLockWrite, next);
+			bt_unpinlatch (next);
+			break;
+		}
+
+		bt_unlockpage (BtLockWrite, latch);
+		bt_unpinlatch (latch);
+		prev_no = page_no;
+		page_no = next_no;
+		latch = next;
+		page = temp;
 	}
 
-	//	return zero if key is on right link page
+	len = bt->page_size - page->min;
+	amt = bt_postblock ((unsigned char *)page + page->min, len, post->id, post->add, bt->postbuf);
 
- 	return good ? higher : 0;
+	if( amt < 0 ) {
+		post->same = 1;
+		bt_unlockpage (BtLockWrite, latch);
+		bt_unpinlatch (latch);
+		return 0;
+	}
+
+	//	the stored length changes once the pages have
+	//	been changed
+
+	total = bt_ovfllen (ovfl) - len + amt;
+
+	//	the last uid of a page is gone, link around it
+
+	if( !amt ) {
+		if( prev_no ) {
+			if( !(next = bt_pinlatch (bt, prev_no)) ) {
+				bt_unlockpage (BtLockWrite, latch);
+				bt_unpinlatch (latch);
+				return bt->err;
+			}
+
+			bt_lockpage (BtLockWrite, next);
+			temp = bt_mappage (bt, next);
+			memcpy (temp->right, page->right, BtId);
+			bt_update (bt, temp);
+			bt_unlockpage (BtLockWrite, next);
+			bt_unpinlatch (next);
+		} else
+			memcpy (ovfl->page, page->right, BtId);
+
+		bt_putovfllen (ovfl, total);
+		bt_lockpage (BtLockDelete, latch);
+		return bt_freepage (bt, page_no, latch);
+	}
+
+	//	a full page keeps the first half of the block,
+	//	the second half starts a page of its own with
+	//	its first uid as it is
+
+	if( amt > max ) {
+		at = 0;
+		val = 0;
+
+		while( at < amt / 2 ) {
+			at += bt_postget (bt->postbuf + at, amt - at, &delta);
+			val += delta;
+		}
+
+		//	the uid at the split, after the block in postbuf
+
+		half = at + bt_postget (bt->postbuf + at, amt - at, &delta);
+		len = bt_postput (bt->postbuf + amt, val + delta);
+
+		memset (bt->frame, 0, bt->page_size);
+		bt->frame->bits = bt->page_bits;
+		bt->frame->min = bt->page_size - (amt - half) - len;
+		memcpy ((unsigned char *)bt->frame + bt->frame->min, bt->postbuf + amt, len);
+		memcpy ((unsigned char *)bt->frame + bt->frame->min + len, bt->postbuf + half, amt - half);
+		memcpy (bt->frame->right, page->right, BtId);
+
+		if( !(next_no = bt_newpage (bt, bt->frame)) ) {
+			bt_unlockpage (BtLockWrite, latch);
+			bt_unpinlatch (latch);
+			return bt->err;
+		}
+
+		total += at + bt->page_size - bt->frame->min - amt;
+		bt_putid(page->right, next_no);
+		amt = at;
+	}
+
+	page->min = bt->page_size - amt;
+	memcpy ((unsigned char *)page + page->min, bt->postbuf, amt);
+	bt_putovfllen (ovfl, total);
+	bt_update (bt, page);
+	bt_unlockpage (BtLockWrite, latch);
+	bt_unpinlatch (latch);
+	return 0;
 }
 
-//  find and load page at given level for given key
-//	leave page rd or wr locked as requested
+//	merge a uid into the list of the key at slot, on a
+//	leaf that is write locked. A list in overflow pages
+//	is changed where it is, otherwise the new list, or
+//	the BtOvfl of a list that moved to an overflow page,
+//	is left in post to be stored.
 
-int bt_loadpage (BtDb *bt, unsigned char *key, uint len, uint lvl, uint lock)
+BTERR bt_postmerge (BtDb *bt, BtPage page, uint slot, uint found, uint len, BtPost *post)
 {
-uid page_no = ROOT_page, prevpage = 0;
-uint drill = 0xff, slot;
-BtLatchSet *prevlatch;
-uint mode, prevmode;
+unsigned char *block = NULL;
+uint blen = 0;
+BtOvfl *ovfl;
+uid id = 0;
+int amt;
 
-  //  start at root of btree and drill down
+	if( !bt->postbuf && !(bt->postbuf = malloc (bt->page_size + 32)) )
+		return bt->err = BTERR_ovflw;
 
-  do {
-	// determine lock mode of drill level
-	mode = (lock == BtLockWrite) && (drill == lvl) ? BtLockWrite : BtLockRead; 
+	post->same = 0;
 
-	if(( bt->latch = bt_pinlatch(bt, page_no) )) {
-		bt->page_no = page_no;
-	} else {
-		return 0;
-    }
+	if( found ) {
+		id = bt_getid(slotptr(page, slot)->id);
 
- 	// obtain access lock using lock chaining
+		//	a key with a uid of its own has no list
 
-	if(( page_no > ROOT_page )) {
-		bt_lockpage(BtLockAccess, bt->latch);
-    }
+		if( !(id & BT_value) )
+			return bt->err = BTERR_struct;
 
-	if(( prevpage )) {
-		bt_unlockpage(prevmode, prevlatch);
-		bt_unpinlatch(prevlatch);
-		prevpage = 0;
+		block = valptr(page, slot);
+		blen = bt_valsize (page, slot);
 	}
 
- 	// obtain read lock using lock chaining
+	if( id & BT_ovfl ) {
+		ovfl = (BtOvfl *)block;
 
-	bt_lockpage(mode, bt->latch);
+		//	a list emptied before the leaf had to split
+		//	is still empty when the merge is tried again
 
-	if(( page_no > ROOT_page )) {
-		bt_unlockpage(BtLockAccess, bt->latch);
-    }
+		if( bt_getid(ovfl->page) && bt_postchain (bt, ovfl, post) )
+			return bt->err;
 
-	//	map/obtain page contents
+		if( post->same )
+			return 0;
 
-	bt->page = bt_mappage (bt, bt->latch);
+		//	the list is empty when its last page is gone
 
-	// re-read and re-lock root after determining actual level of root
+		if( !bt_getid(ovfl->page) ) {
+			post->word = BT_value;
+			post->vlen = 0;
+			return 0;
+		}
 
-	if(( bt->page->lvl != drill)) {
-		if(( bt->page_no != ROOT_page )) {
-			return bt->err = BTERR_struct, 0;
-        }
-			
-		drill = bt->page->lvl;
+		bt_update (bt, page);
+		post->same = 1;
+		return 0;
+	}
 
-		if(( lock != BtLockRead && drill == lvl )) {
-			bt_unlockpage(mode, bt->latch);
-			bt_unpinlatch(bt->latch);
-			continue;
-		}
+	if( (amt = bt_postblock (block, blen, post->id, post->add, bt->postbuf)) < 0 ) {
+		post->same = 1;
+		return 0;
 	}
 
-	prevpage = bt->page_no;
-	prevlatch = bt->latch;
-	prevmode = mode;
+	if( amt <= bt->page_size >> 3 && keyroom(bt, len) + amt <= bt->page_size >> 3 ) {
+		post->word = BT_value | amt;
+		post->val = bt->postbuf;
+		post->vlen = amt;
+		return 0;
+	}
 
-	//  find key on page at this level
-	//  and descend to requested level
+	//	a list too long for the leaf goes to a page of its own
 
-	if(( !bt->page->kill )) {
-	 if(( slot = bt_findslot (bt, key, len) )) {
-	  if(( drill == lvl )) {
-		return slot;
-      }
+	memset (bt->frame, 0, bt->page_size);
+	bt->frame->bits = bt->page_bits;
+	bt->frame->min = bt->page_size - amt;
+	memcpy ((unsigned char *)bt->frame + bt->frame->min, bt->postbuf, amt);
 
-	  while( slotptr(bt->page, slot)->dead ) {
-		if(( slot++ < bt->page->cnt )) {
-			continue;
-		} else {
-			goto slideright;
-        }
-      }
+	if( !(post->chain = bt_newpage (bt, bt->frame)) )
+		return bt->err;
 
-	  page_no = bt_getid(slotptr(bt->page, slot)->id);
-	  drill--;
-	  continue;
-	 }
-    }
+	bt_putovfllen (post->ovfl, amt);
+	bt_putid(post->ovfl->page, post->chain);
+	post->word = BT_value | BT_ovfl | sizeof(BtOvfl);
+	post->val = (unsigned char *)post->ovfl;
+	post->vlen = sizeof(BtOvfl);
+	return 0;
+}
 
-	//  or slide right into next page
+//	add a uid to the postings list of a key,
+//	a uid can't be zero
 
-slideright:
-	page_no = bt_getid(bt->page->right);
+BTERR bt_postadd (BtDb *bt, unsigned char *key, uint len, uid id)
+{
+BtPost post[1];
 
-  } while( page_no );
+	if( len > keylimit(bt) || !id )
+		return bt->err = BTERR_struct;
 
-  // return error on end of right chain
+	memset (post, 0, sizeof(BtPost));
+	post->id = id;
+	post->add = 1;
 
-  bt->err = BTERR_eof;
-  return 0;	// return error
+	return bt_insertval (bt, key, len, 0, 0, time(NULL), NULL, 0, post);
 }
 
-//	a fence key was deleted from a page
-//	push new fence value upwards
+//	delete a uid from the postings list of a key, a
+//	key keeps an empty list until it is deleted
 
-BTERR bt_fixfence (BtDb *bt, uid page_no, uint lvl)
+BTERR bt_postdel (BtDb *bt, unsigned char *key, uint len, uid id)
 {
-unsigned char leftkey[256], rightkey[256];
-BtLatchSet *latch = bt->latch;
-BtKey ptr;
-
-	// remove deleted key, the old fence value
+BtPost post[1];
 
-	ptr = keyptr(bt->page, bt->page->cnt);
-	memcpy(rightkey, ptr, ptr->len + 1);
+	if( len > keylimit(bt) || !id )
+		return bt->err = BTERR_struct;
 
-	memset (slotptr(bt->page, bt->page->cnt--), 0, sizeof(BtSlot));
-	bt->page->clean = 1;
+	memset (post, 0, sizeof(BtPost));
+	post->id = id;
 
-	ptr = keyptr(bt->page, bt->page->cnt);
-	memcpy(leftkey, ptr, ptr->len + 1);
+	return bt_insertval (bt, key, len, 0, 0, time(NULL), NULL, 0, post);
+}
 
-	bt_update (bt, bt->page);
-	bt_lockpage (BtLockParent, latch);
-	bt_unlockpage (BtLockWrite, latch);
+//	append a block to the list of a cursor, its first
+//	uid as the difference from the last one. The list
+//	can't get longer than the blocks, unless it isn't
+//	a list, which stops where it goes out of order.
 
-	//  insert new (now smaller) fence key
+uint bt_postappend (BtPostings *post, unsigned char *block, uint len, uid *last)
+{
+uid delta, val = 0;
+uint at = 0;
 
-	if( bt_insertkey (bt, leftkey+1, *leftkey, lvl + 1, page_no, time(NULL)) )
-		return bt->err;
+	while( at < len ) {
+		at += bt_postget (block + at, len - at, &delta);
 
-	//  remove old (larger) fence key
+		if( (val += delta) <= *last )
+			break;
 
-	if( bt_deletekey (bt, rightkey+1, *rightkey, lvl + 1) )
-		return bt->err;
+		post->len += bt_postput (post->list + post->len, val - *last);
+		*last = val;
+	}
 
-	bt_unlockpage (BtLockParent, latch);
-	bt_unpinlatch (latch);
-	return 0;
+	return post->len;
 }
 
-//	root has a single child
-//	collapse a level from the btree
-//	call with root locked in bt->page
+//	open a cursor on the postings list of a key. A key
+//	that isn't there, or has no list, gives an empty one.
 
-BTERR bt_collapseroot (BtDb *bt, BtPage root)
+BtPostings *bt_postopen (BtDb *bt, unsigned char *key, uint len)
 {
 BtLatchSet *latch;
-BtPage temp;
-uid child;
-uint idx;
+BtPostings *post;
+BtOvfl *ovfl;
+uint slot, size;
+uid page_no, last = 0;
+BtPage page;
+uid id;
 
-	// find the child entry
-	//	and promote to new root
+	if( !(post = calloc (1, sizeof(BtPostings))) ) {
+		bt->err = BTERR_ovflw;
+		return NULL;
+	}
 
-  do {
-	for( idx = 0; idx++ < root->cnt; ) {
-	  if( !slotptr(root, idx)->dead ) {
-		break;
-      }
-    }
+	if( !(slot = bt_loadpage (bt, key, len, 0, BtLockRead)) ) {
+		free (post);
+		return NULL;
+	}
 
-	child = bt_getid (slotptr(root, idx)->id);
-	if(( latch = bt_pinlatch (bt, child) )) {
-		temp = bt_mappage (bt, latch);
-	} else {
-		return bt->err;
-    }
+	//	the leaf stays locked while the overflow
+	//	pages are read, so they can't change
 
-	bt_lockpage (BtLockDelete, latch);
-	bt_lockpage (BtLockWrite, latch);
-	memcpy (root, temp, bt->page_size);
+	if( !bt_slotcmp (bt, bt->page, slot, key, len) && !slotptr(bt->page, slot)->dead ) {
+		id = bt_getid(slotptr(bt->page, slot)->id);
+		size = bt_valsize (bt->page, slot);
+		ovfl = (BtOvfl *)valptr(bt->page, slot);
 
-	bt_update (bt, root);
+		if( id & BT_ovfl )
+			size = bt_ovfllen (ovfl);
 
-	if(( bt_freepage (bt, child, latch) ))
-		return bt->err;
+		if( !(post->list = malloc (size + 1)) ) {
+			bt->err = BTERR_ovflw;
+			size = 0, id = 0;
+		}
 
-  } while( root->lvl > 1 && root->act == 1 );
+		if( id & BT_ovfl ) {
+			page_no = bt_getid(ovfl->page);
+
+			while( page_no ) {
+				if( !(latch = bt_pinlatch (bt, page_no)) )
+					break;
+
+				bt_lockpage (BtLockRead, latch);
+				page = bt_mappage (bt, latch);
+				bt_postappend (post, (unsigned char *)page + page->min, bt->page_size - page->min, &last);
+				page_no = bt_getid(page->right);
+				bt_unlockpage (BtLockRead, latch);
+				bt_unpinlatch (latch);
+			}
+		} else if( id & BT_value )
+			bt_postappend (post, (unsigned char *)ovfl, size, &last);
+	}
 
-  bt_unlockpage (BtLockWrite, bt->latch);
-  bt_unpinlatch (bt->latch);
-  return 0;
+	bt_unlockpage (BtLockRead, bt->latch);
+	bt_unpinlatch (bt->latch);
+	return post;
 }
 
-//  find and delete key on page by marking delete flag bit
-//  when page becomes empty, delete it
+//	return the next uid of the list, or 0 at the end
 
-BTERR bt_deletekey (BtDb *bt, unsigned char *key, uint len, uint lvl)
+uid bt_postnext (BtPostings *post)
 {
-unsigned char lowerkey[256], higherkey[256];
-uint slot, dirty = 0, idx, fence, found;
-BtLatchSet *latch, *rlatch;
-uid page_no, right;
-BtPage temp;
-BtKey ptr;
+uid delta;
 
-	if(( slot = bt_loadpage (bt, key, len, lvl, BtLockWrite) )) {
-		ptr = keyptr(bt->page, slot);
-	} else {
-		return bt->err;
-    }
+	if( post->off >= post->len )
+		return 0;
 
-	// are we deleting a fence slot?
+	post->off += bt_postget (post->list + post->off, post->len - post->off, &delta);
+	return post->last += delta;
+}
 
-	fence = slot == bt->page->cnt;
+//	move to the first uid at or after id, the uid
+//	the cursor is on counts, or 0 at the end
 
-	// if key is found delete it, otherwise ignore request
+uid bt_postseek (BtPostings *post, uid id)
+{
+uid val = post->last;
 
-	if(( found = !keycmp (ptr, key, len) )) {
-	  if(( found = slotptr(bt->page, slot)->dead == 0 )) {
- 		dirty = slotptr(bt->page,slot)->dead = 1;
- 		bt->page->clean = 1;
- 		bt->page->act--;
+	while( val < id )
+		if( !(val = bt_postnext (post)) )
+			return 0;
 
-		// collapse empty slots
+	return val;
+}
 
-		while(( idx = bt->page->cnt - 1 )) {
-		  if( slotptr(bt->page, idx)->dead ) {
-			*slotptr(bt->page, idx) = *slotptr(bt->page, idx + 1);
-			memset (slotptr(bt->page, bt->page->cnt--), 0, sizeof(BtSlot));
-		  } else {
+//	return up to max more of the uids that are
+//	in both lists, or 0 when there are no more
+
+uint bt_postand (BtPostings *post1, BtPostings *post2, uid *ids, uint max)
+{
+uint cnt = 0;
+uid id1, id2;
+
+	while( cnt < max ) {
+		if( !(id1 = bt_postnext (post1)) )
 			break;
-          }
-        }
-	  }
-    }
 
-	right = bt_getid(bt->page->right);
-	page_no = bt->page_no;
-	latch = bt->latch;
+		while( 1 ) {
+			if( !(id2 = bt_postseek (post2, id1)) )
+				return cnt;
 
-	if(( !dirty )) {
-	  if(( lvl )) {
-		return bt_abort (bt, bt->page, page_no, BTERR_notfound);
-      }
-	  bt_unlockpage(BtLockWrite, latch);
-	  bt_unpinlatch (latch);
-	  return bt->found = found, 0;
-	}
+			if( id2 == id1 ) {
+				ids[cnt++] = id1;
+				break;
+			}
 
-	//	did we delete a fence key in an upper level?
+			if( !(id1 = bt_postseek (post1, id2)) )
+				return cnt;
+		}
+	}
 
-	if(( lvl && bt->page->act && fence )) {
-	  if(( bt_fixfence (bt, page_no, lvl) )) {
-		return bt->err;
-	  }else{
-		return bt->found = found, 0;
-      }
-    }
+	return cnt;
+}
 
-	//	is this a collapsed root?
+void bt_postclose (BtPostings *post)
+{
+	if( post->list )
+		free (post->list);
 
-	if(( lvl > 1 && page_no == ROOT_page && bt->page->act == 1 )) {
-	  if(( bt_collapseroot (bt, bt->page) )) {
-		return bt->err;
-	  }else{
-		return bt->found = found, 0;
-      }
-    }
+	free (post);
+}
 
-	// return if page is not empty
 
-	if(( bt->page->act )) {
-	  bt_update(bt, bt->page);
-	  bt_unlockpage(BtLockWrite, latch);
-	  bt_unpinlatch (latch);
-	  return bt->found = found, 0;
-	}
+//	Bulk loading. Keys are appended to a page on each
+//	level in ascending order. When a page fills it is
+//	linked to a new right sibling, written once, and its
+//	fence key is posted to the level above. The leaves
+//	are packed left to right starting with LEAF_page,
+//	and the page that is left alone on the top level
+//	becomes the root.
 
-	// cache copy of fence key
-	//	in order to find parent
+//	write a finished page, the root and first leaf
+//	may be in the buffer pool, so they go through it
 
-	ptr = keyptr(bt->page, bt->page->cnt);
-	memcpy(lowerkey, ptr, ptr->len + 1);
+BTERR bt_loadwrite (BtLoad *load, BtPage page, uid page_no)
+{
+BtDb *bt = load->bt;
+BtLatchSet *latch;
+BtPage pool;
 
-	// obtain lock on right page
+	if( page_no > LEAF_page )
+		return bt_writepage (bt, page, page_no);
 
-	if(( rlatch = bt_pinlatch (bt, right) )) {
-		temp = bt_mappage (bt, rlatch);
+	if(( latch = bt_pinlatch (bt, page_no) )) {
+		bt_lockpage (BtLockWrite, latch);
 	} else {
 		return bt->err;
-    }
+	}
 
-	bt_lockpage(BtLockWrite, rlatch);
+	pool = bt_mappage (bt, latch);
+	memcpy (pool, page, bt->page_size);
+	bt_update (bt, pool);
 
-	if(( temp->kill )) {
-		bt_abort(bt, temp, right, 0);
-		return bt_abort(bt, bt->page, bt->page_no, BTERR_kill);
-	}
+	bt_unlockpage (BtLockWrite, latch);
+	bt_unpinlatch (latch);
+	return 0;
+}
 
-	// pull contents of next page into current empty page 
+//	start an empty page on a level
 
-	memcpy (bt->page, temp, bt->page_size);
+void bt_loadinit (BtLoad *load, uint lvl)
+{
+BtPage page = load->page[lvl];
+
+	memset (page, 0, load->bt->page_size);
+	page->bits = load->bt->page_bits;
+	page->pack = load->bt->latchmgr->pack;
+	page->longkeys = load->bt->latchmgr->version > 1;
+	page->min = load->bt->page_size - page->pack;
+	page->lvl = lvl;
+}
 
-	//	cache copy of key to update
+//	write the rest of a long key to overflow pages
+//	of the load, return the first one, 0 on error
 
-	ptr = keyptr(temp, temp->cnt);
-	memcpy(higherkey, ptr, ptr->len + 1);
+uid bt_loadchain (BtLoad *load, unsigned char *key, uint len)
+{
+BtDb *bt = load->bt;
+uint max = bt->page_size - sizeof(*bt->frame);
+uint part, parts = (len + max - 1) / max;
+uid first = load->next;
+uint off, amt;
 
-	//  Mark right page as deleted and point it to left page
-	//	until we can post updates at higher level.
+	load->next += parts;
 
-	bt_putid(temp->right, page_no);
-	temp->kill = 1;
+	for( part = 0; part < parts; part++ ) {
+		off = part * max;
+		amt = len - off > max ? max : len - off;
 
-	bt_update(bt, bt->page);
-	bt_update(bt, temp);
+		memset (bt->frame, 0, bt->page_size);
+		bt->frame->bits = bt->page_bits;
+		bt->frame->min = bt->page_size - amt;
+		memcpy ((unsigned char *)bt->frame + bt->frame->min, key + off, amt);
 
-	bt_lockpage(BtLockParent, latch);
-	bt_unlockpage(BtLockWrite, latch);
+		if( part + 1 < parts )
+			bt_putid(bt->frame->right, first + part + 1);
 
-	bt_lockpage(BtLockParent, rlatch);
-	bt_unlockpage(BtLockWrite, rlatch);
+		if( bt_writepage (bt, bt->frame, first + part) )
+			return 0;
+	}
 
-	//  redirect higher key directly to consolidated node
+	return first;
+}
 
-	if(( bt_insertkey (bt, higherkey+1, *higherkey, lvl+1, page_no, time(NULL)) ))
-		return bt->err;
+//	append a key to the page on a level,
+//	finishing the page first if it is full.
+//	The keys of a packed page come in order, so
+//	its prefix is the one the first key and the
+//	new key share, and it is repacked when that
+//	changes.
 
-	//  delete old lower key to consolidated node
+BTERR bt_loadpost (BtLoad *load, uint lvl, unsigned char *key, uint len, uid id)
+{
+BtDb *bt = load->bt;
+unsigned char fencebuf[256];
+unsigned char *fence;
+uint pfx, share = 0;
+uint fencelen;
+int used, need;
+BTERR err = 0;
+BtPage page;
+uid right, chain;
 
-	if(( bt_deletekey (bt, lowerkey + 1, *lowerkey, lvl + 1) ))
-		return bt->err;
+	if( lvl >= MAX_lvl )
+		return bt->err = BTERR_ovflw;
 
-	//  obtain write & delete lock on deleted node
-	//	add right block to free chain
+	if( !load->page[lvl] ) {
+		if( !(load->page[lvl] = malloc (bt->page_size)) )
+			return bt->err = BTERR_ovflw;
 
-	bt_lockpage(BtLockDelete, rlatch);
-	bt_lockpage(BtLockWrite, rlatch);
-	bt_unlockpage(BtLockParent, rlatch);
+		bt_loadinit (load, lvl);
+	}
 
-	if(( bt_freepage (bt, right, rlatch) ))
-		return bt->err;
+	page = load->page[lvl];
+	pfx = pfxlen(page);
 
-	bt_unlockpage(BtLockParent, latch);
-	bt_unpinlatch(latch);
-	return 0;
-}
+	//	a long first key gives no more than its head,
+	//	long keys don't shrink, so used is the most a
+	//	new prefix can leave
 
-//	find key in leaf level and return row-id
+	if( page->pack && page->cnt ) {
+		bt_getkey (page, 1, fencebuf);
+		share = bt_lcp (fencebuf + 1, *fencebuf, key, len);
+	}
 
-uid bt_findkey (BtDb *bt, unsigned char *key, uint len)
-{
-uint  slot;
-BtKey ptr;
-uid id;
+	used = sizeof(*page) + page->cnt * sizeof(BtSlot) + bt->page_size - page->min;
+	used += ((int)page->cnt - 1) * ((int)pfx - (int)share);
+	need = sizeof(BtSlot) + newsize(page, len, share);
 
-	if(( slot = bt_loadpage (bt, key, len, 0, BtLockRead) )) {
-		ptr = keyptr(bt->page, slot);
-	} else {
-		return 0;
-    }
+	//	keep at least two keys on a page, so each level
+	//	is smaller than the one below it
 
-	// if key exists, return row-id
-	//	otherwise return 0
+	if( used + need > (int)bt->page_size || (page->cnt > 1 && used + need > (int)load->fill) ) {
+		if( !(fence = bt_wholekey (bt, page, page->cnt, fencebuf, &fencelen)) )
+			return bt->err;
 
-	if(( ptr->len == len && !memcmp (ptr->key, key, len) )) {
-		id = bt_getid(slotptr(bt->page,slot)->id);
-	}else{
-		id = 0;
-    }
+		if( !load->page_no[lvl] )
+			load->page_no[lvl] = load->next++;
 
-	bt_unlockpage (BtLockRead, bt->latch);
-	bt_unpinlatch (bt->latch);
-	return id;
-}
+		right = load->next++;
+		bt_putid(page->right, right);
 
-//	check page for space available,
-//	clean if necessary and return
-//	0 - page needs splitting
-//	>0 - go ahead with new slot
- 
-uint bt_cleanpage(BtDb *bt, uint amt, uint slot)
-{
-uint nxt = bt->page_size;
-BtPage page = bt->page;
-uint cnt = 0, idx = 0;
-uint max = page->cnt;
-uint newslot = slot;
-BtKey key;
+		if( bt_loadwrite (load, page, load->page_no[lvl]) || bt_loadpost (load, lvl + 1, fence, fencelen, load->page_no[lvl]) )
+			err = bt->err;
 
-	if( page->min >= (max+1) * sizeof(BtSlot) + sizeof(*page) + amt + 1 )
-		return slot;
+		if( fence != fencebuf + 1 )
+			free (fence);
 
-	//	skip cleanup if nothing to reclaim
+		if( err )
+			return err;
 
-	if( !page->clean )
-		return 0;
+		bt_loadinit (load, lvl);
+		load->page_no[lvl] = right;
+		pfx = share = 0;
+	}
 
-	memcpy (bt->frame, page, bt->page_size);
+	if( share != pfx ) {
+		memcpy (bt->frame, page, bt->page_size);
+		memset (page+1, 0, bt->page_size - sizeof(*page));
+		bt_copykeys (bt, page, bt->frame, 1, bt->frame->cnt, share, 0);
+	}
 
-	// skip page info and set rest of page to zero
+	if( page->longkeys && len > BT_keymax ) {
+		if( !(chain = bt_loadchain (load, key + BT_keyhead, len - BT_keyhead)) )
+			return bt->err;
+
+		page->min -= newsize(page, len, share);
+		bt_putlong ((BtKey)((unsigned char *)page + page->min), key, len, chain);
+	} else {
+		page->min -= len - share + 1;
+		((unsigned char *)page)[page->min] = len - share;
+		memcpy ((unsigned char *)page + page->min + 1, key + share, len - share);
+	}
+
+	page->cnt++;
+	page->act++;
+	bt_putid(slotptr(page, page->cnt)->id, id);
+	slotptr(page, page->cnt)->off = page->min;
+#ifdef USETOD
+	slotptr(page, page->cnt)->tod = time(NULL);
+#endif
+	return 0;
+}
+
+//	start a bulk load into an empty btree,
+//	fill is the percentage of each page to use
+
+BtLoad *bt_loadopen (BtDb *bt, uint fill)
+{
+BtLatchSet *latch;
+BtLoad *load;
+uint empty;
+
+	//	the btree must be as bt_open created it
+
+	if(( latch = bt_pinlatch (bt, LEAF_page) )) {
+		bt_lockpage (BtLockRead, latch);
+	} else {
+		return NULL;
+	}
 
-	memset (page+1, 0, bt->page_size - sizeof(*page));
-	page->act = 0;
+	empty = bt_mappage (bt, latch)->cnt == 1;
 
-	while( cnt++ < max ) {
-		if( cnt == slot )
-			newslot = idx + 1;
-		// always leave fence key in list
-		if( cnt < max && slotptr(bt->frame,cnt)->dead )
-			continue;
+	bt_unlockpage (BtLockRead, latch);
+	bt_unpinlatch (latch);
 
-		// copy key
-		key = keyptr(bt->frame, cnt);
-		nxt -= key->len + 1;
-		memcpy ((unsigned char *)page + nxt, key, key->len + 1);
+	if( !empty || bt_getid(bt->latchmgr->alloc[1].right) ||
+		bt_getid(bt->latchmgr->alloc->right) != MIN_lvl + 1 + bt->latchmgr->nlatchpage ) {
+		bt->err = BTERR_struct;
+		return NULL;
+	}
 
-		// copy slot
-		memcpy(slotptr(page, ++idx)->id, slotptr(bt->frame, cnt)->id, BtId);
-		if( !(slotptr(page, idx)->dead = slotptr(bt->frame, cnt)->dead) )
-			page->act++;
-#ifdef USETOD
-		slotptr(page, idx)->tod = slotptr(bt->frame, cnt)->tod;
-#endif
-		slotptr(page, idx)->off = nxt;
+	if( !(load = calloc (1, sizeof(BtLoad))) ) {
+		bt->err = BTERR_ovflw;
+		return NULL;
 	}
 
-	page->min = nxt;
-	page->cnt = idx;
+	if( !fill || fill > 100 )
+		fill = 100;
 
-	if( page->min >= (max+1) * sizeof(BtSlot) + sizeof(*page) + amt + 1 )
-		return newslot;
+	load->bt = bt;
+	load->fill = (uint)((uid)bt->page_size * fill / 100);
+	load->next = bt_getid(bt->latchmgr->alloc->right);
+	load->page_no[0] = LEAF_page;
 
-	return 0;
+	return load;
 }
 
-// split the root and raise the height of the btree
+//	add the next key, keys must be in ascending order
 
-BTERR bt_splitroot(BtDb *bt, unsigned char *leftkey, uid page_no2)
+BTERR bt_loadkey (BtLoad *load, unsigned char *key, uint len, uid id)
 {
-uint nxt = bt->page_size;
-BtPage root = bt->page;
-uid right;
+BtDb *bt = load->bt;
+int ans;
 
-	//  Obtain an empty page to use, and copy the current
-	//  root contents into it
+	//	keys must ascend, and sort below the stopper key
 
-	if( !(right = bt_newpage(bt, root)) )
-		return bt->err;
+	if( !len || len > keylimit(bt) || (len > 1 && key[0] == 0xff && key[1] == 0xff) )
+		return bt->err = BTERR_struct;
 
-	// preserve the page info at the bottom
-	// and set rest to zero
+	if( id & ~BT_idmask )
+		return bt->err = BTERR_struct;
 
-	memset(root+1, 0, bt->page_size - sizeof(*root));
+	if( load->count ) {
+		ans = memcmp (load->last, key, load->lastlen < len ? load->lastlen : len);
 
-	// insert first key on newroot page
+		if( ans > 0 || (!ans && load->lastlen >= len) )
+			return bt->err = BTERR_struct;
+	}
 
-	nxt -= *leftkey + 1;
-	memcpy ((unsigned char *)root + nxt, leftkey, *leftkey + 1);
-	bt_putid(slotptr(root, 1)->id, right);
-	slotptr(root, 1)->off = nxt;
-	
-	// insert second key on newroot page
-	// and increase the root height
+	if( len > load->lastmax ) {
+		free (load->last);
+		load->lastmax = 0;
 
-	nxt -= 3;
-	((unsigned char *)root)[nxt] = 2;
-	((unsigned char *)root)[nxt+1] = 0xff;
-	((unsigned char *)root)[nxt+2] = 0xff;
-	bt_putid(slotptr(root, 2)->id, page_no2);
-	slotptr(root, 2)->off = nxt;
+		if( !(load->last = malloc (len)) )
+			return bt->err = BTERR_ovflw;
 
-	bt_putid(root->right, 0);
-	root->min = nxt;		// reset lowest used offset and key count
-	root->cnt = 2;
-	root->act = 2;
-	root->lvl++;
+		load->lastmax = len;
+	}
 
-	// update and release root (bt->page)
+	if( bt_loadpost (load, 0, key, len, id) )
+		return bt->err;
 
-	bt_update(bt, root);
+	load->lastlen = len;
+	memcpy (load->last, key, len);
+	load->count++;
 
-	bt_unlockpage(BtLockWrite, bt->latch);
-	bt_unpinlatch(bt->latch);
 	return 0;
 }
 
-//  split already locked full node
-//	return unlocked.
+//	finish the bulk load and release the loader
 
-BTERR bt_splitpage (BtDb *bt)
+BTERR bt_loadclose (BtLoad *load)
 {
-uint cnt = 0, idx = 0, max, nxt = bt->page_size;
-unsigned char fencekey[256], rightkey[256];
-uid page_no = bt->page_no, right;
-BtLatchSet *latch, *rlatch;
-BtPage page = bt->page;
-uint lvl = page->lvl;
-BtKey key;
+unsigned char stopper[2] = {0xff, 0xff};
+BtDb *bt = load->bt;
+BTERR err = 0;
+uint lvl;
+
+	//	close each level with the stopper key, which
+	//	points to the last page of the level below,
+	//	until a level is left with only one page
+
+	if( bt_loadpost (load, 0, stopper, 2, 0) ) {
+		err = bt->err;
+		goto release;
+	}
 
-	latch = bt->latch;
+	for( lvl = 0; lvl < MAX_lvl; lvl++ ) {
+		if( lvl && !load->page_no[lvl] ) {
+			err = bt_loadwrite (load, load->page[lvl], ROOT_page);
+			break;
+		}
 
-	//  split higher half of keys to bt->frame
-	//	the last key (fence key) might be dead
+		if(( err = bt_loadwrite (load, load->page[lvl], load->page_no[lvl]) ))
+			break;
 
-	memset (bt->frame, 0, bt->page_size);
-	max = page->cnt;
-	cnt = max / 2;
-	idx = 0;
-
-	while( cnt++ < max ) {
-		key = keyptr(page, cnt);
-		nxt -= key->len + 1;
-		memcpy ((unsigned char *)bt->frame + nxt, key, key->len + 1);
-		memcpy(slotptr(bt->frame,++idx)->id, slotptr(page,cnt)->id, BtId);
-		if( !(slotptr(bt->frame, idx)->dead = slotptr(page, cnt)->dead) )
-			bt->frame->act++;
-#ifdef USETOD
-		slotptr(bt->frame, idx)->tod = slotptr(page, cnt)->tod;
-#endif
-		slotptr(bt->frame, idx)->off = nxt;
+		if(( err = bt_loadpost (load, lvl + 1, stopper, 2, load->page_no[lvl]) ))
+			break;
 	}
 
-	//	remember fence key for new right page
+	if( err )
+		goto release;
 
-	memcpy (rightkey, key, key->len + 1);
+	//	hand the pages past the last one to the allocator
 
-	bt->frame->bits = bt->page_bits;
-	bt->frame->min = nxt;
-	bt->frame->cnt = idx;
-	bt->frame->lvl = lvl;
+	bt_spinwritelock (bt->latchmgr->lock);
+	bt_putid(bt->latchmgr->alloc->right, load->next);
+	bt_spinreleasewrite (bt->latchmgr->lock);
+	bt_update (bt, bt->latchmgr->alloc);
 
-	// link right node
+	//	the pages were written around the redo log,
+	//	a checkpoint makes them durable
 
-	if( page_no > ROOT_page )
-		memcpy (bt->frame->right, page->right, BtId);
+	err = bt_checkpoint (bt);
 
-	//	get new free page and write frame to it.
+release:
+	for( lvl = 0; lvl < MAX_lvl; lvl++ )
+		if( load->page[lvl] )
+			free (load->page[lvl]);
 
-	if( !(right = bt_newpage(bt, bt->frame)) )
-		return bt->err;
+	free (load->last);
+	free (load);
+	return bt->err = err;
+}
 
-	//	update lower keys to continue in old page
+//	Range cursors. Each batch is taken from one leaf page
+//	in the buffer pool, it is pinned and read locked while
+//	the caller uses the batch. The next right page is read
+//	ahead while the batch is in use. A finished page is
+//	left by its right link, a page that was left part way
+//	is found again from the last key, as it may have been
+//	split while it was unlocked.
 
-	memcpy (bt->frame, page, bt->page_size);
-	memset (page+1, 0, bt->page_size - sizeof(*page));
-	nxt = bt->page_size;
-	page->clean = 0;
-	page->act = 0;
-	cnt = 0;
-	idx = 0;
+//	start a range scan from the low key, up to and
+//	including the high key, if high is NULL the scan
+//	goes to the end of the btree
 
-	//  assemble page of smaller keys
-	//	(they're all active keys)
+BtCursor *bt_cursoropen (BtDb *bt, unsigned char *low, uint lowlen, unsigned char *high, uint highlen)
+{
+BtCursor *cursor;
 
-	while( cnt++ < max / 2 ) {
-		key = keyptr(bt->frame, cnt);
-		nxt -= key->len + 1;
-		memcpy ((unsigned char *)page + nxt, key, key->len + 1);
-		memcpy(slotptr(page,++idx)->id, slotptr(bt->frame,cnt)->id, BtId);
-#ifdef USETOD
-		slotptr(page, idx)->tod = slotptr(bt->frame, cnt)->tod;
-#endif
-		slotptr(page, idx)->off = nxt;
-		page->act++;
+	if( !(cursor = calloc (1, sizeof(BtCursor))) ) {
+		bt->err = BTERR_ovflw;
+		return NULL;
 	}
 
-	// remember fence key for smaller page
+	cursor->bt = bt;
 
-	memcpy (fencekey, key, key->len + 1);
+	if( !(cursor->last = malloc (lowlen + 1)) || (high && !(cursor->high = malloc (highlen + 1))) ) {
+		bt_cursorclose (cursor);
+		bt->err = BTERR_ovflw;
+		return NULL;
+	}
 
-	bt_putid(page->right, right);
-	page->min = nxt;
-	page->cnt = idx;
+	cursor->lastmax = lowlen + 1;
+	cursor->lastlen = lowlen;
+	memcpy (cursor->last, low, lowlen);
 
-	// if current page is the root page, split it
+	if( high ) {
+		cursor->limit = 1;
+		cursor->highlen = highlen;
+		memcpy (cursor->high, high, highlen);
+	}
 
-	if(( page_no == ROOT_page )) {
-		return bt_splitroot (bt, fencekey, right);
-    }
+	return cursor;
+}
 
-	//	lock right page
+//	release the page of the previous batch
 
-	if(( rlatch = bt_pinlatch (bt, right) )) {
-		bt_lockpage (BtLockParent, rlatch);
-	}else{
-		return bt->err;
-    }
+void bt_cursorrelease (BtCursor *cursor)
+{
+	if( cursor->latch ) {
+		bt_unlockpage (BtLockRead, cursor->latch);
+		bt_unpinlatch (cursor->latch);
+		cursor->latch = NULL;
+	}
+}
 
-	// update left (containing) node
+//	make room for size bytes in a buffer of the cursor
 
-	bt_update(bt, page);
+unsigned char *bt_cursorroom (BtDb *bt, unsigned char **buf, uint *max, uint size)
+{
+	if( size > *max ) {
+		free (*buf);
+		*max = 0;
 
-	bt_lockpage (BtLockParent, latch);
-	bt_unlockpage (BtLockWrite, latch);
+		if( !(*buf = malloc (size)) ) {
+			bt->err = BTERR_ovflw;
+			return NULL;
+		}
 
-	// insert new fence for reformulated left block
+		*max = size;
+	}
 
-	if( bt_insertkey (bt, fencekey+1, *fencekey, lvl+1, page_no, time(NULL)) )
-		return bt->err;
+	return *buf;
+}
+
+//	rebuild the keys of a batch that aren't whole in
+//	the page, the keys of a packed page and long keys,
+//	slot is the one the batch started from
+
+BTERR bt_cursorkeys (BtCursor *cursor, BtPair *pairs, uint count, uint slot)
+{
+BtDb *bt = cursor->bt;
+BtPage page = cursor->page;
+uint idx, size = 0, off = 0;
+BtKey ptr;
 
-	//	switch fence for right block of larger keys to new right page
+	for( idx = 0; idx < count; idx++ )
+		if( !pairs[idx].key )
+			size += pairs[idx].len;
 
-	if( bt_insertkey (bt, rightkey+1, *rightkey, lvl+1, right, time(NULL)) )
+	if( !bt_cursorroom (bt, &cursor->keys, &cursor->keymax, size) )
 		return bt->err;
 
-	bt_unlockpage (BtLockParent, latch);
-	bt_unlockpage (BtLockParent, rlatch);
+	for( idx = 0; idx < count; idx++, slot++ ) {
+		while( slotptr(page, slot)->dead )
+			slot++;
+
+		if( pairs[idx].key )
+			continue;
+
+		pairs[idx].key = cursor->keys + off;
+		ptr = keyptr(page, slot);
+
+		if( longkey(page, ptr) ) {
+			memcpy (pairs[idx].key, ptr->key, BT_keyhead);
+
+			if( bt_readchain (bt, bt_getid(keyovfl(ptr)->page), pairs[idx].key + BT_keyhead, pairs[idx].len - BT_keyhead) )
+				return bt->err;
+		} else {
+			memcpy (pairs[idx].key, pfxptr(page), pfxlen(page));
+			memcpy (pairs[idx].key + pfxlen(page), ptr->key, ptr->len);
+		}
+
+		off += pairs[idx].len;
+	}
 
-	bt_unpinlatch (rlatch);
-	bt_unpinlatch (latch);
 	return 0;
 }
 
-//  Insert new key into the btree at requested level.
-//  Pages are unlocked at exit.
+//	return the next batch of up to max keys,
+//	or 0 at the end of the range
 
-BTERR bt_insertkey (BtDb *bt, unsigned char *key, uint len, uint lvl, uid id, uint tod)
+uint bt_cursornext (BtCursor *cursor, BtPair *pairs, uint max)
 {
-uint slot, idx;
+BtDb *bt = cursor->bt;
+uint follow = 0;
+uint count = 0;
+uint first;
 BtPage page;
 BtKey ptr;
 
-  while( 1 ) {
-	if(( slot = bt_loadpage (bt, key, len, lvl, BtLockWrite) )) {
-		ptr = keyptr(bt->page, slot);
-	}
-    else
-	{
-		if( !bt->err )
-			bt->err = BTERR_ovflw;
-		return bt->err;
-	}
-
-	// if key already exists, update id and return
+	if( cursor->latch ) {
+		follow = cursor->slot > cursor->page->cnt;
+		bt_cursorrelease (cursor);
 
-	page = bt->page;
-
-	if( !keycmp (ptr, key, len) ) {
-	  if( slotptr(page, slot)->dead )
-		page->act++;
-	  slotptr(page, slot)->dead = 0;
-#ifdef USETOD
-	  slotptr(page, slot)->tod = tod;
-#endif
-	  bt_putid(slotptr(page,slot)->id, id);
-	  bt_update(bt, bt->page);
-	  bt_unlockpage(BtLockWrite, bt->latch);
-	  bt_unpinlatch (bt->latch);
-	  return 0;
+		if( follow && !cursor->right )
+			cursor->done = 1;
 	}
 
-	// check if page has enough space
-
-	if(( slot = bt_cleanpage (bt, len, slot) ))
-		break;
+	if( cursor->done || !max )
+		return 0;
 
-	if( bt_splitpage (bt) )
-		return bt->err;
-  }
+	while( 1 ) {
 
-  // calculate next available slot and copy key into page
+		//	take the right page, unless it is being deleted
 
-  page->min -= len + 1; // reset lowest used offset
-  ((unsigned char *)page)[page->min] = len;
-  memcpy ((unsigned char *)page + page->min +1, key, len );
+		if( follow ) {
+			if( !(cursor->latch = bt_pinlatch (bt, cursor->right)) )
+				return cursor->done = 1, 0;
 
-  for( idx = slot; idx < page->cnt; idx++ )
-	if( slotptr(page, idx)->dead )
-		break;
+			bt_lockpage (BtLockRead, cursor->latch);
+			cursor->page = bt_mappage (bt, cursor->latch);
+			cursor->slot = 1;
 
-  // now insert key into array before slot
-  // preserving the fence slot
+			if( cursor->page->kill || cursor->page->free ) {
+				bt_cursorrelease (cursor);
+				follow = 0;
+				continue;
+			}
+		} else {
+			if( !(cursor->slot = bt_loadpage (bt, cursor->last, cursor->lastlen, 0, BtLockRead)) )
+				return cursor->done = 1, 0;
 
-  if( idx == page->cnt )
-	idx++, page->cnt++;
+			cursor->latch = bt->latch;
+			cursor->page = bt->page;
 
-  page->act++;
+			if( cursor->started && !bt_slotcmp (bt, cursor->page, cursor->slot, cursor->last, cursor->lastlen) )
+				cursor->slot++;
+		}
 
-  while( idx > slot )
-	*slotptr(page, idx) = *slotptr(page, idx -1), idx--;
+		page = cursor->page;
+		first = cursor->slot;
 
-  bt_putid(slotptr(page,slot)->id, id);
-  slotptr(page, slot)->off = page->min;
-#ifdef USETOD
-  slotptr(page, slot)->tod = tod;
+		if(( cursor->right = bt_getid(page->right) )) {
+#ifdef unix
+			posix_fadvise (bt->idx, cursor->right << bt->page_bits, bt->page_size, POSIX_FADV_WILLNEED);
 #endif
-  slotptr(page, slot)->dead = 0;
-
-  bt_update(bt, bt->page);
-
-  bt_unlockpage(BtLockWrite, bt->latch);
-  bt_unpinlatch(bt->latch);
-  return 0;
-}
-
-//  cache page of keys into cursor and return starting slot for given key
+		}
 
-uint bt_startkey (BtDb *bt, unsigned char *key, uint len)
-{
-uint slot;
+		for( ; cursor->slot <= page->cnt && count < max; cursor->slot++ ) {
+			if( slotptr(page, cursor->slot)->dead )
+				continue;
 
-	// cache page for retrieval
+			//	the stopper key ends the last page
 
-	if(( slot = bt_loadpage (bt, key, len, 0, BtLockRead) )) {
-	  memcpy (bt->cursor, bt->page, bt->page_size);
-	}else{
-	  return 0;
-    }
+			if( !cursor->right && cursor->slot == page->cnt ) {
+				cursor->done = 1;
+				break;
+			}
 
-	bt_unlockpage(BtLockRead, bt->latch);
-	bt->cursor_page = bt->page_no;
-	bt_unpinlatch (bt->latch);
-	return slot;
-}
+			if( cursor->limit && bt_slotcmp (bt, page, cursor->slot, cursor->high, cursor->highlen) > 0 ) {
+				cursor->done = 1;
+				break;
+			}
 
-//  return next slot for cursor page
-//  or slide cursor right into next page
+			//	a key that isn't whole in the page is rebuilt
 
-uint bt_nextkey (BtDb *bt, uint slot)
-{
-BtLatchSet *latch;
-off64_t right;
+			ptr = keyptr(page, cursor->slot);
 
-  do {
-	right = bt_getid(bt->cursor->right);
+			if( longkey(page, ptr) ) {
+				pairs[count].key = NULL;
+				pairs[count].len = bt_ovfllen (keyovfl(ptr));
+			} else {
+				pairs[count].key = pfxlen(page) ? NULL : ptr->key;
+				pairs[count].len = pfxlen(page) + ptr->len;
+			}
 
-	while( slot++ < bt->cursor->cnt )
-	  if( slotptr(bt->cursor,slot)->dead ) {
-		continue;
-	  } else if( right || (slot < bt->cursor->cnt)) {
-		return slot;
-	  } else {
-		break;
-      }
+			pairs[count].id = bt_getid(slotptr(page, cursor->slot)->id);
+			count++;
+		}
 
-	if( !right )
-		break;
+		if( count ) {
+			if( bt_cursorkeys (cursor, pairs, count, first) )
+				return cursor->done = 1, 0;
 
-	bt->cursor_page = right;
+			if( !bt_cursorroom (bt, &cursor->last, &cursor->lastmax, pairs[count - 1].len) )
+				return cursor->done = 1, 0;
 
-	if(( latch = bt_pinlatch (bt, right) )) {
-    	bt_lockpage(BtLockRead, latch);
-	}else{
-		return 0;
-    }
+			cursor->lastlen = pairs[count - 1].len;
+			memcpy (cursor->last, pairs[count - 1].key, cursor->lastlen);
+			cursor->started = 1;
+			return count;
+		}
 
-	bt->page = bt_mappage (bt, latch);
-	memcpy (bt->cursor, bt->page, bt->page_size);
-	bt_unlockpage(BtLockRead, latch);
-	bt_unpinlatch (latch);
-	slot = 0;
-  } while( 1 );
+		bt_cursorrelease (cursor);
 
-  return bt->err = 0;
-}
+		if( cursor->done || !cursor->right )
+			return cursor->done = 1, 0;
 
-BtKey bt_key(BtDb *bt, uint slot)
-{
-	return keyptr(bt->cursor, slot);
+		follow = 1;
+	}
 }
 
-uid bt_uid(BtDb *bt, uint slot)
-{
-	return bt_getid(slotptr(bt->cursor,slot)->id);
-}
+//	finish the scan and release the cursor
 
-#ifdef USETOD
-uint bt_tod(BtDb *bt, uint slot)
+void bt_cursorclose (BtCursor *cursor)
 {
-	return slotptr(bt->cursor,slot)->tod;
+	bt_cursorrelease (cursor);
+	free (cursor->keys);
+	free (cursor->last);
+	free (cursor->high);
+	free (cursor);
 }
-#endif
-
@@ -0,0 +1,319 @@
+
+#include <stdio.h>
+#include <time.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/isam.h"
+#include "xas/misc/misc.h"
+#include "rms-test.h"
+
+/*
+ * keyed access. A unique index on the id and an index with duplicates
+ * on the city. Lookups, partial keys, ranges, updates and deletes are
+ * checked against the indexes. An update whose second key can't be
+ * made must leave the record and its first key as they were. Then the
+ * indexes are removed and rebuilt from the data file.
+ */
+
+#define RECORDS 5000
+
+typedef struct _person_s {
+    char id[8];
+    char name[16];
+    char city[8];
+} person_t;
+
+char *cities[4] = {
+    "boston  ", "chicago ", "denver  ", "seattle "
+};
+
+isam_t *temp = NULL;
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+char *path = "";
+char *filename = "isam-test1";
+
+int by_id(void *record, void *key, int *length) {
+
+    memcpy(key, ((person_t *)record)->id, 8);
+    *length = 8;
+
+    return OK;
+
+}
+
+/* there is no key for nowhere */
+
+int by_city(void *record, void *key, int *length) {
+
+    if (memcmp(((person_t *)record)->city, "nowhere ", 8) == 0) return ERR;
+
+    memcpy(key, ((person_t *)record)->city, 8);
+    *length = 8;
+
+    return OK;
+
+}
+
+int compare(void *wanted, void *data) {
+
+    return (memcmp(wanted, data, 8) == 0);
+
+}
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+void capture_trace(error_trace_t *error) {
+
+    tracer_add(trace, error);
+
+}
+
+int count_city(char *city) {
+
+    int count = 0;
+    off_t recnum = 0;
+    person_t person;
+
+    isam_start(temp, 1, city, 8, ISAM_S_EQUAL);
+
+    for (isam_next(temp, &person, &recnum); recnum > 0;
+         isam_next(temp, &person, &recnum)) {
+
+        if (memcmp(person.city, city, 8) == 0) count++;
+
+    }
+
+    return count;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int stat = OK;
+    int bad = 0;
+    int count = 0;
+    int ids = 0;
+    int cities_ix = 0;
+    off_t recnum = 0;
+    off_t found = 0;
+    person_t person;
+    char id[9];
+    double keyed = 0;
+    double scanned = 0;
+    struct timespec start;
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        temp = isam_create(path, filename, 100, sizeof(person_t), 30, 30);
+        check_creation(temp);
+
+        stat = isam_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = isam_add_index(temp, FALSE, by_id, &ids);
+        check_return(stat, temp);
+
+        stat = isam_add_index(temp, TRUE, by_city, &cities_ix);
+        check_return(stat, temp);
+
+        stat = rel_set_autoextend(REL(temp), TRUE);
+        check_return(stat, temp);
+
+        stat = isam_open(temp, O_RDWR, (S_IRWXU | S_IRWXG));
+        check_return(stat, temp);
+
+        for (x = 0; x < RECORDS; x++) {
+
+            memset(&person, ' ', sizeof(person_t));
+            snprintf(id, 9, "%08d", x * 2);
+            memcpy(person.id, id, 8);
+            memcpy(person.name, "name", 4);
+            memcpy(person.city, cities[x % 4], 8);
+
+            stat = isam_add(temp, &person);
+            check_return(stat, temp);
+
+        }
+
+        /* a duplicate id is refused, the expected error isn't traced */
+
+        stat = isam_set_trace(temp, NULL);
+        check_return(stat, temp);
+
+        stat = isam_add(temp, &person);
+        printf("duplicate add: %s\n", (stat == ERR) ? "refused" : "ALLOWED");
+
+        if (stat != ERR) bad++;
+
+        stat = isam_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        /* keyed lookup against a full scan */
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        stat = isam_get_key(temp, ids, "00009000", 8, &person, &recnum);
+        check_return(stat, temp);
+
+        keyed = elapsed(&start) * 1000.0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        stat = rel_find(REL(temp), "00009000", compare, &found);
+        check_return(stat, temp);
+
+        scanned = elapsed(&start) * 1000.0;
+
+        printf("keyed: record %ld, %.8s, %.1f us\n", (long)recnum, person.id, keyed);
+        printf("scan: record %ld, %.1f us\n", (long)found, scanned);
+
+        stat = isam_get_key(temp, ids, "00009001", 8, &person, &recnum);
+        check_return(stat, temp);
+
+        printf("missing key: record %ld\n", (long)recnum);
+
+        /* partial key, 0000010 matches 00000100 .. 00000108 */
+
+        count = 0;
+        stat = isam_start(temp, ids, "0000010", 7, ISAM_S_PARTIAL);
+        check_return(stat, temp);
+
+        for (isam_next(temp, &person, &recnum); recnum > 0;
+             isam_next(temp, &person, &recnum)) {
+
+            count++;
+
+        }
+
+        printf("partial: %d records\n", count);
+
+        /* range, 00001000 .. 00001998 inclusive */
+
+        count = 0;
+        stat = isam_range(temp, ids, "00001000", 8, "00001998", 8);
+        check_return(stat, temp);
+
+        for (isam_next(temp, &person, &recnum); recnum > 0;
+             isam_next(temp, &person, &recnum)) {
+
+            count++;
+
+        }
+
+        printf("range: %d records\n", count);
+        printf("denver: %d records\n", count_city("denver  "));
+
+        /* move a record to another city and delete another */
+
+        stat = isam_get_key(temp, ids, "00000002", 8, &person, &recnum);
+        check_return(stat, temp);
+
+        memcpy(person.city, "denver  ", 8);
+
+        stat = isam_put(temp, recnum, &person);
+        check_return(stat, temp);
+
+        stat = isam_get_key(temp, ids, "00000006", 8, &person, &recnum);
+        check_return(stat, temp);
+
+        stat = isam_del(temp, recnum);
+        check_return(stat, temp);
+
+        stat = isam_get_key(temp, ids, "00000006", 8, &person, &recnum);
+        check_return(stat, temp);
+
+        printf("deleted: record %ld\n", (long)recnum);
+        printf("denver: %d records, chicago: %d records\n",
+               count_city("denver  "), count_city("chicago "));
+
+        /* a new id with a city that has no key, the id is moved */
+        /* before the city fails, so it must be put back         */
+
+        count = count_city("boston  ");
+
+        stat = isam_get_key(temp, ids, "00000008", 8, &person, &recnum);
+        check_return(stat, temp);
+
+        found = recnum;
+        memcpy(person.id, "00000009", 8);
+        memcpy(person.city, "nowhere ", 8);
+
+        stat = isam_set_trace(temp, NULL);
+        check_return(stat, temp);
+
+        stat = isam_put(temp, found, &person);
+        printf("failed update: %s\n", (stat == ERR) ? "refused" : "ALLOWED");
+
+        if (stat != ERR) bad++;
+
+        stat = isam_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = isam_get_key(temp, ids, "00000009", 8, &person, &recnum);
+        check_return(stat, temp);
+
+        if (recnum != 0) bad++;
+
+        stat = isam_get_key(temp, ids, "00000008", 8, &person, &recnum);
+        check_return(stat, temp);
+
+        if ((recnum != found) || (memcmp(person.city, "boston  ", 8) != 0)) bad++;
+        if (count_city("boston  ") != count) bad++;
+
+        printf("restored: record %ld, %.8s, boston: %d records\n",
+               (long)recnum, person.city, count_city("boston  "));
+
+        stat = isam_close(temp);
+        check_return(stat, temp);
+
+        /* remove the indexes, they are built on open */
+
+        unlink("isam-test1.ix0");
+        unlink("isam-test1.ix1");
+
+        stat = isam_open(temp, O_RDWR, 0);
+        check_return(stat, temp);
+
+        stat = isam_get_key(temp, ids, "00009000", 8, &person, &recnum);
+        check_return(stat, temp);
+
+        printf("rebuilt: record %ld, denver: %d records\n",
+               (long)recnum, count_city("denver  "));
+
+        stat = isam_remove(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    isam_destroy(temp);
+
+    return passed(bad);
+
+}
+
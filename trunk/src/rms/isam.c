@@ -0,0 +1,1625 @@
+
+/*---------------------------------------------------------------------------*/
+/*                Copyright (c) 2024 by Kevin L. Esteb                       */
+/*                                                                           */
+/*  Permission to use, copy, modify, and distribute this software and its    */
+/*  documentation for any purpose and without fee is hereby granted,         */
+/*  provided that this copyright notice appears in all copies. The author    */
+/*  makes no representations about the suitability of this software for      */
+/*  any purpose. It is provided "as is" without express or implied warranty. */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+
+#include "xas/rms/isam.h"
+#include "xas/error_codes.h"
+#include "xas/error_handler.h"
+#include "xas/gpl/fnm_util.h"
+
+require_klass(REL_KLASS);
+
+/*----------------------------------------------------------------*/
+/* klass methods                                                  */
+/*----------------------------------------------------------------*/
+
+int _isam_ctor(object_t *, item_list_t *);
+int _isam_dtor(object_t *);
+int _isam_compare(isam_t *, isam_t *);
+int _isam_override(isam_t *, item_list_t *);
+
+int _isam_start(isam_t *, int, void *, int, int);
+int _isam_next(isam_t *, void *, off_t *);
+
+/*----------------------------------------------------------------*/
+/* klass overrides                                                */
+/*----------------------------------------------------------------*/
+
+int _isam_open(rel_t *, int, mode_t);
+int _isam_remove(rel_t *);
+int _isam_add(rel_t *, void *);
+int _isam_put(rel_t *, off_t, void *);
+int _isam_del(rel_t *, off_t);
+int _isam_put_many(rel_t *, off_t *, void **, int);
+
+/* the rel methods that are extended */
+
+extern int _rel_open(rel_t *, int, mode_t);
+extern int _rel_remove(rel_t *);
+extern int _rel_add(rel_t *, void *);
+extern int _rel_put(rel_t *, off_t, void *);
+extern int _rel_del(rel_t *, off_t);
+
+/*----------------------------------------------------------------*/
+/* klass declaration                                              */
+/*----------------------------------------------------------------*/
+
+declare_klass(ISAM_KLASS) {
+    .size = KLASS_SIZE(isam_t),
+    .name = KLASS_NAME(isam_t),
+    .ctor = _isam_ctor,
+    .dtor = _isam_dtor,
+};
+
+/*----------------------------------------------------------------*/
+/* klass private macros                                           */
+/*----------------------------------------------------------------*/
+
+/* each index is a btree in <name>.ix<n>. The pages are 4k and the */
+/* buffer pool holds 256 of them. On an index that allows          */
+/* duplicates, the record number is appended to the key, so each   */
+/* entry is unique and duplicates are returned in record order.    */
+
+#define ISAM_B_BITS      12
+#define ISAM_B_POOL      256
+#define ISAM_K_RECNUM    BtId
+#define ISAM_K_STORED    (ISAM_KEYSIZE + ISAM_K_RECNUM)
+
+/* a missing index is rebuilt by sorting the keys in memory and   */
+/* bulk loading them, leaving room on the pages for later inserts */
+
+#define ISAM_B_FILL      90
+#define ISAM_B_ENTRIES   1024
+
+typedef struct _isam_entry_s {
+    off_t recnum;
+    int length;
+    unsigned char key[];
+} isam_entry_t;
+
+/*----------------------------------------------------------------*/
+/* private methods                                                */
+/*----------------------------------------------------------------*/
+
+static void _isam_path(isam_t *, int, char *, int);
+static int _isam_key(isam_t *, int, void *, off_t, unsigned char *, int *);
+static int _isam_unique(isam_t *, int, unsigned char *, int, off_t);
+static int _isam_insert(isam_t *, int, unsigned char *, int, off_t);
+static int _isam_delete(isam_t *, int, unsigned char *, int);
+static int _isam_compare_entry(const void *, const void *);
+static int _isam_load(isam_t *, int, isam_entry_t **, int);
+static int _isam_build(isam_t *);
+static void _isam_close_indexes(isam_t *);
+
+/*----------------------------------------------------------------*/
+/* klass interface                                                */
+/*----------------------------------------------------------------*/
+
+isam_t *isam_create(char *path, char *name, int records, int recsize, int retries, int timeout) {
+
+    int stat = ERR;
+    char xpath[256];
+    isam_t *self = NULL;
+    item_list_t items[7];
+
+    memset(xpath, '\0', 256);
+    strncpy(xpath, fnm_build(1, FnmPath, name, ".dat", path, NULL), 255);
+
+    SET_ITEM(items[0], FIB_K_PATH, xpath, strlen(xpath), NULL);
+    SET_ITEM(items[1], REL_K_NAME, name, strlen(name), NULL);
+    SET_ITEM(items[2], BLK_K_RETRIES, &retries, sizeof(int), NULL);
+    SET_ITEM(items[3], BLK_K_TIMEOUT, &timeout, sizeof(int), NULL);
+    SET_ITEM(items[4], REL_K_RECORDS, &records, sizeof(int), NULL);
+    SET_ITEM(items[5], REL_K_RECSIZE, &recsize, sizeof(int), NULL);
+    SET_ITEM(items[6], 0,0,0,0);
+
+    self = (isam_t *)object_create(ISAM_KLASS, items, &stat);
+
+    return self;
+
+}
+
+int isam_destroy(isam_t *self) {
+
+    int stat = OK;
+
+    when_error {
+
+        if (self != NULL) {
+
+            if (object_assert(self, isam_t)) {
+
+                stat = self->dtor(OBJECT(self));
+                check_return(stat, self);
+
+            } else {
+
+                cause_error(E_INVOBJ);
+
+            }
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int isam_override(isam_t *self, item_list_t *items) {
+
+    int stat = OK;
+
+    when_error {
+
+        if (self != NULL) {
+
+            stat = self->_override(self, items);
+            check_return(stat, self);
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int isam_compare(isam_t *us, isam_t *them) {
+
+    int stat = OK;
+
+    when_error {
+
+        if (us != NULL) {
+
+            if (object_assert(them, isam_t)) {
+
+                stat = us->_compare(us, them);
+                check_return(stat, us);
+
+            } else {
+
+                cause_error(E_INVOBJ);
+
+            }
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(us);
+
+    } end_when;
+
+    return stat;
+
+}
+
+char *isam_version(isam_t *self) {
+
+    char *version = PACKAGE_VERSION;
+
+    return version;
+
+}
+
+int isam_add_index(isam_t *self, int duplicates, int (*extract)(void *, void *, int *), int *index) {
+
+    int x;
+    int stat = OK;
+    isam_index_t *temp = NULL;
+
+    when_error_in {
+
+        if ((self == NULL) || (extract == NULL) || (index == NULL)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        /* indexes can only be added while the indexes are closed */
+
+        for (x = 0; x < self->indexes; x++) {
+
+            if (self->index[x].btree != NULL) {
+
+                cause_error(E_INVOPS);
+
+            }
+
+        }
+
+        errno = 0;
+        temp = realloc(self->index, (self->indexes + 1) * sizeof(isam_index_t));
+        check_null(temp);
+
+        self->index = temp;
+        self->index[self->indexes].duplicates = duplicates;
+        self->index[self->indexes].rebuild = FALSE;
+        self->index[self->indexes].extract = extract;
+        self->index[self->indexes].btree = NULL;
+
+        *index = self->indexes;
+        self->indexes++;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int isam_close(isam_t *self) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if (self == NULL) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        _isam_close_indexes(self);
+
+        stat = rel_close(REL(self));
+        check_return(stat, REL(self));
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int isam_start(isam_t *self, int index, void *key, int length, int match) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || ((key == NULL) && (length > 0)) ||
+            (length < 0) || (length > ISAM_KEYSIZE) ||
+            ((match != ISAM_S_EQUAL) &&
+             (match != ISAM_S_PARTIAL) &&
+             (match != ISAM_S_GREATER))) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        stat = self->_start(self, index, key, length, match);
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int isam_range(isam_t *self, int index, void *low, int lowlen, void *high, int highlen) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || ((low == NULL) && (lowlen > 0)) ||
+            (lowlen < 0) || (lowlen > ISAM_KEYSIZE) ||
+            (high == NULL) || (highlen < 0) || (highlen > ISAM_KEYSIZE)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        stat = self->_start(self, index, low, lowlen, ISAM_S_GREATER);
+        check_return(stat, self);
+
+        memcpy(self->high, high, highlen);
+        self->highlen = highlen;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int isam_next(isam_t *self, void *record, off_t *recnum) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (recnum == NULL)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        stat = self->_next(self, record, recnum);
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int isam_get_key(isam_t *self, int index, void *key, int length, void *record, off_t *recnum) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (key == NULL) || (recnum == NULL) ||
+            (length < 1) || (length > ISAM_KEYSIZE)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        stat = self->_start(self, index, key, length, ISAM_S_EQUAL);
+        check_return(stat, self);
+
+        stat = self->_next(self, record, recnum);
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+/*----------------------------------------------------------------*/
+/* klass implementation                                           */
+/*----------------------------------------------------------------*/
+
+int _isam_ctor(object_t *object, item_list_t *items) {
+
+    int stat = OK;
+    isam_t *self = NULL;
+
+    if (object != NULL) {
+
+        stat = OK;
+
+        when_error_in {
+
+            /* intialize the base klass here */
+
+            stat = REL_KLASS->ctor(object, items);
+            check_return(stat, object);
+
+            /* initilize our base klass here */
+
+            object_set_error1(object, OK);
+
+            /* initialize our derived klass here */
+
+            self = ISAM(object);
+
+            /* assign our methods here */
+
+            self->ctor = _isam_ctor;
+            self->dtor = _isam_dtor;
+            self->_compare = _isam_compare;
+            self->_override = _isam_override;
+
+            self->_start = _isam_start;
+            self->_next  = _isam_next;
+
+            /* the rel methods that maintain the indexes */
+
+            REL(object)->_open = _isam_open;
+            REL(object)->_remove = _isam_remove;
+            REL(object)->_add = _isam_add;
+            REL(object)->_put = _isam_put;
+            REL(object)->_del = _isam_del;
+            REL(object)->_put_many = _isam_put_many;
+
+            /* initialize internal variables here */
+
+            self->indexes = 0;
+            self->index = NULL;
+            self->current = -1;
+            self->match = ISAM_S_EQUAL;
+            self->slot = 0;
+            self->wantlen = 0;
+            self->highlen = -1;
+
+            exit_when;
+
+        } use {
+
+            stat = ERR;
+            process_error(self);
+
+        } end_when;
+
+    }
+
+    return stat;
+
+}
+
+int _isam_dtor(object_t *object) {
+
+    int stat = OK;
+    rel_t *rel = REL(object);
+    isam_t *self = ISAM(object);
+
+    /* free local resources here */
+
+    _isam_close_indexes(self);
+    free(self->index);
+
+    /* walk the chain, freeing as we go */
+
+    object_demote(object, rel_t);
+    rel_destroy(rel);
+
+    return stat;
+
+}
+
+int _isam_override(isam_t *self, item_list_t *items) {
+
+    int stat = ERR;
+
+    when_error_in {
+
+        if (items != NULL) {
+
+            stat = rel_override(REL(self), items);
+            check_return(stat, self);
+
+            errno = E_UNKOVER;
+
+            int x;
+            for (x = 0;; x++) {
+
+                if ((items[x].buffer_length == 0) &&
+                    (items[x].item_code == 0)) break;
+
+                switch(items[x].item_code) {
+                    case ISAM_M_DESTRUCTOR: {
+                        self->dtor = NULL;
+                        self->dtor = items[x].buffer_address;
+                        check_null(self->dtor);
+                        break;
+                    }
+                    case ISAM_M_START: {
+                        self->_start = NULL;
+                        self->_start = items[x].buffer_address;
+                        check_null(self->_start);
+                        break;
+                    }
+                    case ISAM_M_NEXT: {
+                        self->_next = NULL;
+                        self->_next = items[x].buffer_address;
+                        check_null(self->_next);
+                        break;
+                    }
+                }
+
+            }
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _isam_compare(isam_t *self, isam_t *other) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((rel_compare(REL(self), REL(other)) == 0) &&
+            (self->ctor == other->ctor) &&
+            (self->dtor == other->dtor) &&
+            (self->_compare == other->_compare) &&
+            (self->_override == other->_override) &&
+            (self->_start == other->_start) &&
+            (self->_next == other->_next) &&
+            (self->indexes == other->indexes)) {
+
+            stat = OK;
+
+        } else {
+
+            cause_error(E_NOTSAME);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _isam_start(isam_t *self, int index, void *key, int length, int match) {
+
+    uint slot = 0;
+    int stat = OK;
+    BtDb *btree = NULL;
+    unsigned char empty[1] = {0};
+
+    when_error_in {
+
+        if ((index < 0) || (index >= self->indexes)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        if ((btree = self->index[index].btree) == NULL) {
+
+            cause_error(E_INVOPS);
+
+        }
+
+        self->current = -1;
+        self->highlen = -1;
+
+        if (length == 0) key = empty;
+
+        /* the slot of the first key >= key, _next() moves from there */
+
+        if ((slot = bt_startkey(btree, key, length)) == 0) {
+
+            if (btree->err) {
+
+                cause_error(EIO);
+
+            }
+
+        } else {
+
+            memcpy(self->want, key, length);
+
+            self->slot = slot - 1;
+            self->match = match;
+            self->wantlen = length;
+            self->current = index;
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _isam_next(isam_t *self, void *record, off_t *recnum) {
+
+    uid id = 0;
+    int cmp = 0;
+    uint slot = 0;
+    int stat = OK;
+    int length = 0;
+    BtKey key = NULL;
+    BtDb *btree = NULL;
+    isam_index_t *index = NULL;
+
+    when_error_in {
+
+        *recnum = 0;
+
+        while (self->current >= 0) {
+
+            index = &self->index[self->current];
+            btree = index->btree;
+
+            if ((slot = bt_nextkey(btree, self->slot)) == 0) {
+
+                self->current = -1;
+
+                if (btree->err) {
+
+                    cause_error(EIO);
+
+                }
+
+                break;
+
+            }
+
+            self->slot = slot;
+
+            key = bt_key(btree, slot);
+            id = bt_uid(btree, slot);
+            length = key->len - (index->duplicates ? ISAM_K_RECNUM : 0);
+
+            /* the keys are in order, so the first miss ends the scan */
+
+            if (self->match == ISAM_S_EQUAL) {
+
+                if ((length < self->wantlen) ||
+                    (memcmp(key->key, self->want, self->wantlen) != 0)) {
+
+                    self->current = -1;
+                    break;
+
+                }
+
+                if (length != self->wantlen) continue;
+
+            } else if (self->match == ISAM_S_PARTIAL) {
+
+                if ((length < self->wantlen) ||
+                    (memcmp(key->key, self->want, self->wantlen) != 0)) {
+
+                    self->current = -1;
+                    break;
+
+                }
+
+            } else if (self->highlen >= 0) {
+
+                cmp = memcmp(key->key, self->high,
+                             (length < self->highlen) ? length : self->highlen);
+
+                if ((cmp > 0) || ((cmp == 0) && (length > self->highlen))) {
+
+                    self->current = -1;
+                    break;
+
+                }
+
+            }
+
+            if (id == 0) continue;
+
+            *recnum = id;
+
+            if (record != NULL) {
+
+                stat = REL(self)->_get(REL(self), id, record);
+                check_return(stat, REL(self));
+
+            }
+
+            break;
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _isam_open(rel_t *rel, int flags, mode_t mode) {
+
+    int x;
+    int stat = OK;
+    int exists = 0;
+    int opened = FALSE;
+    char path[1024];
+    isam_t *self = ISAM(rel);
+
+    when_error_in {
+
+        stat = blk_exists(BLK(rel), &exists);
+        check_return(stat, rel);
+
+        stat = _rel_open(rel, flags, mode);
+        check_return(stat, rel);
+
+        opened = TRUE;
+
+        /* an index that is missing for an existing file is built */
+
+        for (x = 0; x < self->indexes; x++) {
+
+            _isam_path(self, x, path, sizeof(path));
+
+            self->index[x].rebuild = (exists && (access(path, F_OK) != 0));
+
+            errno = E_NOLOAD;
+            self->index[x].btree = bt_open(path, BT_rw, ISAM_B_BITS, ISAM_B_POOL);
+            check_null(self->index[x].btree);
+
+        }
+
+        stat = _isam_build(self);
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        /* nothing is left open for the next try */
+
+        _isam_close_indexes(self);
+        if (opened) rel_close(rel);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _isam_remove(rel_t *rel) {
+
+    int x;
+    int y;
+    int stat = OK;
+    char path[1024];
+    isam_t *self = ISAM(rel);
+
+    when_error_in {
+
+        _isam_close_indexes(self);
+
+        for (x = 0; x < self->indexes; x++) {
+
+            _isam_path(self, x, path, sizeof(path));
+
+            if ((unlink(path) != 0) && (errno != ENOENT)) {
+
+                cause_error(errno);
+
+            }
+
+            /* and the redo logs of the btree */
+
+            for (y = 0; y < 2; y++) {
+
+                _isam_path(self, x, path, sizeof(path));
+                snprintf(path + strlen(path), sizeof(path) - strlen(path), ".log%d", y);
+
+                if ((unlink(path) != 0) && (errno != ENOENT)) {
+
+                    cause_error(errno);
+
+                }
+
+            }
+
+        }
+
+        stat = _rel_remove(rel);
+        check_return(stat, rel);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _isam_add(rel_t *rel, void *record) {
+
+    int x;
+    int y;
+    int stat = OK;
+    int length = 0;
+    int inserted = 0;
+    off_t recnum = 0;
+    isam_t *self = ISAM(rel);
+    unsigned char key[ISAM_K_STORED];
+
+    when_error_in {
+
+        /* nobody else may add a key between the check and the */
+        /* insert, so the master lock is held across all three */
+
+        stat = rel->_master_lock(rel);
+        check_return(stat, rel);
+
+        rel->master_held = TRUE;
+
+        /* check every unique key before the record is written */
+
+        for (x = 0; x < self->indexes; x++) {
+
+            if (! self->index[x].duplicates) {
+
+                stat = _isam_key(self, x, record, 0, key, &length);
+                check_return(stat, self);
+
+                stat = _isam_unique(self, x, key, length, 0);
+                check_return(stat, self);
+
+            }
+
+        }
+
+        stat = _rel_add(rel, record);
+        check_return(stat, rel);
+
+        recnum = rel->record;
+
+        for (inserted = 0; inserted < self->indexes; inserted++) {
+
+            stat = _isam_key(self, inserted, record, recnum, key, &length);
+            check_return(stat, self);
+
+            stat = _isam_insert(self, inserted, key, length, recnum);
+            check_return(stat, self);
+
+        }
+
+        rel->master_held = FALSE;
+
+        stat = rel->_master_unlock(rel);
+        check_return(stat, rel);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        /* take back the keys and the record that were added */
+
+        if (recnum > 0) {
+
+            for (y = 0; y < inserted; y++) {
+
+                if (_isam_key(self, y, record, recnum, key, &length) == OK) {
+
+                    _isam_delete(self, y, key, length);
+
+                }
+
+            }
+
+            _rel_del(rel, recnum);
+
+        }
+
+        if (rel->master_held) {
+
+            rel->master_held = FALSE;
+            rel->_master_unlock(rel);
+
+        }
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _isam_put(rel_t *rel, off_t recnum, void *record) {
+
+    int x;
+    int y;
+    int stat = OK;
+    int moved = 0;
+    int length = 0;
+    int oldlength = 0;
+    int written = FALSE;
+    int deleted = FALSE;
+    void *old = NULL;
+    isam_t *self = ISAM(rel);
+    unsigned char key[ISAM_K_STORED];
+    unsigned char oldkey[ISAM_K_STORED];
+
+    when_error_in {
+
+        errno = 0;
+        old = calloc(1, rel->recsize);
+        check_null(old);
+
+        /* as with an add, the master lock is held from the */
+        /* unique check until the keys have been moved      */
+
+        stat = rel->_master_lock(rel);
+        check_return(stat, rel);
+
+        rel->master_held = TRUE;
+
+        stat = rel->_get(rel, recnum, old);
+        check_return(stat, rel);
+
+        for (x = 0; x < self->indexes; x++) {
+
+            if (! self->index[x].duplicates) {
+
+                stat = _isam_key(self, x, record, recnum, key, &length);
+                check_return(stat, self);
+
+                stat = _isam_unique(self, x, key, length, recnum);
+                check_return(stat, self);
+
+            }
+
+        }
+
+        stat = _rel_put(rel, recnum, record);
+        check_return(stat, rel);
+
+        written = TRUE;
+
+        /* only the keys that have changed are moved */
+
+        for (moved = 0; moved < self->indexes; moved++) {
+
+            stat = _isam_key(self, moved, record, recnum, key, &length);
+            check_return(stat, self);
+
+            stat = _isam_key(self, moved, old, recnum, oldkey, &oldlength);
+            check_return(stat, self);
+
+            if ((length != oldlength) || (memcmp(key, oldkey, length) != 0)) {
+
+                stat = _isam_delete(self, moved, oldkey, oldlength);
+                check_return(stat, self);
+
+                deleted = TRUE;
+
+                stat = _isam_insert(self, moved, key, length, recnum);
+                check_return(stat, self);
+
+                deleted = FALSE;
+
+            }
+
+        }
+
+        rel->master_held = FALSE;
+
+        stat = rel->_master_unlock(rel);
+        check_return(stat, rel);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        /* put back the old keys and the old record, a key whose */
+        /* old entry was deleted but not replaced goes back too  */
+
+        if ((written) && (moved < self->indexes)) {
+
+            for (y = 0; y <= moved; y++) {
+
+                if ((_isam_key(self, y, record, recnum, key, &length) != OK) ||
+                    (_isam_key(self, y, old, recnum, oldkey, &oldlength) != OK)) {
+
+                    continue;
+
+                }
+
+                if ((length == oldlength) && (memcmp(key, oldkey, length) == 0)) {
+
+                    continue;
+
+                }
+
+                if (y < moved) {
+
+                    _isam_delete(self, y, key, length);
+                    _isam_insert(self, y, oldkey, oldlength, recnum);
+
+                } else if (deleted) {
+
+                    _isam_insert(self, y, oldkey, oldlength, recnum);
+
+                }
+
+            }
+
+            _rel_put(rel, recnum, old);
+
+        }
+
+        if (rel->master_held) {
+
+            rel->master_held = FALSE;
+            rel->_master_unlock(rel);
+
+        }
+
+    } end_when;
+
+    free(old);
+
+    return stat;
+
+}
+
+int _isam_del(rel_t *rel, off_t recnum) {
+
+    int x;
+    int stat = OK;
+    int length = 0;
+    void *old = NULL;
+    isam_t *self = ISAM(rel);
+    unsigned char key[ISAM_K_STORED];
+
+    when_error_in {
+
+        errno = 0;
+        old = calloc(1, rel->recsize);
+        check_null(old);
+
+        /* the record read is the one whose keys are deleted, */
+        /* so the master lock is held until they are gone     */
+
+        stat = rel->_master_lock(rel);
+        check_return(stat, rel);
+
+        rel->master_held = TRUE;
+
+        stat = rel->_get(rel, recnum, old);
+        check_return(stat, rel);
+
+        stat = _rel_del(rel, recnum);
+        check_return(stat, rel);
+
+        for (x = 0; x < self->indexes; x++) {
+
+            stat = _isam_key(self, x, old, recnum, key, &length);
+            check_return(stat, self);
+
+            stat = _isam_delete(self, x, key, length);
+            check_return(stat, self);
+
+        }
+
+        rel->master_held = FALSE;
+
+        stat = rel->_master_unlock(rel);
+        check_return(stat, rel);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        if (rel->master_held) {
+
+            rel->master_held = FALSE;
+            rel->_master_unlock(rel);
+
+        }
+
+    } end_when;
+
+    free(old);
+
+    return stat;
+
+}
+
+int _isam_put_many(rel_t *rel, off_t *recnums, void **records, int count) {
+
+    /* each record may move keys, so they are updated one at a */
+    /* time, each under the master lock _isam_put holds        */
+
+    int x;
+    int stat = OK;
+
+    when_error_in {
+
+        for (x = 0; x < count; x++) {
+
+            stat = _isam_put(rel, recnums[x], records[x]);
+            check_return(stat, rel);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(rel);
+
+    } end_when;
+
+    return stat;
+
+}
+
+/*----------------------------------------------------------------*/
+/* private methods                                                */
+/*----------------------------------------------------------------*/
+
+static void _isam_path(isam_t *self, int index, char *path, int size) {
+
+    char extension[32];
+
+    snprintf(extension, sizeof(extension), ".ix%d", index);
+
+    memset(path, '\0', size);
+    strncpy(path, fnm_build(1, FnmPath, extension, FIB(self)->path, NULL), size - 1);
+
+}
+
+static int _isam_key(isam_t *self, int index, void *record, off_t recnum, unsigned char *key, int *length) {
+
+    /* extract the key, on a duplicates index the record number */
+    /* is appended, most significant byte first                 */
+
+    int x;
+    int stat = OK;
+
+    when_error_in {
+
+        *length = 0;
+
+        stat = self->index[index].extract(record, key, length);
+        check_status(stat);
+
+        if ((*length < 1) || (*length > ISAM_KEYSIZE)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        if (self->index[index].duplicates) {
+
+            for (x = ISAM_K_RECNUM; x--; recnum >>= 8) {
+
+                key[*length + x] = (unsigned char)(recnum & 0xff);
+
+            }
+
+            *length += ISAM_K_RECNUM;
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+static int _isam_unique(isam_t *self, int index, unsigned char *key, int length, off_t recnum) {
+
+    uid id = 0;
+    int stat = OK;
+
+    when_error_in {
+
+        id = bt_findkey(self->index[index].btree, key, length);
+
+        if ((id != 0) && (id != recnum)) {
+
+            cause_error(E_DUPKEY);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+static int _isam_insert(isam_t *self, int index, unsigned char *key, int length, off_t recnum) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if (bt_insertkey(self->index[index].btree, key, length, 0, recnum, 0) != BTERR_ok) {
+
+            cause_error(EIO);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+static int _isam_delete(isam_t *self, int index, unsigned char *key, int length) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if (bt_deletekey(self->index[index].btree, key, length, 0) != BTERR_ok) {
+
+            cause_error(EIO);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+static int _isam_compare_entry(const void *a, const void *b) {
+
+    int stat = 0;
+    isam_entry_t *x = *(isam_entry_t **)a;
+    isam_entry_t *y = *(isam_entry_t **)b;
+
+    stat = memcmp(x->key, y->key, (x->length < y->length) ? x->length : y->length);
+    if (stat == 0) stat = x->length - y->length;
+
+    return stat;
+
+}
+
+static int _isam_load(isam_t *self, int index, isam_entry_t **entries, int count) {
+
+    /* sort the keys and bulk load them into the empty btree */
+
+    int x;
+    int stat = OK;
+    BtLoad *load = NULL;
+    BtDb *btree = self->index[index].btree;
+
+    when_error_in {
+
+        qsort(entries, count, sizeof(isam_entry_t *), _isam_compare_entry);
+
+        for (x = 1; x < count; x++) {
+
+            if (_isam_compare_entry(&entries[x - 1], &entries[x]) == 0) {
+
+                cause_error(E_DUPKEY);
+
+            }
+
+        }
+
+        if ((load = bt_loadopen(btree, ISAM_B_FILL)) == NULL) {
+
+            cause_error(EIO);
+
+        }
+
+        for (x = 0; x < count; x++) {
+
+            if (bt_loadkey(load, entries[x]->key, entries[x]->length, entries[x]->recnum) != BTERR_ok) {
+
+                cause_error(EIO);
+
+            }
+
+        }
+
+        stat = bt_loadclose(load);
+        load = NULL;
+
+        if (stat != BTERR_ok) {
+
+            cause_error(EIO);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    if (load != NULL) bt_loadclose(load);
+
+    return stat;
+
+}
+
+static int _isam_build(isam_t *self) {
+
+    /* collect the keys of the live records, then sort and bulk */
+    /* load them into the new indexes                           */
+
+    int x;
+    int y;
+    int stat = OK;
+    int build = FALSE;
+    int length = 0;
+    int count = 0;
+    int size = ISAM_B_ENTRIES;
+    off_t recnum = 0;
+    void *record = NULL;
+    void *temp = NULL;
+    isam_entry_t ***entries = NULL;
+    rel_cursor_t *cursor = NULL;
+    unsigned char key[ISAM_K_STORED];
+
+    when_error_in {
+
+        for (x = 0; x < self->indexes; x++) {
+
+            if (self->index[x].rebuild) build = TRUE;
+
+        }
+
+        if (! build) {
+
+            exit_when;
+
+        }
+
+        errno = 0;
+        record = calloc(1, REL(self)->recsize);
+        check_null(record);
+
+        errno = 0;
+        entries = calloc(self->indexes, sizeof(isam_entry_t **));
+        check_null(entries);
+
+        for (x = 0; x < self->indexes; x++) {
+
+            if (! self->index[x].rebuild) continue;
+
+            errno = 0;
+            entries[x] = calloc(size, sizeof(isam_entry_t *));
+            check_null(entries[x]);
+
+        }
+
+        stat = rel_cursor_create(REL(self), REL_C_CONSISTENT, &cursor);
+        check_return(stat, REL(self));
+
+        stat = rel_cursor_first(REL(self), cursor, record, &recnum);
+        check_return(stat, REL(self));
+
+        while (recnum > 0) {
+
+            /* each index gets one key per record */
+
+            if (count == size) {
+
+                for (x = 0; x < self->indexes; x++) {
+
+                    if (! self->index[x].rebuild) continue;
+
+                    errno = 0;
+                    temp = realloc(entries[x], (size * 2) * sizeof(isam_entry_t *));
+                    check_null(temp);
+
+                    entries[x] = temp;
+                    memset(&entries[x][size], 0, size * sizeof(isam_entry_t *));
+
+                }
+
+                size *= 2;
+
+            }
+
+            for (x = 0; x < self->indexes; x++) {
+
+                if (! self->index[x].rebuild) continue;
+
+                stat = _isam_key(self, x, record, recnum, key, &length);
+                check_return(stat, self);
+
+                errno = 0;
+                entries[x][count] = malloc(sizeof(isam_entry_t) + length);
+                check_null(entries[x][count]);
+
+                entries[x][count]->recnum = recnum;
+                entries[x][count]->length = length;
+                memcpy(entries[x][count]->key, key, length);
+
+            }
+
+            count++;
+
+            stat = rel_cursor_next(REL(self), cursor, record, &recnum);
+            check_return(stat, REL(self));
+
+        }
+
+        for (x = 0; x < self->indexes; x++) {
+
+            if (! self->index[x].rebuild) continue;
+
+            stat = _isam_load(self, x, entries[x], count);
+            check_return(stat, self);
+
+            self->index[x].rebuild = FALSE;
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    for (x = 0; (entries != NULL) && (x < self->indexes); x++) {
+
+        if (entries[x] == NULL) continue;
+
+        for (y = 0; y < size; y++) {
+
+            free(entries[x][y]);
+
+        }
+
+        free(entries[x]);
+
+    }
+
+    free(entries);
+
+    if (cursor != NULL) rel_cursor_destroy(REL(self), cursor);
+    free(record);
+
+    return stat;
+
+}
+
+static void _isam_close_indexes(isam_t *self) {
+
+    int x;
+
+    for (x = 0; x < self->indexes; x++) {
+
+        if (self->index[x].btree != NULL) {
+
+            bt_close(self->index[x].btree);
+            self->index[x].btree = NULL;
+
+        }
+
+    }
+
+    self->current = -1;
+
+}
+
@@ -0,0 +1,344 @@
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/rel.h"
+#include "xas/misc/misc.h"
+#include "rel-test.h"
+#include "rms-test.h"
+
+/*
+ * live record bitmap. Records are added and every third one is deleted,
+ * the bit of each record in the .live sidecar must match, along with
+ * the count rel_get_live() returns and the number of records a search
+ * finds. Then the sidecar is removed, it must be built again the same
+ * on an open for writing and kept up to date by later deletes. So must
+ * a sidecar in the older format, without the free list in its header.
+ * Removing the datastore removes the sidecar.
+ */
+
+#define RECORDS 1000
+
+rel_t *temp = NULL;
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+char *testfile = "rel-test10.dat";
+char *livefile = "rel-test10.live";
+char live[RECORDS + 1];
+
+int capture(rel_t *temp, void *data, queue_t *results) {
+
+    int stat = OK;
+    off_t *recnum = NULL;
+
+    when_error_in {
+
+        errno = 0;
+        recnum = calloc(1, sizeof(off_t));
+        check_null(recnum);
+
+        stat = rel_record(temp, recnum);
+        check_return(stat, temp);
+
+        stat = que_push_head(results, recnum);
+        check_status(stat);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        capture_error(trace);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int compare(void *wanted, void *data) {
+
+    int stat = FALSE;
+
+    if (strncmp((char *)wanted, (char *)data, recsize) == 0) {
+
+        stat = TRUE;
+
+    }
+
+    return stat;
+
+}
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+void capture_trace(error_trace_t *error) {
+
+    tracer_add(trace, error);
+
+}
+
+/* compare the sidecar with the records that should be live */
+
+int check_bits(char *what) {
+
+    int fd;
+    int bad = 0;
+    int expected = 0;
+    off_t recnum;
+    unsigned char byte = 0;
+    char type[8];
+    unsigned long count = 0;
+
+    if ((fd = open(livefile, O_RDONLY)) < 0) {
+
+        printf("%s: no %s\n", what, livefile);
+        return 1;
+
+    }
+
+    pread(fd, type, sizeof(type), 0);
+    pread(fd, &count, sizeof(count), sizeof(type));
+
+    if (strcmp(type, "LIVE2") != 0) bad++;
+
+    /* the header also holds the options and the free list */
+
+    for (recnum = 1; recnum <= RECORDS; recnum++) {
+
+        if (pread(fd, &byte, 1, sizeof(type) + (3 * sizeof(count)) + (recnum / 8)) != 1) byte = 0;
+        if (((byte >> (recnum % 8)) & 1) != live[recnum]) bad++;
+
+        expected += live[recnum];
+
+    }
+
+    close(fd);
+
+    if (count != expected) bad++;
+
+    printf("%s: %lu live, expected %d, %d wrong\n", what, count, expected, bad);
+
+    return bad;
+
+}
+
+int check_count(char *what) {
+
+    int x;
+    int expected = 0;
+    off_t count = 0;
+
+    for (x = 1; x <= RECORDS; x++) expected += live[x];
+
+    if (rel_get_live(temp, &count) != OK) return 1;
+
+    printf("%s: rel_get_live %ld, expected %d\n", what, (long)count, expected);
+
+    return (count != expected) ? 1 : 0;
+
+}
+
+/* a sidecar as it was before the free list was kept in it, */
+/* a shorter header and no bits set                          */
+
+int write_older(void) {
+
+    int fd;
+    char older[16 + (RECORDS / 8) + 1];
+
+    memset(older, '\0', sizeof(older));
+    strcpy(older, "LIVE");
+
+    if ((fd = open(livefile, O_WRONLY | O_TRUNC)) < 0) return 1;
+
+    if (write(fd, older, sizeof(older)) != sizeof(older)) {
+
+        close(fd);
+        return 1;
+
+    }
+
+    close(fd);
+
+    return 0;
+
+}
+
+/* the records holding values[12] that are still live */
+
+int check_search(char *what) {
+
+    int x;
+    int found = 0;
+    int expected = 0;
+    int bad = 0;
+    off_t *recnum = NULL;
+    queue_t results;
+
+    for (x = 1; x <= RECORDS; x++) {
+
+        if (live[x] && (((x - 1) % 26) == 12)) expected++;
+
+    }
+
+    que_init(&results);
+
+    if (rel_search(temp, values[12], compare, capture, &results) != OK) bad++;
+
+    while ((recnum = que_pop_tail(&results))) {
+
+        if (! live[*recnum]) bad++;
+        found++;
+        free(recnum);
+
+    }
+
+    if (found != expected) bad++;
+
+    printf("%s: search found %d, expected %d\n", what, found, expected);
+
+    return bad;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int stat = OK;
+    int bad = 0;
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        unlink(testfile);
+        unlink(livefile);
+
+        temp = rel_create(path, testfile, RECORDS, recsize, retries, timeout);
+        check_creation(temp);
+
+        stat = rel_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = rel_open(temp, flags, mode);
+        check_return(stat, temp);
+
+        for (x = 1; x <= RECORDS; x++) {
+
+            stat = rel_add(temp, values[(x - 1) % 26]);
+            check_return(stat, temp);
+
+            live[x] = 1;
+
+        }
+
+        for (x = 3; x <= RECORDS; x += 3) {
+
+            stat = rel_del(temp, x);
+            check_return(stat, temp);
+
+            live[x] = 0;
+
+        }
+
+        bad += check_bits("deleted");
+        bad += check_count("deleted");
+        bad += check_search("deleted");
+
+        stat = rel_close(temp);
+        check_return(stat, temp);
+
+        /* a missing sidecar is built on an open for writing */
+
+        unlink(livefile);
+
+        stat = rel_open(temp, flags, mode);
+        check_return(stat, temp);
+
+        bad += check_bits("rebuilt");
+        bad += check_count("rebuilt");
+        bad += check_search("rebuilt");
+
+        /* and is kept up to date after that */
+
+        for (x = 4; x <= RECORDS; x += 4) {
+
+            if (! live[x]) continue;
+
+            stat = rel_del(temp, x);
+            check_return(stat, temp);
+
+            live[x] = 0;
+
+        }
+
+        bad += check_bits("deleted again");
+        bad += check_count("deleted again");
+        bad += check_search("deleted again");
+
+        /* an older sidecar is built again */
+
+        stat = rel_close(temp);
+        check_return(stat, temp);
+
+        bad += write_older();
+
+        stat = rel_open(temp, flags, mode);
+        check_return(stat, temp);
+
+        bad += check_bits("older");
+        bad += check_count("older");
+
+        /* the free list, which went with the older sidecar, is */
+        /* chained again from the lowest deleted record         */
+
+        stat = rel_add(temp, values[0]);
+        check_return(stat, temp);
+
+        if (temp->record != 3) bad++;
+
+        live[temp->record] = 1;
+
+        bad += check_bits("added");
+
+        if (access(livefile, F_OK) != 0) bad++;
+
+        stat = rel_remove(temp);
+        check_return(stat, temp);
+
+        if (access(livefile, F_OK) == 0) bad++;
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    rel_destroy(temp);
+
+    return passed(bad);
+
+}
+
@@ -0,0 +1,214 @@
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/rel.h"
+#include "xas/misc/misc.h"
+#include "rel-test.h"
+#include "rms-test.h"
+
+/*
+ * the free list. A datastore is filled, some records are deleted and
+ * rel_add() must give back exactly those records, before and after a
+ * reopen. A full datastore must refuse an add and a deleted record
+ * must refuse a put. Records big enough to hold the file header keep
+ * the head of the free list there, smaller ones keep it in the header
+ * of the .live bitmap, both must behave the same.
+ */
+
+#define RECORDS 100
+#define GAP     7
+
+rel_t *temp = NULL;
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+char *testfile = "rel-test11.dat";
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+/* the adds and puts that must fail leave errors behind, each one */
+/* is copied so the tracer owns what it frees                      */
+
+void capture_trace(error_trace_t *error) {
+
+    error_trace_t *copy = calloc(1, sizeof(error_trace_t));
+
+    if (copy != NULL) {
+
+        copy->errnum = error->errnum;
+        copy->lineno = error->lineno;
+        copy->filename = strdup(error->filename);
+        copy->function = strdup(error->function);
+        tracer_add(trace, copy);
+
+    }
+
+}
+
+/* delete every GAP'th record from first on, then add them back */
+
+int reuse(int size, int first, int reopen, char *what) {
+
+    int x;
+    int bad = 0;
+    int stat = OK;
+    off_t recnum = 0;
+    char used[RECORDS + 1];
+    char buffer[128];
+    char record[128];
+
+    memset(used, 0, sizeof(used));
+
+    for (x = first; x <= RECORDS; x += GAP) {
+
+        if (rel_del(temp, x) != OK) bad++;
+
+    }
+
+    if (reopen) {
+
+        if (rel_close(temp) != OK) bad++;
+        if (rel_open(temp, flags, mode) != OK) bad++;
+
+    }
+
+    /* a deleted record can't be written */
+
+    memset(record, 'x', size);
+    if (rel_put(temp, first, record) == OK) bad++;
+
+    for (x = first; x <= RECORDS; x += GAP) {
+
+        snprintf(record, sizeof(record), "%0*d", size - 1, x);
+
+        if ((rel_add(temp, record) != OK) || (rel_record(temp, &recnum) != OK)) {
+
+            bad++;
+            continue;
+
+        }
+
+        if ((recnum < first) || (recnum > RECORDS) ||
+            (((recnum - first) % GAP) != 0) || used[recnum]) {
+
+            printf("%s: added record %ld\n", what, (long)recnum);
+            bad++;
+            continue;
+
+        }
+
+        used[recnum] = 1;
+
+        stat = rel_get(temp, recnum, buffer);
+        if ((stat != OK) || (memcmp(buffer, record, size) != 0)) bad++;
+
+    }
+
+    /* and now it is full */
+
+    if (rel_add(temp, record) == OK) bad++;
+
+    printf("%s: %d errors\n", what, bad);
+
+    return bad;
+
+}
+
+int run(int size, int freelist) {
+
+    int x;
+    int bad = 0;
+    int stat = OK;
+    off_t recnum = 0;
+    char record[128];
+
+    when_error_in {
+
+        unlink(testfile);
+
+        temp = rel_create(path, testfile, RECORDS, size, retries, timeout);
+        check_creation(temp);
+
+        stat = rel_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = rel_open(temp, flags, mode);
+        check_return(stat, temp);
+
+        if (temp->freelist != freelist) bad++;
+
+        for (x = 1; x <= RECORDS; x++) {
+
+            snprintf(record, sizeof(record), "%0*d", size - 1, x);
+
+            stat = rel_add(temp, record);
+            check_return(stat, temp);
+
+            stat = rel_record(temp, &recnum);
+            check_return(stat, temp);
+
+            if (recnum != x) bad++;
+
+        }
+
+        printf("size %d, free list %s\n", size, freelist ? "yes" : "no");
+
+        bad += reuse(size, 3, FALSE, "open");
+
+        /* the deleted records are kept across a reopen */
+
+        bad += reuse(size, 5, TRUE, "reopen");
+
+        if (temp->freelist != freelist) bad++;
+
+        stat = rel_remove(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    rel_destroy(temp);
+    temp = NULL;
+
+    return bad;
+
+}
+
+int main(int argc, char **argv) {
+
+    int bad = 0;
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    bad += run(26, TRUE);
+    bad += run(40, TRUE);
+    bad += run(64, TRUE);
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+
+    return passed(bad);
+
+}
+
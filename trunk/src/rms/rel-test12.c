@@ -0,0 +1,257 @@
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/rel.h"
+#include "xas/misc/misc.h"
+#include "rel-test.h"
+#include "rms-test.h"
+
+/*
+ * read ahead cursors. A datastore several read ahead chunks long has
+ * every fifth record and a long run of records deleted. A cursor in
+ * each read mode must return every live record once, in order, with
+ * its own data, and then a record number of 0. Two cursors on the same
+ * datastore must not disturb each other, and rel_find() must find the
+ * first live record that matches.
+ */
+
+#define RECORDS 20000
+#define SIZE    64
+#define RUNFROM 5000
+#define RUNTO   9000
+
+rel_t *temp = NULL;
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+char *testfile = "rel-test12.dat";
+char live[RECORDS + 1];
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+void capture_trace(error_trace_t *error) {
+
+    tracer_add(trace, error);
+
+}
+
+int compare(void *wanted, void *data) {
+
+    return (memcmp(wanted, data, SIZE) == 0) ? TRUE : FALSE;
+
+}
+
+void make_record(char *record, off_t recnum) {
+
+    snprintf(record, SIZE + 1, "%0*ld", SIZE - 1, (long)recnum);
+
+}
+
+/* the next live record after recnum, or 0 */
+
+off_t next_live(off_t recnum) {
+
+    while (++recnum <= RECORDS) {
+
+        if (live[recnum]) return recnum;
+
+    }
+
+    return 0;
+
+}
+
+/* check one step of a cursor against where it should be */
+
+int step(rel_cursor_t *cursor, int first, off_t *expect) {
+
+    int bad = 0;
+    off_t recnum = 0;
+    char record[SIZE + 1];
+    char wanted[SIZE + 1];
+
+    if (first) {
+
+        if (rel_cursor_first(temp, cursor, record, &recnum) != OK) bad++;
+
+    } else {
+
+        if (rel_cursor_next(temp, cursor, record, &recnum) != OK) bad++;
+
+    }
+
+    *expect = first ? next_live(0) : next_live(*expect);
+
+    if (recnum != *expect) {
+
+        bad++;
+
+    } else if (recnum > 0) {
+
+        make_record(wanted, recnum);
+        if (memcmp(record, wanted, SIZE) != 0) bad++;
+
+    }
+
+    return bad;
+
+}
+
+int walk(int mode, char *what) {
+
+    int bad = 0;
+    int seen = 0;
+    off_t expect = 0;
+    rel_cursor_t *cursor = NULL;
+
+    if (rel_cursor_create(temp, mode, &cursor) != OK) return 1;
+
+    bad += step(cursor, TRUE, &expect);
+
+    while (expect > 0) {
+
+        seen++;
+        bad += step(cursor, FALSE, &expect);
+
+    }
+
+    rel_cursor_destroy(temp, cursor);
+
+    printf("%s: %d records, %d errors\n", what, seen, bad);
+
+    return bad;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int bad = 0;
+    int stat = OK;
+    off_t one = 0;
+    off_t two = 0;
+    off_t recnum = 0;
+    char record[SIZE + 1];
+    rel_cursor_t *first = NULL;
+    rel_cursor_t *second = NULL;
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        unlink(testfile);
+
+        temp = rel_create(path, testfile, RECORDS, SIZE, retries, timeout);
+        check_creation(temp);
+
+        stat = rel_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = rel_open(temp, flags, mode);
+        check_return(stat, temp);
+
+        for (x = 1; x <= RECORDS; x++) {
+
+            make_record(record, x);
+
+            stat = rel_add(temp, record);
+            check_return(stat, temp);
+
+            live[x] = 1;
+
+        }
+
+        for (x = 1; x <= RECORDS; x++) {
+
+            if (((x % 5) == 0) || ((x >= RUNFROM) && (x <= RUNTO))) {
+
+                stat = rel_del(temp, x);
+                check_return(stat, temp);
+
+                live[x] = 0;
+
+            }
+
+        }
+
+        bad += walk(REL_C_CONSISTENT, "consistent");
+        bad += walk(REL_C_DIRTY, "dirty");
+
+        /* two cursors, one a step ahead of the other */
+
+        stat = rel_cursor_create(temp, REL_C_CONSISTENT, &first);
+        check_return(stat, temp);
+
+        stat = rel_cursor_create(temp, REL_C_DIRTY, &second);
+        check_return(stat, temp);
+
+        x = 0;
+        bad += step(first, TRUE, &one);
+        bad += step(second, TRUE, &two);
+        bad += step(second, FALSE, &two);
+
+        while (one > 0) {
+
+            bad += step(first, FALSE, &one);
+            if (two > 0) bad += step(second, FALSE, &two);
+
+            if ((two > 0) && (two != next_live(one))) bad++;
+            x++;
+
+        }
+
+        rel_cursor_destroy(temp, first);
+        rel_cursor_destroy(temp, second);
+
+        printf("interleaved: %d steps, %d errors\n", x, bad);
+
+        /* a find starts at the first record */
+
+        make_record(record, RUNTO + 1);
+
+        stat = rel_find(temp, record, compare, &recnum);
+        check_return(stat, temp);
+
+        if (recnum != RUNTO + 1) bad++;
+
+        make_record(record, RUNFROM);
+
+        if ((rel_find(temp, record, compare, &recnum) != OK) || (recnum != 0)) bad++;
+
+        printf("find: %d errors\n", bad);
+
+        stat = rel_remove(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    rel_destroy(temp);
+
+    return passed(bad);
+
+}
+
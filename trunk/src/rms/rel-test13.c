@@ -0,0 +1,238 @@
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/rel.h"
+#include "xas/misc/misc.h"
+#include "rel-test.h"
+#include "rms-test.h"
+
+/*
+ * extending a datastore. A full datastore refuses an add until
+ * autoextend is set, then it grows by its own size, at least 16
+ * records at a time, and every record added can be read back. An
+ * explicit extend adds deleted records, reserves the space on disk
+ * and the new records can be used.
+ */
+
+#define FIRST   10
+#define ADDS    1000
+#define EXTEND  100000
+#define SIZE    64
+
+rel_t *temp = NULL;
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+char *testfile = "rel-test13.dat";
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+/* the add that must fail leaves errors behind, each one is */
+/* copied so the tracer owns what it frees                  */
+
+void capture_trace(error_trace_t *error) {
+
+    error_trace_t *copy = calloc(1, sizeof(error_trace_t));
+
+    if (copy != NULL) {
+
+        copy->errnum = error->errnum;
+        copy->lineno = error->lineno;
+        copy->filename = strdup(error->filename);
+        copy->function = strdup(error->function);
+        tracer_add(trace, copy);
+
+    }
+
+}
+
+void make_record(char *record, int n) {
+
+    snprintf(record, SIZE + 1, "%0*d", SIZE - 1, n);
+
+}
+
+/* the file holds the header and the records, and is allocated */
+
+int check_size(off_t records, char *what) {
+
+    struct stat buf;
+    off_t expect = (records + 1) * (SIZE + 8);
+
+    if (stat(testfile, &buf) < 0) return 1;
+
+    printf("%s: %ld records, %ld bytes, %ld allocated\n", what,
+           (long)records, (long)buf.st_size, (long)buf.st_blocks * 512);
+
+    return ((buf.st_size != expect) || ((buf.st_blocks * 512) < expect)) ? 1 : 0;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int bad = 0;
+    int grows = 0;
+    int stat = OK;
+    int autoextend = TRUE;
+    off_t records = 0;
+    off_t before = 0;
+    off_t live = 0;
+    off_t recnum = 0;
+    char record[SIZE + 1];
+    char buffer[SIZE + 1];
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        unlink(testfile);
+
+        temp = rel_create(path, testfile, FIRST, SIZE, retries, timeout);
+        check_creation(temp);
+
+        stat = rel_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = rel_open(temp, flags, mode);
+        check_return(stat, temp);
+
+        stat = rel_get_autoextend(temp, &autoextend);
+        check_return(stat, temp);
+
+        if (autoextend) bad++;
+
+        for (x = 1; x <= FIRST; x++) {
+
+            make_record(record, x);
+
+            stat = rel_add(temp, record);
+            check_return(stat, temp);
+
+        }
+
+        /* full, and not allowed to grow */
+
+        make_record(record, FIRST + 1);
+        if (rel_add(temp, record) == OK) bad++;
+
+        stat = rel_get_records(temp, &records);
+        check_return(stat, temp);
+
+        if (records != FIRST) bad++;
+
+        /* growing by its own size */
+
+        stat = rel_set_autoextend(temp, TRUE);
+        check_return(stat, temp);
+
+        for (x = FIRST + 1; x <= FIRST + ADDS; x++) {
+
+            before = records;
+            make_record(record, x);
+
+            stat = rel_add(temp, record);
+            check_return(stat, temp);
+
+            stat = rel_get_records(temp, &records);
+            check_return(stat, temp);
+
+            if (records != before) {
+
+                grows++;
+                if (records != before + ((before < 16) ? 16 : before)) bad++;
+
+            }
+
+        }
+
+        printf("autoextend: %d adds, %d extends, %d errors\n", ADDS, grows, bad);
+
+        bad += check_size(records, "grown");
+
+        for (x = 1; x <= FIRST + ADDS; x++) {
+
+            make_record(record, x);
+
+            stat = rel_get(temp, x, buffer);
+            check_return(stat, temp);
+
+            if (memcmp(record, buffer, SIZE) != 0) bad++;
+
+        }
+
+        /* an explicit extend adds deleted records */
+
+        before = records;
+
+        stat = rel_extend(temp, EXTEND);
+        check_return(stat, temp);
+
+        stat = rel_get_records(temp, &records);
+        check_return(stat, temp);
+
+        if (records != before + EXTEND) bad++;
+
+        stat = rel_get_live(temp, &live);
+        check_return(stat, temp);
+
+        if (live != FIRST + ADDS) bad++;
+
+        bad += check_size(records, "extended");
+
+        stat = rel_set_autoextend(temp, FALSE);
+        check_return(stat, temp);
+
+        make_record(record, 0);
+
+        stat = rel_add(temp, record);
+        check_return(stat, temp);
+
+        stat = rel_record(temp, &recnum);
+        check_return(stat, temp);
+
+        if (recnum <= FIRST + ADDS) bad++;
+
+        stat = rel_get(temp, recnum, buffer);
+        check_return(stat, temp);
+
+        if (memcmp(record, buffer, SIZE) != 0) bad++;
+
+        printf("extend: %d errors\n", bad);
+
+        stat = rel_remove(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    rel_destroy(temp);
+
+    return passed(bad);
+
+}
+
@@ -0,0 +1,256 @@
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/rel.h"
+#include "xas/misc/misc.h"
+#include "rel-test.h"
+#include "rms-test.h"
+
+/*
+ * batched reads and writes. Record numbers in random order, with
+ * repeats and runs longer than a read ahead chunk, are read with
+ * rel_get_many() and must match rel_get(). They are written with
+ * rel_put_many(), where the last of a repeated record wins. A batch
+ * with a deleted record fails, and nothing in the run with the deleted
+ * record is written.
+ */
+
+#define RECORDS 20000
+#define BATCH   6000
+#define SIZE    64
+
+rel_t *temp = NULL;
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+char *testfile = "rel-test14.dat";
+off_t recnums[BATCH];
+void *buffers[BATCH];
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+/* the batches that must fail leave errors behind, each one is */
+/* copied so the tracer owns what it frees                     */
+
+void capture_trace(error_trace_t *error) {
+
+    error_trace_t *copy = calloc(1, sizeof(error_trace_t));
+
+    if (copy != NULL) {
+
+        copy->errnum = error->errnum;
+        copy->lineno = error->lineno;
+        copy->filename = strdup(error->filename);
+        copy->function = strdup(error->function);
+        tracer_add(trace, copy);
+
+    }
+
+}
+
+void make_record(char *record, char *tag, long n) {
+
+    snprintf(record, SIZE + 1, "%s%0*ld", tag, (int)(SIZE - 1 - strlen(tag)), n);
+
+}
+
+/* a long run, then random numbers, some of them repeated */
+
+void make_batch(unsigned int *seed) {
+
+    int x;
+
+    for (x = 0; x < BATCH / 2; x++) {
+
+        recnums[x] = 1000 + x;
+
+    }
+
+    for (; x < BATCH; x++) {
+
+        recnums[x] = (x % 10 == 0) ? recnums[rand_r(seed) % x]
+                                   : (rand_r(seed) % RECORDS) + 1;
+
+    }
+
+    for (x = BATCH - 1; x > 0; x--) {
+
+        int y = rand_r(seed) % (x + 1);
+        off_t swap = recnums[x];
+
+        recnums[x] = recnums[y];
+        recnums[y] = swap;
+
+    }
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int bad = 0;
+    int stat = OK;
+    unsigned int seed = 1;
+    off_t batch[3];
+    void *pointers[3];
+    char *last[RECORDS + 1];
+    char record[SIZE + 1];
+    char buffer[SIZE + 1];
+    char parts[3][SIZE + 1];
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        unlink(testfile);
+
+        temp = rel_create(path, testfile, RECORDS, SIZE, retries, timeout);
+        check_creation(temp);
+
+        stat = rel_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = rel_open(temp, flags, mode);
+        check_return(stat, temp);
+
+        for (x = 1; x <= RECORDS; x++) {
+
+            make_record(record, "r", x);
+
+            stat = rel_add(temp, record);
+            check_return(stat, temp);
+
+        }
+
+        for (x = 0; x < BATCH; x++) {
+
+            errno = 0;
+            buffers[x] = calloc(1, SIZE + 1);
+            check_null(buffers[x]);
+
+        }
+
+        /* reads */
+
+        make_batch(&seed);
+
+        stat = rel_get_many(temp, recnums, buffers, BATCH);
+        check_return(stat, temp);
+
+        for (x = 0; x < BATCH; x++) {
+
+            stat = rel_get(temp, recnums[x], buffer);
+            check_return(stat, temp);
+
+            if (memcmp(buffers[x], buffer, SIZE) != 0) bad++;
+
+        }
+
+        printf("get_many: %d records, %d errors\n", BATCH, bad);
+
+        /* writes, the last of a repeated record wins */
+
+        make_batch(&seed);
+        memset(last, 0, sizeof(last));
+
+        for (x = 0; x < BATCH; x++) {
+
+            make_record(buffers[x], "w", x);
+            last[recnums[x]] = buffers[x];
+
+        }
+
+        stat = rel_put_many(temp, recnums, buffers, BATCH);
+        check_return(stat, temp);
+
+        for (x = 1; x <= RECORDS; x++) {
+
+            if (last[x] == NULL) {
+
+                make_record(record, "r", x);
+
+            } else {
+
+                memcpy(record, last[x], SIZE);
+
+            }
+
+            stat = rel_get(temp, x, buffer);
+            check_return(stat, temp);
+
+            if (memcmp(record, buffer, SIZE) != 0) bad++;
+
+        }
+
+        printf("put_many: %d records, %d errors\n", BATCH, bad);
+
+        /* a deleted record stops the batch */
+
+        stat = rel_del(temp, 500);
+        check_return(stat, temp);
+
+        for (x = 0; x < 3; x++) {
+
+            batch[x] = 501 - x;
+            pointers[x] = parts[x];
+
+        }
+
+        if (rel_get_many(temp, batch, pointers, 3) == OK) bad++;
+
+        /* the records before the deleted one were read into parts */
+
+        for (x = 0; x < 3; x++) make_record(parts[x], "d", x);
+
+        if (rel_put_many(temp, batch, pointers, 3) == OK) bad++;
+
+        for (x = 0; x < 3; x++) {
+
+            if (batch[x] == 500) continue;
+
+            stat = rel_get(temp, batch[x], buffer);
+            check_return(stat, temp);
+
+            if (memcmp(buffer, parts[x], SIZE) == 0) bad++;
+
+        }
+
+        printf("deleted: %d errors\n", bad);
+
+        for (x = 0; x < BATCH; x++) free(buffers[x]);
+
+        stat = rel_remove(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    rel_destroy(temp);
+
+    return passed(bad);
+
+}
+
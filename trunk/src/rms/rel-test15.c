@@ -0,0 +1,357 @@
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/rel.h"
+#include "xas/misc/misc.h"
+#include "rel-test.h"
+#include "rms-test.h"
+
+/*
+ * mapped reads. The same reads are done with REL_A_BLOCK and with
+ * REL_A_MMAP, rel_get(), rel_find(), rel_search() and a cursor must
+ * return the same records in both modes, and deleted records must be
+ * refused in both. Records written and added while mapped must be seen
+ * thru the mapping, as must the records from an extend, which remaps
+ * the datastore, and the records added into them.
+ */
+
+#define RECORDS 5000
+#define EXTEND  1000
+#define SIZE    64
+
+rel_t *temp = NULL;
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+char *testfile = "rel-test15.dat";
+char live[RECORDS + EXTEND + 1];
+char *tags[RECORDS + EXTEND + 1];
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+/* the reads of deleted records leave errors behind, each one */
+/* is copied so the tracer owns what it frees                 */
+
+void capture_trace(error_trace_t *error) {
+
+    error_trace_t *copy = calloc(1, sizeof(error_trace_t));
+
+    if (copy != NULL) {
+
+        copy->errnum = error->errnum;
+        copy->lineno = error->lineno;
+        copy->filename = strdup(error->filename);
+        copy->function = strdup(error->function);
+        tracer_add(trace, copy);
+
+    }
+
+}
+
+void make_record(char *record, char *tag, off_t recnum) {
+
+    snprintf(record, SIZE + 1, "%s%0*ld", tag, (int)(SIZE - 1 - strlen(tag)), (long)recnum);
+
+}
+
+int compare(void *wanted, void *data) {
+
+    return (memcmp(wanted, data, SIZE) == 0) ? TRUE : FALSE;
+
+}
+
+/* every record that ends in a 3 */
+
+int ends_in_3(void *wanted, void *data) {
+
+    return (((char *)data)[SIZE - 2] == '3') ? TRUE : FALSE;
+
+}
+
+int capture(rel_t *temp, void *data, queue_t *results) {
+
+    int stat = OK;
+    off_t *recnum = NULL;
+
+    when_error_in {
+
+        errno = 0;
+        recnum = calloc(1, sizeof(off_t));
+        check_null(recnum);
+
+        stat = rel_record(temp, recnum);
+        check_return(stat, temp);
+
+        stat = que_push_head(results, recnum);
+        check_status(stat);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        capture_error(trace);
+
+    } end_when;
+
+    return stat;
+
+}
+
+/* read everything in one access mode and check it against what */
+/* was written, records is how many there are                  */
+
+int reads(int access, off_t records, char *what) {
+
+    int bad = 0;
+    off_t x = 0;
+    off_t *one = NULL;
+    off_t recnum = 0;
+    queue_t results;
+    rel_cursor_t *cursor = NULL;
+    char record[SIZE + 1];
+    char wanted[SIZE + 1];
+
+    if (rel_set_access(temp, access) != OK) return 1;
+
+    /* gets */
+
+    for (x = 1; x <= records; x++) {
+
+        if (live[x]) {
+
+            make_record(wanted, tags[x], x);
+
+            if ((rel_get(temp, x, record) != OK) ||
+                (memcmp(record, wanted, SIZE) != 0)) bad++;
+
+        } else {
+
+            if (rel_get(temp, x, record) == OK) bad++;
+
+        }
+
+    }
+
+    /* finds, a live record and a deleted one */
+
+    make_record(wanted, tags[records - 1], records - 1);
+
+    if ((rel_find(temp, wanted, compare, &recnum) != OK) ||
+        (recnum != (live[records - 1] ? records - 1 : 0))) bad++;
+
+    make_record(wanted, tags[7], 7);
+
+    if ((rel_find(temp, wanted, compare, &recnum) != OK) || (recnum != 0)) bad++;
+
+    /* a search, the matches come back in order */
+
+    que_init(&results);
+
+    if (rel_search(temp, NULL, ends_in_3, capture, &results) != OK) bad++;
+
+    for (x = 1; x <= records; x++) {
+
+        if ((! live[x]) || ((x % 10) != 3)) continue;
+
+        if (((one = que_pop_tail(&results)) == NULL) || (*one != x)) bad++;
+
+        free(one);
+
+    }
+
+    while ((one = que_pop_tail(&results))) {
+
+        bad++;
+        free(one);
+
+    }
+
+    /* a cursor */
+
+    if (rel_cursor_create(temp, REL_C_CONSISTENT, &cursor) != OK) return bad + 1;
+
+    if (rel_cursor_first(temp, cursor, record, &recnum) != OK) bad++;
+
+    for (x = 1; x <= records; x++) {
+
+        if (! live[x]) continue;
+
+        make_record(wanted, tags[x], x);
+
+        if ((recnum != x) || (memcmp(record, wanted, SIZE) != 0)) bad++;
+        if (rel_cursor_next(temp, cursor, record, &recnum) != OK) bad++;
+
+    }
+
+    if (recnum != 0) bad++;
+
+    rel_cursor_destroy(temp, cursor);
+
+    printf("%s: %ld records, %d errors\n", what, (long)records, bad);
+
+    return bad;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int bad = 0;
+    int stat = OK;
+    int access = 0;
+    off_t recnum = 0;
+    off_t records = 0;
+    char record[SIZE + 1];
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        unlink(testfile);
+
+        temp = rel_create(path, testfile, RECORDS, SIZE, retries, timeout);
+        check_creation(temp);
+
+        stat = rel_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = rel_open(temp, flags, mode);
+        check_return(stat, temp);
+
+        stat = rel_get_access(temp, &access);
+        check_return(stat, temp);
+
+        if (access != REL_A_BLOCK) bad++;
+        if (rel_set_access(temp, REL_A_MMAP + 1) == OK) bad++;
+
+        for (x = 1; x <= RECORDS + EXTEND; x++) tags[x] = "r";
+
+        for (x = 1; x <= RECORDS; x++) {
+
+            make_record(record, tags[x], x);
+
+            stat = rel_add(temp, record);
+            check_return(stat, temp);
+
+            live[x] = 1;
+
+        }
+
+        for (x = 7; x <= RECORDS; x += 7) {
+
+            stat = rel_del(temp, x);
+            check_return(stat, temp);
+
+            live[x] = 0;
+
+        }
+
+        bad += reads(REL_A_BLOCK, RECORDS, "block");
+        bad += reads(REL_A_MMAP, RECORDS, "mmap");
+
+        stat = rel_get_access(temp, &access);
+        check_return(stat, temp);
+
+        if (access != REL_A_MMAP) bad++;
+
+        /* writes while mapped are seen thru the mapping */
+
+        for (x = 1; x <= RECORDS; x += 3) {
+
+            if (! live[x]) continue;
+
+            tags[x] = "w";
+            make_record(record, tags[x], x);
+
+            stat = rel_put(temp, x, record);
+            check_return(stat, temp);
+
+        }
+
+        stat = rel_del(temp, 1);
+        check_return(stat, temp);
+
+        live[1] = 0;
+
+        bad += reads(REL_A_MMAP, RECORDS, "written");
+
+        /* an extend grows the file past the mapping */
+
+        stat = rel_extend(temp, EXTEND);
+        check_return(stat, temp);
+
+        stat = rel_get_records(temp, &records);
+        check_return(stat, temp);
+
+        if (records != RECORDS + EXTEND) bad++;
+
+        bad += reads(REL_A_MMAP, records, "extended");
+
+        /* adds fill the deleted records, wherever they are */
+
+        for (x = 0; x < EXTEND; x++) {
+
+            make_record(record, "a", 0);
+
+            stat = rel_add(temp, record);
+            check_return(stat, temp);
+
+            stat = rel_record(temp, &recnum);
+            check_return(stat, temp);
+
+            if ((recnum < 1) || (recnum > records) || (live[recnum])) {
+
+                bad++;
+                continue;
+
+            }
+
+            tags[recnum] = "a";
+            make_record(record, tags[recnum], recnum);
+
+            stat = rel_put(temp, recnum, record);
+            check_return(stat, temp);
+
+            live[recnum] = 1;
+
+        }
+
+        bad += reads(REL_A_MMAP, records, "added");
+        bad += reads(REL_A_BLOCK, records, "block again");
+
+        stat = rel_remove(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    rel_destroy(temp);
+
+    return passed(bad);
+
+}
+
@@ -0,0 +1,279 @@
+
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "xas/types.h"
+#include "xas/errors.h"
+#include "xas/tracer.h"
+#include "xas/error_handler.h"
+#include "xas/error_codes.h"
+#include "xas/gpl/vperror.h"
+#include "xas/rms/rel.h"
+#include "xas/misc/misc.h"
+#include "rel-test.h"
+#include "rms-test.h"
+
+/*
+ * parallel search. The same search is done on one thread and then
+ * split across several, the matching record numbers must be the same
+ * and in the same order. This is done for a consistent and a dirty
+ * scan. A lock the caller holds on another handle, past the records,
+ * must still be held after the searches.
+ */
+
+#define THREADS 4
+#define RECORDS 50000
+
+rel_t *temp = NULL;
+err_t *errors = NULL;
+tracer_t *trace = NULL;
+char *testfile = "rel-test9.dat";
+
+int capture(rel_t *temp, void *data, queue_t *results) {
+
+    int stat = OK;
+    off_t *recnum = NULL;
+
+    when_error_in {
+
+        errno = 0;
+        recnum = calloc(1, sizeof(off_t));
+        check_null(recnum);
+
+        stat = rel_record(temp, recnum);
+        check_return(stat, temp);
+
+        stat = que_push_head(results, recnum);
+        check_status(stat);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        capture_error(trace);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int compare(void *wanted, void *data) {
+
+    int stat = FALSE;
+
+    if (strncmp((char *)wanted, (char *)data, recsize) == 0) {
+
+        stat = TRUE;
+
+    }
+
+    return stat;
+
+}
+
+int output_trace(char *buffer) {
+
+    fprintf(stderr, "%s\n", buffer);
+
+    return OK;
+
+}
+
+void capture_trace(error_trace_t *error) {
+
+    tracer_add(trace, error);
+
+}
+
+/* search serially and in parallel, the results must be the same */
+
+int search(char *what) {
+
+    int bad = 0;
+    int stat = OK;
+    int same = TRUE;
+    off_t *one = NULL;
+    off_t *many = NULL;
+    queue_t serial;
+    queue_t parallel;
+    double serial_ms = 0;
+    double parallel_ms = 0;
+    struct timespec start;
+    char *wanted = values[12];
+
+    when_error_in {
+
+        stat = que_init(&serial);
+        check_status(stat);
+
+        stat = que_init(&parallel);
+        check_status(stat);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        stat = rel_search(temp, wanted, compare, capture, &serial);
+        check_return(stat, temp);
+
+        serial_ms = elapsed(&start);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        stat = rel_search_parallel(temp, wanted, compare, capture, &parallel, THREADS);
+        check_return(stat, temp);
+
+        parallel_ms = elapsed(&start);
+
+        printf("%s serial: %d matches, %.2f ms\n", what, que_size(&serial), serial_ms);
+        printf("%s parallel: %d matches, %.2f ms, %d threads\n",
+               what, que_size(&parallel), parallel_ms, THREADS);
+
+        if (que_size(&serial) != que_size(&parallel)) same = FALSE;
+
+        while ((one = que_pop_tail(&serial))) {
+
+            many = que_pop_tail(&parallel);
+
+            if ((many == NULL) || (*one != *many)) same = FALSE;
+
+            free(one);
+            free(many);
+
+        }
+
+        printf("%s results: %s\n", what, same ? "the same" : "DIFFERENT");
+
+        if (! same) bad++;
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    return bad;
+
+}
+
+/* another process asks if anyone holds a lock on the range */
+
+int is_locked(off_t offset, off_t length) {
+
+    int fd;
+    int status = 0;
+    pid_t pid;
+    struct flock lock;
+
+    if ((pid = fork()) == 0) {
+
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = F_WRLCK;
+        lock.l_whence = SEEK_SET;
+        lock.l_start = offset;
+        lock.l_len = length;
+
+        if ((fd = open(testfile, O_RDWR)) < 0) _exit(2);
+        if (fcntl(fd, F_GETLK, &lock) < 0) _exit(2);
+
+        _exit((lock.l_type != F_UNLCK) ? 0 : 1);
+
+    }
+
+    if ((pid < 0) || (waitpid(pid, &status, 0) != pid)) return FALSE;
+
+    return (WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int bad = 0;
+    int stat = OK;
+    blk_t *other = NULL;
+    off_t offset = (RECORDS * 2) * (recsize + 8);
+
+    errors = err_create();
+    trace = tracer_create(errors);
+    vperror_init(capture_trace);
+
+    when_error_in {
+
+        temp = rel_create(path, testfile, RECORDS, recsize, retries, timeout);
+        check_creation(temp);
+
+        stat = rel_set_trace(temp, capture_trace);
+        check_return(stat, temp);
+
+        stat = rel_open(temp, flags, mode);
+        check_return(stat, temp);
+
+        for (x = 0; x < RECORDS; x++) {
+
+            stat = rel_add(temp, values[x % 26]);
+            check_return(stat, temp);
+
+        }
+
+        for (x = 1; x <= RECORDS; x += 7) {
+
+            stat = rel_del(temp, x);
+            check_return(stat, temp);
+
+        }
+
+        other = blk_create(testfile, retries, timeout);
+        check_creation(other);
+
+        stat = blk_open(other, O_RDWR, 0);
+        check_return(stat, other);
+
+        stat = blk_lock(other, offset, recsize + 8, BLK_L_SHARED);
+        check_return(stat, other);
+
+        bad += search("consistent");
+
+        stat = rel_set_scan(temp, REL_C_DIRTY);
+        check_return(stat, temp);
+
+        bad += search("dirty");
+
+        if (! is_locked(offset, recsize + 8)) bad++;
+
+        printf("lock: %s\n", is_locked(offset, recsize + 8) ? "held" : "DROPPED");
+
+        stat = blk_unlock(other);
+        check_return(stat, other);
+
+        stat = blk_close(other);
+        check_return(stat, other);
+
+        stat = rel_remove(temp);
+        check_return(stat, temp);
+
+        exit_when;
+
+    } use {
+
+        bad++;
+        capture_error(trace);
+        tracer_dump(trace, output_trace);
+
+    } end_when;
+
+    err_destroy(errors);
+    tracer_destroy(trace);
+    blk_destroy(other);
+    rel_destroy(temp);
+
+    return passed(bad);
+
+}
+
@@ -10,6 +10,12 @@
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
 #include "xas/rms/rel.h"
 #include "xas/error_codes.h"
 #include "xas/error_handler.h"
@@ -36,6 +42,8 @@ int _rel_add(rel_t *, void *);
 int _rel_record(rel_t *, off_t *);
 int _rel_get(rel_t *, off_t, void *);
 int _rel_put(rel_t *, off_t, void *);
+int _rel_get_many(rel_t *, off_t *, void **, int);
+int _rel_put_many(rel_t *, off_t *, void **, int);
 int _rel_read_header(rel_t *);
 int _rel_write_header(rel_t *);
 int _rel_update_header(rel_t *);
@@ -71,8 +79,40 @@ typedef struct header {
     unsigned long recsize;
     unsigned long records;
     unsigned long lastrec;
+    unsigned long options;
+    unsigned long freelist;
 } rel_header_t;
 
+typedef struct _rel_live_s {
+    char type[8];
+    unsigned long live;
+    unsigned long options;
+    unsigned long freelist;
+} rel_live_t;
+
+typedef struct _rel_batch_s {
+    off_t recnum;
+    int slot;
+} rel_batch_t;
+
+typedef struct _rel_match_s {
+    off_t recnum;
+    char data[];
+} rel_match_t;
+
+typedef struct _rel_worker_s {
+    rel_t *self;
+    blk_t *blk;
+    int fd;
+    off_t first;
+    off_t last;
+    void *data;
+    int (*compare)(void *, void *);
+    int stat;
+    int errnum;
+    queue_t matches;
+} rel_worker_t;
+
 /*----------------------------------------------------------------*/
 /* klass private macros                                           */
 /*----------------------------------------------------------------*/
@@ -87,6 +127,76 @@ typedef struct header {
 #define REL_RECORD(n, s) (((n) / REL_RECSIZE(s)))
 #define REL_OFFSET(n, s) ((((n)) * REL_RECSIZE(s)))
 
+/* deleted records are chained together through their data area, */
+/* with the head of the chain kept in the header. A record needs  */
+/* room for the link. When the whole header doesn't fit within    */
+/* record 0, its options and the head of the chain are kept in    */
+/* the header of the live record bitmap instead.                  */
+
+#define REL_H_FREELIST   0
+#define REL_HDRFITS(s)   ((s) >= sizeof(rel_header_t))
+#define REL_FREEFITS(s)  ((s) >= sizeof(unsigned long))
+
+/* autoextend grows the file by its current size, so the number of */
+/* extends stays logarithmic, but never by more than REL_X_MAX     */
+/* records at once. New records are written REL_X_CHUNK at a time. */
+
+#define REL_X_MIN        16
+#define REL_X_MAX        (1024 * 1024)
+#define REL_X_CHUNK      (1024 * 1024)
+
+/* the live record bitmap is kept in <name>.live, a header with */
+/* the number of live records followed by one bit per record. A  */
+/* bit is set before a record is added and cleared after it is   */
+/* deleted, so a scan guided by the bitmap never misses a record. */
+/* A scan reads runs of live records, a gap of deleted records   */
+/* bigger than REL_B_GAP bytes is not read. A bitmap from before  */
+/* the header held the free list is rebuilt, or not used when the */
+/* datastore is opened to read.                                   */
+
+#define REL_B_TYPE       "LIVE2"
+#define REL_B_HEADER     sizeof(rel_live_t)
+#define REL_B_CHUNK      4096
+#define REL_B_BYTE(n)    (REL_B_HEADER + ((n) / 8))
+#define REL_B_BIT(n)     ((n) % 8)
+#define REL_B_GAP        (32 * 1024)
+
+/* the most threads a parallel search will start. Workers read    */
+/* thru the handle of the rel_t. A consistent search locks what a */
+/* worker reads, so each worker needs a handle of its own, which  */
+/* is only safe with open file description locks. Closing it with */
+/* process locks would drop those of the whole process, so then   */
+/* the search is not split.                                       */
+
+#define REL_T_MAX        64
+
+/*----------------------------------------------------------------*/
+/* private methods                                                */
+/*----------------------------------------------------------------*/
+
+static int _rel_get_header(rel_t *, rel_header_t *);
+static int _rel_put_header(rel_t *, rel_header_t *);
+static int _rel_chain_free(rel_t *);
+static rel_cursor_t *_rel_cursor_alloc(rel_t *, int);
+static int _rel_cursor_fill(rel_t *, rel_cursor_t *, off_t, off_t);
+static int _rel_cursor_seek(rel_t *, rel_cursor_t *, off_t, rel_record_t **);
+static int _rel_cursor_live(rel_t *, rel_cursor_t *, void *, off_t *);
+static int _rel_batch_sort(off_t *, int, rel_batch_t **);
+static int _rel_batch_compare(const void *, const void *);
+static int _rel_batch_range(rel_batch_t *, int, int, off_t);
+static int _rel_map_record(rel_t *, off_t, rel_record_t **);
+static int _rel_remap(rel_t *);
+static void _rel_unmap(rel_t *);
+static int _rel_live_open(rel_t *, int, mode_t, int);
+static int _rel_live_build(rel_t *);
+static int _rel_live_mark(rel_t *, off_t, int);
+static int _rel_live_next(rel_t *, rel_cursor_t *, off_t, off_t *);
+static int _rel_live_span(rel_t *, rel_cursor_t *, off_t, off_t, off_t *);
+static int _rel_cursor_scan(rel_t *, rel_cursor_t *, rel_record_t **);
+static int _rel_cursor_start(rel_t *);
+static void *_rel_search_worker(void *);
+static int _rel_search_range(rel_worker_t *);
+
 /*----------------------------------------------------------------*/
 /* klass interface                                                */
 /*----------------------------------------------------------------*/
@@ -257,6 +367,45 @@ int rel_open(rel_t *self, int flags, mode_t mode) {
 
 }
 
+int rel_close(rel_t *self) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if (self == NULL) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        _rel_unmap(self);
+
+        if (self->bitmap) {
+
+            self->bitmap = FALSE;
+
+            stat = blk_close(self->live);
+            check_return(stat, self);
+
+        }
+
+        stat = blk_close(BLK(self));
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
 int rel_remove(rel_t *self) {
 
     int stat = OK;
@@ -313,19 +462,19 @@ int rel_add(rel_t *self, void *data) {
 
 }
 
-int rel_del(rel_t *self, off_t recnum) {
+int rel_extend(rel_t *self, int amount) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self == NULL) || ((recnum < 0) && (recnum > self->records))) {
+        if ((self == NULL) || (amount < 1)) {
 
             cause_error(E_INVPARM);
 
         }
 
-        stat = self->_del(self, recnum);
+        stat = self->_extend(self, amount);
         check_return(stat, self);
 
         exit_when;
@@ -341,20 +490,19 @@ int rel_del(rel_t *self, off_t recnum) {
 
 }
 
-int rel_get(rel_t *self, off_t recnum, void *data) {
+int rel_del(rel_t *self, off_t recnum) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self == NULL) || (data == NULL) ||
-            ((recnum < 0) && (recnum > self->records))) {
+        if ((self == NULL) || ((recnum < 0) && (recnum > self->records))) {
 
             cause_error(E_INVPARM);
 
         }
 
-        stat = self->_get(self, recnum, data);
+        stat = self->_del(self, recnum);
         check_return(stat, self);
 
         exit_when;
@@ -370,20 +518,20 @@ int rel_get(rel_t *self, off_t recnum, void *data) {
 
 }
 
-int rel_put(rel_t *self, off_t recnum, void *data) {
+int rel_get(rel_t *self, off_t recnum, void *data) {
 
     int stat = OK;
 
     when_error_in {
 
         if ((self == NULL) || (data == NULL) ||
-            ((recnum < 1) && (recnum > self->records))) {
+            ((recnum < 0) && (recnum > self->records))) {
 
             cause_error(E_INVPARM);
 
         }
 
-        stat = self->_put(self, recnum, data);
+        stat = self->_get(self, recnum, data);
         check_return(stat, self);
 
         exit_when;
@@ -399,19 +547,20 @@ int rel_put(rel_t *self, off_t recnum, void *data) {
 
 }
 
-int rel_record(rel_t *self, off_t *recnum) {
+int rel_put(rel_t *self, off_t recnum, void *data) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self == NULL) || (recnum == NULL)) {
+        if ((self == NULL) || (data == NULL) ||
+            ((recnum < 1) && (recnum > self->records))) {
 
             cause_error(E_INVPARM);
 
         }
 
-        stat = self->_record(self, recnum);
+        stat = self->_put(self, recnum, data);
         check_return(stat, self);
 
         exit_when;
@@ -427,20 +576,33 @@ int rel_record(rel_t *self, off_t *recnum) {
 
 }
 
-int rel_get_records(rel_t *self, off_t *recnum) {
+int rel_get_many(rel_t *self, off_t *recnums, void **records, int count) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self == NULL) || (recnum == NULL)) {
+        if ((self == NULL) || (recnums == NULL) || 
+            (records == NULL) || (count < 1)) {
 
             cause_error(E_INVPARM);
 
         }
 
-        *recnum = self->records;
-        
+        int x = 0;
+        for (; x < count; x++) {
+
+            if ((recnums[x] < 1) || (records[x] == NULL)) {
+
+                cause_error(E_INVPARM);
+
+            }
+
+        }
+
+        stat = self->_get_many(self, recnums, records, count);
+        check_return(stat, self);
+
         exit_when;
 
     } use {
@@ -454,19 +616,32 @@ int rel_get_records(rel_t *self, off_t *recnum) {
 
 }
 
-int rel_get_recsize(rel_t *self, off_t *recsize) {
+int rel_put_many(rel_t *self, off_t *recnums, void **records, int count) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self == NULL) || (recsize == NULL)) {
+        if ((self == NULL) || (recnums == NULL) || 
+            (records == NULL) || (count < 1)) {
 
             cause_error(E_INVPARM);
 
         }
 
-        *recsize = self->recsize;
+        int x = 0;
+        for (; x < count; x++) {
+
+            if ((recnums[x] < 1) || (records[x] == NULL)) {
+
+                cause_error(E_INVPARM);
+
+            }
+
+        }
+
+        stat = self->_put_many(self, recnums, records, count);
+        check_return(stat, self);
 
         exit_when;
 
@@ -481,19 +656,19 @@ int rel_get_recsize(rel_t *self, off_t *recsize) {
 
 }
 
-int rel_find(rel_t *self, void *data, int (*compare)(void *, void *), off_t *recnum) {
+int rel_record(rel_t *self, off_t *recnum) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self == NULL) || (data == NULL) || (compare == NULL)) {
+        if ((self == NULL) || (recnum == NULL)) {
 
             cause_error(E_INVPARM);
 
         }
 
-        stat = self->_find(self, data, compare, recnum);
+        stat = self->_record(self, recnum);
         check_return(stat, self);
 
         exit_when;
@@ -509,21 +684,20 @@ int rel_find(rel_t *self, void *data, int (*compare)(void *, void *), off_t *rec
 
 }
 
-int rel_search(rel_t *self, void *data, int (*compare)(void *, void *), int (*capture)(rel_t *, void *, queue_t *), queue_t *results) {
+int rel_get_records(rel_t *self, off_t *recnum) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self == NULL) || (compare == NULL) || (capture == NULL)) {
+        if ((self == NULL) || (recnum == NULL)) {
 
             cause_error(E_INVPARM);
 
         }
 
-        stat = self->_search(self, data, compare, capture, results);
-        check_return(stat, self);
-
+        *recnum = self->records;
+        
         exit_when;
 
     } use {
@@ -537,164 +711,810 @@ int rel_search(rel_t *self, void *data, int (*compare)(void *, void *), int (*ca
 
 }
 
-/*----------------------------------------------------------------*/
-/* klass implementation                                           */
-/*----------------------------------------------------------------*/
-
-int _rel_ctor(object_t *object, item_list_t *items) {
+int rel_get_live(rel_t *self, off_t *live) {
 
     int stat = OK;
-    int records = 0;
-    int recsize = 0;
-    rel_t *self = NULL;
+    ssize_t count = 0;
+    rel_live_t header;
+    rel_cursor_t *cursor = NULL;
+    rel_record_t *ondisk = NULL;
 
-    if (object != NULL) {
+    when_error_in {
 
-        stat = OK;
+        if ((self == NULL) || (live == NULL)) {
 
-        when_error_in {
+            cause_error(E_INVPARM);
 
-            /* intialize the base klass here */
-        
-            stat = BLK_KLASS->ctor(object, items);
-            check_return(stat, object);
-        
-            /* capture our items */
+        }
 
-            if (items != NULL) {
+        *live = 0;
 
-                int x;
-                for (x = 0;; x++) {
+        if (self->bitmap) {
 
-                    if ((items[x].buffer_length == 0) &&
-                        (items[x].item_code == 0)) break;
+            stat = blk_pread(self->live, &header, REL_B_HEADER, 0, &count);
+            check_return(stat, self);
 
-                    switch(items[x].item_code) {
-                        case REL_K_RECORDS: {
-                            memcpy(&records, 
-                                   items[x].buffer_address, 
-                                   items[x].buffer_length);
-                            break;
-                        }
-                        case REL_K_RECSIZE: {
-                            memcpy(&recsize, 
-                                   items[x].buffer_address, 
-                                   items[x].buffer_length);
-                            break;
-                        }
-                    }
+            if (count != REL_B_HEADER) {
 
-                }
+                cause_error(EIO);
 
             }
 
-            /* initilize our base klass here */
+            *live = header.live;
 
-            object_set_error1(object, OK);
+        } else {
 
-            /* initialize our derived klass here */
+            /* without a bitmap, the records need to be counted */
 
-            self = REL(object);
+            errno = 0;
+            cursor = _rel_cursor_alloc(self, self->scan);
+            check_null(cursor);
 
-            /* assign our methods here */
+            for (;;) {
 
-            self->ctor = _rel_ctor;
-            self->dtor = _rel_dtor;
-            self->_compare = _rel_compare;
-            self->_override = _rel_override;
+                stat = _rel_cursor_scan(self, cursor, &ondisk);
+                check_return(stat, self);
 
-            self->_add    = _rel_add;
-            self->_del    = _rel_del;
-            self->_get    = _rel_get;
-            self->_put    = _rel_put;
-            self->_init   = _rel_init;
-            self->_find   = _rel_find;
-            self->_last   = _rel_last;
-            self->_next   = _rel_next;
-            self->_open   = _rel_open;
-            self->_prev   = _rel_prev;
-            self->_build  = _rel_build;
-            self->_first  = _rel_first;
-            self->_extend = _rel_extend;
-            self->_record = _rel_record;
-            self->_remove = _rel_remove;
-            self->_search = _rel_search;
-            self->_default = _rel_default;
-            self->_normalize = _rel_normalize;
-            self->_read_header = _rel_read_header;
-            self->_write_header = _rel_write_header;
-            self->_update_header = _rel_update_header;
-            self->_master_lock = _rel_master_lock;
-            self->_master_unlock = _rel_master_unlock;
+                if (ondisk == NULL) break;
+                (*live)++;
 
-            /* initialize internal variables here */
+            }
 
-            self->record = 1;
-            self->autoextend = FALSE;
+            free(cursor->buffer);
+            free(cursor->bits);
+            free(cursor);
 
-            /* these are overwritten by the header */
+        }
 
-            self->lastrec = 1;
-            self->recsize = recsize;
-            self->records = records;
+        exit_when;
 
-            exit_when;
+    } use {
 
-        } use {
+        stat = ERR;
+        process_error(self);
 
-            stat = ERR;
-            process_error(self);
+        if (cursor) {
 
-        } end_when;
+            free(cursor->buffer);
+            free(cursor->bits);
+            free(cursor);
 
-    }
+        }
+
+    } end_when;
 
     return stat;
 
 }
 
-int _rel_dtor(object_t *object) {
+int rel_get_recsize(rel_t *self, off_t *recsize) {
 
     int stat = OK;
-    blk_t *blk = BLK(object);
 
-    /* free local resources here */
+    when_error_in {
 
-    /* walk the chain, freeing as we go */
+        if ((self == NULL) || (recsize == NULL)) {
 
-    object_demote(object, blk_t);
-    blk_destroy(blk);
+            cause_error(E_INVPARM);
+
+        }
+
+        *recsize = self->recsize;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
 
     return stat;
 
 }
 
-int _rel_override(rel_t *self, item_list_t *items) {
+int rel_find(rel_t *self, void *data, int (*compare)(void *, void *), off_t *recnum) {
 
-    int stat = ERR;
+    int stat = OK;
 
     when_error_in {
 
-        if (items != NULL) {
+        if ((self == NULL) || (data == NULL) || (compare == NULL)) {
 
-            stat = blk_override(BLK(self), items);
-            check_return(stat, self);
+            cause_error(E_INVPARM);
 
-            errno = E_UNKOVER;
+        }
 
-            int x;
-            for (x = 0;; x++) {
+        stat = self->_find(self, data, compare, recnum);
+        check_return(stat, self);
 
-                if ((items[x].buffer_length == 0) &&
-                    (items[x].item_code == 0)) break;
+        exit_when;
 
-                switch(items[x].item_code) {
-                    case REL_M_DESTRUCTOR: {
-                        self->dtor = NULL;
-                        self->dtor = items[x].buffer_address;
-                        check_null(self->dtor);
-                        break;
-                    }
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_search(rel_t *self, void *data, int (*compare)(void *, void *), int (*capture)(rel_t *, void *, queue_t *), queue_t *results) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (compare == NULL) || (capture == NULL)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        stat = self->_search(self, data, compare, capture, results);
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_search_parallel(rel_t *self, void *data, int (*compare)(void *, void *), int (*capture)(rel_t *, void *, queue_t *), queue_t *results, int threads) {
+
+    int x;
+    int fd = -1;
+    int stat = OK;
+    int started = 0;
+    int workers = 0;
+    off_t size = 0;
+    off_t first = 1;
+    off_t chunk = 1;
+    off_t recsize = 0;
+    off_t records = 0;
+    pthread_t *tids = NULL;
+    rel_match_t *match = NULL;
+    rel_worker_t *worker = NULL;
+
+    when_error_in {
+
+        if ((self == NULL) || (compare == NULL) || 
+            (capture == NULL) || (threads < 1)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        /* split the records, after the header, into one range per worker */
+
+        recsize = REL_RECSIZE(self->recsize);
+        chunk = (REL_C_CHUNK / recsize) > 0 ? (REL_C_CHUNK / recsize) : 1;
+
+        stat = blk_size(BLK(self), &size);
+        check_return(stat, self);
+
+        records = (size / recsize) - 1;
+        if (records < 0) records = 0;
+
+        /* each worker gets at least one chunk of records, so a small */
+        /* datastore is not split up for nothing                      */
+
+        workers = (records + chunk - 1) / chunk;
+        if (workers > threads) workers = threads;
+        if (workers > REL_T_MAX) workers = REL_T_MAX;
+
+#ifndef F_OFD_SETLK
+        if (self->scan == REL_C_CONSISTENT) workers = 1;
+#endif
+
+        if (workers < 2) {
+
+            stat = self->_search(self, data, compare, capture, results);
+            check_return(stat, self);
+
+            exit_when;
+
+        }
+
+        stat = blk_get_fd(BLK(self), &fd);
+        check_return(stat, self);
+
+        errno = 0;
+        worker = calloc(workers, sizeof(rel_worker_t));
+        check_null(worker);
+
+        errno = 0;
+        tids = calloc(workers, sizeof(pthread_t));
+        check_null(tids);
+
+        for (x = 0; x < workers; x++) {
+
+            worker[x].fd = fd;
+            worker[x].self = self;
+            worker[x].data = data;
+            worker[x].compare = compare;
+            worker[x].first = first;
+            worker[x].last = first + (records / workers) + 
+                             ((x < (records % workers)) ? 1 : 0);
+
+            first = worker[x].last;
+
+            stat = que_init(&worker[x].matches);
+            check_status(stat);
+
+        }
+
+        for (x = 0; x < workers; x++) {
+
+            errno = pthread_create(&tids[x], NULL, _rel_search_worker, &worker[x]);
+            check_status(errno);
+
+            started++;
+
+        }
+
+        for (x = 0; x < started; x++) {
+
+            pthread_join(tids[x], NULL);
+
+        }
+
+        started = 0;
+
+        for (x = 0; x < workers; x++) {
+
+            if (worker[x].stat != OK) {
+
+                cause_error(worker[x].errnum);
+
+            }
+
+        }
+
+        /* the ranges are in record order, so are the matches within them */
+
+        for (x = 0; x < workers; x++) {
+
+            while ((match = que_pop_head(&worker[x].matches)) != NULL) {
+
+                self->record = match->recnum;
+
+                stat = capture(self, match->data, results);
+                free(match);
+                check_return(stat, self);
+
+            }
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        for (x = 0; x < started; x++) {
+
+            pthread_join(tids[x], NULL);
+
+        }
+
+    } end_when;
+
+    if (worker != NULL) {
+
+        for (x = 0; x < workers; x++) {
+
+            while ((match = que_pop_head(&worker[x].matches)) != NULL) {
+
+                free(match);
+
+            }
+
+        }
+
+    }
+
+    free(worker);
+    free(tids);
+
+    return stat;
+
+}
+
+int rel_cursor_create(rel_t *self, int mode, rel_cursor_t **cursor) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (cursor == NULL) ||
+            ((mode != REL_C_CONSISTENT) && (mode != REL_C_DIRTY))) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        errno = 0;
+        *cursor = _rel_cursor_alloc(self, mode);
+        check_null(*cursor);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_cursor_destroy(rel_t *self, rel_cursor_t *cursor) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (cursor == NULL)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        free(cursor->buffer);
+        free(cursor->bits);
+        free(cursor);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_cursor_first(rel_t *self, rel_cursor_t *cursor, void *record, off_t *recnum) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (cursor == NULL) || 
+            (record == NULL) || (recnum == NULL)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        cursor->count = 0;
+        cursor->recnum = 0;
+        cursor->bitscount = 0;
+
+        stat = _rel_cursor_live(self, cursor, record, recnum);
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_cursor_next(rel_t *self, rel_cursor_t *cursor, void *record, off_t *recnum) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (cursor == NULL) || 
+            (record == NULL) || (recnum == NULL)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        stat = _rel_cursor_live(self, cursor, record, recnum);
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_get_scan(rel_t *self, int *mode) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (mode == NULL)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        *mode = self->scan;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_set_scan(rel_t *self, int mode) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || 
+            ((mode != REL_C_CONSISTENT) && (mode != REL_C_DIRTY))) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        self->scan = mode;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_get_autoextend(rel_t *self, int *autoextend) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (autoextend == NULL)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        *autoextend = self->autoextend;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_set_autoextend(rel_t *self, int autoextend) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || 
+            ((autoextend != TRUE) && (autoextend != FALSE))) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        self->autoextend = autoextend;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_get_access(rel_t *self, int *access) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || (access == NULL)) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        *access = self->access;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int rel_set_access(rel_t *self, int access) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) || 
+            ((access != REL_A_BLOCK) && (access != REL_A_MMAP))) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        /* the mapping is made on first use */
+
+        if (access != REL_A_MMAP) _rel_unmap(self);
+        self->access = access;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+/*----------------------------------------------------------------*/
+/* klass implementation                                           */
+/*----------------------------------------------------------------*/
+
+int _rel_ctor(object_t *object, item_list_t *items) {
+
+    int stat = OK;
+    int records = 0;
+    int recsize = 0;
+    rel_t *self = NULL;
+    char livepath[1024];
+
+    if (object != NULL) {
+
+        stat = OK;
+
+        when_error_in {
+
+            /* intialize the base klass here */
+        
+            stat = BLK_KLASS->ctor(object, items);
+            check_return(stat, object);
+        
+            /* capture our items */
+
+            if (items != NULL) {
+
+                int x;
+                for (x = 0;; x++) {
+
+                    if ((items[x].buffer_length == 0) &&
+                        (items[x].item_code == 0)) break;
+
+                    switch(items[x].item_code) {
+                        case REL_K_RECORDS: {
+                            memcpy(&records, 
+                                   items[x].buffer_address, 
+                                   items[x].buffer_length);
+                            break;
+                        }
+                        case REL_K_RECSIZE: {
+                            memcpy(&recsize, 
+                                   items[x].buffer_address, 
+                                   items[x].buffer_length);
+                            break;
+                        }
+                    }
+
+                }
+
+            }
+
+            /* initilize our base klass here */
+
+            object_set_error1(object, OK);
+
+            /* initialize our derived klass here */
+
+            self = REL(object);
+
+            /* assign our methods here */
+
+            self->ctor = _rel_ctor;
+            self->dtor = _rel_dtor;
+            self->_compare = _rel_compare;
+            self->_override = _rel_override;
+
+            self->_add    = _rel_add;
+            self->_del    = _rel_del;
+            self->_get    = _rel_get;
+            self->_put    = _rel_put;
+            self->_get_many = _rel_get_many;
+            self->_put_many = _rel_put_many;
+            self->_init   = _rel_init;
+            self->_find   = _rel_find;
+            self->_last   = _rel_last;
+            self->_next   = _rel_next;
+            self->_open   = _rel_open;
+            self->_prev   = _rel_prev;
+            self->_build  = _rel_build;
+            self->_first  = _rel_first;
+            self->_extend = _rel_extend;
+            self->_record = _rel_record;
+            self->_remove = _rel_remove;
+            self->_search = _rel_search;
+            self->_default = _rel_default;
+            self->_normalize = _rel_normalize;
+            self->_read_header = _rel_read_header;
+            self->_write_header = _rel_write_header;
+            self->_update_header = _rel_update_header;
+            self->_master_lock = _rel_master_lock;
+            self->_master_unlock = _rel_master_unlock;
+
+            /* initialize internal variables here */
+
+            self->record = 1;
+            self->scan = REL_C_CONSISTENT;
+            self->cursor = NULL;
+            self->access = REL_A_BLOCK;
+            self->mapsize = 0;
+            self->map = NULL;
+            self->bitmap = FALSE;
+            self->live = NULL;
+
+            /* the bitmap lives next to the datastore */
+
+            memset(livepath, '\0', 1024);
+            strncpy(livepath, fnm_build(1, FnmPath, ".live", FIB(self)->path, NULL), 1023);
+
+            self->live = blk_create(livepath, BLK(self)->retries, BLK(self)->timeout);
+            check_creation(self->live);
+            self->freelist = FALSE;
+            self->autoextend = FALSE;
+            self->master_held = FALSE;
+
+            /* these are overwritten by the header */
+
+            self->lastrec = 1;
+            self->recsize = recsize;
+            self->records = records;
+
+            exit_when;
+
+        } use {
+
+            stat = ERR;
+            process_error(self);
+
+        } end_when;
+
+    }
+
+    return stat;
+
+}
+
+int _rel_dtor(object_t *object) {
+
+    int stat = OK;
+    blk_t *blk = BLK(object);
+
+    /* free local resources here */
+
+    rel_t *self = REL(object);
+
+    if (self->cursor != NULL) {
+
+        free(self->cursor->buffer);
+        free(self->cursor->bits);
+        free(self->cursor);
+
+    }
+
+    _rel_unmap(self);
+
+    if (self->bitmap) blk_close(self->live);
+    if (self->live != NULL) blk_destroy(self->live);
+
+    /* walk the chain, freeing as we go */
+
+    object_demote(object, blk_t);
+    blk_destroy(blk);
+
+    return stat;
+
+}
+
+int _rel_override(rel_t *self, item_list_t *items) {
+
+    int stat = ERR;
+
+    when_error_in {
+
+        if (items != NULL) {
+
+            stat = blk_override(BLK(self), items);
+            check_return(stat, self);
+
+            errno = E_UNKOVER;
+
+            int x;
+            for (x = 0;; x++) {
+
+                if ((items[x].buffer_length == 0) &&
+                    (items[x].item_code == 0)) break;
+
+                switch(items[x].item_code) {
+                    case REL_M_DESTRUCTOR: {
+                        self->dtor = NULL;
+                        self->dtor = items[x].buffer_address;
+                        check_null(self->dtor);
+                        break;
+                    }
                     case REL_M_OPEN: {
                         self->_open = NULL;
                         self->_open = items[x].buffer_address;
@@ -713,6 +1533,18 @@ int _rel_override(rel_t *self, item_list_t *items) {
                         check_null(self->_put);
                         break;
                     }
+                    case REL_M_GET_MANY: {
+                        self->_get_many = NULL;
+                        self->_get_many = items[x].buffer_address;
+                        check_null(self->_get_many);
+                        break;
+                    }
+                    case REL_M_PUT_MANY: {
+                        self->_put_many = NULL;
+                        self->_put_many = items[x].buffer_address;
+                        check_null(self->_put_many);
+                        break;
+                    }
                     case REL_M_NEXT: {
                         self->_next = NULL;
                         self->_next = items[x].buffer_address;
@@ -809,24 +1641,1207 @@ int _rel_override(rel_t *self, item_list_t *items) {
                         check_null(self->_update_header);
                         break;
                     }
-                    case REL_M_MASTER_LOCK: {
-                        self->_master_lock = NULL;
-                        self->_master_lock = items[x].buffer_address;
-                        check_null(self->_master_lock);
-                        break;
+                    case REL_M_MASTER_LOCK: {
+                        self->_master_lock = NULL;
+                        self->_master_lock = items[x].buffer_address;
+                        check_null(self->_master_lock);
+                        break;
+                    }
+                    case REL_M_MASTER_UNLOCK: {
+                        self->_master_unlock = NULL;
+                        self->_master_unlock = items[x].buffer_address;
+                        check_null(self->_master_unlock);
+                        break;
+                    }
+                }
+
+            }
+            
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_compare(rel_t *self, rel_t *other) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((blk_compare(BLK(self), BLK(other)) == 0) &&
+            (self->ctor == other->ctor) &&
+            (self->dtor == other->dtor) &&
+            (self->_compare == other->_compare) &&
+            (self->_override == other->_override) &&
+            (self->_open    == other->_open) &&
+            (self->_add    == other->_add) &&
+            (self->_del    == other->_del) &&
+            (self->_get    == other->_get) &&
+            (self->_put    == other->_put) &&
+            (self->_get_many == other->_get_many) &&
+            (self->_put_many == other->_put_many) &&
+            (self->_next   == other->_next) &&
+            (self->_prev   == other->_prev) &&
+            (self->_last   == other->_last) &&
+            (self->_first  == other->_first) &&
+            (self->_build  == other->_build) &&
+            (self->_find   == other->_find) &&
+            (self->_record == other->_record) &&
+            (self->_remove == other->_remove) &&
+            (self->_extend == other->_extend) &&
+            (self->_search == other->_search) &&
+            (self->_normalize == other->_normalize) &&
+            (self->_read_header == other->_read_header) &&
+            (self->_write_header == other->_write_header) &&
+            (self->_update_header == other->_update_header) &&
+            (self->_master_lock == other->_master_lock) &&
+            (self->_master_unlock == other->_master_unlock) &&
+            (self->autoextend == other->autoextend) &&
+            (self->master_locked == other->master_locked) &&
+            (self->freelist == other->freelist) &&
+            (self->scan == other->scan) &&
+            (self->access == other->access) &&
+            (self->record == other->record) &&
+            (self->lastrec == other->lastrec) &&
+            (self->recsize == other->recsize) &&
+            (self->records == other->records)) {
+
+            stat = OK;
+
+        } else {
+
+            cause_error(E_NOTSAME);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_open(rel_t *self, int flags, mode_t mode) {
+
+    int stat = OK;
+    int exists = 0;
+
+    when_error_in {
+
+        stat = blk_exists(BLK(self), &exists);
+        check_return(stat, self);
+
+        if (exists) {
+
+            stat = blk_open(BLK(self), flags, mode);
+            check_return(stat, self);
+
+            stat = self->_read_header(self);
+            check_return(stat, self);
+
+            stat = _rel_live_open(self, flags, mode, FALSE);
+            check_return(stat, self);
+
+            if ((! self->freelist) && REL_FREEFITS(self->recsize) &&
+                ((flags & O_ACCMODE) != O_RDONLY)) {
+
+                stat = _rel_chain_free(self);
+                check_return(stat, self);
+
+            }
+
+        } else {
+
+            stat = blk_creat(BLK(self), mode);
+            check_return(stat, self);
+            
+            stat = blk_open(BLK(self), flags, mode);
+            check_return(stat, self);
+
+            stat = self->_write_header(self);
+            check_return(stat, self);
+
+            stat = _rel_live_open(self, flags, mode, TRUE);
+            check_return(stat, self);
+
+            stat = self->_extend(self, self->records);
+            check_return(stat, self);
+
+            stat = self->_init(self);
+            check_return(stat, self);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_remove(rel_t *self) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        _rel_unmap(self);
+
+        if (self->bitmap) {
+
+            self->bitmap = FALSE;
+
+            stat = blk_close(self->live);
+            check_return(stat, self);
+
+            stat = blk_unlink(self->live);
+            check_return(stat, self);
+
+        }
+
+        stat = blk_close(BLK(self));
+        check_return(stat, self);
+
+        stat = blk_unlink(BLK(self));
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_record(rel_t *self, off_t *recnum) {
+
+    *recnum = self->record;
+
+    return OK;
+
+}
+
+int _rel_first(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
+
+    int stat = OK;
+    rel_record_t *record = NULL;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+
+    when_error_in {
+
+        *count = 0;
+
+        stat = _rel_cursor_start(self);
+        check_return(stat, self);
+
+        stat = _rel_cursor_seek(self, self->cursor, 1, &record);
+        check_return(stat, self);
+
+        self->record = 1;
+
+        if (record != NULL) {
+
+            memcpy(ondisk, record, recsize);
+            *count = recsize;
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_next(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
+
+    int stat = OK;
+    rel_record_t *record = NULL;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+
+    when_error_in {
+
+        *count = 0;
+
+        if (self->cursor == NULL) {
+
+            cause_error(E_INVOPS);
+
+        }
+
+        stat = _rel_cursor_seek(self, self->cursor, self->record + 1, &record);
+        check_return(stat, self);
+
+        self->record++;
+
+        if (record != NULL) {
+
+            memcpy(ondisk, record, recsize);
+            *count = recsize;
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_prev(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
+
+    int stat = OK;
+    off_t offset = 0;
+    int locked = FALSE;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+
+    when_error_in {
+
+        *count = 0;
+
+        if (self->record > 1) {
+
+            self->record--;
+            offset = REL_OFFSET(self->record, self->recsize);
+
+            stat = blk_lock(BLK(self), offset, recsize, BLK_L_SHARED);
+            check_return(stat, self);
+
+            stat = blk_pread(BLK(self), ondisk, recsize, offset, count);
+            check_return(stat, self);
+
+            stat = blk_unlock(BLK(self));
+            check_return(stat, self);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        blk_is_locked(BLK(self), &locked);
+        if (locked) blk_unlock(BLK(self));
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_last(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
+
+    int stat = OK;
+    off_t size = 0;
+    off_t offset = 0;
+    int locked = FALSE;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+
+    when_error_in {
+
+        *count = 0;
+
+        stat = blk_size(BLK(self), &size);
+        check_return(stat, self);
+
+        self->record = REL_RECORD(size, self->recsize) - 1;
+
+        if (self->record > 0) {
+
+            offset = REL_OFFSET(self->record, self->recsize);
+
+            stat = blk_lock(BLK(self), offset, recsize, BLK_L_SHARED);
+            check_return(stat, self);
+
+            stat = blk_pread(BLK(self), ondisk, recsize, offset, count);
+            check_return(stat, self);
+
+            stat = blk_unlock(BLK(self));
+            check_return(stat, self);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        blk_is_locked(BLK(self), &locked);
+        if (locked) blk_unlock(BLK(self));
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_get(rel_t *self, off_t recnum, void *record) {
+
+    int stat = OK;
+    ssize_t count = 0;
+    int locked = FALSE;
+    rel_record_t *ondisk = NULL;
+    rel_record_t *mapped = NULL;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+    off_t offset = REL_OFFSET(recnum, self->recsize);
+
+    when_error_in {
+
+        if (self->access == REL_A_MMAP) {
+
+            /* read straight from the mapping, without locking */
+
+            stat = _rel_map_record(self, recnum, &mapped);
+            check_return(stat, self);
+
+            if (mapped == NULL) {
+
+                cause_error(EIO);
+
+            }
+
+            if (bit_test(mapped->flags, REL_F_DELETED)) {
+
+                cause_error(E_RMSDEL);
+
+            }
+
+            stat = self->_build(self, &mapped->data, record);
+            check_return(stat, self);
+
+            exit_when;
+
+        }
+
+        errno = 0;
+        ondisk = calloc(1, recsize);
+        check_null(ondisk);
+
+        stat = blk_lock(BLK(self), offset, recsize, BLK_L_SHARED);
+        check_return(stat, self);
+
+        stat = blk_pread(BLK(self), ondisk, recsize, offset, &count);
+        check_return(stat, self);
+
+        stat = blk_unlock(BLK(self));
+        check_return(stat, self);
+
+        if (count != recsize) {
+
+            cause_error(EIO);
+
+        }
+
+        if (bit_test(ondisk->flags, REL_F_DELETED)) {
+
+            cause_error(E_RMSDEL);
+
+        }
+
+        stat = self->_build(self, &ondisk->data, record);
+        check_return(stat, self);
+
+        free((void *)ondisk);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        if (ondisk) free((void *)ondisk);
+        blk_is_locked(BLK(self), &locked);
+        if (locked) blk_unlock(BLK(self));
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_put(rel_t *self, off_t recnum, void *record) {
+
+    int stat = OK;
+    ssize_t count = 0;
+    int locked = FALSE;
+    rel_record_t *ondisk = NULL;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+    off_t offset = REL_OFFSET(recnum, self->recsize);
+
+    when_error_in {
+
+        errno = 0;
+        ondisk = calloc(1, recsize);
+        check_null(ondisk);
+
+        stat = blk_lock(BLK(self), offset, recsize, BLK_L_EXCLUSIVE);
+        check_return(stat, self);
+
+        stat = blk_pread(BLK(self), ondisk, recsize, offset, &count);
+        check_return(stat, self);
+
+        if (count != recsize) {
+
+            cause_error(EIO);
+
+        }
+
+        if (bit_test(ondisk->flags, REL_F_DELETED)) {
+
+            cause_error(E_RMSDEL);
+
+        }
+
+        stat = self->_normalize(self, &ondisk->data, record);
+        check_return(stat, self);
+
+        stat = blk_pwrite(BLK(self), ondisk, recsize, offset, &count);
+        check_return(stat, self);
+
+        if (count != recsize) {
+
+            cause_error(EIO);
+
+        }
+
+        stat = blk_unlock(BLK(self));
+        check_return(stat, self);
+
+        free((void *)ondisk);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        if (ondisk) free((void *)ondisk);
+        blk_is_locked(BLK(self), &locked);
+        if (locked) blk_unlock(BLK(self));
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_get_many(rel_t *self, off_t *recnums, void **records, int count) {
+
+    int x = 0;
+    int y = 0;
+    int z = 0;
+    int stat = OK;
+    off_t first = 0;
+    off_t length = 0;
+    off_t offset = 0;
+    ssize_t bytes = 0;
+    int locked = FALSE;
+    rel_batch_t *batch = NULL;
+    rel_record_t *ondisk = NULL;
+    unsigned char *buffer = NULL;
+    off_t recsize = REL_RECSIZE(self->recsize);
+    off_t chunk = (REL_C_CHUNK / recsize) > 0 ? (REL_C_CHUNK / recsize) : 1;
+
+    when_error_in {
+
+        stat = _rel_batch_sort(recnums, count, &batch);
+        check_status(stat);
+
+        errno = 0;
+        buffer = calloc(chunk, recsize);
+        check_null(buffer);
+
+        /* read each run of adjacent records with one lock and read */
+
+        for (x = 0; x < count; x = y) {
+
+            y = _rel_batch_range(batch, x, count, chunk);
+
+            first = batch[x].recnum;
+            length = (batch[y - 1].recnum - first + 1) * recsize;
+            offset = REL_OFFSET(first, self->recsize);
+
+            stat = blk_lock(BLK(self), offset, length, BLK_L_SHARED);
+            check_return(stat, self);
+
+            stat = blk_pread(BLK(self), buffer, length, offset, &bytes);
+            check_return(stat, self);
+
+            stat = blk_unlock(BLK(self));
+            check_return(stat, self);
+
+            if (bytes != length) {
+
+                cause_error(EIO);
+
+            }
+
+            for (z = x; z < y; z++) {
+
+                ondisk = (rel_record_t *)(buffer + ((batch[z].recnum - first) * recsize));
+
+                if (bit_test(ondisk->flags, REL_F_DELETED)) {
+
+                    cause_error(E_RMSDEL);
+
+                }
+
+                stat = self->_build(self, &ondisk->data, records[batch[z].slot]);
+                check_return(stat, self);
+
+            }
+
+        }
+
+        free((void *)buffer);
+        free((void *)batch);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        if (batch) free((void *)batch);
+        if (buffer) free((void *)buffer);
+        blk_is_locked(BLK(self), &locked);
+        if (locked) blk_unlock(BLK(self));
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_put_many(rel_t *self, off_t *recnums, void **records, int count) {
+
+    int x = 0;
+    int y = 0;
+    int z = 0;
+    int stat = OK;
+    off_t first = 0;
+    off_t length = 0;
+    off_t offset = 0;
+    ssize_t bytes = 0;
+    int locked = FALSE;
+    rel_batch_t *batch = NULL;
+    rel_record_t *ondisk = NULL;
+    unsigned char *buffer = NULL;
+    off_t recsize = REL_RECSIZE(self->recsize);
+    off_t chunk = (REL_C_CHUNK / recsize) > 0 ? (REL_C_CHUNK / recsize) : 1;
+
+    when_error_in {
+
+        stat = _rel_batch_sort(recnums, count, &batch);
+        check_status(stat);
+
+        errno = 0;
+        buffer = calloc(chunk, recsize);
+        check_null(buffer);
+
+        /* update each run of adjacent records with one lock, read */
+        /* and write. A run with a deleted record is not written.  */
+
+        for (x = 0; x < count; x = y) {
+
+            y = _rel_batch_range(batch, x, count, chunk);
+
+            first = batch[x].recnum;
+            length = (batch[y - 1].recnum - first + 1) * recsize;
+            offset = REL_OFFSET(first, self->recsize);
+
+            stat = blk_lock(BLK(self), offset, length, BLK_L_EXCLUSIVE);
+            check_return(stat, self);
+
+            stat = blk_pread(BLK(self), buffer, length, offset, &bytes);
+            check_return(stat, self);
+
+            if (bytes != length) {
+
+                cause_error(EIO);
+
+            }
+
+            for (z = x; z < y; z++) {
+
+                ondisk = (rel_record_t *)(buffer + ((batch[z].recnum - first) * recsize));
+
+                if (bit_test(ondisk->flags, REL_F_DELETED)) {
+
+                    cause_error(E_RMSDEL);
+
+                }
+
+            }
+
+            /* repeated records are applied in the callers order */
+
+            for (z = x; z < y; z++) {
+
+                ondisk = (rel_record_t *)(buffer + ((batch[z].recnum - first) * recsize));
+
+                stat = self->_normalize(self, &ondisk->data, records[batch[z].slot]);
+                check_return(stat, self);
+
+            }
+
+            stat = blk_pwrite(BLK(self), buffer, length, offset, &bytes);
+            check_return(stat, self);
+
+            if (bytes != length) {
+
+                cause_error(EIO);
+
+            }
+
+            stat = blk_unlock(BLK(self));
+            check_return(stat, self);
+
+        }
+
+        free((void *)buffer);
+        free((void *)batch);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        if (batch) free((void *)batch);
+        if (buffer) free((void *)buffer);
+        blk_is_locked(BLK(self), &locked);
+        if (locked) blk_unlock(BLK(self));
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_find(rel_t *self, void *data, int (*compare)(void *, void *), off_t *recnum) {
+
+    int stat = OK;
+    rel_record_t *ondisk = NULL;
+
+    when_error_in {
+
+        *recnum = 0;
+
+        stat = _rel_cursor_start(self);
+        check_return(stat, self);
+
+        for (;;) {
+
+            stat = _rel_cursor_scan(self, self->cursor, &ondisk);
+            check_return(stat, self);
+
+            if (ondisk == NULL) break;
+
+            self->record = self->cursor->recnum;
+
+            if (compare(data, &ondisk->data)) {
+
+                *recnum = self->record;
+                break;
+
+            }
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_search(rel_t *self, void *data, int (*compare)(void *, void *), int (*capture)(rel_t *, void *, queue_t *), queue_t *results) {
+
+    int stat = OK;
+    rel_record_t *ondisk = NULL;
+
+    when_error_in {
+
+        stat = _rel_cursor_start(self);
+        check_return(stat, self);
+
+        for (;;) {
+
+            stat = _rel_cursor_scan(self, self->cursor, &ondisk);
+            check_return(stat, self);
+
+            if (ondisk == NULL) break;
+
+            self->record = self->cursor->recnum;
+
+            if (compare(data, &ondisk->data)) {
+
+                stat = capture(self, &ondisk->data, results);
+                check_return(stat, self);
+
+            }
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_add(rel_t *self, void *record) {
+
+    int stat = OK;
+    ssize_t count = 0;
+    int locked = FALSE;
+    int grow = 0;
+    int created = FALSE;
+    off_t recnum = 0;
+    off_t offset = 0;
+    unsigned long next = 0;
+    rel_header_t header;
+    rel_record_t *ondisk = NULL;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+
+    when_error_in {
+
+        errno = 0;
+        ondisk = calloc(1, recsize);
+        check_null(ondisk);
+
+        for (;;) {
+
+            stat = self->_master_lock(self);
+            check_return(stat, self);
+
+            if (self->freelist) {
+
+                /* pop the head of the free list */
+
+                stat = _rel_get_header(self, &header);
+                check_return(stat, self);
+
+                if ((recnum = header.freelist) > 0) {
+
+                    offset = REL_OFFSET(recnum, self->recsize);
+
+                    stat = blk_lock(BLK(self), offset, recsize, BLK_L_EXCLUSIVE);
+                    check_return(stat, self);
+
+                    stat = blk_pread(BLK(self), ondisk, recsize, offset, &count);
+                    check_return(stat, self);
+
+                    if ((count != recsize) || 
+                        (! bit_test(ondisk->flags, REL_F_DELETED))) {
+
+                        cause_error(E_INVREC);
+
+                    }
+
+                    memcpy(&next, &ondisk->data, sizeof(unsigned long));
+                    memcpy(&ondisk->data, record, self->recsize);
+                    bit_clear(ondisk->flags, REL_F_DELETED);
+
+                    stat = _rel_live_mark(self, recnum, TRUE);
+                    check_return(stat, self);
+
+                    stat = blk_pwrite(BLK(self), ondisk, recsize, offset, &count);
+                    check_return(stat, self);
+
+                    if (count != recsize) {
+
+                        cause_error(EIO);
+
                     }
-                    case REL_M_MASTER_UNLOCK: {
-                        self->_master_unlock = NULL;
-                        self->_master_unlock = items[x].buffer_address;
-                        check_null(self->_master_unlock);
+
+                    stat = blk_unlock(BLK(self));
+                    check_return(stat, self);
+
+                    header.freelist = next;
+
+                    stat = _rel_put_header(self, &header);
+                    check_return(stat, self);
+
+                    self->record = recnum;
+                    created = TRUE;
+
+                }
+
+            } else {
+
+                stat = self->_first(self, ondisk, &count);
+                check_return(stat, self);
+
+                while (count > 0) {
+
+                    if (bit_test(ondisk->flags, REL_F_DELETED)) {
+
+                        memcpy(&ondisk->data, record, self->recsize);
+                        bit_clear(ondisk->flags, REL_F_DELETED);
+
+                        stat = _rel_live_mark(self, self->record, TRUE);
+                        check_return(stat, self);
+
+                        offset = REL_OFFSET(self->record, self->recsize);
+
+                        stat = blk_pwrite(BLK(self), ondisk, recsize, offset, &count);
+                        check_return(stat, self);
+
+                        if (count != recsize) {
+
+                            cause_error(EIO);
+
+                        }
+
+                        created = TRUE;
                         break;
+
                     }
+
+                    stat = self->_next(self, ondisk, &count);
+                    check_return(stat, self);
+
+                }
+
+            }
+
+            stat = self->_master_unlock(self);
+            check_return(stat, self);
+
+            if (created || (! self->autoextend)) break;
+
+            /* no free slot, grow the file and try again */
+
+            grow = (self->records < REL_X_MIN) ? REL_X_MIN : self->records;
+            if (grow > REL_X_MAX) grow = REL_X_MAX;
+
+            stat = self->_extend(self, grow);
+            check_return(stat, self);
+
+        }
+
+        if (! created) {
+
+            cause_error(EOVERFLOW);
+
+        }
+
+        free((void *)ondisk);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        if (ondisk) free((void *)ondisk);
+        blk_is_locked(BLK(self), &locked);
+        if (locked) blk_unlock(BLK(self));
+        if (self->master_locked) self->_master_unlock(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_del(rel_t *self, off_t recnum) {
+
+    int stat = OK;
+    ssize_t count = 0;
+    int locked = FALSE;
+    rel_header_t header;
+    unsigned long next = 0;
+    rel_record_t *ondisk = NULL;
+    off_t recsize = REL_RECSIZE(self->recsize);
+    off_t offset = REL_OFFSET(recnum, self->recsize);
+
+    when_error_in {
+
+        errno = 0;
+        ondisk = calloc(1, recsize);
+        check_null(ondisk);
+
+        if (self->freelist || self->bitmap) {
+
+            stat = self->_master_lock(self);
+            check_return(stat, self);
+
+        }
+
+        stat = blk_lock(BLK(self), offset, recsize, BLK_L_EXCLUSIVE);
+        check_return(stat, self);
+
+        stat = blk_pread(BLK(self), ondisk, recsize, offset, &count);
+        check_return(stat, self);
+
+        if (count != recsize) {
+
+            cause_error(EIO);
+
+        }
+
+        /* a deleted record is already on the free list */
+
+        if (! (self->freelist && bit_test(ondisk->flags, REL_F_DELETED))) {
+
+            bit_set(ondisk->flags, REL_F_DELETED);
+            memset(&ondisk->data, '\0', self->recsize);
+
+            if (self->freelist) {
+
+                /* push the record onto the free list */
+
+                stat = _rel_get_header(self, &header);
+                check_return(stat, self);
+
+                next = header.freelist;
+                memcpy(&ondisk->data, &next, sizeof(unsigned long));
+
+            }
+
+            stat = blk_pwrite(BLK(self), ondisk, recsize, offset, &count);
+            check_return(stat, self);
+
+            if (count != recsize) {
+
+                cause_error(EIO);
+
+            }
+
+            if (self->freelist) {
+
+                header.freelist = recnum;
+
+                stat = _rel_put_header(self, &header);
+                check_return(stat, self);
+
+            }
+
+            stat = _rel_live_mark(self, recnum, FALSE);
+            check_return(stat, self);
+
+        }
+
+        stat = blk_unlock(BLK(self));
+        check_return(stat, self);
+
+        if (self->freelist || self->bitmap) {
+
+            stat = self->_master_unlock(self);
+            check_return(stat, self);
+
+        }
+
+        free((void *)ondisk);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        if (ondisk) free((void *)ondisk);
+        blk_is_locked(BLK(self), &locked);
+        if (locked) blk_unlock(BLK(self));
+        if (self->master_locked) self->_master_unlock(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_extend(rel_t *self, int amount) {
+
+    int fd;
+    int x = 0;
+    int stat = OK;
+    int batch = 0;
+    off_t size = 0;
+    off_t first = 0;
+    off_t offset = 0;
+    ssize_t count = 0;
+    rel_header_t header;
+    unsigned long next = 0;
+    rel_record_t *ondisk = NULL;
+    unsigned char *buffer = NULL;
+    off_t recsize = REL_RECSIZE(self->recsize);
+    int chunk = (REL_X_CHUNK / recsize) > 0 ? (REL_X_CHUNK / recsize) : 1;
+
+    when_error_in {
+
+        if (chunk > amount) chunk = (amount > 0) ? amount : 1;
+
+        errno = 0;
+        buffer = calloc(chunk, recsize);
+        check_null(buffer);
+
+        /* every new record starts out as "deleted" */
+
+        for (x = 0; x < chunk; x++) {
+
+            ondisk = (rel_record_t *)(buffer + (x * recsize));
+            bit_set(ondisk->flags, REL_F_MARK);
+            bit_set(ondisk->flags, REL_F_DELETED);
+
+        }
+
+        stat = self->_master_lock(self);
+        check_return(stat, self);
+
+        stat = _rel_get_header(self, &header);
+        check_return(stat, self);
+
+        /* new records are appended after the last whole record */
+
+        stat = blk_size(BLK(self), &size);
+        check_return(stat, self);
+
+        first = REL_RECORD(size, self->recsize);
+        if (first < 1) first = 1;
+
+        if (amount > 0) {
+
+            /* reserve the space up front, so running out of room */
+            /* fails before anything is written                    */
+
+            stat = blk_get_fd(BLK(self), &fd);
+            check_return(stat, self);
+
+            offset = REL_OFFSET(first, self->recsize);
+
+            errno = posix_fallocate(fd, offset, (off_t)amount * recsize);
+            if ((errno == EINVAL) || (errno == EOPNOTSUPP)) {
+
+                errno = 0;
+                if (ftruncate(fd, offset + ((off_t)amount * recsize)) == -1) {
+
+                    cause_error(errno);
+
+                }
+
+            } else if (errno != 0) {
+
+                cause_error(errno);
+
+            }
+
+        }
+
+        /* write the records a chunk at a time, chaining them onto */
+        /* the free list in order                                  */
+
+        for (x = 0; x < amount; x += batch) {
+
+            batch = ((amount - x) < chunk) ? (amount - x) : chunk;
+
+            if (self->freelist) {
+
+                int y = 0;
+                for (; y < batch; y++) {
+
+                    ondisk = (rel_record_t *)(buffer + (y * recsize));
+                    next = ((x + y + 1) < amount) ? first + x + y + 1 : header.freelist;
+                    memcpy(&ondisk->data, &next, sizeof(unsigned long));
+
                 }
 
             }
-            
+
+            offset = REL_OFFSET(first + x, self->recsize);
+
+            stat = blk_pwrite(BLK(self), buffer, batch * recsize, offset, &count);
+            check_return(stat, self);
+
+            if (count != (batch * recsize)) {
+
+                cause_error(EIO);
+
+            }
+
+        }
+
+        if (amount > 0) {
+
+            self->records = (first - 1) + amount;
+
+            header.records = self->records;
+            if (self->freelist) header.freelist = first;
+
+            stat = _rel_put_header(self, &header);
+            check_return(stat, self);
+
         }
 
+        stat = self->_master_unlock(self);
+        check_return(stat, self);
+
+        free((void *)buffer);
+
         exit_when;
 
     } use {
@@ -834,59 +2849,270 @@ int _rel_override(rel_t *self, item_list_t *items) {
         stat = ERR;
         process_error(self);
 
+        if (buffer) free((void *)buffer);
+        if (self->master_locked) self->_master_unlock(self);
+
     } end_when;
 
     return stat;
 
 }
 
-int _rel_compare(rel_t *self, rel_t *other) {
+int _rel_master_lock(rel_t *self) {
 
     int stat = OK;
+    off_t recsize = REL_RECSIZE(self->recsize);
 
     when_error_in {
 
-        if ((blk_compare(BLK(self), BLK(other)) == 0) &&
-            (self->ctor == other->ctor) &&
-            (self->dtor == other->dtor) &&
-            (self->_compare == other->_compare) &&
-            (self->_override == other->_override) &&
-            (self->_open    == other->_open) &&
-            (self->_add    == other->_add) &&
-            (self->_del    == other->_del) &&
-            (self->_get    == other->_get) &&
-            (self->_put    == other->_put) &&
-            (self->_next   == other->_next) &&
-            (self->_prev   == other->_prev) &&
-            (self->_last   == other->_last) &&
-            (self->_first  == other->_first) &&
-            (self->_build  == other->_build) &&
-            (self->_find   == other->_find) &&
-            (self->_record == other->_record) &&
-            (self->_remove == other->_remove) &&
-            (self->_extend == other->_extend) &&
-            (self->_search == other->_search) &&
-            (self->_normalize == other->_normalize) &&
-            (self->_read_header == other->_read_header) &&
-            (self->_write_header == other->_write_header) &&
-            (self->_update_header == other->_update_header) &&
-            (self->_master_lock == other->_master_lock) &&
-            (self->_master_unlock == other->_master_unlock) &&
-            (self->autoextend == other->autoextend) &&
-            (self->master_locked == other->master_locked) &&
-            (self->record == other->record) &&
-            (self->lastrec == other->lastrec) &&
-            (self->recsize == other->recsize) &&
-            (self->records == other->records)) {
+        /* a subclass holding the lock across several methods */
+        /* keeps it until it lets go                          */
+
+        if (! self->master_held) {
+
+            self->master.l_type = F_WRLCK;
+            self->master.l_start = 1;
+            self->master.l_len = recsize;
+            self->master.l_whence = SEEK_SET;
+
+            stat = blk_acquire(BLK(self), &self->master);
+            check_return(stat, self);
+
+        }
+
+        self->master_locked = TRUE;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_master_unlock(rel_t *self) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if (! self->master_held) {
+
+            stat = blk_release(BLK(self), &self->master);
+            check_return(stat, self);
+
+        }
+
+        self->master_locked = FALSE;
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_read_header(rel_t *self) {
+
+    int stat = OK;
+    ssize_t count = 0;
+    rel_header_t header;
+    rel_record_t *ondisk = NULL;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+
+    when_error_in {
+
+        errno = 0;
+        ondisk = calloc(1, recsize + sizeof(rel_header_t));
+        check_null(ondisk);
+
+        stat = self->_master_lock(self);
+        check_return(stat, self);
+
+        stat = blk_pread(BLK(self), ondisk, recsize, 0, &count);
+        check_return(stat, self);
+
+        if (count != recsize) {
+
+            cause_error(EIO);
+
+        }
+
+        stat = self->_master_unlock(self);
+        check_return(stat, self);
+
+        memcpy(&header, &ondisk->data, sizeof(rel_header_t));
+
+        self->recsize = header.recsize;
+        self->records = header.records;
+        self->lastrec = header.lastrec;
+        self->freelist = (REL_HDRFITS(self->recsize) &&
+                          bit_test(header.options, REL_H_FREELIST));
+
+        free((void *)ondisk);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        if (ondisk) free((void *)ondisk);
+        if (self->master_locked) self->_master_unlock(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_write_header(rel_t *self) {
+
+    int stat = OK;
+    ssize_t count = 0;
+    rel_header_t header;
+    rel_record_t *ondisk = NULL;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+
+    when_error_in {
+
+        errno = 0;
+        ondisk = calloc(1, recsize + sizeof(rel_header_t));
+        check_null(ondisk);
+
+        header.type[0] = 'R';
+        header.type[1] = 'E';
+        header.type[2] = 'L';
+        header.type[3] = '\0';
+
+        header.recsize = self->recsize;
+        header.records = self->records;
+        header.lastrec = self->lastrec;
+        header.options = 0;
+        header.freelist = 0;
+
+        /* new files keep their deleted records on a free list */
+
+        self->freelist = REL_FREEFITS(self->recsize);
+        if (self->freelist) bit_set(header.options, REL_H_FREELIST);
+
+        ondisk->flags = 0;
+        memcpy(&ondisk->data, &header, sizeof(rel_header_t));
+
+        stat = self->_master_lock(self);
+        check_return(stat, self);
+
+        stat = blk_pwrite(BLK(self), ondisk, recsize, 0, &count);
+        check_return(stat, self);
+
+        if (count != recsize) {
+
+            cause_error(EIO);
+
+        }
+
+        stat = self->_master_unlock(self);
+        check_return(stat, self);
+
+        free((void *)ondisk);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+        if (ondisk) free((void *)ondisk);
+        if (self->master_locked) self->_master_unlock(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _rel_update_header(rel_t *self) {
+
+    int stat = OK;
+    long records = 0;
+    long lastrec = 0;
+    long recsize = 0;
+    ssize_t count = 0;
+    rel_header_t header;
+    rel_record_t *ondisk = NULL;
+    ssize_t xrecsize = REL_RECSIZE(self->recsize);
+
+    when_error_in {
+
+        errno = 0;
+        ondisk = calloc(1, xrecsize + sizeof(rel_header_t));
+        check_null(ondisk);
+
+        stat = self->_master_lock(self);
+        check_return(stat, self);
+
+        stat = blk_pread(BLK(self), ondisk, xrecsize, 0, &count);
+        check_return(stat, self);
+
+        if (count != xrecsize) {
+
+            cause_error(EIO);
+
+        }
+
+        memcpy(&header, ondisk->data, sizeof(rel_header_t));
+
+        recsize = header.recsize;
+        records = header.records;
+        lastrec = header.lastrec;
+
+        if (recsize != self->recsize) {
+
+            cause_error(E_INVREC);
+
+        }
+
+        if (records < self->records) {
+
+            cause_error(EIO);
+
+        }
+
+        self->records = records;
+        self->lastrec = lastrec;
 
-            stat = OK;
+        header.recsize = self->recsize;
+        header.records = self->records;
+        header.lastrec = self->lastrec;
 
-        } else {
+        memcpy(&ondisk->data, &header, sizeof(rel_header_t));
 
-            cause_error(E_NOTSAME);
+        stat = blk_pwrite(BLK(self), ondisk, xrecsize, 0, &count);
+        check_return(stat, self);
+
+        if (count != xrecsize) {
+
+            cause_error(EIO);
 
         }
 
+        stat = self->_master_unlock(self);
+        check_return(stat, self);
+
+        free((void *)ondisk);
+
         exit_when;
 
     } use {
@@ -894,48 +3120,61 @@ int _rel_compare(rel_t *self, rel_t *other) {
         stat = ERR;
         process_error(self);
 
+        if (ondisk) free((void *)ondisk);
+        if (self->master_locked) self->_master_unlock(self);
+
     } end_when;
 
     return stat;
 
 }
 
-int _rel_open(rel_t *self, int flags, mode_t mode) {
+int _rel_build(rel_t *self, void *ondisk, void *data) {
+
+    /* default behavior, this should to be overridden */
 
     int stat = OK;
-    int exists = 0;
+    void *junk = NULL;
 
     when_error_in {
 
-        stat = blk_exists(BLK(self), &exists);
-        check_return(stat, self);
+        errno = ENOMEM;
+        junk = memcpy(data, ondisk, self->recsize);
+        check_null(junk);
 
-        if (exists) {
+        exit_when;
 
-            stat = blk_open(BLK(self), flags, mode);
-            check_return(stat, self);
+    } use {
 
-            stat = self->_read_header(self);
-            check_return(stat, self);
+        stat = ERR;
+        process_error(self);
 
-        } else {
+    } end_when;
 
-            stat = blk_creat(BLK(self), mode);
-            check_return(stat, self);
-            
-            stat = blk_open(BLK(self), flags, mode);
-            check_return(stat, self);
+    return stat;
 
-            stat = self->_write_header(self);
-            check_return(stat, self);
+}
 
-            stat = self->_extend(self, self->records);
-            check_return(stat, self);
+int _rel_init(rel_t *self) {
 
-            stat = self->_init(self);
-            check_return(stat, self);
+    /* this may need to be overridden, default is to do nothing */
 
-        }
+    return OK;
+
+}
+
+int _rel_default(rel_t *self, void *ondisk, void *data) {
+
+    /* default behavior, this should to be overridden */
+
+    int stat = OK;
+    void *junk = NULL;
+
+    when_error_in {
+
+        errno = ENOMEM;
+        junk = memcpy(ondisk, data, self->recsize);
+        check_null(junk);
 
         exit_when;
 
@@ -950,17 +3189,18 @@ int _rel_open(rel_t *self, int flags, mode_t mode) {
 
 }
 
-int _rel_remove(rel_t *self) {
+int _rel_normalize(rel_t *self, void *ondisk, void *data) {
+
+    /* default behavior, this should to be overridden */
 
     int stat = OK;
+    void *junk = NULL;
 
     when_error_in {
 
-        stat = blk_close(BLK(self));
-        check_return(stat, self);
-
-        stat = blk_unlink(BLK(self));
-        check_return(stat, self);
+        errno = ENOMEM;
+        junk = memcpy(ondisk, data, self->recsize);
+        check_null(junk);
 
         exit_when;
 
@@ -975,39 +3215,54 @@ int _rel_remove(rel_t *self) {
 
 }
 
-int _rel_record(rel_t *self, off_t *recnum) {
-
-    *recnum = self->record;
-
-    return OK;
+/*----------------------------------------------------------------*/
+/* private methods                                                */
+/*----------------------------------------------------------------*/
 
-}
+static int _rel_get_header(rel_t *self, rel_header_t *header) {
 
-int _rel_first(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
+    /* read the header, the caller must hold the master lock */
 
     int stat = OK;
-    int locked = FALSE;
-    ssize_t position = 0;
+    ssize_t count = 0;
+    rel_live_t live;
+    rel_record_t *ondisk = NULL;
     ssize_t recsize = REL_RECSIZE(self->recsize);
 
     when_error_in {
 
-        stat = blk_seek(BLK(self), recsize, SEEK_SET);
-        check_return(stat, self);
+        errno = 0;
+        ondisk = calloc(1, recsize + sizeof(rel_header_t));
+        check_null(ondisk);
 
-        stat = blk_tell(BLK(self), &position);
+        stat = blk_pread(BLK(self), ondisk, recsize, 0, &count);
         check_return(stat, self);
 
-        self->record = REL_RECORD(position, self->recsize);
+        if (count != recsize) {
+
+            cause_error(EIO);
 
-        stat = blk_lock(BLK(self), position, recsize);
-        check_return(stat, self);
+        }
 
-        stat = blk_read(BLK(self), ondisk, recsize, count);
-        check_return(stat, self);
+        memcpy(header, &ondisk->data, sizeof(rel_header_t));
 
-        stat = blk_unlock(BLK(self));
-        check_return(stat, self);
+        if ((! REL_HDRFITS(self->recsize)) && (self->bitmap)) {
+
+            stat = blk_pread(self->live, &live, REL_B_HEADER, 0, &count);
+            check_return(stat, self);
+
+            if (count != REL_B_HEADER) {
+
+                cause_error(EIO);
+
+            }
+
+            header->options = live.options;
+            header->freelist = live.freelist;
+
+        }
+
+        free((void *)ondisk);
 
         exit_when;
 
@@ -1016,8 +3271,7 @@ int _rel_first(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
         stat = ERR;
         process_error(self);
 
-        blk_is_locked(BLK(self), &locked);
-        if (locked) blk_unlock(BLK(self));
+        if (ondisk) free((void *)ondisk);
 
     } end_when;
 
@@ -1025,28 +3279,60 @@ int _rel_first(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
 
 }
 
-int _rel_next(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
+static int _rel_put_header(rel_t *self, rel_header_t *header) {
+
+    /* write the header, the caller must hold the master lock */
 
     int stat = OK;
-    int locked = FALSE;
-    ssize_t position = 0;
+    ssize_t count = 0;
+    rel_live_t live;
+    rel_record_t *ondisk = NULL;
     ssize_t recsize = REL_RECSIZE(self->recsize);
 
     when_error_in {
 
-        stat = blk_tell(BLK(self), &position);
-        check_return(stat, self);
+        errno = 0;
+        ondisk = calloc(1, recsize + sizeof(rel_header_t));
+        check_null(ondisk);
 
-        self->record = REL_RECORD(position, self->recsize);
+        ondisk->flags = 0;
+        memcpy(&ondisk->data, header, sizeof(rel_header_t));
 
-        stat = blk_lock(BLK(self), position, recsize);
+        stat = blk_pwrite(BLK(self), ondisk, recsize, 0, &count);
         check_return(stat, self);
 
-        stat = blk_read(BLK(self), ondisk, recsize, count);
-        check_return(stat, self);
+        if (count != recsize) {
 
-        stat = blk_unlock(BLK(self));
-        check_return(stat, self);
+            cause_error(EIO);
+
+        }
+
+        if ((! REL_HDRFITS(self->recsize)) && (self->bitmap)) {
+
+            stat = blk_pread(self->live, &live, REL_B_HEADER, 0, &count);
+            check_return(stat, self);
+
+            if (count != REL_B_HEADER) {
+
+                cause_error(EIO);
+
+            }
+
+            live.options = header->options;
+            live.freelist = header->freelist;
+
+            stat = blk_pwrite(self->live, &live, REL_B_HEADER, 0, &count);
+            check_return(stat, self);
+
+            if (count != REL_B_HEADER) {
+
+                cause_error(EIO);
+
+            }
+
+        }
+
+        free((void *)ondisk);
 
         exit_when;
 
@@ -1055,8 +3341,7 @@ int _rel_next(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
         stat = ERR;
         process_error(self);
 
-        blk_is_locked(BLK(self), &locked);
-        if (locked) blk_unlock(BLK(self));
+        if (ondisk) free((void *)ondisk);
 
     } end_when;
 
@@ -1064,87 +3349,78 @@ int _rel_next(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
 
 }
 
-int _rel_prev(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
+static int _rel_chain_free(rel_t *self) {
+
+    /* thread the deleted records of an older file into a free list */
 
     int stat = OK;
-    int locked = FALSE;
-    ssize_t position = 0;
-    off_t offset = REL_RECSIZE(self->recsize);
+    off_t recnum = 0;
+    off_t offset = 0;
+    ssize_t count = 0;
+    rel_header_t header;
+    unsigned long next = 0;
+    rel_record_t *ondisk = NULL;
     ssize_t recsize = REL_RECSIZE(self->recsize);
 
     when_error_in {
 
-        *count = 0;
+        errno = 0;
+        ondisk = calloc(1, recsize);
+        check_null(ondisk);
 
-        stat = blk_seek(BLK(self), -offset, SEEK_CUR);
+        stat = self->_master_lock(self);
         check_return(stat, self);
 
-        stat = blk_tell(BLK(self), &position);
+        stat = _rel_get_header(self, &header);
         check_return(stat, self);
 
-        if (position > recsize) {
+        /* walk backwards so the lowest record ends up at the head */
 
-            stat = blk_lock(BLK(self), position - offset, recsize);
-            check_return(stat, self);
-
-            self->record = REL_RECORD(position - offset, self->recsize);
-
-            stat = blk_read(BLK(self), ondisk, recsize, count);
-            check_return(stat, self);
+        for (recnum = self->records; recnum > 0; recnum--) {
 
-            stat = blk_unlock(BLK(self));
-            check_return(stat, self);
+            offset = REL_OFFSET(recnum, self->recsize);
 
-            stat = blk_seek(BLK(self), -offset, SEEK_CUR);
+            stat = blk_pread(BLK(self), ondisk, recsize, offset, &count);
             check_return(stat, self);
 
-        }
-
-        exit_when;
+            if (count != recsize) {
 
-    } use {
+                cause_error(EIO);
 
-        stat = ERR;
-        process_error(self);
+            }
 
-        blk_is_locked(BLK(self), &locked);
-        if (locked) blk_unlock(BLK(self));
+            if (bit_test(ondisk->flags, REL_F_DELETED)) {
 
-    } end_when;
+                memset(&ondisk->data, '\0', self->recsize);
+                memcpy(&ondisk->data, &next, sizeof(unsigned long));
 
-    return stat;
+                stat = blk_pwrite(BLK(self), ondisk, recsize, offset, &count);
+                check_return(stat, self);
 
-}
+                if (count != recsize) {
 
-int _rel_last(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
+                    cause_error(EIO);
 
-    int stat = OK;
-    int locked = FALSE;
-    ssize_t position = 0;
-    off_t offset = REL_RECSIZE(self->recsize);
-    ssize_t recsize = REL_RECSIZE(self->recsize);
+                }
 
-    when_error_in {
+                next = recnum;
 
-        stat = blk_seek(BLK(self), offset, SEEK_END);
-        check_return(stat, self);
+            }
 
-        stat = blk_tell(BLK(self), &position);
-        check_return(stat, self);
+        }
 
-        self->record = REL_RECORD(position, self->recsize);
+        header.freelist = next;
+        bit_set(header.options, REL_H_FREELIST);
 
-        stat = blk_lock(BLK(self), position, recsize);
+        stat = _rel_put_header(self, &header);
         check_return(stat, self);
 
-        stat = blk_read(BLK(self), ondisk, recsize, count);
+        stat = self->_master_unlock(self);
         check_return(stat, self);
 
-        stat = blk_unlock(BLK(self));
-        check_return(stat, self);
+        self->freelist = TRUE;
 
-        stat = blk_seek(BLK(self), -offset, SEEK_CUR);
-        check_return(stat, self);
+        free((void *)ondisk);
 
         exit_when;
 
@@ -1153,8 +3429,8 @@ int _rel_last(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
         stat = ERR;
         process_error(self);
 
-        blk_is_locked(BLK(self), &locked);
-        if (locked) blk_unlock(BLK(self));
+        if (ondisk) free((void *)ondisk);
+        if (self->master_locked) self->_master_unlock(self);
 
     } end_when;
 
@@ -1162,49 +3438,80 @@ int _rel_last(rel_t *self, rel_record_t *ondisk, ssize_t *count) {
 
 }
 
-int _rel_get(rel_t *self, off_t recnum, void *record) {
+static rel_cursor_t *_rel_cursor_alloc(rel_t *self, int mode) {
+
+    /* the buffer holds as many whole records as fit in a chunk */
+
+    rel_cursor_t *cursor = NULL;
+    ssize_t recsize = REL_RECSIZE(self->recsize);
+    off_t records = REL_C_CHUNK / recsize;
+
+    if (records < 1) records = 1;
+
+    if ((cursor = calloc(1, sizeof(rel_cursor_t))) != NULL) {
+
+        cursor->mode = mode;
+        cursor->size = records * recsize;
+
+        cursor->buffer = malloc(cursor->size);
+        cursor->bits = malloc(REL_B_CHUNK);
+
+        if ((cursor->buffer == NULL) || (cursor->bits == NULL)) {
+
+            free(cursor->buffer);
+            free(cursor->bits);
+            free(cursor);
+            cursor = NULL;
+
+        }
+
+    }
+
+    return cursor;
+
+}
+
+static int _rel_cursor_fill(rel_t *self, rel_cursor_t *cursor, off_t recnum, off_t records) {
+
+    /* read up to records, starting at recnum, 0 fills the buffer. */
+    /* In consistent mode the read is under one shared range lock  */
 
     int stat = OK;
     ssize_t count = 0;
     int locked = FALSE;
-    rel_record_t *ondisk = NULL;
     ssize_t recsize = REL_RECSIZE(self->recsize);
     off_t offset = REL_OFFSET(recnum, self->recsize);
+    off_t length = cursor->size;
 
-    when_error_in {
-
-        errno = 0;
-        ondisk = calloc(1, recsize);
-        check_null(ondisk);
-
-        stat = blk_seek(BLK(self), offset, SEEK_SET);
-        check_return(stat, self);
-
-        stat = blk_lock(BLK(self), offset, recsize);
-        check_return(stat, self);
+    if ((records > 0) && ((records * recsize) < length)) {
 
-        stat = blk_read(BLK(self), ondisk, recsize, &count);
-        check_return(stat, self);
+        length = records * recsize;
 
-        if (bit_test(ondisk->flags, REL_F_DELETED)) {
+    }
 
-            cause_error(E_RMSDEL);
+    when_error_in {
 
-        }
-        
-        if (count != recsize) {
+        cursor->first = recnum;
+        cursor->count = 0;
 
-            cause_error(EIO);
+        if (cursor->mode == REL_C_CONSISTENT) {
+
+            stat = blk_lock(BLK(self), offset, length, BLK_L_SHARED);
+            check_return(stat, self);
 
         }
 
-        stat = blk_unlock(BLK(self));
+        stat = blk_pread(BLK(self), cursor->buffer, length, offset, &count);
         check_return(stat, self);
 
-        stat = self->_build(self, &ondisk->data, record);
-        check_return(stat, self);
+        if (cursor->mode == REL_C_CONSISTENT) {
 
-        free((void *)ondisk);
+            stat = blk_unlock(BLK(self));
+            check_return(stat, self);
+
+        }
+
+        cursor->count = count / recsize;
 
         exit_when;
 
@@ -1213,7 +3520,6 @@ int _rel_get(rel_t *self, off_t recnum, void *record) {
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
         blk_is_locked(BLK(self), &locked);
         if (locked) blk_unlock(BLK(self));
 
@@ -1223,56 +3529,46 @@ int _rel_get(rel_t *self, off_t recnum, void *record) {
 
 }
 
-int _rel_put(rel_t *self, off_t recnum, void *record) {
+static int _rel_cursor_seek(rel_t *self, rel_cursor_t *cursor, off_t recnum, rel_record_t **ondisk) {
+
+    /* return a pointer to recnum within the buffer, refilling it */
+    /* when needed, NULL is returned at the end of the file       */
 
     int stat = OK;
-    ssize_t count = 0;
-    int locked = FALSE;
-    rel_record_t *ondisk = NULL;
     ssize_t recsize = REL_RECSIZE(self->recsize);
-    off_t offset = REL_OFFSET(recnum, self->recsize);
 
     when_error_in {
 
-        errno = 0;
-        ondisk = calloc(1, recsize);
-        check_null(ondisk);
-
-        stat = blk_seek(BLK(self), offset, SEEK_SET);
-        check_return(stat, self);
+        *ondisk = NULL;
 
-        stat = blk_lock(BLK(self), offset, recsize);
-        check_return(stat, self);
+        if (self->access == REL_A_MMAP) {
 
-        stat = blk_read(BLK(self), ondisk, recsize, &count);
-        check_return(stat, self);
+            stat = _rel_map_record(self, recnum, ondisk);
+            check_return(stat, self);
 
-        if (count != recsize) {
+            if (*ondisk != NULL) cursor->recnum = recnum;
 
-            cause_error(EIO);
+            exit_when;
 
         }
 
-        stat = self->_normalize(self, &ondisk->data, record);
-        check_return(stat, self);
+        if ((recnum < cursor->first) || 
+            (recnum >= cursor->first + cursor->count)) {
 
-        stat = blk_seek(BLK(self), -recsize, SEEK_CUR);
-        check_return(stat, self);
+            stat = _rel_cursor_fill(self, cursor, recnum, 0);
+            check_return(stat, self);
 
-        stat = blk_write(BLK(self), ondisk, recsize, &count);
-        check_return(stat, self);
+        }
 
-        if (count != recsize) {
+        if ((recnum >= cursor->first) && 
+            (recnum < cursor->first + cursor->count)) {
 
-            cause_error(EIO);
+            *ondisk = (rel_record_t *)(cursor->buffer + 
+                      ((recnum - cursor->first) * recsize));
+            cursor->recnum = recnum;
 
         }
 
-        stat = blk_unlock(BLK(self));
-        check_return(stat, self);
-
-        free((void *)ondisk);
-
         exit_when;
 
     } use {
@@ -1280,53 +3576,34 @@ int _rel_put(rel_t *self, off_t recnum, void *record) {
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
-        blk_is_locked(BLK(self), &locked);
-        if (locked) blk_unlock(BLK(self));
-
     } end_when;
 
     return stat;
 
 }
 
-int _rel_find(rel_t *self, void *data, int (*compare)(void *, void *), off_t *recnum) {
+static int _rel_cursor_live(rel_t *self, rel_cursor_t *cursor, void *record, off_t *recnum) {
+
+    /* advance to the next record that is not deleted */
 
     int stat = OK;
-    ssize_t count = 0;
     rel_record_t *ondisk = NULL;
-    ssize_t recsize = REL_RECSIZE(self->recsize);
 
     when_error_in {
 
         *recnum = 0;
 
-        errno = 0;
-        ondisk = calloc(1, recsize);
-        check_null(ondisk);
-
-        stat = self->_first(self, ondisk, &count);
+        stat = _rel_cursor_scan(self, cursor, &ondisk);
         check_return(stat, self);
 
-        while (count == recsize) {
-
-            if (! bit_test(ondisk->flags, REL_F_DELETED)) {
+        if (ondisk != NULL) {
 
-                if (compare(data, &ondisk->data)) {
-
-                    *recnum = self->record;
-                    break;
-
-                }
-
-            }
-
-            stat = self->_next(self, ondisk, &count);
+            stat = self->_build(self, &ondisk->data, record);
             check_return(stat, self);
 
-        }
+            *recnum = cursor->recnum;
 
-        free((void *)ondisk);
+        }
 
         exit_when;
 
@@ -1335,49 +3612,63 @@ int _rel_find(rel_t *self, void *data, int (*compare)(void *, void *), off_t *re
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
-
     } end_when;
 
     return stat;
 
 }
 
-int _rel_search(rel_t *self, void *data, int (*compare)(void *, void *), int (*capture)(rel_t *, void *, queue_t *), queue_t *results) {
+static int _rel_cursor_scan(rel_t *self, rel_cursor_t *cursor, rel_record_t **ondisk) {
+
+    /* return a pointer to the next record that is not deleted,   */
+    /* the bitmap is used to skip over runs of deleted records.   */
+    /* NULL is returned at the end of the file                    */
 
     int stat = OK;
-    ssize_t count = 0;
-    rel_record_t *ondisk = NULL;
-    ssize_t recsize = REL_RECSIZE(self->recsize);
+    off_t span = 0;
+    off_t recnum = 0;
+    rel_record_t *record = NULL;
+    off_t recsize = REL_RECSIZE(self->recsize);
 
     when_error_in {
 
-        errno = 0;
-        ondisk = calloc(1, recsize);
-        check_null(ondisk);
+        *ondisk = NULL;
 
-        stat = self->_first(self, ondisk, &count);
-        check_return(stat, self);
+        for (;;) {
 
-        while (count == recsize) {
+            stat = _rel_live_next(self, cursor, cursor->recnum + 1, &recnum);
+            check_return(stat, self);
 
-            if (! bit_test(ondisk->flags, REL_F_DELETED)) {
+            if (recnum == 0) break;
 
-                if (compare(data, &ondisk->data)) {
+            if ((self->bitmap) && (self->access != REL_A_MMAP) &&
+                ((recnum < cursor->first) || 
+                 (recnum >= cursor->first + cursor->count))) {
 
-                    stat = capture(self, &ondisk->data, results);
-                    check_return(stat, self);
+                /* only read the run of live records */
 
-                }
+                stat = _rel_live_span(self, cursor, recnum, 
+                                      cursor->size / recsize, &span);
+                check_return(stat, self);
+
+                stat = _rel_cursor_fill(self, cursor, recnum, span);
+                check_return(stat, self);
 
             }
 
-            stat = self->_next(self, ondisk, &count);
+            stat = _rel_cursor_seek(self, cursor, recnum, &record);
             check_return(stat, self);
 
-        }
+            if (record == NULL) break;
 
-        free((void *)ondisk);
+            if (! bit_test(record->flags, REL_F_DELETED)) {
+
+                *ondisk = record;
+                break;
+
+            }
+
+        }
 
         exit_when;
 
@@ -1386,73 +3677,100 @@ int _rel_search(rel_t *self, void *data, int (*compare)(void *, void *), int (*c
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
-
     } end_when;
 
     return stat;
 
 }
 
-int _rel_add(rel_t *self, void *record) {
+static int _rel_batch_compare(const void *a, const void *b) {
+
+    const rel_batch_t *x = a;
+    const rel_batch_t *y = b;
 
+    if (x->recnum != y->recnum) {
+
+        return (x->recnum < y->recnum) ? -1 : 1;
+
+    }
+
+    return (x->slot < y->slot) ? -1 : (x->slot > y->slot);
+
+}
+
+static int _rel_batch_sort(off_t *recnums, int count, rel_batch_t **batch) {
+
+    /* order the record numbers, remembering where each one came  */
+    /* from. Ties keep the callers order.                          */
+
+    int x = 0;
     int stat = OK;
-    ssize_t count = 0;
-    int created = FALSE;
-    rel_record_t *ondisk = NULL;
-    ssize_t recsize = REL_RECSIZE(self->recsize);
 
-    when_error_in {
+    errno = 0;
+    if ((*batch = calloc(count, sizeof(rel_batch_t))) == NULL) {
 
-        errno = 0;
-        ondisk = calloc(1, self->recsize);
-        check_null(ondisk);
+        return ERR;
 
-        stat = self->_master_lock(self);
-        check_return(stat, self);
+    }
 
-        stat = self->_first(self, ondisk, &count);
-        check_return(stat, self);
+    for (; x < count; x++) {
 
-        while (count > 0) {
+        (*batch)[x].recnum = recnums[x];
+        (*batch)[x].slot = x;
 
-            if (bit_test(ondisk->flags, REL_F_DELETED)) {
+    }
 
-                memcpy(&ondisk->data, record, self->recsize);
-                bit_clear(ondisk->flags, REL_F_DELETED);
+    qsort(*batch, count, sizeof(rel_batch_t), _rel_batch_compare);
 
-                stat = blk_seek(BLK(self), -recsize, SEEK_CUR);
-                check_return(stat, self);
+    return stat;
 
-                stat = blk_write(BLK(self), ondisk, recsize, &count);
-                check_return(stat, self);
+}
 
-                if (count != recsize) {
+static int _rel_batch_range(rel_batch_t *batch, int start, int count, off_t chunk) {
 
-                    cause_error(EIO);
+    /* return the end of the run of adjacent, or repeated, record */
+    /* numbers that starts at start, limited to chunk records     */
 
-                }
+    int x = start + 1;
+    off_t first = batch[start].recnum;
 
-                created = TRUE;
-                break;
+    for (; x < count; x++) {
 
-            }
+        if ((batch[x].recnum - batch[x - 1].recnum) > 1) break;
+        if ((batch[x].recnum - first) >= chunk) break;
 
-            stat = self->_next(self, ondisk, &count);
-            check_return(stat, self);
+    }
 
-        }
+    return x;
 
-        stat = self->_master_unlock(self);
-        check_return(stat, self);
+}
 
-        if (! created) {
+static int _rel_map_record(rel_t *self, off_t recnum, rel_record_t **ondisk) {
 
-            cause_error(EOVERFLOW);
+    /* return a pointer to recnum within the mapping, the file is */
+    /* remapped when the record lies past the end of the mapping  */
+    /* NULL is returned at the end of the file                    */
+
+    int stat = OK;
+    off_t recsize = REL_RECSIZE(self->recsize);
+    off_t offset = REL_OFFSET(recnum, self->recsize);
+
+    when_error_in {
+
+        *ondisk = NULL;
+
+        if ((offset + recsize) > self->mapsize) {
+
+            stat = _rel_remap(self);
+            check_return(stat, self);
 
         }
 
-        free((void *)ondisk);
+        if ((offset + recsize) <= self->mapsize) {
+
+            *ondisk = (rel_record_t *)(self->map + offset);
+
+        }
 
         exit_when;
 
@@ -1461,69 +3779,50 @@ int _rel_add(rel_t *self, void *record) {
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
-        if (self->master_locked) self->_master_unlock(self);
-
     } end_when;
 
     return stat;
 
 }
 
-int _rel_del(rel_t *self, off_t recnum) {
+static int _rel_remap(rel_t *self) {
+
+    /* map the whole file, if it has changed size */
 
+    int fd;
     int stat = OK;
-    ssize_t count = 0;
-    int locked = FALSE;
-    ssize_t position = 0;
-    rel_record_t *ondisk = NULL;
-    off_t recsize = REL_RECSIZE(self->recsize);
-    off_t offset = REL_OFFSET(recnum, self->recsize);
+    off_t size = 0;
+    void *map = NULL;
 
     when_error_in {
 
-        errno = 0;
-        ondisk = calloc(1, recsize);
-        check_null(ondisk);
-
-        stat = blk_seek(BLK(self), offset, SEEK_SET);
-        check_return(stat, self);
-
-        stat = blk_tell(BLK(self), &position);
-        check_return(stat, self);
-
-        stat = blk_lock(BLK(self), position, recsize);
+        stat = blk_size(BLK(self), &size);
         check_return(stat, self);
 
-        stat = blk_read(BLK(self), ondisk, recsize, &count);
-        check_return(stat, self);
+        if (size != self->mapsize) {
 
-        if (count != recsize) {
+            _rel_unmap(self);
 
-            cause_error(EIO);
+            if (size > 0) {
 
-        }
+                stat = blk_get_fd(BLK(self), &fd);
+                check_return(stat, self);
 
-        bit_set(ondisk->flags, REL_F_DELETED);
-        memset(&ondisk->data, '\0', self->recsize);
+                errno = 0;
+                map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+                if (map == MAP_FAILED) {
 
-        stat = blk_seek(BLK(self), -recsize, SEEK_CUR);
-        check_return(stat, self);
+                    cause_error(errno);
 
-        stat = blk_write(BLK(self), ondisk, recsize, &count);
-        check_return(stat, self);
+                }
 
-        if (count != recsize) {
+                self->map = map;
+                self->mapsize = size;
 
-            cause_error(EIO);
+            }
 
         }
 
-        stat = blk_unlock(BLK(self));
-        check_return(stat, self);
-
-        free((void *)ondisk);
-
         exit_when;
 
     } use {
@@ -1531,54 +3830,47 @@ int _rel_del(rel_t *self, off_t recnum) {
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
-        blk_is_locked(BLK(self), &locked);
-        if (locked) blk_unlock(BLK(self));
-
     } end_when;
 
     return stat;
 
 }
 
-int _rel_extend(rel_t *self, int amount) {
+static void _rel_unmap(rel_t *self) {
 
-    int stat = OK;
-    ssize_t count = 0;
-    rel_record_t *ondisk = NULL;
-    off_t recsize = REL_RECSIZE(self->recsize);
+    if (self->map != NULL) {
 
-    when_error_in {
+        munmap(self->map, self->mapsize);
 
-        errno = 0;
-        ondisk = calloc(1, recsize);
-        check_null(ondisk);
+    }
 
-        bit_set(ondisk->flags, REL_F_MARK);
-        bit_set(ondisk->flags, REL_F_DELETED);
-        memset(&ondisk->data, '\0', self->recsize);
+    self->map = NULL;
+    self->mapsize = 0;
 
-        stat = self->_master_lock(self);
-        check_return(stat, self);
+}
 
-        int x = 0;
-        for (; x < self->records; x++) {
+static int _rel_cursor_start(rel_t *self) {
 
-            stat = blk_write(BLK(self), ondisk, recsize, &count);
-            check_return(stat, self);
+    /* ready the internal cursor for a new scan */
 
-            if (count != recsize) {
+    int stat = OK;
 
-                cause_error(EIO);
+    when_error_in {
 
-            }
+        if (self->cursor == NULL) {
+
+            errno = 0;
+            self->cursor = _rel_cursor_alloc(self, self->scan);
+            check_null(self->cursor);
 
         }
 
-        stat = self->_master_unlock(self);
-        check_return(stat, self);
+        /* always start with fresh buffers */
 
-        free((void *)ondisk);
+        self->cursor->mode = self->scan;
+        self->cursor->count = 0;
+        self->cursor->recnum = 0;
+        self->cursor->bitscount = 0;
 
         exit_when;
 
@@ -1587,70 +3879,101 @@ int _rel_extend(rel_t *self, int amount) {
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
-        if (self->master_locked) self->_master_unlock(self);
-
     } end_when;
 
     return stat;
 
 }
 
-int _rel_master_lock(rel_t *self) {
+static int _rel_live_open(rel_t *self, int flags, mode_t mode, int created) {
+
+    /* open the bitmap, a new datastore gets a new bitmap and an  */
+    /* older datastore has one built, when it is opened for       */
+    /* writing. Otherwise scans go without one. A datastore whose */
+    /* records are too small for the file header finds out here   */
+    /* if it keeps a free list.                                   */
 
-    int fd;
     int stat = OK;
-    int count = 0;
-    int retries = 0;
-    int timeout = 0;
-    off_t recsize = REL_RECSIZE(self->recsize);
+    int exists = FALSE;
+    ssize_t count = 0;
+    rel_live_t header;
+    int writable = ((flags & O_ACCMODE) != O_RDONLY);
 
     when_error_in {
 
-        stat = fib_get_fd(FIB(self), &fd);
-        check_return(stat, self);
+        self->bitmap = FALSE;
 
-        stat = blk_get_retries(BLK(self), &retries);
-        check_return(stat, self);
+        if (created) {
 
-        stat = blk_get_timeout(BLK(self), &timeout);
-        check_return(stat, self);
+            stat = blk_open(self->live, O_RDWR | O_CREAT | O_TRUNC, mode);
+            check_return(stat, self);
 
-        self->master.l_type = F_WRLCK;
-        self->master.l_start = 1;
-        self->master.l_len = recsize;
-        self->master.l_whence = SEEK_SET;
-        self->master.l_pid = getpid();
+            memset(&header, '\0', REL_B_HEADER);
+            strcpy(header.type, REL_B_TYPE);
+            if (self->freelist) bit_set(header.options, REL_H_FREELIST);
 
-        for (;;) {
+            stat = blk_pwrite(self->live, &header, REL_B_HEADER, 0, &count);
+            check_return(stat, self);
 
-            errno = 0;
-            if (fcntl(fd, F_SETLK, &self->master) == -1) {
+            if (count != REL_B_HEADER) {
+
+                cause_error(EIO);
+
+            }
+
+            self->bitmap = TRUE;
 
-                if ((errno == EAGAIN) || (errno == EACCES)) {
+        } else {
 
-                    count++;
+            stat = blk_exists(self->live, &exists);
+            check_return(stat, self);
 
-                    if (count > retries) {
+            if (exists || writable) {
 
-                        cause_error(errno);
+                stat = blk_open(self->live, 
+                                (writable ? (O_RDWR | O_CREAT) : O_RDONLY), 
+                                mode);
+                check_return(stat, self);
 
-                    } else {
+                self->bitmap = TRUE;
 
-                        sleep(timeout);
+                if (writable) {
 
-                    }
+                    stat = _rel_live_build(self);
+                    check_return(stat, self);
 
                 } else {
 
-                    cause_error(errno);
+                    /* an older bitmap is not used */
+
+                    stat = blk_pread(self->live, &header, REL_B_HEADER, 0, &count);
+                    check_return(stat, self);
+
+                    if ((count != REL_B_HEADER) || 
+                        (strcmp(header.type, REL_B_TYPE) != 0)) {
+
+                        blk_close(self->live);
+                        self->bitmap = FALSE;
+
+                    }
+
+                }
+
+            }
+
+            if ((self->bitmap) && (! REL_HDRFITS(self->recsize))) {
+
+                stat = blk_pread(self->live, &header, REL_B_HEADER, 0, &count);
+                check_return(stat, self);
+
+                if (count != REL_B_HEADER) {
+
+                    cause_error(EIO);
 
                 }
 
-            } else {
-
-                self->master_locked = TRUE;
-                break;
+                self->freelist = (REL_FREEFITS(self->recsize) &&
+                                  bit_test(header.options, REL_H_FREELIST));
 
             }
 
@@ -1663,84 +3986,104 @@ int _rel_master_lock(rel_t *self) {
         stat = ERR;
         process_error(self);
 
+        if (self->bitmap) blk_close(self->live);
+        self->bitmap = FALSE;
+
     } end_when;
 
     return stat;
 
 }
 
-int _rel_master_unlock(rel_t *self) {
+static int _rel_live_build(rel_t *self) {
+
+    /* build the bitmap for a datastore that does not have one */
 
-    int fd;
     int stat = OK;
+    off_t size = 0;
+    off_t live = 0;
+    off_t recnum = 0;
+    ssize_t count = 0;
+    off_t length = 0;
+    rel_live_t older;
+    rel_live_t *header = NULL;
+    rel_record_t *ondisk = NULL;
+    rel_cursor_t *cursor = NULL;
+    unsigned char *bits = NULL;
 
     when_error_in {
 
-        stat = fib_get_fd(FIB(self), &fd);
+        stat = self->_master_lock(self);
         check_return(stat, self);
 
-        self->master.l_type = F_UNLCK;
+        stat = blk_size(self->live, &size);
+        check_return(stat, self);
 
-        errno = 0;
-        if (fcntl(fd, F_SETLK, &self->master) == -1) {
+        /* a bitmap from before the free list was kept in its */
+        /* header is built again, over the top of the old one */
 
-            cause_error(errno);
+        memset(&older, '\0', REL_B_HEADER);
+
+        if (size >= REL_B_HEADER) {
+
+            stat = blk_pread(self->live, &older, REL_B_HEADER, 0, &count);
+            check_return(stat, self);
 
         }
 
-        self->master_locked = FALSE;
-        exit_when;
+        if ((size < REL_B_HEADER) || (strcmp(older.type, REL_B_TYPE) != 0)) {
 
-    } use {
+            stat = blk_size(BLK(self), &size);
+            check_return(stat, self);
 
-        stat = ERR;
-        process_error(self);
+            length = REL_B_BYTE(REL_RECORD(size, self->recsize)) + 1;
 
-    } end_when;
+            errno = 0;
+            bits = calloc(1, length);
+            check_null(bits);
 
-    return stat;
+            errno = 0;
+            cursor = _rel_cursor_alloc(self, REL_C_DIRTY);
+            check_null(cursor);
 
-}
+            for (recnum = 1;; recnum++) {
 
-int _rel_read_header(rel_t *self) {
+                stat = _rel_cursor_seek(self, cursor, recnum, &ondisk);
+                check_return(stat, self);
 
-    int stat = OK;
-    ssize_t count = 0;
-    rel_header_t header;
-    rel_record_t *ondisk = NULL;
-    ssize_t recsize = REL_RECSIZE(self->recsize);
+                if (ondisk == NULL) break;
 
-    when_error_in {
+                if (! bit_test(ondisk->flags, REL_F_DELETED)) {
 
-        errno = 0;
-        ondisk = calloc(1, recsize);
-        check_null(ondisk);
+                    bit_set(bits[REL_B_BYTE(recnum)], REL_B_BIT(recnum));
+                    live++;
 
-        stat = self->_master_lock(self);
-        check_return(stat, self);
+                }
 
-        stat = blk_seek(BLK(self), 0, SEEK_SET);
-        check_return(stat, self);
+            }
 
-        stat = blk_read(BLK(self), ondisk, recsize, &count);
-        check_return(stat, self);
+            header = (rel_live_t *)bits;
+            strcpy(header->type, REL_B_TYPE);
+            header->live = live;
 
-        if (count != recsize) {
+            stat = blk_pwrite(self->live, bits, length, 0, &count);
+            check_return(stat, self);
 
-            cause_error(EIO);
+            if (count != length) {
 
-        }
+                cause_error(EIO);
 
-        stat = self->_master_unlock(self);
-        check_return(stat, self);
+            }
 
-        memcpy(&header, &ondisk->data, sizeof(rel_header_t));
+            free(cursor->buffer);
+            free(cursor->bits);
+            free(cursor);
+            free(bits);
 
-        self->recsize = header.recsize;
-        self->records = header.records;
-        self->lastrec = header.lastrec;
+        }
 
-        free((void *)ondisk);
+        stat = self->_master_unlock(self);
+        check_return(stat, self);
 
         exit_when;
 
@@ -1749,7 +4092,16 @@ int _rel_read_header(rel_t *self) {
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
+        if (bits) free(bits);
+
+        if (cursor) {
+
+            free(cursor->buffer);
+            free(cursor->bits);
+            free(cursor);
+
+        }
+
         if (self->master_locked) self->_master_unlock(self);
 
     } end_when;
@@ -1758,51 +4110,65 @@ int _rel_read_header(rel_t *self) {
 
 }
 
-int _rel_write_header(rel_t *self) {
+static int _rel_live_mark(rel_t *self, off_t recnum, int live) {
+
+    /* set or clear the bit for recnum and adjust the count, the  */
+    /* caller must hold the master lock                           */
 
     int stat = OK;
     ssize_t count = 0;
-    rel_header_t header;
-    rel_record_t *ondisk = NULL;
-    ssize_t recsize = REL_RECSIZE(self->recsize);
+    rel_live_t header;
+    unsigned char byte = 0;
 
     when_error_in {
 
-        errno = 0;
-        ondisk = calloc(1, recsize);
-        check_null(ondisk);
+        if (self->bitmap) {
 
-        header.type[0] = 'R';
-        header.type[1] = 'E';
-        header.type[2] = 'L';
-        header.type[3] = '\0';
+            stat = blk_pread(self->live, &header, REL_B_HEADER, 0, &count);
+            check_return(stat, self);
 
-        header.recsize = self->recsize;
-        header.records = self->records;
-        header.lastrec = self->lastrec;
+            if (count != REL_B_HEADER) {
 
-        ondisk->flags = 0;
-        memcpy(&ondisk->data, &header, sizeof(rel_header_t));
+                cause_error(EIO);
 
-        stat = self->_master_lock(self);
-        check_return(stat, self);
+            }
 
-        stat = blk_seek(BLK(self), 0, SEEK_SET);
-        check_return(stat, self);
+            /* bits past the end of the bitmap are clear */
 
-        stat = blk_write(BLK(self), ondisk, recsize, &count);
-        check_return(stat, self);
+            stat = blk_pread(self->live, &byte, 1, REL_B_BYTE(recnum), &count);
+            check_return(stat, self);
 
-        if (count != recsize) {
+            if (count != 1) byte = 0;
 
-            cause_error(EIO);
+            if (bit_test(byte, REL_B_BIT(recnum)) != LBOOL(live)) {
 
-        }
+                if (live) {
 
-        stat = self->_master_unlock(self);
-        check_return(stat, self);
+                    bit_set(byte, REL_B_BIT(recnum));
+                    header.live++;
 
-        free((void *)ondisk);
+                } else {
+
+                    bit_clear(byte, REL_B_BIT(recnum));
+                    header.live--;
+
+                }
+
+                stat = blk_pwrite(self->live, &byte, 1, REL_B_BYTE(recnum), &count);
+                check_return(stat, self);
+
+                stat = blk_pwrite(self->live, &header, REL_B_HEADER, 0, &count);
+                check_return(stat, self);
+
+                if (count != REL_B_HEADER) {
+
+                    cause_error(EIO);
+
+                }
+
+            }
+
+        }
 
         exit_when;
 
@@ -1811,90 +4177,71 @@ int _rel_write_header(rel_t *self) {
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
-        if (self->master_locked) self->_master_unlock(self);
-
     } end_when;
 
     return stat;
 
 }
 
-int _rel_update_header(rel_t *self) {
+static int _rel_live_next(rel_t *self, rel_cursor_t *cursor, off_t from, off_t *next) {
+
+    /* find the first record at or after from, that the bitmap    */
+    /* shows as live. 0 is returned when there are no more        */
 
     int stat = OK;
-    long records = 0;
-    long lastrec = 0;
-    long recsize = 0;
+    off_t byte = 0;
     ssize_t count = 0;
-    rel_header_t header;
-    rel_record_t *ondisk = NULL;
-    ssize_t xrecsize = REL_RECSIZE(self->recsize);
+    off_t recnum = from;
+    unsigned char bits = 0;
 
     when_error_in {
 
-        errno = 0;
-        ondisk = calloc(1, xrecsize);
-        check_null(ondisk);
-
-        stat = self->_master_lock(self);
-        check_return(stat, self);
-
-        stat = blk_seek(BLK(self), 0, SEEK_SET);
-        check_return(stat, self);
-
-        stat = blk_read(BLK(self), ondisk, xrecsize, &count);
-        check_return(stat, self);
+        *next = 0;
 
-        if (count != xrecsize) {
+        if (! self->bitmap) {
 
-            cause_error(EIO);
+            *next = from;
+            exit_when;
 
         }
 
-        memcpy(&header, ondisk->data, sizeof(rel_header_t));
-
-        recsize = header.recsize;
-        records = header.records;
-        lastrec = header.lastrec;
+        for (;;) {
 
-        if (recsize != self->recsize) {
+            byte = REL_B_BYTE(recnum);
 
-            cause_error(E_INVREC);
+            if ((byte < cursor->bitsfirst) || 
+                (byte >= cursor->bitsfirst + cursor->bitscount)) {
 
-        }
+                stat = blk_pread(self->live, cursor->bits, REL_B_CHUNK, byte, &count);
+                check_return(stat, self);
 
-        if (records < self->records) {
+                cursor->bitsfirst = byte;
+                cursor->bitscount = count;
 
-            cause_error(EIO);
+                if (count == 0) break;
 
-        }
+            }
 
-        self->records = records;
-        self->lastrec = lastrec;
+            bits = cursor->bits[byte - cursor->bitsfirst];
 
-        header.recsize = self->recsize;
-        header.records = self->records;
-        header.lastrec = self->lastrec;
+            if (bits == 0) {
 
-        memcpy(&ondisk->data, &header, sizeof(rel_header_t));
+                /* skip the whole byte */
 
-        stat = blk_seek(BLK(self), 0, SEEK_SET);
-        check_return(stat, self);
+                recnum = ((recnum / 8) + 1) * 8;
 
-        stat = blk_write(BLK(self), ondisk, xrecsize, &count);
-        check_return(stat, self);
+            } else if (bit_test(bits, REL_B_BIT(recnum))) {
 
-        if (count != xrecsize) {
+                *next = recnum;
+                break;
 
-            cause_error(EIO);
+            } else {
 
-        }
+                recnum++;
 
-        stat = self->_master_unlock(self);
-        check_return(stat, self);
+            }
 
-        free((void *)ondisk);
+        }
 
         exit_when;
 
@@ -1903,27 +4250,39 @@ int _rel_update_header(rel_t *self) {
         stat = ERR;
         process_error(self);
 
-        if (ondisk) free((void *)ondisk);
-        if (self->master_locked) self->_master_unlock(self);
-
     } end_when;
 
     return stat;
 
 }
 
-int _rel_build(rel_t *self, void *ondisk, void *data) {
+static int _rel_live_span(rel_t *self, rel_cursor_t *cursor, off_t from, off_t limit, off_t *span) {
 
-    /* default behavior, this should to be overridden */
+    /* return the number of records from "from" to the last live  */
+    /* record that can be reached without crossing a big gap      */
 
     int stat = OK;
-    void *junk = NULL;
+    off_t last = from;
+    off_t recnum = 0;
+    off_t recsize = REL_RECSIZE(self->recsize);
+    off_t gap = (REL_B_GAP / recsize) > 0 ? (REL_B_GAP / recsize) : 1;
 
     when_error_in {
 
-        errno = ENOMEM;
-        junk = memcpy(data, ondisk, self->recsize);
-        check_null(junk);
+        for (;;) {
+
+            stat = _rel_live_next(self, cursor, last + 1, &recnum);
+            check_return(stat, self);
+
+            if ((recnum == 0) || 
+                ((recnum - from) >= limit) ||
+                ((recnum - last) > gap)) break;
+
+            last = recnum;
+
+        }
+
+        *span = (last - from) + 1;
 
         exit_when;
 
@@ -1938,62 +4297,154 @@ int _rel_build(rel_t *self, void *ondisk, void *data) {
 
 }
 
-int _rel_init(rel_t *self) {
+static void *_rel_search_worker(void *data) {
 
-    /* this may need to be overridden, default is to do nothing */
+    rel_worker_t *worker = (rel_worker_t *)data;
 
-    return OK;
+    worker->stat = _rel_search_range(worker);
+
+    return NULL;
 
 }
 
-int _rel_default(rel_t *self, void *ondisk, void *data) {
+static int _rel_search_range(rel_worker_t *worker) {
 
-    /* default behavior, this should to be overridden */
+    /* search one range of records with a private buffer, reading   */
+    /* with pread() on the shared fd, or on a handle of its own when */
+    /* the reads are locked. Matches are copied to the workers queue, */
+    /* the error number is kept in the worker, as the rel_t error is */
+    /* not thread safe                                               */
 
+    off_t x;
     int stat = OK;
-    void *junk = NULL;
+    off_t recnum = 0;
+    off_t offset = 0;
+    off_t length = 0;
+    ssize_t count = 0;
+    off_t records = 0;
+    int opened = FALSE;
+    int locked = FALSE;
+    char *buffer = NULL;
+    rel_t *self = worker->self;
+    rel_match_t *match = NULL;
+    rel_record_t *ondisk = NULL;
+    off_t recsize = REL_RECSIZE(self->recsize);
+    off_t chunk = (REL_C_CHUNK / recsize) > 0 ? (REL_C_CHUNK / recsize) : 1;
 
     when_error_in {
 
-        errno = ENOMEM;
-        junk = memcpy(ondisk, data, self->recsize);
-        check_null(junk);
+        if (self->scan == REL_C_CONSISTENT) {
 
-        exit_when;
+            worker->blk = blk_create(FIB(self)->path, BLK(self)->retries, BLK(self)->timeout);
+            check_creation(worker->blk);
 
-    } use {
+            stat = blk_set_wait(worker->blk, BLK(self)->wait);
+            check_return(stat, worker->blk);
 
-        stat = ERR;
-        process_error(self);
+            stat = blk_open(worker->blk, O_RDONLY, 0);
+            check_return(stat, worker->blk);
 
-    } end_when;
+            opened = TRUE;
 
-    return stat;
+        }
 
-}
+        errno = 0;
+        buffer = malloc(chunk * recsize);
+        check_null(buffer);
 
-int _rel_normalize(rel_t *self, void *ondisk, void *data) {
+        for (recnum = worker->first; recnum < worker->last; recnum += records) {
 
-    /* default behavior, this should to be overridden */
+            records = worker->last - recnum;
+            if (records > chunk) records = chunk;
 
-    int stat = OK;
-    void *junk = NULL;
+            offset = REL_OFFSET(recnum, self->recsize);
+            length = records * recsize;
 
-    when_error_in {
+            if (opened) {
 
-        errno = ENOMEM;
-        junk = memcpy(ondisk, data, self->recsize);
-        check_null(junk);
+                stat = blk_lock(worker->blk, offset, length, BLK_L_SHARED);
+                check_return(stat, worker->blk);
+
+                stat = blk_pread(worker->blk, buffer, length, offset, &count);
+                check_return(stat, worker->blk);
+
+                stat = blk_unlock(worker->blk);
+                check_return(stat, worker->blk);
+
+            } else {
+
+                errno = 0;
+                if ((count = pread(worker->fd, buffer, length, offset)) == -1) {
+
+                    cause_error(errno);
+
+                }
+
+            }
+
+            records = count / recsize;
+            if (records == 0) break;
+
+            for (x = 0; x < records; x++) {
+
+                ondisk = (rel_record_t *)(buffer + (x * recsize));
+
+                if (bit_test(ondisk->flags, REL_F_DELETED)) continue;
+
+                if (worker->compare(worker->data, &ondisk->data)) {
+
+                    errno = 0;
+                    match = malloc(sizeof(rel_match_t) + self->recsize);
+                    check_null(match);
+
+                    match->recnum = recnum + x;
+                    memcpy(match->data, &ondisk->data, self->recsize);
+
+                    stat = que_push_tail(&worker->matches, match);
+                    check_status(stat);
+
+                    match = NULL;
+
+                }
+
+            }
+
+        }
+
+        if (opened) {
+
+            opened = FALSE;
+
+            stat = blk_close(worker->blk);
+            check_return(stat, worker->blk);
+
+        }
 
         exit_when;
 
     } use {
 
         stat = ERR;
-        process_error(self);
+        worker->errnum = trace_errnum;
+        clear_error();
+
+        if (opened) {
+
+            blk_is_locked(worker->blk, &locked);
+            if (locked) blk_unlock(worker->blk);
+
+            blk_close(worker->blk);
+
+        }
+
+        free(match);
 
     } end_when;
 
+    free(buffer);
+    if (worker->blk) blk_destroy(worker->blk);
+    worker->blk = NULL;
+
     return stat;
 
 }
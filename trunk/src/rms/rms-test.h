@@ -0,0 +1,47 @@
+
+/*---------------------------------------------------------------------------*/
+/*                Copyright (c) 2024 by Kevin L. Esteb                       */
+/*                                                                           */
+/*  Permission to use, copy, modify, and distribute this software and its    */
+/*  documentation for any purpose and without fee is hereby granted,         */
+/*  provided that this copyright notice appears in all copies. The author    */
+/*  makes no representations about the suitability of this software for      */
+/*  any purpose. It is provided "as is" without express or implied warranty. */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#ifndef _RMS_TEST_H
+#define _RMS_TEST_H
+
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * helpers used with the rms tests
+ */
+
+/* milliseconds since start */
+
+double elapsed(struct timespec *start) {
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((now.tv_sec - start->tv_sec) * 1000.0) +
+           ((now.tv_nsec - start->tv_nsec) / 1000000.0);
+
+}
+
+/* report the errors, the result is the exit status */
+
+int passed(int errors) {
+
+    printf("%d errors\n%s\n", errors, errors ? "FAILED" : "passed");
+
+    return errors ? 1 : 0;
+
+}
+
+#endif
+
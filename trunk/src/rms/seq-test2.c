@@ -0,0 +1,176 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "xas/rms/seq.h"
+#include "rms-test.h"
+
+/*
+ * buffered line reads. A file of generated lines, with empty lines,
+ * one line longer than the read buffer and a last line without a line
+ * feed, is read back with seq_getline() and with seq_gets() into a
+ * buffer too small for some lines. Every line must come back intact.
+ * The read rates are compared with reading a byte at a time, the way
+ * xgetline() does.
+ */
+
+#define LINES  200000
+#define BIG    1000
+#define BIGLEN (SEQ_C_BUFSIZE + 12345)
+#define SIZE   101
+
+extern int xgetline(int, char *, int, int);
+
+char *filename = "seq-test2.dat";
+
+double rate(off_t bytes, double ms) {
+
+    return (ms > 0) ? (bytes / (1024.0 * 1024.0)) / (ms / 1000.0) : 0;
+
+}
+
+/* line n of the file */
+
+size_t make_line(int n, char *line) {
+
+    size_t x;
+    size_t length = (n == BIG) ? BIGLEN : (n * 37) % 120;
+
+    for (x = 0; x < length; x++) {
+
+        line[x] = 'a' + ((n + x) % 26);
+
+    }
+
+    line[length] = '\0';
+
+    return length;
+
+}
+
+int main(int argc, char **argv) {
+
+    int n;
+    int fd;
+    int errors = 0;
+    char *line = NULL;
+    char *expect = malloc(BIGLEN + 2);
+    char *joined = malloc(BIGLEN + SIZE);
+    char buffer[SIZE];
+    size_t length;
+    size_t joinlen;
+    ssize_t count;
+    off_t bytes = 0;
+    seq_t *seq = NULL;
+    struct timespec start;
+    double ms;
+
+    /* write the file */
+
+    seq = seq_create(filename);
+    seq_open(seq, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    seq_get_fd(seq, &fd);
+
+    for (n = 1; n <= LINES; n++) {
+
+        length = make_line(n, expect);
+        if (n < LINES) expect[length++] = '\n';
+
+        bytes += write(fd, expect, length);
+
+    }
+
+    seq_close(seq);
+
+    /* zero copy lines */
+
+    n = 0;
+    seq_open(seq, O_RDONLY, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ((seq_getline(seq, &line, &length) == OK) && (line != NULL)) {
+
+        n++;
+
+        if ((length != make_line(n, expect)) ||
+            (memcmp(line, expect, length) != 0) ||
+            (line[length] != '\0')) {
+
+            if (errors++ < 5) printf("getline: line %d is wrong\n", n);
+
+        }
+
+    }
+
+    ms = elapsed(&start);
+    seq_close(seq);
+
+    if (n != LINES) errors++;
+
+    printf("seq_getline: %d lines, %.1f ms, %.0f MB/s\n", n, ms, rate(bytes, ms));
+
+    /* copied lines, the long ones in pieces */
+
+    n = 0;
+    joinlen = 0;
+    seq_open(seq, O_RDONLY, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ((seq_gets(seq, buffer, SIZE, &count) == OK) && (count > 0)) {
+
+        length = strlen(buffer);
+        memcpy(joined + joinlen, buffer, length);
+        joinlen += length;
+
+        /* the line feed was used when more was read than returned */
+
+        if ((count > length) || (n + 1 == LINES)) {
+
+            n++;
+
+            if ((joinlen != make_line(n, expect)) ||
+                (memcmp(joined, expect, joinlen) != 0)) {
+
+                if (errors++ < 5) printf("gets: line %d is wrong\n", n);
+
+            }
+
+            joinlen = 0;
+
+        }
+
+    }
+
+    ms = elapsed(&start);
+    seq_close(seq);
+
+    if ((n != LINES) || (joinlen != 0)) errors++;
+
+    printf("seq_gets: %d lines, %.1f ms, %.0f MB/s\n", n, ms, rate(bytes, ms));
+
+    /* a byte at a time, for comparison */
+
+    n = 0;
+    seq_open(seq, O_RDONLY, 0);
+    seq_get_fd(seq, &fd);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (xgetline(fd, buffer, SIZE, '\n') > 0) n++;
+
+    ms = elapsed(&start);
+    seq_close(seq);
+
+    printf("xgetline: %d reads, %.1f ms, %.0f MB/s\n", n, ms, rate(bytes, ms));
+
+    seq_unlink(seq);
+    seq_destroy(seq);
+
+    free(expect);
+    free(joined);
+
+    return passed(errors);
+
+}
+
@@ -0,0 +1,200 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "xas/rms/seq.h"
+#include "rms-test.h"
+
+/*
+ * buffered line writes. Lines of every length up to one larger than
+ * the write buffer are written with seq_puts() and read back with
+ * seq_getline(). Nothing may reach the file before a flush, and a line
+ * written after reading must land after the last line read, not after
+ * what was read ahead. The write rate is compared with one allocation
+ * and write(2) per line, the way seq_puts used to work.
+ */
+
+#define LINES  1000000
+#define BIG    1000
+#define BIGLEN (SEQ_C_BUFSIZE + 12345)
+
+char *filename = "seq-test3.dat";
+
+/* line n of the file */
+
+size_t make_line(int n, char *line) {
+
+    size_t x;
+    size_t length = (n == BIG) ? BIGLEN : (n * 37) % 80;
+
+    for (x = 0; x < length; x++) {
+
+        line[x] = 'a' + ((n + x) % 26);
+
+    }
+
+    line[length] = '\0';
+
+    return length;
+
+}
+
+int verify(seq_t *seq, int lines, char *expect) {
+
+    int n = 0;
+    int errors = 0;
+    char *line = NULL;
+    size_t length;
+
+    seq_open(seq, O_RDONLY, 0);
+
+    while ((seq_getline(seq, &line, &length) == OK) && (line != NULL)) {
+
+        n++;
+
+        if ((length != make_line(n, expect)) ||
+            (memcmp(line, expect, length) != 0)) {
+
+            if (errors++ < 5) printf("line %d is wrong\n", n);
+
+        }
+
+    }
+
+    seq_close(seq);
+
+    if (n != lines) errors++;
+
+    return errors;
+
+}
+
+int main(int argc, char **argv) {
+
+    int n;
+    int fd;
+    int errors = 0;
+    char *line = NULL;
+    char *output = NULL;
+    char *expect = malloc(BIGLEN + 2);
+    size_t length;
+    ssize_t count;
+    off_t size;
+    off_t total = 0;
+    seq_t *seq = NULL;
+    struct timespec start;
+
+    seq = seq_create(filename);
+
+    /* buffered */
+
+    seq_open(seq, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (n = 1; n <= LINES; n++) {
+
+        make_line(n, expect);
+
+        if ((seq_puts(seq, expect, &count) != OK) ||
+            (count != strlen(expect) + 1)) errors++;
+
+    }
+
+    seq_close(seq);
+
+    printf("seq_puts: %d lines, %.1f ms\n", LINES, elapsed(&start));
+
+    errors += verify(seq, LINES, expect);
+
+    /* a line at a time, for comparison */
+
+    seq_open(seq, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    seq_get_fd(seq, &fd);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (n = 1; n <= LINES; n++) {
+
+        length = make_line(n, expect);
+        output = calloc(1, length + 3);
+        sprintf(output, "%s%s", expect, "\n");
+        write(fd, output, strlen(output));
+        free(output);
+
+    }
+
+    seq_close(seq);
+
+    printf("write: %d lines, %.1f ms\n", LINES, elapsed(&start));
+
+    /* nothing is written until a flush */
+
+    seq_open(seq, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+    for (n = 1; n <= 10; n++) {
+
+        make_line(n, expect);
+        seq_puts(seq, expect, &count);
+
+    }
+
+    seq_size(seq, &size);
+    if (size != 0) errors++;
+
+    seq_flush(seq);
+
+    seq_size(seq, &size);
+    if (size == 0) errors++;
+
+    /* or until the next write after the flush interval has passed */
+
+    seq_set_flush(seq, 1);
+    make_line(11, expect);
+    seq_puts(seq, expect, &count);
+    sleep(2);
+    make_line(12, expect);
+    seq_puts(seq, expect, &count);
+
+    seq_size(seq, &size);
+    seq_close(seq);
+
+    for (n = 1; n <= 12; n++) total += make_line(n, expect) + 1;
+    if (size != total) errors++;
+
+    errors += verify(seq, 12, expect);
+
+    /* a write after reading goes after the last line read */
+
+    seq_open(seq, O_RDWR, 0);
+    seq_set_flush(seq, 0);
+
+    for (n = 1; n <= 5; n++) seq_getline(seq, &line, &length);
+
+    for (n = 6; n <= 8; n++) {
+
+        make_line(n, expect);
+        seq_puts(seq, expect, &count);
+
+    }
+
+    /* and a read after writing sees it */
+
+    seq_getline(seq, &line, &length);
+    if ((length != make_line(9, expect)) || (memcmp(line, expect, length) != 0)) errors++;
+
+    seq_close(seq);
+
+    errors += verify(seq, 12, expect);
+
+    printf("flushes: %d errors\n", errors);
+
+    seq_unlink(seq);
+    seq_destroy(seq);
+
+    free(expect);
+
+    return passed(errors);
+
+}
+
@@ -0,0 +1,243 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "xas/rms/seq.h"
+#include "rms-test.h"
+
+/*
+ * memory mapped line reads. A file of generated lines with "\r\n" line
+ * ends is read with seq_getline() from a mapping and from the buffer,
+ * the eol must be stripped in both. Switching modes part way thru must
+ * carry on from the same line, lines appended to a mapped file must be
+ * found, as must lines written after it was truncated, and a fifo must
+ * fall back to buffered reads.
+ */
+
+#define LINES  500000
+#define SWITCH 1234
+
+char *filename = "seq-test4.dat";
+char *fifoname = "seq-test4.fifo";
+
+/* line n of the file */
+
+size_t make_line(int n, char *line) {
+
+    size_t x;
+    size_t length = (n * 37) % 120;
+
+    for (x = 0; x < length; x++) {
+
+        line[x] = 'a' + ((n + x) % 26);
+
+    }
+
+    line[length] = '\0';
+
+    return length;
+
+}
+
+int write_lines(seq_t *seq, int first, int last) {
+
+    int n;
+    char line[128];
+    ssize_t count;
+
+    for (n = first; n <= last; n++) {
+
+        make_line(n, line);
+        seq_puts(seq, line, &count);
+
+    }
+
+    return OK;
+
+}
+
+/* read lines from the current one on, switching mode at a line */
+
+int read_lines(seq_t *seq, int *n, int last, int at, int access) {
+
+    int errors = 0;
+    char *line = NULL;
+    char expect[128];
+    size_t length;
+
+    while ((*n < last) && (seq_getline(seq, &line, &length) == OK) && (line != NULL)) {
+
+        (*n)++;
+
+        if ((length != make_line(*n, expect)) ||
+            (memcmp(line, expect, length) != 0)) {
+
+            if (errors++ < 5) printf("line %d is wrong\n", *n);
+
+        }
+
+        if (*n == at) seq_set_access(seq, access);
+
+    }
+
+    return errors;
+
+}
+
+int main(int argc, char **argv) {
+
+    int n;
+    int access;
+    int errors = 0;
+    char *line = NULL;
+    size_t length;
+    pid_t pid;
+    seq_t *seq = NULL;
+    seq_t *fifo = NULL;
+    seq_t *other = NULL;
+    struct timespec start;
+
+    seq = seq_create(filename);
+    seq_set_eol(seq, "\r\n");
+
+    seq_open(seq, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    write_lines(seq, 1, LINES);
+    seq_close(seq);
+
+    /* mapped */
+
+    n = 0;
+    seq_set_access(seq, SEQ_A_MMAP);
+    seq_open(seq, O_RDONLY, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    errors += read_lines(seq, &n, LINES + 1, 0, 0);
+
+    printf("mmap: %d lines, %.1f ms\n", n, elapsed(&start));
+    seq_close(seq);
+
+    if (n != LINES) errors++;
+
+    /* buffered */
+
+    n = 0;
+    seq_set_access(seq, SEQ_A_BUFFER);
+    seq_open(seq, O_RDONLY, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    errors += read_lines(seq, &n, LINES + 1, 0, 0);
+
+    printf("buffer: %d lines, %.1f ms\n", n, elapsed(&start));
+    seq_close(seq);
+
+    if (n != LINES) errors++;
+
+    /* from one mode to the other and back */
+
+    n = 0;
+    seq_open(seq, O_RDONLY, 0);
+
+    errors += read_lines(seq, &n, SWITCH * 2, SWITCH, SEQ_A_MMAP);
+    errors += read_lines(seq, &n, LINES + 1, SWITCH * 3, SEQ_A_BUFFER);
+
+    seq_close(seq);
+
+    if (n != LINES) errors++;
+
+    printf("switched: %d lines, %d errors\n", n, errors);
+
+    /* lines appended to a mapped file by someone else */
+
+    n = 0;
+    seq_set_access(seq, SEQ_A_MMAP);
+    seq_open(seq, O_RDONLY, 0);
+
+    errors += read_lines(seq, &n, LINES + 1, 0, 0);
+
+    other = seq_create(filename);
+    seq_set_eol(other, "\r\n");
+    seq_open(other, O_WRONLY | O_APPEND, 0);
+    write_lines(other, LINES + 1, LINES + 10);
+    seq_close(other);
+    seq_destroy(other);
+
+    errors += read_lines(seq, &n, LINES + 11, 0, 0);
+
+    seq_close(seq);
+
+    if (n != LINES + 10) errors++;
+
+    printf("appended: %d lines, %d errors\n", n, errors);
+
+    /* a mapped file that is truncated and written again */
+
+    n = 0;
+    seq_open(seq, O_RDONLY, 0);
+
+    errors += read_lines(seq, &n, LINES + 11, 0, 0);
+
+    other = seq_create(filename);
+    seq_set_eol(other, "\r\n");
+    seq_open(other, O_WRONLY | O_TRUNC, 0);
+
+    if ((seq_getline(seq, &line, &length) != OK) || (line != NULL)) errors++;
+
+    write_lines(other, 1, 10);
+    seq_close(other);
+    seq_destroy(other);
+
+    n = 0;
+    errors += read_lines(seq, &n, 11, 0, 0);
+
+    seq_close(seq);
+
+    if (n != 10) errors++;
+
+    printf("truncated: %d lines, %d errors\n", n, errors);
+
+    /* a fifo can't be mapped */
+
+    unlink(fifoname);
+    mkfifo(fifoname, 0644);
+    fflush(stdout);
+
+    if ((pid = fork()) == 0) {
+
+        fifo = seq_create(fifoname);
+        seq_set_eol(fifo, "\r\n");
+        seq_open(fifo, O_WRONLY, 0);
+        write_lines(fifo, 1, LINES);
+        seq_close(fifo);
+        exit(0);
+
+    }
+
+    n = 0;
+    fifo = seq_create(fifoname);
+    seq_set_eol(fifo, "\r\n");
+    seq_set_access(fifo, SEQ_A_MMAP);
+    seq_open(fifo, O_RDONLY, 0);
+
+    errors += read_lines(fifo, &n, LINES + 1, 0, 0);
+
+    seq_get_access(fifo, &access);
+    seq_close(fifo);
+    waitpid(pid, NULL, 0);
+
+    if ((n != LINES) || (access != SEQ_A_BUFFER)) errors++;
+
+    printf("fifo: %d lines, %d errors\n", n, errors);
+
+    seq_unlink(fifo);
+    seq_destroy(fifo);
+
+    seq_unlink(seq);
+    seq_destroy(seq);
+
+    return passed(errors);
+
+}
+
@@ -0,0 +1,292 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "xas/rms/seq.h"
+#include "rms-test.h"
+
+/*
+ * parallel line processing. A file of "id,amount,text" lines is summed
+ * by seq_process_parallel() with different numbers of threads and the
+ * totals must match a serial read with seq_getline(). Each line is
+ * seen once, whatever the ranges cut thru, including a line longer
+ * than the read buffer and a last line without an eol. A callback
+ * that fails must stop the run and every state must still be reduced.
+ */
+
+#define LINES  400000
+#define BIG    777
+#define BIGLEN (SEQ_C_BUFSIZE * 2 + 99)
+#define FAILAT 123456
+
+char *filename = "seq-test5.dat";
+char *fifoname = "seq-test5.fifo";
+
+typedef struct _totals_s {
+    long lines;
+    long amount;
+    unsigned long hash;
+    size_t longest;
+} totals_t;
+
+/* the order of the lines does not change the hash */
+
+unsigned long line_hash(char *line, size_t length) {
+
+    size_t x;
+    unsigned long hash = 14695981039346656037UL;
+
+    for (x = 0; x < length; x++) {
+
+        hash = (hash ^ (unsigned char)line[x]) * 1099511628211UL;
+
+    }
+
+    return hash;
+
+}
+
+void *create(void *data) {
+
+    return calloc(1, sizeof(totals_t));
+
+}
+
+int process(void *state, char *line, size_t length) {
+
+    char *comma = memchr(line, ',', length);
+    totals_t *totals = state;
+
+    totals->lines++;
+    totals->amount += (comma != NULL) ? atol(comma + 1) : 0;
+    totals->hash += line_hash(line, length);
+    if (length > totals->longest) totals->longest = length;
+
+    return OK;
+
+}
+
+int failing(void *state, char *line, size_t length) {
+
+    totals_t *totals = state;
+
+    if (atol(line) == FAILAT) return ERR;
+
+    totals->lines++;
+
+    return OK;
+
+}
+
+int reduce(void *data, void *state) {
+
+    totals_t *result = data;
+    totals_t *totals = state;
+
+    result->lines += totals->lines;
+    result->amount += totals->amount;
+    result->hash += totals->hash;
+    if (totals->longest > result->longest) result->longest = totals->longest;
+
+    free(totals);
+
+    return OK;
+
+}
+
+int write_file(seq_t *seq, char *eol) {
+
+    int n;
+    char *text = malloc(BIGLEN + 1);
+    char *line = malloc(BIGLEN + 64);
+    ssize_t count;
+
+    seq_set_eol(seq, eol);
+    seq_open(seq, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+    for (n = 1; n <= LINES; n++) {
+
+        size_t length = (n == BIG) ? BIGLEN : (n * 37) % 90;
+
+        memset(text, 'a' + (n % 26), length);
+        text[length] = '\0';
+
+        sprintf(line, "%d,%d,%s", n, (n * 7) % 1000, text);
+
+        if (n < LINES) {
+
+            seq_puts(seq, line, &count);
+
+        } else {
+
+            /* no eol after the last line */
+
+            seq_set_eol(seq, "");
+            seq_puts(seq, line, &count);
+            seq_set_eol(seq, eol);
+
+        }
+
+    }
+
+    seq_close(seq);
+
+    free(text);
+    free(line);
+
+    return OK;
+
+}
+
+int serial(seq_t *seq, totals_t *totals) {
+
+    char *line = NULL;
+    size_t length;
+
+    memset(totals, 0, sizeof(totals_t));
+
+    seq_open(seq, O_RDONLY, 0);
+
+    while ((seq_getline(seq, &line, &length) == OK) && (line != NULL)) {
+
+        process(totals, line, length);
+
+    }
+
+    seq_close(seq);
+
+    return OK;
+
+}
+
+int compare(char *what, totals_t *expect, totals_t *result) {
+
+    if ((expect->lines != result->lines) ||
+        (expect->amount != result->amount) ||
+        (expect->hash != result->hash) ||
+        (expect->longest != result->longest)) {
+
+        printf("%s: %ld lines, expected %ld\n", what, result->lines, expect->lines);
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+int main(int argc, char **argv) {
+
+    int x;
+    int t;
+    int errors = 0;
+    int threads[] = { 1, 2, 3, 4, 8, 64 };
+    char *eols[] = { "\n", "\r\n" };
+    pid_t pid;
+    seq_t *seq = NULL;
+    seq_t *fifo = NULL;
+    totals_t expect;
+    totals_t result;
+    struct timespec start;
+    double ms;
+
+    seq = seq_create(filename);
+
+    for (x = 0; x < 2; x++) {
+
+        write_file(seq, eols[x]);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        serial(seq, &expect);
+        ms = elapsed(&start);
+
+        printf("eol %d: serial %ld lines, %.1f ms\n", x, expect.lines, ms);
+
+        if (expect.lines != LINES) errors++;
+
+        for (t = 0; t < sizeof(threads) / sizeof(int); t++) {
+
+            memset(&result, 0, sizeof(totals_t));
+
+            seq_open(seq, O_RDONLY, 0);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+
+            if (seq_process_parallel(seq, create, process, reduce, &result, threads[t]) != OK) errors++;
+
+            ms = elapsed(&start);
+            seq_close(seq);
+
+            errors += compare("parallel", &expect, &result);
+
+            printf("eol %d: %d threads, %.1f ms\n", x, threads[t], ms);
+
+        }
+
+    }
+
+    /* a failing callback */
+
+    memset(&result, 0, sizeof(totals_t));
+
+    seq_open(seq, O_RDONLY, 0);
+
+    if (seq_process_parallel(seq, create, failing, reduce, &result, 4) == OK) errors++;
+    if (result.lines >= LINES) errors++;
+
+    seq_close(seq);
+
+    printf("failed: %ld lines before stopping, %d errors\n", result.lines, errors);
+
+    /* an empty file */
+
+    seq_open(seq, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    memset(&result, 0, sizeof(totals_t));
+
+    if (seq_process_parallel(seq, create, process, reduce, &result, 4) != OK) errors++;
+    if (result.lines != 0) errors++;
+
+    seq_close(seq);
+
+    /* a fifo is processed in order on the calling thread */
+
+    write_file(seq, "\n");
+    serial(seq, &expect);
+
+    unlink(fifoname);
+    mkfifo(fifoname, 0644);
+    fflush(stdout);
+
+    if ((pid = fork()) == 0) {
+
+        fifo = seq_create(fifoname);
+        write_file(fifo, "\n");
+        exit(0);
+
+    }
+
+    fifo = seq_create(fifoname);
+    seq_open(fifo, O_RDONLY, 0);
+    memset(&result, 0, sizeof(totals_t));
+
+    if (seq_process_parallel(fifo, create, process, reduce, &result, 4) != OK) errors++;
+
+    seq_close(fifo);
+    waitpid(pid, NULL, 0);
+
+    errors += compare("fifo", &expect, &result);
+
+    printf("fifo: %ld lines, %d errors\n", result.lines, errors);
+
+    seq_unlink(fifo);
+    seq_destroy(fifo);
+
+    seq_unlink(seq);
+    seq_destroy(seq);
+
+    return passed(errors);
+
+}
+
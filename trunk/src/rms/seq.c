@@ -13,19 +13,43 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "xas/rms/seq.h"
 #include "xas/rms/fib.h"
 #include "xas/error_codes.h"
 #include "xas/error_handler.h"
 
-extern int xgetline(int, char *, int, int);
-
 require_klass(FIB_KLASS);
 
+/*----------------------------------------------------------------*/
+/* klass private data                                             */
+/*----------------------------------------------------------------*/
+
+typedef struct _seq_worker_s {
+    seq_t *self;
+    int fd;
+    off_t first;
+    off_t last;
+    off_t size;
+    void *state;
+    int (*process)(void *, char *, size_t);
+    volatile int *stop;
+    int stat;
+    int errnum;
+} seq_worker_t;
+
+/* the most threads seq_process_parallel() will start */
+
+#define SEQ_T_MAX        64
+
 /*----------------------------------------------------------------*/
 /* klass methods                                                  */
 /*----------------------------------------------------------------*/
@@ -37,6 +61,24 @@ int _seq_override(seq_t *, item_list_t *);
 
 int _seq_gets(seq_t *, char *, size_t, ssize_t *);
 int _seq_puts(seq_t *, char *, ssize_t *);
+int _seq_getline(seq_t *, char **, size_t *);
+
+/*----------------------------------------------------------------*/
+/* private methods                                                */
+/*----------------------------------------------------------------*/
+
+static int _seq_fill(seq_t *);
+static int _seq_scan(seq_t *, size_t, char **, size_t *, size_t *);
+static void _seq_reset(seq_t *);
+static int _seq_flush(seq_t *);
+static int _seq_write(seq_t *, struct iovec *, int);
+static int _seq_unread(seq_t *);
+static int _seq_remap(seq_t *);
+static int _seq_unmap(seq_t *);
+static size_t _seq_strip(seq_t *, char *, size_t);
+static void *_seq_process_worker(void *);
+static int _seq_process_range(seq_worker_t *);
+static int _seq_process_serial(seq_t *, void *, int (*)(void *, char *, size_t));
 
 /*----------------------------------------------------------------*/
 /* klass declaration                                              */
@@ -182,23 +224,61 @@ char *seq_version(seq_t *self) {
 
 }
 
-int seq_gets(seq_t *self, char *buffer, size_t size, ssize_t *count) {
+int seq_open(seq_t *self, int flags, mode_t mode) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self != NULL) && (buffer != NULL) && (count != NULL)) {
+        if (self == NULL) {
 
-            stat = self->_gets(self, buffer, size, count);
-            check_return(stat, self);
+            cause_error(E_INVPARM);
 
-        } else {
+        }
+
+        _seq_reset(self);
+
+        stat = fib_open(FIB(self), flags, mode);
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int seq_close(seq_t *self) {
+
+    int stat = OK;
+    int flushed = OK;
+
+    when_error_in {
+
+        if (self == NULL) {
 
             cause_error(E_INVPARM);
 
         }
 
+        /* pending writes go out before the close, the file is */
+        /* closed even when they fail, then the failure is     */
+        /* reported                                             */
+
+        flushed = _seq_flush(self);
+        _seq_reset(self);
+
+        stat = fib_close(FIB(self));
+        check_return(stat, self);
+
+        check_return(flushed, self);
+
         exit_when;
 
     } use {
@@ -212,15 +292,43 @@ int seq_gets(seq_t *self, char *buffer, size_t size, ssize_t *count) {
 
 }
 
-int seq_puts(seq_t *self, char *buffer, ssize_t *count) {
+int seq_flush(seq_t *self) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self != NULL) && (buffer != NULL) && (count != NULL)) {
+        if (self == NULL) {
 
-            stat = self->_puts(self, buffer, count);
+            cause_error(E_INVPARM);
+
+        }
+
+        stat = _seq_flush(self);
+        check_return(stat, self);
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int seq_gets(seq_t *self, char *buffer, size_t size, ssize_t *count) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && (buffer != NULL) && (count != NULL) && (size > 1)) {
+
+            stat = self->_gets(self, buffer, size, count);
             check_return(stat, self);
 
         } else {
@@ -242,15 +350,16 @@ int seq_puts(seq_t *self, char *buffer, ssize_t *count) {
 
 }
 
-int seq_get_eol(seq_t *self, char *eol) {
-    
+int seq_puts(seq_t *self, char *buffer, ssize_t *count) {
+
     int stat = OK;
 
     when_error_in {
 
-        if ((self != NULL) && (eol != NULL)) {
+        if ((self != NULL) && (buffer != NULL) && (count != NULL)) {
 
-            eol = self->eol;
+            stat = self->_puts(self, buffer, count);
+            check_return(stat, self);
 
         } else {
 
@@ -271,15 +380,16 @@ int seq_get_eol(seq_t *self, char *eol) {
 
 }
 
-int seq_set_eol(seq_t *self, char *eol) {
+int seq_getline(seq_t *self, char **line, size_t *length) {
 
     int stat = OK;
 
     when_error_in {
 
-        if ((self != NULL) && (eol != NULL)) {
+        if ((self != NULL) && (line != NULL) && (length != NULL)) {
 
-            self->eol = eol;
+            stat = self->_getline(self, line, length);
+            check_return(stat, self);
 
         } else {
 
@@ -300,180 +410,180 @@ int seq_set_eol(seq_t *self, char *eol) {
 
 }
 
-/*----------------------------------------------------------------*/
-/* klass implementation                                           */
-/*----------------------------------------------------------------*/
+int seq_process_parallel(seq_t *self, void *(*create)(void *), int (*process)(void *, char *, size_t), int (*reduce)(void *, void *), void *data, int threads) {
 
-int _seq_ctor(object_t *object, item_list_t *items) {
+    int x;
+    int fd;
+    int stat = OK;
+    int started = 0;
+    int created = 0;
+    int workers = 0;
+    off_t first = 0;
+    volatile int stop = FALSE;
+    pthread_t *tids = NULL;
+    seq_worker_t *worker = NULL;
+    struct stat buf;
 
-    int stat = ERR;
-    char *eol = "\n";
-    seq_t *self = NULL;
+    when_error_in {
 
-    if (object != NULL) {
+        if ((self == NULL) || (process == NULL) || (threads < 1)) {
 
-        stat = OK;
-        
-        when_error_in {
-            
-            /* intialize the base klass here */
-        
-            stat = FIB_KLASS->ctor(object, items);
-            check_return(stat, object);
-        
-            /* capture our items */
+            cause_error(E_INVPARM);
 
-            /* if (items != NULL) { */
-               
-            /*    int x; */
-            /*    for (x = 0;; x++) { */
-                                   
-            /*        if ((items[x].buffer_length == 0) && */
-            /*            (items[x].item_code == 0)) break; */
-                                   
-            /*        switch(items[x].item_code) { */
-            /*            case BELL_K_TIMES: { */
-            /*                memcpy(&times, */
-            /*                       items[x].buffer_address, */
-            /*                       items[x].buffer_length); */
-            /*                break; */
-            /*            } */
-            /*        } */
+        }
 
-            /*    } */
+        /* the workers read the file, not what is waiting to be written */
 
-            /* } */
+        stat = _seq_flush(self);
+        check_return(stat, self);
 
-            /* initilize our base klass here */
+        stat = fib_get_fd(FIB(self), &fd);
+        check_return(stat, self);
 
-            object_set_error1(object, OK);
+        errno = 0;
+        if (fstat(fd, &buf) == -1) {
 
-            /* initialize our derived klass here */
+            cause_error(errno);
 
-            self = SEQ(object);
+        }
 
-            /* assign our methods here */
+        /* split the file into one byte range per worker */
 
-            self->ctor = _seq_ctor;
-            self->dtor = _seq_dtor;
-            self->_compare = _seq_compare;
-            self->_override = _seq_override;
+        workers = 1;
 
-            self->_gets = _seq_gets;
-            self->_puts = _seq_puts;
+        if (S_ISREG(buf.st_mode)) {
 
-            /* initialize internal variables here */
+            /* no worker has less than SEQ_C_BUFSIZE bytes to read */
 
-            self->eol = eol;
+            workers = (buf.st_size + SEQ_C_BUFSIZE - 1) / SEQ_C_BUFSIZE;
+            if (workers > threads) workers = threads;
+            if (workers > SEQ_T_MAX) workers = SEQ_T_MAX;
+            if (workers < 1) workers = 1;
 
-            exit_when;
+        }
 
-        } use {
+        errno = 0;
+        worker = calloc(workers, sizeof(seq_worker_t));
+        check_null(worker);
 
-            stat = ERR;
-            process_error(self);
+        errno = 0;
+        tids = calloc(workers, sizeof(pthread_t));
+        check_null(tids);
 
-        } end_when;
+        for (x = 0; x < workers; x++) {
 
-    }
+            worker[x].self = self;
+            worker[x].fd = fd;
+            worker[x].size = buf.st_size;
+            worker[x].process = process;
+            worker[x].stop = &stop;
+            worker[x].first = first;
+            worker[x].last = first + (buf.st_size / workers) +
+                             ((x < (buf.st_size % workers)) ? 1 : 0);
 
-    return stat;
+            first = worker[x].last;
 
-}
+            worker[x].state = (create != NULL) ? create(data) : NULL;
+            created++;
 
-int _seq_dtor(object_t *object) {
+        }
 
-    int stat = OK;
-    fib_t *fib = FIB(object);
+        if (!S_ISREG(buf.st_mode)) {
 
-    /* free local resources here */
+            /* a pipe can only be read in order, from where it is */
 
+            stat = _seq_process_serial(self, worker[0].state, process);
+            check_return(stat, self);
 
-    /* walk the chain, freeing as we go */
+        } else if (workers < 2) {
 
-    object_demote(object, fib_t);
-    fib_destroy(fib);
+            worker[0].stat = _seq_process_range(&worker[0]);
 
-    return stat;
+        } else {
 
-}
+            for (x = 0; x < workers; x++) {
 
-int _seq_override(seq_t *self, item_list_t *items) {
+                errno = pthread_create(&tids[x], NULL, _seq_process_worker, &worker[x]);
+                check_status(errno);
 
-    int stat = OK;
+                started++;
 
-    when_error_in {
-    
-        if (items != NULL) {
+            }
 
-            stat = fib_override(FIB(self), items);
-            check_return(stat, self);
+            for (x = 0; x < started; x++) {
 
-            errno = E_UNKOVER;
+                pthread_join(tids[x], NULL);
 
-            int x;
-            for (x = 0;; x++) {
+            }
 
-                if ((items[x].buffer_length == 0) &&
-                    (items[x].item_code == 0)) break;
+            started = 0;
 
-                switch(items[x].item_code) {
-                    case SEQ_M_DESTRUCTOR: {
-                        self->dtor = NULL;
-                        self->dtor = items[x].buffer_address;
-                        check_null(self->dtor);
-                        break;
-                    }
-                    case SEQ_M_GETS: {
-                        self->_gets = NULL;
-                        self->_gets = items[x].buffer_address;
-                        check_null(self->_gets);
-                        break;
-                    }
-                    case SEQ_M_PUTS: {
-                        self->_puts = NULL;
-                        self->_puts = items[x].buffer_address;
-                        check_null(self->_puts);
-                        break;
-                    }
-                }
+        }
 
-            } 
+        for (x = 0; x < workers; x++) {
+
+            if (worker[x].stat != OK) {
+
+                cause_error(worker[x].errnum);
+
+            }
 
         }
 
         exit_when;
 
-    } use { 
+    } use {
 
         stat = ERR;
         process_error(self);
 
+        stop = TRUE;
+
+        for (x = 0; x < started; x++) {
+
+            pthread_join(tids[x], NULL);
+
+        }
+
     } end_when;
 
+    /* the ranges are in file order, every state is handed back */
+
+    for (x = 0; x < created; x++) {
+
+        if ((reduce != NULL) && (reduce(data, worker[x].state) != OK)) {
+
+            if (stat == OK) {
+
+                stat = ERR;
+                object_set_error1(OBJECT(self), E_INVOPS);
+
+            }
+
+        }
+
+    }
+
+    free(worker);
+    free(tids);
+
     return stat;
 
 }
 
-int _seq_compare(seq_t *self, seq_t *other) {
-
+int seq_get_eol(seq_t *self, char *eol) {
+    
     int stat = OK;
 
     when_error_in {
 
-        if ((fib_compare(FIB(self), FIB(other)) == 0) &&
-            (self->ctor == other->ctor) &&
-            (self->dtor == other->dtor) &&
-            (self->_compare == other->_compare) &&
-            (self->_override == other->_override) &&
-            (self->_gets == other->_gets) &&
-            (self->_puts == other->_puts)) {
+        if ((self != NULL) && (eol != NULL)) {
 
-            stat = OK;
+            eol = self->eol;
 
         } else {
 
-            cause_error(E_NOTSAME);
+            cause_error(E_INVPARM);
 
         }
 
@@ -490,34 +600,710 @@ int _seq_compare(seq_t *self, seq_t *other) {
 
 }
 
-int _seq_puts(seq_t *self, char *buffer, ssize_t *count) {
+int seq_set_eol(seq_t *self, char *eol) {
 
-    int fd;
     int stat = OK;
-    char *output = NULL;
-    int length = strlen(buffer) + 2;
 
     when_error_in {
 
-        stat = fib_get_fd(FIB(self), &fd);
-        check_return(stat, self);
+        if ((self != NULL) && (eol != NULL)) {
 
-        errno = 0;
-        if ((output = calloc(1, length + 2)) == NULL) {
+            self->eol = eol;
 
-            cause_error(errno);
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int seq_set_flush(seq_t *self, int interval) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && (interval >= 0)) {
+
+            self->interval = interval;
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int seq_get_access(seq_t *self, int *access) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self != NULL) && (access != NULL)) {
+
+            *access = self->access;
+
+        } else {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int seq_set_access(seq_t *self, int access) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((self == NULL) ||
+            ((access != SEQ_A_BUFFER) && (access != SEQ_A_MMAP))) {
+
+            cause_error(E_INVPARM);
+
+        }
+
+        /* the mapping is made on first use, reading goes on */
+        /* from the same line in either mode                 */
+
+        if (access != self->access) {
+
+            if (self->access == SEQ_A_MMAP) {
+
+                stat = _seq_unmap(self);
+                check_return(stat, self);
+
+            }
+
+            self->access = access;
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+/*----------------------------------------------------------------*/
+/* klass implementation                                           */
+/*----------------------------------------------------------------*/
+
+int _seq_ctor(object_t *object, item_list_t *items) {
+
+    int stat = ERR;
+    char *eol = "\n";
+    seq_t *self = NULL;
+
+    if (object != NULL) {
+
+        stat = OK;
+        
+        when_error_in {
+            
+            /* intialize the base klass here */
+        
+            stat = FIB_KLASS->ctor(object, items);
+            check_return(stat, object);
+        
+            /* capture our items */
+
+            /* if (items != NULL) { */
+               
+            /*    int x; */
+            /*    for (x = 0;; x++) { */
+                                   
+            /*        if ((items[x].buffer_length == 0) && */
+            /*            (items[x].item_code == 0)) break; */
+                                   
+            /*        switch(items[x].item_code) { */
+            /*            case BELL_K_TIMES: { */
+            /*                memcpy(&times, */
+            /*                       items[x].buffer_address, */
+            /*                       items[x].buffer_length); */
+            /*                break; */
+            /*            } */
+            /*        } */
+
+            /*    } */
+
+            /* } */
+
+            /* initilize our base klass here */
+
+            object_set_error1(object, OK);
+
+            /* initialize our derived klass here */
+
+            self = SEQ(object);
+
+            /* assign our methods here */
+
+            self->ctor = _seq_ctor;
+            self->dtor = _seq_dtor;
+            self->_compare = _seq_compare;
+            self->_override = _seq_override;
+
+            self->_gets = _seq_gets;
+            self->_puts = _seq_puts;
+            self->_getline = _seq_getline;
+
+            /* initialize internal variables here */
+
+            self->eol = eol;
+            self->eof = FALSE;
+            self->head = 0;
+            self->tail = 0;
+            self->size = 0;
+            self->buffer = NULL;
+            self->interval = 0;
+            self->stamp = 0;
+            self->pending = 0;
+            self->output = NULL;
+            self->access = SEQ_A_BUFFER;
+            self->map = NULL;
+
+            exit_when;
+
+        } use {
+
+            stat = ERR;
+            process_error(self);
+
+        } end_when;
+
+    }
+
+    return stat;
+
+}
+
+int _seq_dtor(object_t *object) {
+
+    int stat = OK;
+    fib_t *fib = FIB(object);
+
+    /* free local resources here */
+
+    _seq_flush(SEQ(object));
+    _seq_reset(SEQ(object));
+
+    /* walk the chain, freeing as we go */
+
+    object_demote(object, fib_t);
+    fib_destroy(fib);
+
+    return stat;
+
+}
+
+int _seq_override(seq_t *self, item_list_t *items) {
+
+    int stat = OK;
+
+    when_error_in {
+    
+        if (items != NULL) {
+
+            stat = fib_override(FIB(self), items);
+            check_return(stat, self);
+
+            errno = E_UNKOVER;
+
+            int x;
+            for (x = 0;; x++) {
+
+                if ((items[x].buffer_length == 0) &&
+                    (items[x].item_code == 0)) break;
+
+                switch(items[x].item_code) {
+                    case SEQ_M_DESTRUCTOR: {
+                        self->dtor = NULL;
+                        self->dtor = items[x].buffer_address;
+                        check_null(self->dtor);
+                        break;
+                    }
+                    case SEQ_M_GETS: {
+                        self->_gets = NULL;
+                        self->_gets = items[x].buffer_address;
+                        check_null(self->_gets);
+                        break;
+                    }
+                    case SEQ_M_PUTS: {
+                        self->_puts = NULL;
+                        self->_puts = items[x].buffer_address;
+                        check_null(self->_puts);
+                        break;
+                    }
+                    case SEQ_M_GETLINE: {
+                        self->_getline = NULL;
+                        self->_getline = items[x].buffer_address;
+                        check_null(self->_getline);
+                        break;
+                    }
+                }
+
+            } 
+
+        }
+
+        exit_when;
+
+    } use { 
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _seq_compare(seq_t *self, seq_t *other) {
+
+    int stat = OK;
+
+    when_error_in {
+
+        if ((fib_compare(FIB(self), FIB(other)) == 0) &&
+            (self->ctor == other->ctor) &&
+            (self->dtor == other->dtor) &&
+            (self->_compare == other->_compare) &&
+            (self->_override == other->_override) &&
+            (self->_gets == other->_gets) &&
+            (self->_puts == other->_puts) &&
+            (self->_getline == other->_getline)) {
+
+            stat = OK;
+
+        } else {
+
+            cause_error(E_NOTSAME);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _seq_puts(seq_t *self, char *buffer, ssize_t *count) {
+
+    int stat = OK;
+    struct iovec iov[2];
+    size_t length = strlen(buffer);
+    size_t eollen = strlen(self->eol);
+
+    when_error_in {
+
+        *count = 0;
+
+        stat = _seq_unread(self);
+        check_return(stat, self);
+
+        if ((self->pending + length + eollen) > SEQ_C_BUFSIZE) {
+
+            stat = _seq_flush(self);
+            check_return(stat, self);
+
+        }
+
+        if ((length + eollen) > SEQ_C_BUFSIZE) {
+
+            /* too big to buffer, it goes straight out */
+
+            iov[0].iov_base = buffer;
+            iov[0].iov_len = length;
+            iov[1].iov_base = self->eol;
+            iov[1].iov_len = eollen;
+
+            stat = _seq_write(self, iov, 2);
+            check_return(stat, self);
+
+        } else {
+
+            if (self->output == NULL) {
+
+                errno = 0;
+                if ((self->output = malloc(SEQ_C_BUFSIZE)) == NULL) {
+
+                    cause_error(errno);
+
+                }
+
+            }
+
+            if (self->pending == 0) self->stamp = time(NULL);
+
+            memcpy(self->output + self->pending, buffer, length);
+            memcpy(self->output + self->pending + length, self->eol, eollen);
+            self->pending += length + eollen;
+
+            if ((self->interval > 0) &&
+                ((time(NULL) - self->stamp) >= self->interval)) {
+
+                stat = _seq_flush(self);
+                check_return(stat, self);
+
+            }
+
+        }
+
+        *count = length + eollen;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _seq_gets(seq_t *self, char *buffer, size_t length, ssize_t *count) {
+
+    int stat = OK;
+    char *line = NULL;
+    size_t size = 0;
+    size_t used = 0;
+
+    when_error_in {
+
+        /* a line longer than the buffer is returned in pieces */
+
+        stat = _seq_scan(self, length - 1, &line, &size, &used);
+        check_return(stat, self);
+
+        if (line != NULL) memcpy(buffer, line, size);
+
+        buffer[size] = '\0';
+        *count = used;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+int _seq_getline(seq_t *self, char **line, size_t *length) {
+
+    int stat = OK;
+    size_t used = 0;
+
+    when_error_in {
+
+        stat = _seq_scan(self, 0, line, length, &used);
+        check_return(stat, self);
+
+        /* the buffer always has room for the terminator, */
+        /* a mapping is read only                         */
+
+        if ((*line != NULL) && (self->access != SEQ_A_MMAP)) {
+
+            (*line)[*length] = '\0';
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+/*----------------------------------------------------------------*/
+/* private methods                                                */
+/*----------------------------------------------------------------*/
+
+static void _seq_reset(seq_t *self) {
+
+    if (self->buffer != NULL) free(self->buffer);
+    if (self->output != NULL) free(self->output);
+    if (self->map != NULL) munmap(self->map, self->tail);
+
+    self->eof = FALSE;
+    self->head = 0;
+    self->tail = 0;
+    self->size = 0;
+    self->buffer = NULL;
+    self->stamp = 0;
+    self->pending = 0;
+    self->output = NULL;
+    self->map = NULL;
+
+}
+
+static int _seq_flush(seq_t *self) {
+
+    int stat = OK;
+    struct iovec iov[1];
+
+    when_error_in {
+
+        if (self->pending > 0) {
+
+            iov[0].iov_base = self->output;
+            iov[0].iov_len = self->pending;
+
+            /* whatever happens, the data is not written twice */
+
+            self->pending = 0;
+
+            stat = _seq_write(self, iov, 1);
+            check_return(stat, self);
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+static int _seq_write(seq_t *self, struct iovec *iov, int iovcnt) {
+
+    /* write all of the vectors, picking up after short writes */
+
+    int fd;
+    int stat = OK;
+    ssize_t count = 0;
+
+    when_error_in {
+
+        stat = fib_get_fd(FIB(self), &fd);
+        check_return(stat, self);
+
+        while (iovcnt > 0) {
+
+            errno = 0;
+            if ((count = writev(fd, iov, iovcnt)) == -1) {
+
+                if (errno == EINTR) continue;
+                cause_error(errno);
+
+            }
+
+            while ((iovcnt > 0) && (count >= iov->iov_len)) {
+
+                count -= iov->iov_len;
+                iov++;
+                iovcnt--;
+
+            }
+
+            if (iovcnt > 0) {
+
+                iov->iov_base = (char *)iov->iov_base + count;
+                iov->iov_len -= count;
+
+            }
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+static int _seq_unread(seq_t *self) {
+
+    /* a write after a read belongs after the last line returned, */
+    /* not after what was read ahead into the buffer              */
+
+    int fd;
+    int stat = OK;
+    off_t unread = self->tail - self->head;
+
+    when_error_in {
+
+        if (self->map != NULL) {
+
+            stat = _seq_unmap(self);
+            check_return(stat, self);
+
+        } else if (unread > 0) {
+
+            stat = fib_get_fd(FIB(self), &fd);
+            check_return(stat, self);
+
+            errno = 0;
+            if ((lseek(fd, -unread, SEEK_CUR) == -1) && (errno != ESPIPE)) {
+
+                cause_error(errno);
+
+            }
+
+        }
+
+        self->eof = FALSE;
+        self->head = 0;
+        self->tail = 0;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+static int _seq_fill(seq_t *self) {
+
+    /* move the unread data to the front of the buffer and read after */
+    /* it. The buffer doubles when one line has filled all of it      */
+
+    int fd;
+    int stat = OK;
+    ssize_t count = 0;
+    char *buffer = NULL;
+
+    when_error_in {
+
+        stat = fib_get_fd(FIB(self), &fd);
+        check_return(stat, self);
+
+        if (self->buffer == NULL) {
+
+            errno = 0;
+            if ((self->buffer = malloc(SEQ_C_BUFSIZE + 1)) == NULL) {
+
+                cause_error(errno);
+
+            }
+
+            self->size = SEQ_C_BUFSIZE;
+
+        }
+
+        if (self->head > 0) {
+
+            memmove(self->buffer, self->buffer + self->head, self->tail - self->head);
+            self->tail -= self->head;
+            self->head = 0;
+
+        }
+
+        if (self->tail == self->size) {
+
+            errno = 0;
+            if ((buffer = realloc(self->buffer, (self->size * 2) + 1)) == NULL) {
+
+                cause_error(errno);
+
+            }
+
+            self->buffer = buffer;
+            self->size *= 2;
 
         }
 
-        sprintf(output, "%s%s", buffer, self->eol);
+        do {
 
-        errno = 0;
-        if ((*count = write(fd, output, strlen(output))) == -1) {
+            errno = 0;
+            count = read(fd, self->buffer + self->tail, self->size - self->tail);
+
+        } while ((count == -1) && (errno == EINTR));
+
+        if (count == -1) {
 
             cause_error(errno);
 
         }
 
+        if (count == 0) self->eof = TRUE;
+
+        self->tail += count;
+
         exit_when;
 
     } use {
@@ -527,16 +1313,121 @@ int _seq_puts(seq_t *self, char *buffer, ssize_t *count) {
 
     } end_when;
 
-    if (output != NULL) free(output);
+    return stat;
+
+}
+
+static int _seq_scan(seq_t *self, size_t limit, char **line, size_t *length, size_t *used) {
+
+    /* find the next line in the buffer or the mapping, reading more  */
+    /* as needed. With a limit the line is cut at that many bytes,    */
+    /* without one it may grow the buffer. The eol is found by its    */
+    /* last character and is not part of the length. *line is NULL   */
+    /* at the end of the file                                         */
+
+    int stat = OK;
+    size_t avail = 0;
+    size_t scanned = 0;
+    char *end = NULL;
+    char *base = NULL;
+    size_t eollen = strlen(self->eol);
+    int delim = (eollen > 0) ? self->eol[eollen - 1] : '\n';
+
+    when_error_in {
+
+        *line = NULL;
+        *length = 0;
+        *used = 0;
+
+        /* the file position must be past what was written */
+
+        if (self->pending > 0) {
+
+            stat = _seq_flush(self);
+            check_return(stat, self);
+
+        }
+
+        /* map the file on first use, or again if it has grown */
+
+        if ((self->access == SEQ_A_MMAP) &&
+            ((self->map == NULL) || (self->head == self->tail))) {
+
+            stat = _seq_remap(self);
+            check_return(stat, self);
+
+        }
+
+        for (;;) {
+
+            base = (self->access == SEQ_A_MMAP) ? self->map : self->buffer;
+
+            avail = self->tail - self->head;
+            if ((limit > 0) && (avail > limit)) avail = limit;
+
+            /* only the bytes read since the last pass are searched */
+
+            if ((avail > scanned) &&
+                ((end = memchr(base + self->head + scanned, delim, avail - scanned)) != NULL)) {
+
+                *line = base + self->head;
+                *length = _seq_strip(self, *line, end - *line);
+                *used = (end - *line) + 1;
+                break;
+
+            }
+
+            if (((limit > 0) && (avail == limit)) ||
+                (self->access == SEQ_A_MMAP) || (self->eof)) {
+
+                if (avail > 0) {
+
+                    *line = base + self->head;
+                    *length = avail;
+                    *used = avail;
+
+                }
+
+                /* a file that is still being written may have more */
+
+                self->eof = FALSE;
+                break;
+
+            }
+
+            scanned = avail;
+
+            stat = _seq_fill(self);
+            check_return(stat, self);
+
+        }
+
+        self->head += *used;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
 
     return stat;
 
 }
 
-int _seq_gets(seq_t *self, char *buffer, size_t length, ssize_t *count) {
+static int _seq_remap(seq_t *self) {
+
+    /* map the whole file, if it has changed size. The mapping starts */
+    /* out at the file position, anything that is not a regular file  */
+    /* is read thru the buffer instead, an empty file is not mapped   */
 
     int fd;
     int stat = OK;
+    off_t offset = 0;
+    char *map = NULL;
+    struct stat buf;
 
     when_error_in {
 
@@ -544,12 +1435,351 @@ int _seq_gets(seq_t *self, char *buffer, size_t length, ssize_t *count) {
         check_return(stat, self);
 
         errno = 0;
-        if ((*count = xgetline(fd, buffer, length, '\n')) == -1) {
+        if (fstat(fd, &buf) == -1) {
 
             cause_error(errno);
 
         }
 
+        if (!S_ISREG(buf.st_mode)) {
+
+            self->access = SEQ_A_BUFFER;
+
+        } else {
+
+            if (self->map == NULL) {
+
+                stat = _seq_unread(self);
+                check_return(stat, self);
+
+                errno = 0;
+                if ((offset = lseek(fd, 0, SEEK_CUR)) == -1) {
+
+                    cause_error(errno);
+
+                }
+
+                if (self->buffer != NULL) free(self->buffer);
+
+                self->buffer = NULL;
+                self->size = 0;
+                self->head = offset;
+                self->tail = offset;
+
+            }
+
+            if ((buf.st_size != self->tail) && (buf.st_size > 0)) {
+
+                errno = 0;
+                map = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                if (map == MAP_FAILED) {
+
+                    cause_error(errno);
+
+                }
+
+                madvise(map, buf.st_size, MADV_SEQUENTIAL);
+
+                if (self->map != NULL) munmap(self->map, self->tail);
+
+                self->map = map;
+                self->tail = buf.st_size;
+
+                if (self->head > self->tail) self->head = self->tail;
+
+            } else if ((buf.st_size == 0) && (self->map != NULL)) {
+
+                /* truncated, the old mapping goes and reading */
+                /* starts over when the file grows again       */
+
+                munmap(self->map, self->tail);
+                self->map = NULL;
+                self->head = 0;
+                self->tail = 0;
+
+                errno = 0;
+                if (lseek(fd, 0, SEEK_SET) == -1) {
+
+                    cause_error(errno);
+
+                }
+
+            }
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+static int _seq_unmap(seq_t *self) {
+
+    /* leave the file position where the mapped lines stopped */
+
+    int fd;
+    int stat = OK;
+
+    when_error_in {
+
+        if (self->map != NULL) {
+
+            stat = fib_get_fd(FIB(self), &fd);
+            check_return(stat, self);
+
+            munmap(self->map, self->tail);
+            self->map = NULL;
+
+            errno = 0;
+            if (lseek(fd, self->head, SEEK_SET) == -1) {
+
+                cause_error(errno);
+
+            }
+
+        }
+
+        self->head = 0;
+        self->tail = 0;
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        process_error(self);
+
+    } end_when;
+
+    return stat;
+
+}
+
+static size_t _seq_strip(seq_t *self, char *line, size_t length) {
+
+    /* the last character of the eol was found at line[length], */
+    /* the rest of the eol is dropped when it is there            */
+
+    size_t eollen = strlen(self->eol);
+
+    if ((eollen > 1) && (length >= eollen - 1) &&
+        (memcmp(line + length - (eollen - 1), self->eol, eollen - 1) == 0)) {
+
+        length -= eollen - 1;
+
+    }
+
+    return length;
+
+}
+
+static void *_seq_process_worker(void *data) {
+
+    seq_worker_t *worker = (seq_worker_t *)data;
+
+    worker->stat = _seq_process_range(worker);
+
+    return NULL;
+
+}
+
+static int _seq_process_range(seq_worker_t *worker) {
+
+    /* process the lines that start within one byte range, with a   */
+    /* private buffer filled by pread(). A range that does not start */
+    /* the file begins after the first eol at or past its start - 1, */
+    /* the line before it belongs to the previous range. The error   */
+    /* number is kept in the worker, as the seq_t error is not thread */
+    /* safe                                                           */
+
+    int stat = OK;
+    int skip = FALSE;
+    off_t offset = worker->first;
+    ssize_t count = 0;
+    size_t head = 0;
+    size_t tail = 0;
+    size_t length = 0;
+    size_t scanned = 0;
+    size_t size = SEQ_C_BUFSIZE;
+    char *end = NULL;
+    char *buffer = NULL;
+    char *grown = NULL;
+    seq_t *self = worker->self;
+    size_t eollen = strlen(self->eol);
+    int delim = (eollen > 0) ? self->eol[eollen - 1] : '\n';
+
+    when_error_in {
+
+        if (worker->first > 0) {
+
+            offset = worker->first - 1;
+            skip = TRUE;
+
+        }
+
+        errno = 0;
+        buffer = malloc(size);
+        check_null(buffer);
+
+        for (;;) {
+
+            /* buffer[0] is at offset in the file */
+
+            if ((!skip) && ((offset + head) >= worker->last)) break;
+
+            end = NULL;
+
+            if ((tail - head) > scanned) {
+
+                end = memchr(buffer + head + scanned, delim, (tail - head) - scanned);
+
+            }
+
+            if (end != NULL) {
+
+                length = end - (buffer + head);
+
+                if (!skip) {
+
+                    errno = 0;
+                    stat = worker->process(worker->state, buffer + head,
+                                           _seq_strip(self, buffer + head, length));
+                    if (stat != OK) {
+
+                        cause_error((errno != 0) ? errno : E_INVOPS);
+
+                    }
+
+                }
+
+                skip = FALSE;
+                head += length + 1;
+                scanned = 0;
+                continue;
+
+            }
+
+            if ((offset + tail) >= worker->size) {
+
+                /* the last line of the file has no eol */
+
+                if ((!skip) && (tail > head)) {
+
+                    errno = 0;
+                    stat = worker->process(worker->state, buffer + head, tail - head);
+                    if (stat != OK) {
+
+                        cause_error((errno != 0) ? errno : E_INVOPS);
+
+                    }
+
+                }
+
+                break;
+
+            }
+
+            if (*worker->stop) break;
+
+            scanned = tail - head;
+
+            if (head > 0) {
+
+                memmove(buffer, buffer + head, tail - head);
+                offset += head;
+                tail -= head;
+                head = 0;
+
+            }
+
+            if (tail == size) {
+
+                errno = 0;
+                grown = realloc(buffer, size * 2);
+                check_null(grown);
+
+                buffer = grown;
+                size *= 2;
+
+            }
+
+            length = size - tail;
+            if ((offset + tail + length) > worker->size) length = worker->size - (offset + tail);
+
+            do {
+
+                errno = 0;
+                count = pread(worker->fd, buffer + tail, length, offset + tail);
+
+            } while ((count == -1) && (errno == EINTR));
+
+            if (count == -1) {
+
+                cause_error(errno);
+
+            }
+
+            /* the file got shorter */
+
+            if (count == 0) worker->size = offset + tail;
+
+            tail += count;
+
+        }
+
+        exit_when;
+
+    } use {
+
+        stat = ERR;
+        worker->errnum = trace_errnum;
+        clear_error();
+
+        *worker->stop = TRUE;
+
+    } end_when;
+
+    free(buffer);
+
+    return stat;
+
+}
+
+static int _seq_process_serial(seq_t *self, void *state, int (*process)(void *, char *, size_t)) {
+
+    /* process the lines of something that can't be split up */
+
+    int stat = OK;
+    char *line = NULL;
+    size_t length = 0;
+
+    when_error_in {
+
+        for (;;) {
+
+            stat = self->_getline(self, &line, &length);
+            check_return(stat, self);
+
+            if (line == NULL) break;
+
+            errno = 0;
+            stat = process(state, line, length);
+            if (stat != OK) {
+
+                cause_error((errno != 0) ? errno : E_INVOPS);
+
+            }
+
+        }
+
         exit_when;
 
     } use {
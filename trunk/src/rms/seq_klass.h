@@ -27,8 +27,20 @@ struct _seq_s {
     int (*_override)(seq_t *, item_list_t *);
     int (*_gets)(seq_t *, char *, size_t, ssize_t *);
     int (*_puts)(seq_t *, char *, ssize_t *);
+    int (*_getline)(seq_t *, char **, size_t *);
 
     char *eol;
+    int eof;                /* the last read returned nothing       */
+    size_t head;            /* start of the unread data             */
+    size_t tail;            /* end of the unread data               */
+    size_t size;            /* size of the read buffer              */
+    char *buffer;           /* read buffer                          */
+    int interval;           /* seconds pending writes may wait      */
+    time_t stamp;           /* when the pending writes started      */
+    size_t pending;         /* bytes waiting in the write buffer    */
+    char *output;           /* write buffer                         */
+    int access;             /* buffered or memory mapped reads      */
+    char *map;              /* memory mapping of the file           */
 };
 
 #endif